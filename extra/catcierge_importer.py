@@ -22,12 +22,18 @@ def main():
 	parser.add_argument("--exe_path", help="Path to catcierge_fsm_tester executable")
 	parser.add_argument("--image_dir", help="Directory of images")
 	parser.add_argument("--extra_args", help="Extra arguments to pass", default="")
+	parser.add_argument("--replay", action="store_true", help="Replay the whole directory in one catcierge_fsm_tester process on a virtual clock")
 	# TODO: Add option to start at a specific image / index.
 
 	args = parser.parse_args()
 
 	extra_args = [os.path.expanduser(os.path.expandvars(s)) for s in args.extra_args.split(" ")]
 
+	if args.replay:
+		the_args = [args.exe_path] + extra_args + ["--replay_dir", args.image_dir]
+		print(the_args)
+		return call(the_args)
+
 	firsts = glob.glob("%s/match*__0.png" % args.image_dir)
 
 	i = 0
@@ -0,0 +1,636 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "catcierge_config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "catcierge_archive.h"
+#include "catcierge_log.h"
+#include "catcierge_util.h"
+
+#define CATCIERGE_ARCHIVE_ALIGN_UP(n) \
+	(((n) + (CATCIERGE_ARCHIVE_ALIGN - 1)) & ~((size_t)CATCIERGE_ARCHIVE_ALIGN - 1))
+
+// Worst case size of PackBits encoded data.
+#define CATCIERGE_ARCHIVE_RLE_MAX(n) ((n) + ((n) + 127) / 128)
+
+int catcierge_is_archive_path(const char *path)
+{
+	size_t len = strlen(path);
+	size_t ext_len = strlen(CATCIERGE_ARCHIVE_EXT);
+
+	return (len > ext_len) && !strcmp(path + len - ext_len, CATCIERGE_ARCHIVE_EXT);
+}
+
+size_t catcierge_archive_rle_encode(const unsigned char *src, size_t len, unsigned char *dst)
+{
+	size_t i = 0;
+	size_t out = 0;
+	size_t run;
+	size_t lit;
+
+	while (i < len)
+	{
+		// Find a run of equal bytes.
+		run = 1;
+		while (((i + run) < len) && (run < 128) && (src[i + run] == src[i]))
+			run++;
+
+		if (run >= 3)
+		{
+			dst[out++] = (unsigned char)(257 - run);
+			dst[out++] = src[i];
+			i += run;
+			continue;
+		}
+
+		// Literals until the next run of at least 3.
+		lit = 0;
+		while (((i + lit) < len) && (lit < 128))
+		{
+			if (((i + lit + 2) < len)
+				&& (src[i + lit] == src[i + lit + 1])
+				&& (src[i + lit] == src[i + lit + 2]))
+			{
+				break;
+			}
+
+			lit++;
+		}
+
+		dst[out++] = (unsigned char)(lit - 1);
+		memcpy(&dst[out], &src[i], lit);
+		out += lit;
+		i += lit;
+	}
+
+	return out;
+}
+
+int catcierge_archive_rle_decode(const unsigned char *src, size_t len, unsigned char *dst, size_t dst_len)
+{
+	size_t i = 0;
+	size_t out = 0;
+	size_t n;
+
+	while (i < len)
+	{
+		unsigned char c = src[i++];
+
+		if (c < 128)
+		{
+			n = c + 1;
+
+			if (((i + n) > len) || ((out + n) > dst_len))
+				return -1;
+
+			memcpy(&dst[out], &src[i], n);
+			i += n;
+		}
+		else if (c > 128)
+		{
+			n = 257 - c;
+
+			if ((i >= len) || ((out + n) > dst_len))
+				return -1;
+
+			memset(&dst[out], src[i++], n);
+		}
+		else
+		{
+			continue;
+		}
+
+		out += n;
+	}
+
+	return (out == dst_len) ? 0 : -1;
+}
+
+void catcierge_archive_init(catcierge_archive_t *ar)
+{
+	assert(ar);
+	memset(ar, 0, sizeof(catcierge_archive_t));
+}
+
+//
+// Cuts the archive file at the given length.
+//
+static int catcierge_archive_truncate(catcierge_archive_t *ar, size_t size)
+{
+	#ifdef _WIN32
+	if (_chsize(_fileno(ar->f), (long)size))
+	#else
+	if (ftruncate(fileno(ar->f), (off_t)size))
+	#endif
+	{
+		CATERR("Failed to truncate archive \"%s\": %s\n", ar->path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+//
+// Finds the end of the last complete record, a crash while writing
+// can leave a partial record after it.
+//
+static int catcierge_archive_recover(catcierge_archive_t *ar)
+{
+	catcierge_archive_reader_t r;
+	size_t magic_len = strlen(CATCIERGE_ARCHIVE_MAGIC);
+	int ret = 0;
+
+	if (catcierge_archive_reader_open(&r, ar->path))
+		return -1;
+
+	while (catcierge_archive_reader_next(&r))
+		;
+
+	// Don't destroy something that isn't an archive.
+	if (r.size < magic_len)
+		magic_len = r.size;
+
+	if ((r.pos == 0) && (r.size > 0) && memcmp(r.data, CATCIERGE_ARCHIVE_MAGIC, magic_len))
+	{
+		CATERR("\"%s\" is not an archive\n", ar->path);
+		ret = -1;
+		goto fail;
+	}
+
+	ar->size = r.pos;
+
+	if (r.pos < r.size)
+	{
+		CATLOG("Archive \"%s\": Removing %d bytes of an incomplete record\n",
+			ar->path, (int)(r.size - r.pos));
+
+		ret = catcierge_archive_truncate(ar, r.pos);
+	}
+
+fail:
+	catcierge_archive_reader_close(&r);
+
+	return ret;
+}
+
+int catcierge_archive_open(catcierge_archive_t *ar, const char *path)
+{
+	assert(ar);
+	assert(path);
+
+	catcierge_archive_close(ar);
+
+	if (!(ar->f = fopen(path, "ab")))
+	{
+		CATERR("Failed to open archive \"%s\": %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	// Each record is written using a single write.
+	setvbuf(ar->f, NULL, _IONBF, 0);
+
+	if (!(ar->path = strdup(path)))
+	{
+		CATERR("Out of memory\n");
+		catcierge_archive_close(ar);
+		return -1;
+	}
+
+	if (catcierge_archive_recover(ar))
+	{
+		catcierge_archive_close(ar);
+		return -1;
+	}
+
+	return 0;
+}
+
+void catcierge_archive_close(catcierge_archive_t *ar)
+{
+	assert(ar);
+
+	if (ar->f)
+	{
+		fclose(ar->f);
+		ar->f = NULL;
+	}
+
+	catcierge_xfree(&ar->path);
+}
+
+static void catcierge_archive_free_buf(catcierge_archive_t *ar)
+{
+	catcierge_xfree(&ar->buf);
+	ar->buf_size = 0;
+	ar->len = 0;
+}
+
+void catcierge_archive_destroy(catcierge_archive_t *ar)
+{
+	assert(ar);
+	catcierge_archive_close(ar);
+	catcierge_archive_free_buf(ar);
+}
+
+static int catcierge_archive_reserve(catcierge_archive_t *ar, size_t size)
+{
+	unsigned char *tmp;
+	size_t new_size = ar->buf_size ? ar->buf_size : (256 * 1024);
+
+	if ((ar->len + size) <= ar->buf_size)
+		return 0;
+
+	while (new_size < (ar->len + size))
+		new_size *= 2;
+
+	if (!(tmp = realloc(ar->buf, new_size)))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	ar->buf = tmp;
+	ar->buf_size = new_size;
+
+	return 0;
+}
+
+int catcierge_archive_begin(catcierge_archive_t *ar, const char *id,
+		const struct timeval *tv, size_t max_frames)
+{
+	catcierge_archive_record_t *rec;
+	size_t header_size = sizeof(catcierge_archive_record_t)
+						+ max_frames * sizeof(catcierge_archive_frame_t);
+	assert(ar);
+
+	// The buffer is kept between records to avoid reallocating it.
+	ar->len = 0;
+	ar->max_frames = max_frames;
+
+	if (catcierge_archive_reserve(ar, header_size))
+		return -1;
+
+	memset(ar->buf, 0, header_size);
+	rec = (catcierge_archive_record_t *)ar->buf;
+	memcpy(rec->magic, CATCIERGE_ARCHIVE_MAGIC, sizeof(rec->magic));
+	rec->version = CATCIERGE_ARCHIVE_VERSION;
+
+	if (tv)
+	{
+		rec->time_sec = tv->tv_sec;
+		rec->time_usec = tv->tv_usec;
+	}
+
+	if (id)
+	{
+		snprintf(rec->id, sizeof(rec->id), "%s", id);
+	}
+
+	ar->len = header_size;
+
+	return 0;
+}
+
+int catcierge_archive_add(catcierge_archive_t *ar, const char *name,
+		catcierge_archive_frame_type_t type, IplImage *img)
+{
+	catcierge_archive_record_t *rec;
+	catcierge_archive_frame_t *frame;
+	unsigned char *data;
+	size_t row_size;
+	size_t raw_size;
+	size_t rle_size;
+	int y;
+	assert(ar);
+	assert(img);
+
+	if (!ar->buf || (ar->len == 0))
+	{
+		CATERR("No archive record started\n");
+		return -1;
+	}
+
+	rec = (catcierge_archive_record_t *)ar->buf;
+
+	if (rec->frame_count >= ar->max_frames)
+	{
+		CATERR("Too many frames in archive record\n");
+		return -1;
+	}
+
+	if ((img->depth != IPL_DEPTH_8U) || (img->width > 0xFFFF) || (img->height > 0xFFFF))
+	{
+		CATERR("Unsupported image format for archive: %s\n", name);
+		return -1;
+	}
+
+	row_size = img->width * img->nChannels;
+	raw_size = row_size * img->height;
+
+	// Room for the packed rows followed by the encoded version of them.
+	if (catcierge_archive_reserve(ar, raw_size + CATCIERGE_ARCHIVE_RLE_MAX(raw_size) + CATCIERGE_ARCHIVE_ALIGN))
+		return -1;
+
+	rec = (catcierge_archive_record_t *)ar->buf;
+	frame = catcierge_archive_get_frame(rec, rec->frame_count);
+	data = ar->buf + ar->len;
+
+	// Pack the rows without the row alignment padding.
+	for (y = 0; y < img->height; y++)
+	{
+		memcpy(&data[y * row_size], img->imageData + (y * img->widthStep), row_size);
+	}
+
+	memset(frame, 0, sizeof(catcierge_archive_frame_t));
+	snprintf(frame->name, sizeof(frame->name), "%s", name);
+	frame->offset = (uint32_t)ar->len;
+	frame->width = img->width;
+	frame->height = img->height;
+	frame->channels = img->nChannels;
+	frame->type = type;
+
+	rle_size = catcierge_archive_rle_encode(data, raw_size, data + raw_size);
+
+	if (rle_size < raw_size)
+	{
+		memmove(data, data + raw_size, rle_size);
+		frame->encoding = CATCIERGE_ARCHIVE_RLE;
+		frame->size = (uint32_t)rle_size;
+	}
+	else
+	{
+		frame->encoding = CATCIERGE_ARCHIVE_RAW;
+		frame->size = (uint32_t)raw_size;
+	}
+
+	ar->len = CATCIERGE_ARCHIVE_ALIGN_UP(ar->len + frame->size);
+	memset(data + frame->size, 0, ar->len - (frame->offset + frame->size));
+	rec->frame_count++;
+
+	return 0;
+}
+
+int catcierge_archive_commit(catcierge_archive_t *ar)
+{
+	catcierge_archive_record_t *rec;
+	size_t unused;
+	size_t i;
+	assert(ar);
+
+	if (!ar->f || !ar->buf || (ar->len == 0))
+		return -1;
+
+	rec = (catcierge_archive_record_t *)ar->buf;
+
+	// Drop the index entries that were reserved but not used.
+	unused = (ar->max_frames - rec->frame_count) * sizeof(catcierge_archive_frame_t);
+
+	if (unused > 0)
+	{
+		size_t index_end = sizeof(catcierge_archive_record_t)
+						+ rec->frame_count * sizeof(catcierge_archive_frame_t);
+
+		memmove(ar->buf + index_end, ar->buf + index_end + unused,
+				ar->len - index_end - unused);
+		ar->len -= unused;
+
+		for (i = 0; i < rec->frame_count; i++)
+		{
+			catcierge_archive_get_frame(rec, i)->offset -= (uint32_t)unused;
+		}
+	}
+
+	// Keep the records aligned.
+	i = ar->len;
+	ar->len = CATCIERGE_ARCHIVE_ALIGN_UP(ar->len);
+	memset(ar->buf + i, 0, ar->len - i);
+	rec->size = (uint32_t)ar->len;
+
+	if (fwrite(ar->buf, 1, ar->len, ar->f) != ar->len)
+	{
+		CATERR("Failed to write to archive \"%s\": %s\n", ar->path, strerror(errno));
+		ar->len = 0;
+
+		// Don't leave a partial record for the next one to be appended to.
+		catcierge_archive_truncate(ar, ar->size);
+		return -1;
+	}
+
+	ar->size += ar->len;
+	ar->record_count++;
+	ar->bytes_written += ar->len;
+	ar->len = 0;
+
+	// Don't hold on to huge buffers if the images suddenly got larger.
+	if (ar->buf_size > (64 * 1024 * 1024))
+	{
+		catcierge_archive_free_buf(ar);
+	}
+
+	return 0;
+}
+
+int catcierge_archive_reader_open(catcierge_archive_reader_t *r, const char *path)
+{
+	#ifdef _WIN32
+	FILE *f = NULL;
+	long size;
+	#else
+	int fd;
+	struct stat st;
+	#endif
+	assert(r);
+	assert(path);
+	memset(r, 0, sizeof(catcierge_archive_reader_t));
+
+	#ifdef _WIN32
+	if (!(f = fopen(path, "rb")))
+	{
+		CATERR("Failed to open archive \"%s\": %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+
+	if ((size > 0) && (r->data = malloc(size)))
+	{
+		r->size = fread(r->data, 1, size, f);
+	}
+
+	fclose(f);
+	#else
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		CATERR("Failed to open archive \"%s\": %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (!fstat(fd, &st) && (st.st_size > 0))
+	{
+		r->size = st.st_size;
+
+		if ((r->data = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		{
+			CATERR("Failed to map archive \"%s\": %s\n", path, strerror(errno));
+			r->data = NULL;
+			r->size = 0;
+			close(fd);
+			return -1;
+		}
+
+		r->mapped = 1;
+	}
+
+	close(fd);
+	#endif
+
+	return 0;
+}
+
+void catcierge_archive_reader_close(catcierge_archive_reader_t *r)
+{
+	assert(r);
+
+	#ifndef _WIN32
+	if (r->mapped)
+	{
+		munmap(r->data, r->size);
+		r->data = NULL;
+	}
+	#endif
+
+	catcierge_xfree(&r->data);
+	r->size = 0;
+	r->pos = 0;
+	r->mapped = 0;
+}
+
+catcierge_archive_record_t *catcierge_archive_reader_next(catcierge_archive_reader_t *r)
+{
+	catcierge_archive_record_t *rec;
+	catcierge_archive_frame_t *frame;
+	size_t left;
+	size_t i;
+	assert(r);
+
+	left = r->size - r->pos;
+
+	if (!r->data || (left < sizeof(catcierge_archive_record_t)))
+		return NULL;
+
+	rec = (catcierge_archive_record_t *)(r->data + r->pos);
+
+	if (memcmp(rec->magic, CATCIERGE_ARCHIVE_MAGIC, sizeof(rec->magic))
+		|| (rec->version != CATCIERGE_ARCHIVE_VERSION)
+		|| (rec->size > left)
+		|| (rec->size < (sizeof(catcierge_archive_record_t)
+				+ rec->frame_count * sizeof(catcierge_archive_frame_t))))
+	{
+		// A truncated or corrupt record, nothing valid can follow.
+		return NULL;
+	}
+
+	for (i = 0; i < rec->frame_count; i++)
+	{
+		frame = catcierge_archive_get_frame(rec, i);
+
+		if (((size_t)frame->offset + frame->size) > rec->size)
+			return NULL;
+	}
+
+	r->pos += rec->size;
+
+	return rec;
+}
+
+catcierge_archive_frame_t *catcierge_archive_get_frame(catcierge_archive_record_t *rec, size_t i)
+{
+	assert(rec);
+	return (catcierge_archive_frame_t *)((unsigned char *)rec
+			+ sizeof(catcierge_archive_record_t)
+			+ i * sizeof(catcierge_archive_frame_t));
+}
+
+IplImage *catcierge_archive_decode(catcierge_archive_record_t *rec, size_t i)
+{
+	IplImage *img = NULL;
+	catcierge_archive_frame_t *frame;
+	const unsigned char *src;
+	unsigned char *packed = NULL;
+	size_t row_size;
+	size_t raw_size;
+	int y;
+	assert(rec);
+
+	if (i >= rec->frame_count)
+		return NULL;
+
+	frame = catcierge_archive_get_frame(rec, i);
+	src = (const unsigned char *)rec + frame->offset;
+	row_size = frame->width * frame->channels;
+	raw_size = row_size * frame->height;
+
+	if (frame->encoding == CATCIERGE_ARCHIVE_RLE)
+	{
+		if (!(packed = malloc(raw_size)))
+		{
+			CATERR("Out of memory\n");
+			return NULL;
+		}
+
+		if (catcierge_archive_rle_decode(src, frame->size, packed, raw_size))
+		{
+			CATERR("Corrupt archive frame: %s\n", frame->name);
+			goto fail;
+		}
+
+		src = packed;
+	}
+	else if ((frame->encoding != CATCIERGE_ARCHIVE_RAW) || (frame->size != raw_size))
+	{
+		CATERR("Unsupported archive frame: %s\n", frame->name);
+		goto fail;
+	}
+
+	img = cvCreateImage(cvSize(frame->width, frame->height), IPL_DEPTH_8U, frame->channels);
+
+	for (y = 0; y < img->height; y++)
+	{
+		memcpy(img->imageData + (y * img->widthStep), &src[y * row_size], row_size);
+	}
+
+fail:
+	free(packed);
+
+	return img;
+}
@@ -0,0 +1,134 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_ARCHIVE_H__
+#define __CATCIERGE_ARCHIVE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <opencv2/imgproc/imgproc_c.h>
+#include <opencv2/highgui/highgui_c.h>
+#include "catcierge_timer.h"
+
+//
+// Append-only archive of saved images. Instead of one PNG per image, all
+// images of a match group are appended as one record using a single write:
+//
+//   record header | index (one entry per frame) | frame data ...
+//
+// Frames are stored as packed 8-bit rows, either raw or PackBits run length
+// encoded (whichever is smaller). The thresholded step images compress very
+// well, the camera frames are mostly stored raw. Since a record is written
+// in one go and records are only ever appended, a crash can at worst leave
+// a truncated record at the end, which the reader ignores. When the archive
+// is opened for appending again such a record is cut off, so that the new
+// records can be read.
+//
+#define CATCIERGE_ARCHIVE_MAGIC "CCAR"
+#define CATCIERGE_ARCHIVE_VERSION 1
+#define CATCIERGE_ARCHIVE_ALIGN 16
+#define CATCIERGE_ARCHIVE_EXT ".cca"
+
+typedef enum catcierge_archive_encoding_e
+{
+	CATCIERGE_ARCHIVE_RAW = 0,
+	CATCIERGE_ARCHIVE_RLE = 1
+} catcierge_archive_encoding_t;
+
+typedef enum catcierge_archive_frame_type_e
+{
+	CATCIERGE_ARCHIVE_OBSTRUCT = 0,
+	CATCIERGE_ARCHIVE_MATCH = 1,
+	CATCIERGE_ARCHIVE_STEP = 2
+} catcierge_archive_frame_type_t;
+
+typedef struct catcierge_archive_record_s
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t size;			// Size of the whole record including the header.
+	uint32_t frame_count;
+	uint64_t time_sec;		// Match group start time.
+	uint32_t time_usec;
+	uint32_t reserved;
+	char id[48];			// Match group id.
+} catcierge_archive_record_t;
+
+typedef struct catcierge_archive_frame_s
+{
+	char name[108];			// The filename the image would have been saved as.
+	uint32_t offset;		// Offset of the data from the start of the record.
+	uint32_t size;			// Size of the stored (encoded) data.
+	uint16_t width;
+	uint16_t height;
+	uint8_t channels;
+	uint8_t encoding;		// catcierge_archive_encoding_t
+	uint8_t type;			// catcierge_archive_frame_type_t
+	uint8_t reserved[5];
+} catcierge_archive_frame_t;
+
+typedef struct catcierge_archive_s
+{
+	FILE *f;
+	char *path;
+	unsigned char *buf;		// The record that is being built.
+	size_t buf_size;
+	size_t len;
+	size_t max_frames;		// Index entries reserved in the buffer.
+	size_t size;			// Length of the complete records in the file.
+	size_t record_count;	// Records written since opened.
+	size_t bytes_written;
+} catcierge_archive_t;
+
+typedef struct catcierge_archive_reader_s
+{
+	unsigned char *data;
+	size_t size;
+	size_t pos;				// Offset of the next record.
+	int mapped;
+} catcierge_archive_reader_t;
+
+int catcierge_is_archive_path(const char *path);
+
+void catcierge_archive_init(catcierge_archive_t *ar);
+// Opens an archive for appending, anything after the last complete record is removed.
+int catcierge_archive_open(catcierge_archive_t *ar, const char *path);
+void catcierge_archive_close(catcierge_archive_t *ar);
+// Closes the archive and frees the record buffer.
+void catcierge_archive_destroy(catcierge_archive_t *ar);
+
+// Starts a new record with room for max_frames images.
+int catcierge_archive_begin(catcierge_archive_t *ar, const char *id,
+		const struct timeval *tv, size_t max_frames);
+int catcierge_archive_add(catcierge_archive_t *ar, const char *name,
+		catcierge_archive_frame_type_t type, IplImage *img);
+// Appends the record to the archive with a single write.
+int catcierge_archive_commit(catcierge_archive_t *ar);
+
+int catcierge_archive_reader_open(catcierge_archive_reader_t *r, const char *path);
+void catcierge_archive_reader_close(catcierge_archive_reader_t *r);
+// Returns the next complete record, or NULL at the end of the archive.
+catcierge_archive_record_t *catcierge_archive_reader_next(catcierge_archive_reader_t *r);
+catcierge_archive_frame_t *catcierge_archive_get_frame(catcierge_archive_record_t *rec, size_t i);
+// Decodes a frame into a new image, release it using cvReleaseImage.
+IplImage *catcierge_archive_decode(catcierge_archive_record_t *rec, size_t i);
+
+size_t catcierge_archive_rle_encode(const unsigned char *src, size_t len, unsigned char *dst);
+int catcierge_archive_rle_decode(const unsigned char *src, size_t len, unsigned char *dst, size_t dst_len);
+
+#endif // __CATCIERGE_ARCHIVE_H__
@@ -25,6 +25,7 @@
 #include "catcierge_log.h"
 #ifdef RPI
 #include "catcierge_rpi_args.h"
+#include "catcierge_gpio.h"
 #endif
 
 #ifdef WITH_RFID
@@ -83,6 +84,44 @@ static int add_lockout_options(cargo_t cargo, catcierge_args_t *args)
 }
 
 #ifdef RPI
+static int parse_gpio_backend(cargo_t ctx, void *user, const char *optname,
+                              int argc, char **argv)
+{
+	int *backend = (int *)user;
+	char *d = NULL;
+
+	if (argc < 1)
+	{
+		cargo_set_error(ctx, 0,
+			"Missing \"sysfs\", \"chardev\" or \"fake\" for %s", optname);
+		return -1;
+	}
+
+	d = argv[0];
+
+	if (!strcasecmp(d, "sysfs"))
+	{
+		*backend = GPIO_BACKEND_SYSFS;
+	}
+	else if (!strcasecmp(d, "chardev"))
+	{
+		*backend = GPIO_BACKEND_CHARDEV;
+	}
+	else if (!strcasecmp(d, "fake"))
+	{
+		*backend = GPIO_BACKEND_FAKE;
+	}
+	else
+	{
+		cargo_set_error(ctx, 0,
+			"Invalid GPIO backend \"%s\", must be \"sysfs\", "
+			"\"chardev\" or \"fake\".", d);
+		return -1;
+	}
+
+	return 1;
+}
+
 static int add_gpio_options(cargo_t cargo, catcierge_args_t *args)
 {
 	int ret = 0;
@@ -122,10 +161,90 @@ static int add_gpio_options(cargo_t cargo, catcierge_args_t *args)
 			"to always be on, this is not needed.",
 			"b", &args->backlight_enable);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<gpio> --gpio_backend",
+			"How the GPIO pins are controlled. \"sysfs\" uses "
+			"/sys/class/gpio, \"chardev\" uses the GPIO character device "
+			"(/dev/gpiochip0 by default) and \"fake\" writes the pin values "
+			"to files in the directory given by --gpio_path, which is "
+			"useful for testing.",
+			"c", parse_gpio_backend, &args->gpio_backend);
+	ret |= cargo_set_metavar(cargo,
+			"--gpio_backend",
+			"sysfs|chardev|fake");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<gpio> --gpio_path",
+			"The sysfs GPIO root, GPIO chip device or fake GPIO directory "
+			"depending on --gpio_backend.",
+			"s", &args->gpio_path);
+
 	return ret;
 }
 #endif // PRI
 
+static int add_capture_options(cargo_t cargo, catcierge_args_t *args)
+{
+	int ret = 0;
+
+	ret |= cargo_add_group(cargo, 0, "capture", "Capture settings",
+			"Record the camera frames to a file, or play back such a "
+			"recording instead of using the camera. This runs the full "
+			"state machine, outputs and events on the recorded frames, "
+			"which makes it possible to benchmark the whole pipeline "
+			"in a repeatable way without a camera.\n"
+			"During playback all timers follow the recorded time, so the "
+			"result is the same no matter the playback speed.");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<capture> --record",
+			"Record all captured frames to this file.",
+			"s", &args->capture.record_path);
+	ret |= cargo_set_metavar(cargo, "--record", "PATH");
+
+	#ifndef _WIN32
+	ret |= cargo_add_option(cargo, 0,
+			"<capture> --play",
+			"Use the frames from a recording made with --record instead "
+			"of the camera. Catcierge exits at the end of the recording.",
+			"s", &args->capture.play_path);
+	ret |= cargo_set_metavar(cargo, "--play", "PATH");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<capture> --play_fast",
+			"Play the recording as fast as possible instead of at the "
+			"recorded frame rate.",
+			"b", &args->capture.play_fast);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<capture> --play_loop",
+			"Start over at the end of the recording.",
+			"b", &args->capture.play_loop);
+	#endif // _WIN32
+
+	ret |= cargo_add_option(cargo, 0,
+			"<capture> --gray",
+			"Convert every frame to grayscale once when it is captured, "
+			"instead of in each step that needs a gray image. The color "
+			"frames are only kept if saved images are in color "
+			"(see --match_encoding and --obstruct_encoding). "
+			"The Raspberry Pi camera already captures in gray.",
+			"b", &args->capture.gray);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<capture> --idle_scale",
+			"Capture frames this many times smaller while waiting for "
+			"something to obstruct the frame, and switch to full frames "
+			"as soon as something does. Saves CPU and power when nothing "
+			"is happening, at the cost of a few frames of latency. "
+			"Only for the camera, not for --play or --record. 0 or 1 is off.",
+			"i", &args->capture.idle_scale);
+	ret |= cargo_add_validation(cargo, 0, "--idle_scale",
+			cargo_validate_int_range(0, 8));
+
+	return ret;
+}
+
 static int add_presentation_options(cargo_t cargo, catcierge_args_t *args)
 {
 	int ret = 0;
@@ -242,6 +361,31 @@ static int add_roi_options(cargo_t cargo, catcierge_args_t *args)
 			"If it is smaller than this, the program will exit. "
 			"Default %d.",DEFAULT_MIN_BACKLIGHT);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<roi> --auto_roi_interval",
+			"If --auto_roi is on, search for the back light again at most "
+			"this often while waiting for a cat, and move the ROI if it has "
+			"changed. This is done in a low priority background thread on "
+			"frames where nothing is obstructing the view. "
+			"0 turns this off (the default).",
+			"d", &args->auto_roi_interval);
+	ret |= cargo_set_metavar(cargo,
+			"--auto_roi_interval",
+			"SECONDS");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<roi> --auto_roi_tolerance",
+			NULL,
+			"i", &args->auto_roi_tolerance);
+	ret |= cargo_set_metavar(cargo,
+			"--auto_roi_tolerance",
+			"PIXELS");
+	ret |= cargo_set_option_description(cargo,
+			"--auto_roi_tolerance",
+			"The number of pixels any edge of the back light area must move "
+			"before --auto_roi_interval changes the ROI. "
+			"Default %d.", DEFAULT_AUTOROI_TOLERANCE);
+
 	ret |= cargo_add_option(cargo, 0,
 			"<roi> --save_auto_roi",
 			"Save the image roi found by --auto_roi. Can be useful for debugging "
@@ -260,6 +404,101 @@ static int add_roi_options(cargo_t cargo, catcierge_args_t *args)
 	return ret;
 }
 
+static int parse_obstruct_method(cargo_t ctx, void *user, const char *optname,
+                                 int argc, char **argv)
+{
+	int *method = (int *)user;
+
+	if (argc < 1)
+	{
+		cargo_set_error(ctx, 0,
+			"Missing \"threshold\" or \"background\" for %s", optname);
+		return -1;
+	}
+
+	if ((*method = catcierge_parse_obstruct_method(argv[0])) < 0)
+	{
+		cargo_set_error(ctx, 0,
+			"Invalid obstruct method \"%s\", must be \"threshold\" "
+			"or \"background\".", argv[0]);
+		return -1;
+	}
+
+	return 1;
+}
+
+static int add_obstruct_options(cargo_t cargo, catcierge_args_t *args)
+{
+	int ret = 0;
+
+	ret |= cargo_add_group(cargo, 0, "obstruct",
+			"Obstruction settings",
+			"Settings for how to decide if something is obstructing the "
+			"middle of the back light, which starts a new match group.");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<obstruct> --obstruct_method",
+			"How to check if the frame is obstructed. \"threshold\" "
+			"counts the dark pixels in the middle of the frame (default). "
+			"\"background\" learns how the clear frame looks and counts "
+			"the parts that are darker than that, which follows slow "
+			"changes in the lighting instead of starting a match group.",
+			"c", parse_obstruct_method, &args->obstruct_method);
+	ret |= cargo_set_metavar(cargo, "--obstruct_method", "METHOD");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<obstruct> --obstruct_decimation",
+			NULL,
+			"i", &args->obstruct_decimation);
+	ret |= cargo_set_metavar(cargo, "--obstruct_decimation", "N");
+	ret |= cargo_add_validation(cargo, 0,
+			"--obstruct_decimation",
+			cargo_validate_int_range(1, 16));
+	ret |= cargo_set_option_description(cargo,
+			"--obstruct_decimation",
+			"For the threshold method, first estimate the number of dark "
+			"pixels by only looking at every Nth pixel of every Nth row, and "
+			"only count every pixel when the estimate is close to the "
+			"decision. Very thin objects can be missed by the estimate, "
+			"1 always counts every pixel. Default %d.",
+			DEFAULT_OBSTRUCT_DECIMATION);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<obstruct> --obstruct_bg_rate",
+			NULL,
+			"i", &args->obstruct_bg_rate);
+	ret |= cargo_set_metavar(cargo, "--obstruct_bg_rate", "BITS");
+	ret |= cargo_set_option_description(cargo,
+			"--obstruct_bg_rate",
+			"How fast the background follows clear frames. Each frame moves "
+			"the background 1/2^BITS of the way. Default %d.",
+			DEFAULT_OBSTRUCT_BG_RATE);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<obstruct> --obstruct_bg_thr",
+			NULL,
+			"i", &args->obstruct_bg_thr);
+	ret |= cargo_set_metavar(cargo, "--obstruct_bg_thr", "LEVELS");
+	ret |= cargo_set_option_description(cargo,
+			"--obstruct_bg_thr",
+			"The number of gray levels a part of the frame must be darker "
+			"than the background to count as obstructed. Default %d.",
+			DEFAULT_OBSTRUCT_BG_THR);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<obstruct> --obstruct_bg_scale",
+			NULL,
+			"i", &args->obstruct_bg_scale);
+	ret |= cargo_set_metavar(cargo, "--obstruct_bg_scale", "PIXELS");
+	ret |= cargo_set_option_description(cargo,
+			"--obstruct_bg_scale",
+			"The frame is compared to the background in blocks of this "
+			"size squared. Default %d.",
+			DEFAULT_OBSTRUCT_BG_SCALE);
+
+	return ret;
+}
+
 static int add_matcher_options(cargo_t cargo, catcierge_args_t *args)
 {
 	//
@@ -285,6 +524,13 @@ static int add_matcher_options(cargo_t cargo, catcierge_args_t *args)
 			"Haar feature based matching algorithm (recommended).",
 			"b=", &args->matcher_type, MATCHER_HAAR);
 
+	#ifdef WITH_DNN
+	ret |= cargo_add_option(cargo, 0,
+			"<!matcher_type, matcher> --dnn_matcher --dnn",
+			"Neural network based matching algorithm, using a local model on the CPU.",
+			"b=", &args->matcher_type, MATCHER_DNN);
+	#endif // WITH_DNN
+
 	ret |= cargo_add_option(cargo, 0,
 			"<matcher> --ok_matches_needed", NULL,
 			"i", &args->ok_matches_needed);
@@ -315,9 +561,66 @@ static int add_matcher_options(cargo_t cargo, catcierge_args_t *args)
 
 	ret |= catcierge_haar_matcher_add_options(cargo, &args->haar);
 	ret |= catcierge_template_matcher_add_options(cargo, &args->templ);
+	#ifdef WITH_DNN
+	ret |= catcierge_dnn_matcher_add_options(cargo, &args->dnn);
+	#endif
 	return ret;
 }
 
+static int parse_image_encoding(cargo_t ctx, void *user, const char *optname,
+                                int argc, char **argv)
+{
+	catcierge_image_encoding_t *enc = (catcierge_image_encoding_t *)user;
+
+	if (argc < 1)
+	{
+		cargo_set_error(ctx, 0,
+			"Missing FORMAT[:LEVEL][:gray] for %s", optname);
+		return -1;
+	}
+
+	if (catcierge_image_encoding_parse(enc, argv[0]))
+	{
+		cargo_set_error(ctx, 0,
+			"Invalid image encoding \"%s\" for %s. Expected FORMAT[:LEVEL][:gray] "
+			"where FORMAT is \"png\" (LEVEL 0-9), \"jpeg\" or \"webp\" "
+			"(LEVEL 1-100) or \"raw\".", argv[0], optname);
+		return -1;
+	}
+
+	if ((enc->format == IMAGE_FORMAT_WEBP) && !cvHaveImageWriter("x.webp"))
+	{
+		cargo_set_error(ctx, 0,
+			"%s: OpenCV was built without WebP support", optname);
+		return -1;
+	}
+
+	return 1;
+}
+
+static int parse_steps_mode(cargo_t ctx, void *user, const char *optname,
+                            int argc, char **argv)
+{
+	int *mode = (int *)user;
+
+	if (argc < 1)
+	{
+		cargo_set_error(ctx, 0,
+			"Missing \"full\", \"summary\" or \"lazy\" for %s", optname);
+		return -1;
+	}
+
+	if ((*mode = catcierge_parse_steps_mode(argv[0])) < 0)
+	{
+		cargo_set_error(ctx, 0,
+			"Invalid steps mode \"%s\", must be \"full\", "
+			"\"summary\" or \"lazy\".", argv[0]);
+		return -1;
+	}
+
+	return 1;
+}
+
 static int add_output_options(cargo_t cargo, catcierge_args_t *args)
 {
 	int ret = 0;
@@ -353,6 +656,58 @@ static int add_output_options(cargo_t cargo, catcierge_args_t *args)
 			"(--save must also be turned on)",
 			"b", &args->save_steps);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --steps_mode",
+			"How the step images are recorded when --save_steps is on. "
+			"\"full\" copies every step while matching (default). "
+			"\"summary\" only keeps the final annotated image. "
+			"\"lazy\" records nothing while matching and instead runs "
+			"the matcher again on the saved match images when they are "
+			"saved, so matching is as fast as without --save_steps. "
+			"Note that in lazy mode the step path variables are empty "
+			"until the images have been saved.",
+			"c", parse_steps_mode, &args->steps_mode);
+	ret |= cargo_set_metavar(cargo, "--steps_mode", "MODE");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --archive",
+			"Instead of writing a separate PNG file for each saved image, "
+			"append all images of a match group to this archive file using "
+			"a single write. The images are stored uncompressed or run "
+			"length encoded, which is much cheaper than PNG encoding. "
+			"Use catcierge_archive to list or extract the images. "
+			"Other %%vars%% can be used in the path, for instance to "
+			"start a new archive each day.\n"
+			"Example: --archive %%output_path%%/%%time:@Y-@m-@d%%.cca",
+			"s", &args->archive_path);
+	ret |= cargo_set_metavar(cargo, "--archive", "PATH");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --match_encoding",
+			"Image encoding for saved match images given as "
+			"FORMAT[:LEVEL][:gray]. FORMAT is one of png, jpeg, webp "
+			"(if OpenCV supports it) or raw (uncompressed PGM/PPM). "
+			"LEVEL is the PNG compression level 0-9 or the JPEG/WebP "
+			"quality 1-100, lower PNG levels are faster to encode. "
+			"Adding gray saves an 8-bit grayscale image instead of color.\n"
+			"Example: --match_encoding png:1:gray",
+			"c", parse_image_encoding, &args->match_encoding);
+	ret |= cargo_set_metavar(cargo, "--match_encoding", "FORMAT[:LEVEL][:gray]");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --steps_encoding",
+			"Image encoding for saved step images. "
+			"Same format as --match_encoding.",
+			"c", parse_image_encoding, &args->steps_encoding);
+	ret |= cargo_set_metavar(cargo, "--steps_encoding", "FORMAT[:LEVEL][:gray]");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --obstruct_encoding",
+			"Image encoding for saved obstruct images. "
+			"Same format as --match_encoding.",
+			"c", parse_image_encoding, &args->obstruct_encoding);
+	ret |= cargo_set_metavar(cargo, "--obstruct_encoding", "FORMAT[:LEVEL][:gray]");
+
 	ret |= cargo_add_option(cargo, 0,
 			"<output> --input",
 			"Path to one or more template files generated on specified events. "
@@ -482,6 +837,13 @@ int add_rfid_options(cargo_t cargo, catcierge_args_t *args)
 			"A comma separated list of allowed RFID tags. Example: %s",
 			EXAMPLE_RFID_STR);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<rfid> --rfid_allowed_file",
+			"Path to a file with allowed RFID tags, one per line. "
+			"Anything after a # is ignored. The file is reloaded "
+			"when the program receives SIGHUP.",
+			"s", &args->rfid_allowed_path);
+
 	return ret;
 }
 #endif // WITH_RFID
@@ -646,6 +1008,15 @@ static int add_options(cargo_t cargo, catcierge_args_t *args)
 			"which are needed for setting GPIO pins on the Raspberry Pi.",
 			"s", &args->chuid);
 
+	ret |= cargo_add_option(cargo, 0,
+			"--mem_stats_interval",
+			"Log the resident and heap memory use of the process this "
+			"often, to spot slow leaks. 0 turns this off (the default).",
+			"d", &args->mem_stats_interval);
+	ret |= cargo_set_metavar(cargo,
+			"--mem_stats_interval",
+			"SECONDS");
+
 	// Meant for the fsm_tester
 	#ifndef _WIN32
 	ret |= cargo_add_option(cargo, 0,
@@ -665,11 +1036,13 @@ static int add_options(cargo_t cargo, catcierge_args_t *args)
 	#endif // RPI
 
 	ret |= add_roi_options(cargo, args);
+	ret |= add_obstruct_options(cargo, args);
 	ret |= add_matcher_options(cargo, args);
 	ret |= add_lockout_options(cargo, args);
 	#ifdef RPI
 	ret |= add_gpio_options(cargo, args);
 	#endif
+	ret |= add_capture_options(cargo, args);
 	ret |= add_presentation_options(cargo, args);
 	ret |= add_output_options(cargo, args);
 	#ifdef WITH_RFID
@@ -735,6 +1108,10 @@ static void print_cmd_help(cargo_t cargo, catcierge_args_t *args)
 	catcierge_template_output_print_usage();
 	printf("\n");
 	catcierge_haar_output_print_usage();
+	#ifdef WITH_DNN
+	printf("\n");
+	catcierge_dnn_output_print_usage();
+	#endif
 }
 
 void catcierge_args_init_vars(catcierge_args_t *args)
@@ -743,9 +1120,16 @@ void catcierge_args_init_vars(catcierge_args_t *args)
 
 	catcierge_template_matcher_args_init(&args->templ);
 	catcierge_haar_matcher_args_init(&args->haar);
+	#ifdef WITH_DNN
+	catcierge_dnn_matcher_args_init(&args->dnn);
+	#endif
 	args->config_path = strdup(CATCIERGE_CONF_PATH);
 	args->saveimg = 1;
 	args->save_obstruct_img = 0;
+	args->steps_mode = STEPS_FULL;
+	catcierge_image_encoding_init(&args->obstruct_encoding);
+	catcierge_image_encoding_init(&args->match_encoding);
+	catcierge_image_encoding_init(&args->steps_encoding);
 	args->match_time = DEFAULT_MATCH_WAIT;
 	args->lockout_method = TIMER_ONLY_1;
 	args->lockout_time = DEFAULT_LOCKOUT_TIME;
@@ -753,6 +1137,12 @@ void catcierge_args_init_vars(catcierge_args_t *args)
 	args->ok_matches_needed = DEFAULT_OK_MATCHES_NEEDED;
 	args->output_path = strdup(".");
 	args->min_backlight = DEFAULT_MIN_BACKLIGHT;
+	args->auto_roi_tolerance = DEFAULT_AUTOROI_TOLERANCE;
+	args->obstruct_method = OBSTRUCT_METHOD_THRESHOLD;
+	args->obstruct_bg_rate = DEFAULT_OBSTRUCT_BG_RATE;
+	args->obstruct_bg_thr = DEFAULT_OBSTRUCT_BG_THR;
+	args->obstruct_bg_scale = DEFAULT_OBSTRUCT_BG_SCALE;
+	args->obstruct_decimation = DEFAULT_OBSTRUCT_DECIMATION;
 
 	#ifdef RPI
 	{
@@ -768,6 +1158,7 @@ void catcierge_args_init_vars(catcierge_args_t *args)
 		args->lockout_gpio_pin = CATCIERGE_LOCKOUT_GPIO;
 		args->backlight_gpio_pin = CATCIERGE_BACKLIGHT_GPIO;
 		args->backlight_enable = 0;
+		args->gpio_backend = GPIO_BACKEND_SYSFS;
 
 		args->rpi_config_path = strdup(CATCIERGE_RPI_CONF_PATH);
 	}
@@ -790,6 +1181,7 @@ void catcierge_args_destroy_vars(catcierge_args_t *args)
 	catcierge_xfree(&args->match_output_path);
 	catcierge_xfree(&args->steps_output_path);
 	catcierge_xfree(&args->obstruct_output_path);
+	catcierge_xfree(&args->archive_path);
 	catcierge_xfree(&args->template_output_path);
 
 	#ifdef WITH_ZMQ
@@ -825,6 +1217,9 @@ void catcierge_args_destroy_vars(catcierge_args_t *args)
 	args->temp_config_count = 0;
 
 	catcierge_xfree(&args->base_time);
+	catcierge_xfree(&args->gpio_path);
+	catcierge_xfree(&args->capture.record_path);
+	catcierge_xfree(&args->capture.play_path);
 
 	#ifdef WITH_RFID
 	catcierge_xfree(&args->rfid_inner_path);
@@ -833,9 +1228,13 @@ void catcierge_args_destroy_vars(catcierge_args_t *args)
 	catcierge_free_list(args->rfid_allowed, args->rfid_allowed_count);
 	args->rfid_allowed_count = 0;
 	args->rfid_allowed = NULL;
+	catcierge_xfree(&args->rfid_allowed_path);
 	#endif // WITH_RFID
 
 	catcierge_haar_matcher_args_destroy(&args->haar);
+	#ifdef WITH_DNN
+	catcierge_dnn_matcher_args_destroy(&args->dnn);
+	#endif
 	catcierge_template_matcher_args_destroy(&args->templ);
 
 	catcierge_xfree_list(&args->user_vars, &args->user_var_count);
@@ -861,7 +1260,9 @@ int catcierge_args_init(catcierge_args_t *args, const char *progname)
 		"Signals:\n"
 		"The program can receive signals that can be sent using the kill command.\n"
 		" SIGUSR1 = Force the cat door to unlock\n"
-		" SIGUSR2 = Force the cat door to lock (for lock timeout)\n");
+		" SIGUSR2 = Force the cat door to lock (for lock timeout)\n"
+		" SIGQUIT = Print match group timing and lockout latency stats\n"
+		" SIGHUP  = Reload the allowed RFID tags from --rfid_allowed_file\n");
 
 	ret = add_options(args->cargo, args);
 
@@ -984,6 +1385,7 @@ fail:
 
 void catcierge_print_settings(catcierge_args_t *args)
 {
+	char enc_str[64];
 	#ifdef WITH_RFID
 	size_t i;
 	#endif
@@ -998,13 +1400,47 @@ void catcierge_print_settings(catcierge_args_t *args)
 	{
 	printf("  Auto ROI threshold: %d\n", args->auto_roi_thr);
 	printf(" Min. backlight area: %d\n", args->min_backlight);
+	printf("   Auto ROI interval: %0.1f seconds\n", args->auto_roi_interval);
+	printf("  Auto ROI tolerance: %d pixels\n", args->auto_roi_tolerance);
+	}
+	printf("     Obstruct method: %s\n", catcierge_obstruct_method_str(args->obstruct_method));
+	if (args->obstruct_method == OBSTRUCT_METHOD_THRESHOLD)
+	{
+	printf(" Obstruct decimation: %d\n", args->obstruct_decimation);
+	}
+	else if (args->obstruct_method == OBSTRUCT_METHOD_BACKGROUND)
+	{
+	printf(" Obstruct background: rate %d, threshold %d, scale %d\n",
+		args->obstruct_bg_rate, args->obstruct_bg_thr, args->obstruct_bg_scale);
 	}
 	printf("          Show video: %d\n", args->show);
 	printf("        Save matches: %d\n", args->saveimg);
 	printf("       Save obstruct: %d\n", args->save_obstruct_img);
 	printf("          Save steps: %d\n", args->save_steps);
+	if (args->save_steps)
+	printf("          Steps mode: %s\n", catcierge_steps_mode_str(args->steps_mode));
+	printf("      Match encoding: %s\n", catcierge_image_encoding_str(&args->match_encoding, enc_str, sizeof(enc_str)));
+	if (args->save_steps)
+	printf("      Steps encoding: %s\n", catcierge_image_encoding_str(&args->steps_encoding, enc_str, sizeof(enc_str)));
+	if (args->save_obstruct_img)
+	printf("   Obstruct encoding: %s\n", catcierge_image_encoding_str(&args->obstruct_encoding, enc_str, sizeof(enc_str)));
 	printf("     Highlight match: %d\n", args->highlight_match);
 	printf("       Lockout dummy: %d\n", args->lockout_dummy);
+	#ifdef RPI
+	printf("        GPIO backend: %s %s\n",
+		catcierge_gpio_backend_str(args->gpio_backend),
+		args->gpio_path ? args->gpio_path : "");
+	#endif // RPI
+	if (args->capture.play_path)
+	printf("      Play recording: %s%s%s\n", args->capture.play_path,
+							args->capture.play_fast ? " (fast)" : "",
+							args->capture.play_loop ? " (loop)" : "");
+	if (args->capture.record_path)
+	printf("    Record frames to: %s\n", args->capture.record_path);
+	if (args->capture.gray)
+	printf("                Gray: Convert at capture\n");
+	if (args->capture.idle_scale > 1)
+	printf("          Idle scale: 1/%d\n", args->capture.idle_scale);
 	printf("      Lockout method: %d\n", args->lockout_method);
 	printf("           Lock time: %d seconds\n", args->lockout_time);
 	printf("       Lockout error: %d %s\n", args->max_consecutive_lockout_count,
@@ -1012,6 +1448,8 @@ void catcierge_print_settings(catcierge_args_t *args)
 	printf("   Lockout err delay: %0.1f\n", args->consecutive_lockout_delay);
 	printf("       Match timeout: %d seconds\n", args->match_time);
 	printf("            Log file: %s\n", args->log_path ? args->log_path : "-");
+	if (args->mem_stats_interval > 0.0)
+	printf("  Mem stats interval: %0.1f seconds\n", args->mem_stats_interval);
 	printf("            No color: %d\n", args->nocolor);
 	printf("        No animation: %d\n", args->noanim);
 	printf("   Ok matches needed: %d\n", args->ok_matches_needed);
@@ -1024,6 +1462,8 @@ void catcierge_print_settings(catcierge_args_t *args)
 	printf("Obstruct output path: %s\n", args->obstruct_output_path);
 	if (args->template_output_path && strcmp(args->output_path, args->template_output_path))
 	printf("Template output path: %s\n", args->template_output_path);
+	if (args->archive_path)
+	printf("        Archive path: %s\n", args->archive_path);
 	#ifdef WITH_ZMQ
 	printf("       ZMQ publisher: %d\n", args->zmq);
 	printf("            ZMQ port: %d\n", args->zmq_port);
@@ -1036,6 +1476,13 @@ void catcierge_print_settings(catcierge_args_t *args)
 		printf("        Matcher type: template\n");
 		catcierge_template_matcher_print_settings(&args->templ);
 	}
+	#ifdef WITH_DNN
+	else if (args->matcher_type == MATCHER_DNN)
+	{
+		printf("        Matcher type: dnn\n");
+		catcierge_dnn_matcher_print_settings(&args->dnn);
+	}
+	#endif // WITH_DNN
 	else
 	{
 		printf("        Matcher type: haar\n");
@@ -1052,6 +1499,7 @@ void catcierge_print_settings(catcierge_args_t *args)
 	{
 		printf("                 %s\n", args->rfid_allowed[i]);
 	}
+	printf("   Allowed RFID file: %s\n", args->rfid_allowed_path ? args->rfid_allowed_path : "-");
 	#endif // WITH_RFID
 	print_line(stdout, 80, "-");
 }
@@ -1068,6 +1516,12 @@ catcierge_matcher_args_t *catcierge_get_matcher_args(catcierge_args_t *args)
 	{
 		margs = (catcierge_matcher_args_t *)&args->haar;
 	}
+	#ifdef WITH_DNN
+	else if (args->matcher_type == MATCHER_DNN)
+	{
+		margs = (catcierge_matcher_args_t *)&args->dnn;
+	}
+	#endif // WITH_DNN
 
 	// TODO: This is an ugly way to pass this on... But whatever for now.
 	if (margs)
@@ -1076,6 +1530,11 @@ catcierge_matcher_args_t *catcierge_get_matcher_args(catcierge_args_t *args)
 		margs->min_backlight = args->min_backlight;
 		margs->auto_roi_thr = args->auto_roi_thr;
 		margs->save_auto_roi_img = args->save_auto_roi_img;
+		margs->obstruct_method = args->obstruct_method;
+		margs->obstruct_bg_rate = args->obstruct_bg_rate;
+		margs->obstruct_bg_thr = args->obstruct_bg_thr;
+		margs->obstruct_bg_scale = args->obstruct_bg_scale;
+		margs->obstruct_decimation = args->obstruct_decimation;
 	}
 
 	return margs;
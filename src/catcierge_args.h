@@ -28,7 +28,11 @@
 #include "catcierge_matcher.h"
 #include "catcierge_template_matcher.h"
 #include "catcierge_haar_matcher.h"
+#ifdef WITH_DNN
+#include "catcierge_dnn_matcher.h"
+#endif
 #include "catcierge_types.h"
+#include "catcierge_capture.h"
 #include "cargo.h"
 #include "cargo_ini.h"
 
@@ -70,13 +74,21 @@ typedef struct catcierge_args_s
 	char *steps_output_path;
 	char *obstruct_output_path;
 	char *template_output_path;
+	char *archive_path;
+	catcierge_image_encoding_t obstruct_encoding;
+	catcierge_image_encoding_t match_encoding;
+	catcierge_image_encoding_t steps_encoding;
 	int ok_matches_needed;
 	int save_steps;
+	int steps_mode;		// catcierge_steps_mode_t
 	int no_final_decision;
 
 	catcierge_matcher_type_t matcher_type;
 	catcierge_template_matcher_args_t templ;
 	catcierge_haar_matcher_args_t haar;
+	#ifdef WITH_DNN
+	catcierge_dnn_matcher_args_t dnn;
+	#endif
 
 	char *log_path; // TODO: Remove this.
 
@@ -103,12 +115,22 @@ typedef struct catcierge_args_s
 	int save_auto_roi_img;
 	char *auto_roi_output_path;
 	int min_backlight;
+	double auto_roi_interval;
+	int auto_roi_tolerance;
 	double startup_delay;
+	catcierge_obstruct_method_t obstruct_method;
+	int obstruct_bg_rate;
+	int obstruct_bg_thr;
+	int obstruct_bg_scale;
+	int obstruct_decimation;
 	int no_default_config;
+	double mem_stats_interval;
 
 	char *base_time;
 	long base_time_diff;
 
+	catcierge_capture_args_t capture;
+
 	#ifdef WITH_RFID
 	char *rfid_inner_path;
 	char *rfid_outer_path;
@@ -116,11 +138,14 @@ typedef struct catcierge_args_s
 	int lock_on_invalid_rfid;
 	char **rfid_allowed;
 	size_t rfid_allowed_count;
+	char *rfid_allowed_path;
 	#endif // WITH_RFID
 
 	int lockout_gpio_pin;
 	int backlight_gpio_pin;
 	int backlight_enable;
+	int gpio_backend;		// catcierge_gpio_backend_t
+	char *gpio_path;		// Sysfs root, gpiochip device or fake directory.
 
 	#ifdef RPI
 	char *rpi_config_path;
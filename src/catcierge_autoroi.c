@@ -0,0 +1,279 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "catcierge_autoroi.h"
+#include "catcierge_log.h"
+
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+static void catcierge_autoroi_search(catcierge_autoroi_t *ar, CvRect *r, int *ret)
+{
+	*ret = catcierge_find_back_light_area(&ar->matcher, ar->img, r, ar->storage);
+}
+
+#ifndef _WIN32
+static void *catcierge_autoroi_thread(void *arg)
+{
+	CvRect r;
+	int ret;
+	catcierge_autoroi_t *ar = (catcierge_autoroi_t *)arg;
+
+	pthread_mutex_lock(&ar->lock);
+
+	while (!ar->quit)
+	{
+		if (!ar->busy || ar->done)
+		{
+			pthread_cond_wait(&ar->cond, &ar->lock);
+			continue;
+		}
+
+		// The image is not touched by the main thread until done is set.
+		pthread_mutex_unlock(&ar->lock);
+		catcierge_autoroi_search(ar, &r, &ret);
+		pthread_mutex_lock(&ar->lock);
+
+		ar->found = r;
+		ar->found_ret = ret;
+		ar->done = 1;
+	}
+
+	pthread_mutex_unlock(&ar->lock);
+
+	return NULL;
+}
+
+static int catcierge_autoroi_start_thread(catcierge_autoroi_t *ar)
+{
+	int ret = -1;
+	#ifdef SCHED_IDLE
+	pthread_attr_t attr;
+	struct sched_param param;
+
+	// Only run the search when the CPU has nothing better to do.
+	memset(&param, 0, sizeof(param));
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_IDLE);
+	pthread_attr_setschedparam(&attr, &param);
+	ret = pthread_create(&ar->thread, &attr, catcierge_autoroi_thread, ar);
+	pthread_attr_destroy(&attr);
+	#endif // SCHED_IDLE
+
+	if (ret && pthread_create(&ar->thread, NULL, catcierge_autoroi_thread, ar))
+	{
+		return -1;
+	}
+
+	ar->threaded = 1;
+
+	return 0;
+}
+#endif // !_WIN32
+
+int catcierge_autoroi_init(catcierge_autoroi_t *ar, catcierge_matcher_t *matcher,
+							double interval, int tolerance)
+{
+	assert(ar);
+	assert(matcher);
+	memset(ar, 0, sizeof(*ar));
+
+	ar->margs = *matcher->args;
+	ar->margs.roi = NULL;
+	ar->matcher = *matcher;
+	ar->matcher.args = &ar->margs;
+	ar->matcher.stages = NULL;
+	ar->interval = interval;
+	ar->tolerance = tolerance;
+	ar->min_backlight = ar->margs.min_backlight;
+
+	if (!(ar->storage = cvCreateMemStorage(0)))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	catcierge_timer_set(&ar->timer, interval);
+	catcierge_timer_start(&ar->timer);
+
+	#ifndef _WIN32
+	pthread_mutex_init(&ar->lock, NULL);
+	pthread_cond_init(&ar->cond, NULL);
+
+	if (catcierge_autoroi_start_thread(ar))
+	{
+		CATERR("Failed to create back light recalibration thread\n");
+		pthread_cond_destroy(&ar->cond);
+		pthread_mutex_destroy(&ar->lock);
+		cvReleaseMemStorage(&ar->storage);
+		return -1;
+	}
+	#endif
+
+	return 0;
+}
+
+void catcierge_autoroi_destroy(catcierge_autoroi_t *ar)
+{
+	assert(ar);
+
+	if (!ar->storage)
+		return;
+
+	#ifndef _WIN32
+	if (ar->threaded)
+	{
+		pthread_mutex_lock(&ar->lock);
+		ar->quit = 1;
+		pthread_cond_signal(&ar->cond);
+		pthread_mutex_unlock(&ar->lock);
+
+		pthread_join(ar->thread, NULL);
+		ar->threaded = 0;
+	}
+
+	pthread_cond_destroy(&ar->cond);
+	pthread_mutex_destroy(&ar->lock);
+	#endif
+
+	cvReleaseImage(&ar->img);
+	cvReleaseMemStorage(&ar->storage);
+}
+
+int catcierge_autoroi_active(catcierge_autoroi_t *ar)
+{
+	assert(ar);
+	return (ar->storage != NULL);
+}
+
+int catcierge_autoroi_submit(catcierge_autoroi_t *ar, IplImage *img, int scale)
+{
+	CvSize size;
+	assert(ar);
+	assert(img);
+
+	// Only the main thread sets busy, so this needs no lock.
+	if (ar->busy || !catcierge_timer_has_timed_out(&ar->timer))
+	{
+		return 0;
+	}
+
+	size = cvGetSize(img);
+
+	if (ar->img
+	 && ((ar->img->width != size.width)
+	  || (ar->img->height != size.height)
+	  || (ar->img->nChannels != img->nChannels)))
+	{
+		cvReleaseImage(&ar->img);
+	}
+
+	if (!ar->img && !(ar->img = cvCreateImage(size, img->depth, img->nChannels)))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	cvCopy(img, ar->img, NULL);
+	ar->scale = (scale > 1) ? scale : 1;
+	ar->margs.min_backlight = ar->min_backlight / (ar->scale * ar->scale);
+
+	#ifdef _WIN32
+	catcierge_autoroi_search(ar, &ar->found, &ar->found_ret);
+	ar->busy = 1;
+	ar->done = 1;
+	#else
+	pthread_mutex_lock(&ar->lock);
+	ar->busy = 1;
+	ar->done = 0;
+	pthread_cond_signal(&ar->cond);
+	pthread_mutex_unlock(&ar->lock);
+	#endif
+
+	return 1;
+}
+
+int catcierge_autoroi_poll(catcierge_autoroi_t *ar, const CvRect *cur, CvRect *roi)
+{
+	int done;
+	assert(ar);
+	assert(cur);
+	assert(roi);
+
+	if (!ar->busy)
+	{
+		return 0;
+	}
+
+	#ifndef _WIN32
+	pthread_mutex_lock(&ar->lock);
+	#endif
+
+	if ((done = ar->done))
+	{
+		ar->busy = 0;
+		ar->done = 0;
+	}
+
+	#ifndef _WIN32
+	pthread_mutex_unlock(&ar->lock);
+	#endif
+
+	if (!done)
+	{
+		return 0;
+	}
+
+	catcierge_timer_start(&ar->timer);
+
+	if (ar->found_ret)
+	{
+		CATERR("Back light recalibration failed, keeping the current ROI\n");
+		return 0;
+	}
+
+	ar->found.x *= ar->scale;
+	ar->found.y *= ar->scale;
+	ar->found.width *= ar->scale;
+	ar->found.height *= ar->scale;
+
+	if (!catcierge_roi_differs(cur, &ar->found, ar->tolerance))
+	{
+		return 0;
+	}
+
+	*roi = ar->found;
+
+	return 1;
+}
+
+int catcierge_roi_differs(const CvRect *a, const CvRect *b, int tolerance)
+{
+	assert(a);
+	assert(b);
+
+	return (abs(a->x - b->x) > tolerance)
+		|| (abs(a->y - b->y) > tolerance)
+		|| (abs((a->x + a->width) - (b->x + b->width)) > tolerance)
+		|| (abs((a->y + a->height) - (b->y + b->height)) > tolerance);
+}
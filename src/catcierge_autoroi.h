@@ -0,0 +1,88 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_AUTOROI_H__
+#define __CATCIERGE_AUTOROI_H__
+
+#include <opencv2/imgproc/imgproc_c.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "catcierge_matcher.h"
+#include "catcierge_timer.h"
+
+//
+// Background recalibration of the --auto_roi back light area.
+//
+// The back light and the camera drift over days, so the area found at
+// startup slowly stops matching what the obstruction check expects.
+// At most once every interval a clear frame from the waiting state is
+// copied and handed to a low priority worker thread that searches it for
+// the back light. The main loop never waits for the worker, it picks up
+// the result the next time it polls and only then changes the ROI, so
+// the obstruction check never sees a half updated rectangle.
+//
+// On Windows there is no worker thread and the search runs when the
+// frame is submitted.
+//
+
+typedef struct catcierge_autoroi_s
+{
+	catcierge_matcher_t matcher;		// Private copies so the worker does not
+	catcierge_matcher_args_t margs;		// depend on the lifetime of the real matcher.
+	double interval;			// Seconds between recalibrations.
+	int tolerance;				// Pixels any edge must move before the ROI is changed.
+	catcierge_timer_t timer;	// Time since the last recalibration.
+	IplImage *img;				// Private copy of the frame being searched.
+	int scale;					// Full frame size divided by the size of img.
+	int min_backlight;			// --min_backlight for full frames.
+	CvMemStorage *storage;		// Contour storage reused between searches.
+	CvRect found;				// Back light area of the last search.
+	int found_ret;				// Result of the last search.
+	int busy;					// A frame has been submitted and the result not yet polled.
+	int done;					// The worker has finished with the submitted frame.
+	#ifndef _WIN32
+	int threaded;
+	int quit;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	#endif
+} catcierge_autoroi_t;
+
+int catcierge_autoroi_init(catcierge_autoroi_t *ar, catcierge_matcher_t *matcher,
+							double interval, int tolerance);
+void catcierge_autoroi_destroy(catcierge_autoroi_t *ar);
+int catcierge_autoroi_active(catcierge_autoroi_t *ar);
+
+// Hands a copy of a clear frame to the worker if the interval has passed
+// and the worker is idle. Returns 1 if the frame was taken, never blocks
+// on the search itself. Scale is how much smaller than a full frame img is,
+// the area found is scaled back up to full frame coordinates.
+int catcierge_autoroi_submit(catcierge_autoroi_t *ar, IplImage *img, int scale);
+
+// Collects the result of a finished search. Returns 1 and sets roi if a
+// back light area was found that differs from cur by more than the tolerance.
+int catcierge_autoroi_poll(catcierge_autoroi_t *ar, const CvRect *cur, CvRect *roi);
+
+// Does any edge of the rectangles differ by more than tolerance pixels?
+int catcierge_roi_differs(const CvRect *a, const CvRect *b, int tolerance);
+
+#endif // __CATCIERGE_AUTOROI_H__
@@ -0,0 +1,1115 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <opencv2/imgproc/imgproc_c.h>
+#include <opencv2/highgui/highgui_c.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <catcierge_config.h>
+#include "catcierge_matcher.h"
+#include "catcierge_template_matcher.h"
+#include "catcierge_haar_matcher.h"
+#include "catcierge_util.h"
+#include "catcierge_types.h"
+#include "catcierge_args.h"
+#include "catcierge_timer.h"
+#include "catcierge_frame.h"
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+//
+// Count the allocations made by the matchers (including OpenCV).
+// On glibc the allocator functions can be overridden by the program itself.
+// C++ new ends up in malloc, and OpenCV may allocate its aligned buffers
+// with posix_memalign, so the aligned allocators are counted as well.
+// Only the obsolete valloc and pvalloc are missed.
+//
+#if defined(__GLIBC__) && !defined(CATCIERGE_BENCH_NO_ALLOC_COUNT)
+#define BENCH_COUNT_ALLOCS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static size_t bench_alloc_count;
+static size_t bench_alloc_bytes;
+
+static void bench_count_alloc(size_t size)
+{
+	__atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&bench_alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+	bench_count_alloc(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	bench_count_alloc(nmemb * size);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	bench_count_alloc(size);
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	bench_count_alloc(size);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	bench_count_alloc(size);
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if ((alignment < sizeof(void *)) || (alignment & (alignment - 1)))
+		return EINVAL;
+
+	bench_count_alloc(size);
+
+	if (!(ptr = __libc_memalign(alignment, size)))
+		return ENOMEM;
+
+	*memptr = ptr;
+	return 0;
+}
+#endif // __GLIBC__
+
+typedef struct bench_image_s
+{
+	char *path;
+	IplImage *img;
+	int expected;			// Expected match success, -1 if unknown.
+	int success;			// Success of the last match.
+	double result;			// Result of the last match.
+	double *times;			// Wall-clock time of each measured match (seconds).
+	catcierge_span_t stages[MATCHER_STAGE_COUNT]; // Summed over all measured matches.
+	size_t alloc_count;		// Summed over all measured matches.
+	size_t alloc_bytes;
+	int obstruct_exact;		// Full resolution obstruction decision.
+	int obstruct_fast;		// Decimated obstruction decision.
+	int obstruct_escalated;	// Did the decimated check need the full count?
+	double obstruct_exact_time; // Summed over all measured passes (seconds).
+	double obstruct_fast_time;
+} bench_image_t;
+
+typedef struct bench_stats_s
+{
+	size_t count;
+	double min;
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+	double max;
+} bench_stats_t;
+
+typedef struct bench_ctx_s
+{
+	char **corpus;
+	size_t corpus_count;
+	int warmup;
+	int iterations;
+	char *csv_path;
+	char *json_path;
+	int soak;
+	int soak_max_growth;
+
+	bench_image_t *images;
+	size_t image_count;
+	size_t image_alloc;
+} bench_ctx_t;
+
+bench_ctx_t ctx;
+
+static int add_options(catcierge_args_t *args)
+{
+	int ret = 0;
+	cargo_t cargo = args->cargo;
+
+	ret |= cargo_add_group(cargo, 0,
+			"bench", "Benchmark Settings",
+			"Settings for benchmarking the catcierge matchers against a corpus of images.");
+
+	ret |= cargo_add_option(cargo, CARGO_OPT_REQUIRED,
+			"<bench> --corpus",
+			"The images to benchmark. Either image files, directories of images "
+			"or manifest files. A manifest has one image path per line (relative "
+			"to the manifest) optionally followed by the expected outcome "
+			"\"ok\" or \"fail\". Lines starting with # are ignored.",
+			"[s]+", &ctx.corpus, &ctx.corpus_count);
+
+	ctx.warmup = 2;
+	ret |= cargo_add_option(cargo, 0,
+			"<bench> --warmup",
+			"Number of passes over the corpus before measuring.",
+			"i", &ctx.warmup);
+	ret |= cargo_add_validation(cargo, 0,
+			"--warmup",
+			cargo_validate_int_range(0, 100000));
+
+	ctx.iterations = 10;
+	ret |= cargo_add_option(cargo, 0,
+			"<bench> --iterations",
+			"Number of measured passes over the corpus.",
+			"i", &ctx.iterations);
+	ret |= cargo_add_validation(cargo, 0,
+			"--iterations",
+			cargo_validate_int_range(1, 100000));
+
+	ret |= cargo_add_option(cargo, 0,
+			"<bench> --csv",
+			"Write the per image and aggregate results to this CSV file.",
+			"s", &ctx.csv_path);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<bench> --json",
+			"Write the per image and aggregate results to this JSON file.",
+			"s", &ctx.json_path);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<bench> --soak",
+			"After the benchmark, run this many matches cycling over the "
+			"corpus while sampling the memory use, for instance 1000000. "
+			"Every match saves all the steps, like --save_steps does. "
+			"Fails if the memory grows more than --soak_max_growth.",
+			"i", &ctx.soak);
+	ret |= cargo_add_validation(cargo, 0,
+			"--soak",
+			cargo_validate_int_range(0, INT_MAX));
+
+	ctx.soak_max_growth = 1024;
+	ret |= cargo_add_option(cargo, 0,
+			"<bench> --soak_max_growth",
+			"How much the resident or heap memory may grow during the soak "
+			"test in kB, after the first 10% of the matches. Default 1024.",
+			"i", &ctx.soak_max_growth);
+	ret |= cargo_add_validation(cargo, 0,
+			"--soak_max_growth",
+			cargo_validate_int_range(0, INT_MAX));
+
+	return ret;
+}
+
+static int bench_add_image(const char *path, int expected)
+{
+	bench_image_t *img;
+
+	if (ctx.image_count >= ctx.image_alloc)
+	{
+		size_t new_alloc = ctx.image_alloc ? (2 * ctx.image_alloc) : 64;
+		bench_image_t *imgs = realloc(ctx.images, new_alloc * sizeof(bench_image_t));
+
+		if (!imgs)
+		{
+			fprintf(stderr, "Out of memory!\n");
+			return -1;
+		}
+
+		ctx.images = imgs;
+		ctx.image_alloc = new_alloc;
+	}
+
+	img = &ctx.images[ctx.image_count];
+	memset(img, 0, sizeof(bench_image_t));
+	img->expected = expected;
+
+	if (!(img->path = strdup(path)))
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+
+	ctx.image_count++;
+
+	return 0;
+}
+
+static int parse_expected(const char *s)
+{
+	if (!strcasecmp(s, "ok") || !strcasecmp(s, "success")
+	 || !strcasecmp(s, "1") || !strcasecmp(s, "true"))
+		return 1;
+
+	if (!strcasecmp(s, "fail") || !strcasecmp(s, "prey")
+	 || !strcasecmp(s, "0") || !strcasecmp(s, "false"))
+		return 0;
+
+	return -1;
+}
+
+static int bench_load_manifest(const char *manifest_path)
+{
+	int ret = 0;
+	FILE *f = NULL;
+	char line[PATH_MAX + 64];
+	char path[PATH_MAX];
+	char dir[PATH_MAX];
+	char *sep;
+
+	if (!(f = fopen(manifest_path, "r")))
+	{
+		fprintf(stderr, "Failed to open manifest %s\n", manifest_path);
+		return -1;
+	}
+
+	// Paths in the manifest are relative to it.
+	snprintf(dir, sizeof(dir), "%s", manifest_path);
+	sep = strrchr(dir, '/');
+	if (strrchr(dir, '\\') > sep) sep = strrchr(dir, '\\');
+	if (sep) sep[1] = '\0';
+	else dir[0] = '\0';
+
+	while (fgets(line, sizeof(line), f))
+	{
+		char *s = line;
+		char *end;
+		char *label;
+		int expected = -1;
+
+		while (isspace((unsigned char)*s)) s++;
+		end = s + strlen(s);
+		while ((end > s) && isspace((unsigned char)end[-1])) end--;
+		*end = '\0';
+
+		if (!*s || (*s == '#'))
+			continue;
+
+		// The expected outcome is an optional last word.
+		if ((label = strrchr(s, ' ')) || (label = strrchr(s, '\t')))
+		{
+			if ((expected = parse_expected(label + 1)) >= 0)
+			{
+				while ((label > s) && isspace((unsigned char)label[-1])) label--;
+				*label = '\0';
+			}
+		}
+
+		if ((s[0] == '/') || (s[0] == '\\') || (s[0] && (s[1] == ':')))
+			snprintf(path, sizeof(path), "%s", s);
+		else
+			snprintf(path, sizeof(path), "%s%s", dir, s);
+
+		if (bench_add_image(path, expected))
+		{
+			ret = -1;
+			break;
+		}
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+static int bench_load_dir(const char *dir_path)
+{
+	#ifdef _WIN32
+	fprintf(stderr, "Directories are not supported on Windows, use a manifest: %s\n", dir_path);
+	return -1;
+	#else
+	int ret = 0;
+	DIR *dir = NULL;
+	struct dirent *entry;
+	char **names = NULL;
+	size_t count = 0;
+	size_t alloc = 0;
+	size_t i;
+	char path[PATH_MAX];
+
+	if (!(dir = opendir(dir_path)))
+	{
+		fprintf(stderr, "Failed to open directory %s\n", dir_path);
+		return -1;
+	}
+
+	while ((entry = readdir(dir)))
+	{
+		if (!catcierge_is_image_path(entry->d_name))
+			continue;
+
+		if (count >= alloc)
+		{
+			char **tmp;
+			alloc = alloc ? (2 * alloc) : 64;
+
+			if (!(tmp = realloc(names, alloc * sizeof(char *))))
+			{
+				fprintf(stderr, "Out of memory!\n");
+				ret = -1; goto fail;
+			}
+
+			names = tmp;
+		}
+
+		if (!(names[count] = strdup(entry->d_name)))
+		{
+			fprintf(stderr, "Out of memory!\n");
+			ret = -1; goto fail;
+		}
+
+		count++;
+	}
+
+	// Always benchmark in the same order.
+	qsort(names, count, sizeof(char *), compare_strings);
+
+	for (i = 0; i < count; i++)
+	{
+		snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+
+		if (bench_add_image(path, -1))
+		{
+			ret = -1; goto fail;
+		}
+	}
+
+fail:
+	for (i = 0; i < count; i++)
+	{
+		free(names[i]);
+	}
+
+	free(names);
+	closedir(dir);
+
+	return ret;
+	#endif // _WIN32
+}
+
+static int bench_load_corpus()
+{
+	size_t i;
+
+	for (i = 0; i < ctx.corpus_count; i++)
+	{
+		const char *path = ctx.corpus[i];
+		#ifndef _WIN32
+		struct stat st;
+
+		if (!stat(path, &st) && S_ISDIR(st.st_mode))
+		{
+			if (bench_load_dir(path))
+				return -1;
+			continue;
+		}
+		#endif
+
+		if (catcierge_is_image_path(path))
+		{
+			if (bench_add_image(path, -1))
+				return -1;
+		}
+		else if (bench_load_manifest(path))
+		{
+			return -1;
+		}
+	}
+
+	if (ctx.image_count == 0)
+	{
+		fprintf(stderr, "No images found in the corpus\n");
+		return -1;
+	}
+
+	// Load everything up front so disk IO doesn't affect the timings.
+	for (i = 0; i < ctx.image_count; i++)
+	{
+		bench_image_t *img = &ctx.images[i];
+
+		if (!(img->img = cvLoadImage(img->path, 1)))
+		{
+			fprintf(stderr, "Failed to load image: %s\n", img->path);
+			return -1;
+		}
+
+		if (!(img->times = calloc(ctx.iterations, sizeof(double))))
+		{
+			fprintf(stderr, "Out of memory!\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double da = *(const double *)a;
+	double db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+// Nearest rank percentile of sorted values.
+static double bench_percentile(const double *sorted, size_t count, double percentile)
+{
+	size_t rank = (size_t)ceil((percentile / 100.0) * count);
+
+	if (rank < 1)
+		rank = 1;
+
+	return sorted[rank - 1];
+}
+
+// Calculates stats in milliseconds. Sorts the values.
+static void bench_calculate_stats(double *values, size_t count, bench_stats_t *stats)
+{
+	size_t i;
+	double sum = 0.0;
+
+	memset(stats, 0, sizeof(bench_stats_t));
+
+	if (count == 0)
+		return;
+
+	qsort(values, count, sizeof(double), compare_doubles);
+
+	for (i = 0; i < count; i++)
+	{
+		sum += values[i];
+	}
+
+	stats->count = count;
+	stats->min = values[0] * 1000.0;
+	stats->max = values[count - 1] * 1000.0;
+	stats->mean = (sum / count) * 1000.0;
+	stats->p50 = bench_percentile(values, count, 50.0) * 1000.0;
+	stats->p95 = bench_percentile(values, count, 95.0) * 1000.0;
+	stats->p99 = bench_percentile(values, count, 99.0) * 1000.0;
+}
+
+static int bench_run(catcierge_matcher_t *matcher)
+{
+	int i;
+	size_t j;
+	int measured;
+	double begin;
+	double match_res;
+	match_result_t *result = NULL;
+
+	if (!(result = calloc(1, sizeof(match_result_t))))
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+
+	// Go over the whole corpus in each pass, like a real
+	// camera feed would not match the same frame repeatedly.
+	for (i = 0; i < (ctx.warmup + ctx.iterations); i++)
+	{
+		measured = (i >= ctx.warmup);
+
+		printf("%s pass %d of %d\n", measured ? "Measured" : "Warmup",
+			measured ? (i - ctx.warmup + 1) : (i + 1),
+			measured ? ctx.iterations : ctx.warmup);
+
+		for (j = 0; j < ctx.image_count; j++)
+		{
+			bench_image_t *img = &ctx.images[j];
+			#ifdef BENCH_COUNT_ALLOCS
+			size_t alloc_count;
+			size_t alloc_bytes;
+			#endif
+
+			memset(result, 0, sizeof(match_result_t));
+			matcher->stages = measured ? img->stages : NULL;
+
+			#ifdef BENCH_COUNT_ALLOCS
+			alloc_count = __atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED);
+			alloc_bytes = __atomic_load_n(&bench_alloc_bytes, __ATOMIC_RELAXED);
+			#endif
+
+			// The corpus images are not from the same match.
+			if (matcher->reset)
+			{
+				matcher->reset(matcher);
+			}
+
+			begin = catcierge_timer_now();
+			match_res = matcher->match(matcher, img->img, result, 0);
+
+			if (measured)
+			{
+				img->times[i - ctx.warmup] = catcierge_timer_now() - begin;
+
+				#ifdef BENCH_COUNT_ALLOCS
+				img->alloc_count += __atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED) - alloc_count;
+				img->alloc_bytes += __atomic_load_n(&bench_alloc_bytes, __ATOMIC_RELAXED) - alloc_bytes;
+				#endif
+			}
+
+			if (match_res < 0.0)
+			{
+				fprintf(stderr, "Something went wrong when matching image: %s\n", img->path);
+				matcher->stages = NULL;
+				free(result);
+				return -1;
+			}
+
+			img->success = result->success;
+			img->result = result->result;
+		}
+	}
+
+	matcher->stages = NULL;
+	free(result);
+
+	return 0;
+}
+
+static void bench_obstruct(catcierge_matcher_t *matcher)
+{
+	int i;
+	size_t j;
+	double begin;
+	int decimation = matcher->args->obstruct_decimation;
+
+	// Compare the decimated threshold obstruction check to counting
+	// every pixel, the corpus frames are all treated as camera frames.
+	for (j = 0; j < ctx.image_count; j++)
+	{
+		bench_image_t *img = &ctx.images[j];
+
+		for (i = 0; i < ctx.iterations; i++)
+		{
+			begin = catcierge_timer_now();
+			img->obstruct_exact = catcierge_is_frame_obstructed_decimated(
+									matcher, img->img, 1, NULL);
+			img->obstruct_exact_time += catcierge_timer_now() - begin;
+
+			begin = catcierge_timer_now();
+			img->obstruct_fast = catcierge_is_frame_obstructed_decimated(
+									matcher, img->img, decimation, &img->obstruct_escalated);
+			img->obstruct_fast_time += catcierge_timer_now() - begin;
+		}
+	}
+}
+
+//
+// Runs the matcher over and over to find slow leaks. The baseline is taken
+// after the first 10% of the matches so that allocator pools and caches
+// have settled, after that the memory use should stay flat. All the steps
+// are saved like --save_steps does on the grabber, since some of the
+// matcher work such as finding the contours only happens then.
+//
+static int bench_soak(catcierge_matcher_t *matcher)
+{
+	int ret = 0;
+	int i;
+	size_t j;
+	int sample_every;
+	long rss_growth = 0;
+	long heap_growth = 0;
+	match_result_t *result = NULL;
+	catcierge_frame_pool_t step_pool;
+	catcierge_mem_stats_t start;
+	catcierge_mem_stats_t base;
+	catcierge_mem_stats_t cur;
+
+	if (!(result = calloc(1, sizeof(match_result_t))))
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+
+	catcierge_frame_pool_init(&step_pool);
+
+	sample_every = (ctx.soak >= 100) ? (ctx.soak / 100) : 1;
+	catcierge_get_mem_stats(&start);
+	base = start;
+	cur = start;
+
+	printf("\nSoak test, %d matches\n", ctx.soak);
+
+	for (i = 0; i < ctx.soak; i++)
+	{
+		bench_image_t *img = &ctx.images[i % ctx.image_count];
+
+		memset(result, 0, sizeof(match_result_t));
+		result->step_pool = &step_pool;
+
+		if (matcher->reset)
+		{
+			matcher->reset(matcher);
+		}
+
+		if (matcher->match(matcher, img->img, result, STEPS_FULL) < 0.0)
+		{
+			fprintf(stderr, "Something went wrong when matching image: %s\n", img->path);
+			ret = -1; goto fail;
+		}
+
+		for (j = 0; j < result->step_img_count; j++)
+		{
+			catcierge_match_step_release(&result->steps[j]);
+		}
+
+		if (((i + 1) % sample_every) != 0)
+			continue;
+
+		catcierge_get_mem_stats(&cur);
+
+		if ((i + 1) <= (ctx.soak / 10))
+		{
+			base = cur;
+		}
+		else
+		{
+			if ((cur.rss_kb - base.rss_kb) > rss_growth)
+				rss_growth = cur.rss_kb - base.rss_kb;
+
+			if ((cur.heap_kb - base.heap_kb) > heap_growth)
+				heap_growth = cur.heap_kb - base.heap_kb;
+		}
+
+		if (((i + 1) % (sample_every * 10)) == 0)
+		{
+			printf("  %9d matches: RSS %ld kB, heap %ld kB\n",
+				i + 1, cur.rss_kb, cur.heap_kb);
+		}
+	}
+
+	printf("Soak memory: RSS %ld kB -> %ld kB, heap %ld kB -> %ld kB\n",
+		start.rss_kb, cur.rss_kb, start.heap_kb, cur.heap_kb);
+	printf("Soak growth after the first 10%%: RSS %ld kB, heap %ld kB (max %d kB)\n",
+		rss_growth, heap_growth, ctx.soak_max_growth);
+
+	if ((rss_growth > ctx.soak_max_growth) || (heap_growth > ctx.soak_max_growth))
+	{
+		fprintf(stderr, "Memory use is not flat, the matcher is leaking!\n");
+		ret = -1;
+	}
+
+fail:
+	for (j = 0; j < MAX_STEPS; j++)
+	{
+		catcierge_match_step_release(&result->steps[j]);
+	}
+
+	catcierge_frame_pool_destroy(&step_pool);
+	free(result);
+
+	return ret;
+}
+
+static const char *bench_expected_str(int expected)
+{
+	switch (expected)
+	{
+		case 1: return "ok";
+		case 0: return "fail";
+		default: return "";
+	}
+}
+
+static void bench_json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+
+	while (*s)
+	{
+		if ((*s == '"') || (*s == '\\'))
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, f);
+		s++;
+	}
+
+	fputc('"', f);
+}
+
+static void bench_json_stats(FILE *f, bench_stats_t *stats)
+{
+	fprintf(f, "\"samples\": %lu, \"min_ms\": %f, \"mean_ms\": %f, "
+		"\"p50_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f, \"max_ms\": %f",
+		(unsigned long)stats->count, stats->min, stats->mean,
+		stats->p50, stats->p95, stats->p99, stats->max);
+}
+
+static void bench_json_stages(FILE *f, catcierge_span_t *stages, size_t matches)
+{
+	int k;
+
+	fprintf(f, "\"stages_ms\": {");
+
+	for (k = 0; k < MATCHER_STAGE_COUNT; k++)
+	{
+		fprintf(f, "%s\"%s\": %f", (k == 0) ? "" : ", ",
+			catcierge_matcher_stage_str(k),
+			matches ? ((stages[k].duration / matches) * 1000.0) : 0.0);
+	}
+
+	fprintf(f, "}");
+}
+
+//
+// A row for an image, or the summary row of all images when img is NULL.
+// The summary leaves the per image decisions empty.
+//
+static void bench_csv_row(FILE *f, const char *name, bench_image_t *img,
+	bench_stats_t *stats, catcierge_span_t *stages, size_t matches,
+	size_t alloc_count, size_t alloc_bytes, int obstruct_escalated)
+{
+	int k;
+
+	fprintf(f, "\"%s\",", name);
+
+	if (img)
+	{
+		fprintf(f, "%s,%d,%f,", bench_expected_str(img->expected), img->success, img->result);
+	}
+	else
+	{
+		fprintf(f, ",,,");
+	}
+
+	fprintf(f, "%lu,%f,%f,%f,%f,%f,%f,%f,%f",
+		(unsigned long)stats->count,
+		stats->min, stats->mean, stats->p50, stats->p95, stats->p99, stats->max,
+		matches ? ((double)alloc_count / matches) : 0.0,
+		matches ? ((double)alloc_bytes / matches) : 0.0);
+
+	for (k = 0; k < MATCHER_STAGE_COUNT; k++)
+	{
+		fprintf(f, ",%f", matches ? ((stages[k].duration / matches) * 1000.0) : 0.0);
+	}
+
+	if (img)
+	{
+		fprintf(f, ",%d,%d,%d\n", img->obstruct_exact, img->obstruct_fast, obstruct_escalated);
+	}
+	else
+	{
+		fprintf(f, ",,,%d\n", obstruct_escalated);
+	}
+}
+
+static int bench_report(catcierge_matcher_t *matcher)
+{
+	int ret = 0;
+	size_t i;
+	int k;
+	size_t total_matches = ctx.image_count * ctx.iterations;
+	size_t alloc_count = 0;
+	size_t alloc_bytes = 0;
+	size_t expected_count = 0;
+	size_t correct_count = 0;
+	size_t obstruct_agree = 0;
+	size_t obstruct_escalated = 0;
+	double obstruct_exact_time = 0.0;
+	double obstruct_fast_time = 0.0;
+	double *all_times = NULL;
+	bench_stats_t *stats = NULL;
+	bench_stats_t all_stats;
+	catcierge_span_t all_stages[MATCHER_STAGE_COUNT];
+	FILE *csv = NULL;
+	FILE *json = NULL;
+	char mismatch[32];
+
+	memset(all_stages, 0, sizeof(all_stages));
+
+	if (!(all_times = calloc(total_matches, sizeof(double)))
+	 || !(stats = calloc(ctx.image_count, sizeof(bench_stats_t))))
+	{
+		fprintf(stderr, "Out of memory!\n");
+		ret = -1; goto fail;
+	}
+
+	printf("\n%-40s %8s %8s %8s %8s %8s  %s\n",
+		"Image", "p50 ms", "p95 ms", "p99 ms", "mean ms", "allocs", "result");
+
+	for (i = 0; i < ctx.image_count; i++)
+	{
+		bench_image_t *img = &ctx.images[i];
+		const char *name = strrchr(img->path, '/');
+		name = name ? (name + 1) : img->path;
+
+		memcpy(&all_times[i * ctx.iterations], img->times, ctx.iterations * sizeof(double));
+		bench_calculate_stats(img->times, ctx.iterations, &stats[i]);
+
+		for (k = 0; k < MATCHER_STAGE_COUNT; k++)
+		{
+			all_stages[k].duration += img->stages[k].duration;
+		}
+
+		alloc_count += img->alloc_count;
+		alloc_bytes += img->alloc_bytes;
+		obstruct_agree += (img->obstruct_exact == img->obstruct_fast);
+		obstruct_escalated += img->obstruct_escalated;
+		obstruct_exact_time += img->obstruct_exact_time;
+		obstruct_fast_time += img->obstruct_fast_time;
+
+		if (img->expected >= 0)
+		{
+			expected_count++;
+			correct_count += (img->expected == img->success);
+		}
+
+		if ((img->expected >= 0) && (img->expected != img->success))
+		{
+			snprintf(mismatch, sizeof(mismatch), " (expected %s)",
+				bench_expected_str(img->expected));
+		}
+		else
+		{
+			mismatch[0] = '\0';
+		}
+
+		printf("%-40.40s %8.2f %8.2f %8.2f %8.2f %8.1f  %s%s\n",
+			name, stats[i].p50, stats[i].p95, stats[i].p99, stats[i].mean,
+			(double)img->alloc_count / ctx.iterations,
+			img->success ? "ok" : "fail", mismatch);
+	}
+
+	bench_calculate_stats(all_times, total_matches, &all_stats);
+
+	printf("\n%s matcher, %d warmup + %d measured passes over %lu images\n",
+		matcher->name, ctx.warmup, ctx.iterations, (unsigned long)ctx.image_count);
+	printf("Match time:  min %.2f  mean %.2f  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms\n",
+		all_stats.min, all_stats.mean, all_stats.p50, all_stats.p95, all_stats.p99, all_stats.max);
+
+	printf("Stages (mean per match):\n");
+	for (k = 0; k < MATCHER_STAGE_COUNT; k++)
+	{
+		printf("  %-12s %8.3f ms\n", catcierge_matcher_stage_str(k),
+			(all_stages[k].duration / total_matches) * 1000.0);
+	}
+
+	#ifdef BENCH_COUNT_ALLOCS
+	printf("Allocations: %.1f per match (%.0f bytes)\n",
+		(double)alloc_count / total_matches, (double)alloc_bytes / total_matches);
+	#else
+	printf("Allocations: not counted on this platform\n");
+	#endif
+
+	if (expected_count > 0)
+	{
+		printf("Correct: %lu of %lu images with an expected outcome\n",
+			(unsigned long)correct_count, (unsigned long)expected_count);
+	}
+
+	printf("Obstruction check: exact %.3f ms, decimation %d %.3f ms, "
+		"agreement %lu of %lu (%.1f%%), escalated %lu\n",
+		(obstruct_exact_time / total_matches) * 1000.0,
+		matcher->args->obstruct_decimation,
+		(obstruct_fast_time / total_matches) * 1000.0,
+		(unsigned long)obstruct_agree, (unsigned long)ctx.image_count,
+		(100.0 * obstruct_agree) / ctx.image_count,
+		(unsigned long)obstruct_escalated);
+
+	if (ctx.csv_path)
+	{
+		if (!(csv = fopen(ctx.csv_path, "w")))
+		{
+			fprintf(stderr, "Failed to open CSV output %s\n", ctx.csv_path);
+			ret = -1; goto fail;
+		}
+
+		fprintf(csv, "image,expected,success,result,samples,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,allocs,alloc_bytes");
+
+		for (k = 0; k < MATCHER_STAGE_COUNT; k++)
+		{
+			fprintf(csv, ",%s_ms", catcierge_matcher_stage_str(k));
+		}
+
+		fprintf(csv, ",obstruct_exact,obstruct_fast,obstruct_escalated\n");
+
+		for (i = 0; i < ctx.image_count; i++)
+		{
+			bench_image_t *img = &ctx.images[i];
+			bench_csv_row(csv, img->path, img, &stats[i], img->stages,
+				ctx.iterations, img->alloc_count, img->alloc_bytes,
+				img->obstruct_escalated);
+		}
+
+		bench_csv_row(csv, "all", NULL, &all_stats,
+			all_stages, total_matches, alloc_count, alloc_bytes,
+			(int)obstruct_escalated);
+
+		printf("Wrote %s\n", ctx.csv_path);
+	}
+
+	if (ctx.json_path)
+	{
+		if (!(json = fopen(ctx.json_path, "w")))
+		{
+			fprintf(stderr, "Failed to open JSON output %s\n", ctx.json_path);
+			ret = -1; goto fail;
+		}
+
+		fprintf(json, "{\n  \"version\": \"%s\",\n  \"git_hash\": \"%s\",\n"
+			"  \"matcher\": \"%s\",\n  \"warmup\": %d,\n  \"iterations\": %d,\n",
+			CATCIERGE_VERSION_STR, CATCIERGE_GIT_HASH,
+			matcher->short_name, ctx.warmup, ctx.iterations);
+
+		fprintf(json, "  \"images\": [\n");
+
+		for (i = 0; i < ctx.image_count; i++)
+		{
+			bench_image_t *img = &ctx.images[i];
+
+			fprintf(json, "    {\"path\": ");
+			bench_json_string(json, img->path);
+			fprintf(json, ", \"expected\": %d, \"success\": %d, \"result\": %f, ",
+				img->expected, img->success, img->result);
+			bench_json_stats(json, &stats[i]);
+			fprintf(json, ", \"allocs\": %f, \"alloc_bytes\": %f, ",
+				(double)img->alloc_count / ctx.iterations,
+				(double)img->alloc_bytes / ctx.iterations);
+			bench_json_stages(json, img->stages, ctx.iterations);
+			fprintf(json, ", \"obstruct_exact\": %d, \"obstruct_fast\": %d, "
+				"\"obstruct_escalated\": %d",
+				img->obstruct_exact, img->obstruct_fast, img->obstruct_escalated);
+			fprintf(json, "}%s\n", (i + 1 < ctx.image_count) ? "," : "");
+		}
+
+		fprintf(json, "  ],\n  \"aggregate\": {");
+		bench_json_stats(json, &all_stats);
+		fprintf(json, ", \"allocs\": %f, \"alloc_bytes\": %f, \"expected\": %lu, \"correct\": %lu, ",
+			(double)alloc_count / total_matches, (double)alloc_bytes / total_matches,
+			(unsigned long)expected_count, (unsigned long)correct_count);
+		bench_json_stages(json, all_stages, total_matches);
+		fprintf(json, "},\n  \"obstruct\": {\"decimation\": %d, \"agree\": %lu, "
+			"\"escalated\": %lu, \"exact_ms\": %f, \"fast_ms\": %f}\n}\n",
+			matcher->args->obstruct_decimation,
+			(unsigned long)obstruct_agree, (unsigned long)obstruct_escalated,
+			(obstruct_exact_time / total_matches) * 1000.0,
+			(obstruct_fast_time / total_matches) * 1000.0);
+
+		printf("Wrote %s\n", ctx.json_path);
+	}
+
+fail:
+	if (csv) fclose(csv);
+	if (json) fclose(json);
+	free(all_times);
+	free(stats);
+
+	return ret;
+}
+
+static void bench_destroy()
+{
+	size_t i;
+
+	for (i = 0; i < ctx.image_count; i++)
+	{
+		free(ctx.images[i].path);
+		free(ctx.images[i].times);
+
+		if (ctx.images[i].img)
+		{
+			cvReleaseImage(&ctx.images[i].img);
+		}
+	}
+
+	free(ctx.images);
+	ctx.images = NULL;
+	ctx.image_count = 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+	catcierge_matcher_t *matcher = NULL;
+	catcierge_args_t args;
+	memset(&args, 0, sizeof(args));
+
+	fprintf(stderr, "Catcierge Matcher Benchmark (C) Joakim Soderberg 2013-2016\n");
+
+	if (catcierge_args_init(&args, argv[0]))
+	{
+		fprintf(stderr, "Failed to init args\n");
+		return -1;
+	}
+
+	if (add_options(&args))
+	{
+		fprintf(stderr, "Failed to init bench args\n");
+		ret = -1; goto fail;
+	}
+
+	if (catcierge_args_parse(&args, argc, argv))
+	{
+		ret = -1; goto fail;
+	}
+
+	if (catcierge_matcher_init(&matcher, catcierge_get_matcher_args(&args)))
+	{
+		fprintf(stderr, "\n\nFailed to init matcher\n\n");
+		ret = -1; goto fail;
+	}
+
+	if (bench_load_corpus())
+	{
+		ret = -1; goto fail;
+	}
+
+	if (bench_run(matcher))
+	{
+		ret = -1; goto fail;
+	}
+
+	bench_obstruct(matcher);
+
+	if (bench_report(matcher))
+	{
+		ret = -1; goto fail;
+	}
+
+	if ((ctx.soak > 0) && bench_soak(matcher))
+	{
+		ret = -1; goto fail;
+	}
+
+fail:
+	bench_destroy();
+	catcierge_matcher_destroy(&matcher);
+	catcierge_args_destroy(&args);
+
+	return ret;
+}
@@ -0,0 +1,585 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "catcierge_config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "catcierge_capture.h"
+#include "catcierge_timer.h"
+#include "catcierge_log.h"
+
+#define CATCIERGE_ALIGN_UP(n) \
+	(((n) + (CATCIERGE_RECORDING_ALIGN - 1)) & ~((size_t)CATCIERGE_RECORDING_ALIGN - 1))
+
+static size_t catcierge_recording_stride(catcierge_recording_header_t *header)
+{
+	return sizeof(catcierge_recording_frame_t) + CATCIERGE_ALIGN_UP((size_t)header->frame_size);
+}
+
+int catcierge_recorder_open(catcierge_recorder_t *rec, const char *path)
+{
+	assert(rec);
+	assert(path);
+	memset(rec, 0, sizeof(catcierge_recorder_t));
+
+	if (!(rec->f = fopen(path, "wb")))
+	{
+		CATERR("Failed to open recording \"%s\": %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int catcierge_recorder_write(catcierge_recorder_t *rec, IplImage *img, double timestamp)
+{
+	static const char padding[CATCIERGE_RECORDING_ALIGN];
+	catcierge_recording_header_t *header;
+	catcierge_recording_frame_t frame;
+	size_t pad;
+	assert(rec);
+	assert(img);
+	header = &rec->header;
+
+	if (!rec->f)
+		return -1;
+
+	// The header is written with the first frame, when the size is known.
+	if (rec->count == 0)
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+
+		memcpy(header->magic, CATCIERGE_RECORDING_MAGIC, sizeof(header->magic));
+		header->version = CATCIERGE_RECORDING_VERSION;
+		header->header_size = sizeof(catcierge_recording_header_t);
+		header->width = img->width;
+		header->height = img->height;
+		header->depth = img->depth;
+		header->channels = img->nChannels;
+		header->width_step = img->widthStep;
+		header->frame_size = img->widthStep * img->height;
+		header->start_sec = tv.tv_sec;
+		header->start_usec = tv.tv_usec;
+		rec->start = timestamp;
+
+		if (fwrite(header, sizeof(*header), 1, rec->f) != 1)
+		{
+			goto fail;
+		}
+	}
+	else if ((img->width != (int)header->width)
+		  || (img->height != (int)header->height)
+		  || (img->nChannels != (int)header->channels)
+		  || (img->widthStep != (int)header->width_step))
+	{
+		CATERR("Recorded frames must all have the same size\n");
+		return -1;
+	}
+
+	memset(&frame, 0, sizeof(frame));
+	frame.timestamp = timestamp - rec->start;
+	frame.index = rec->count;
+	pad = CATCIERGE_ALIGN_UP((size_t)header->frame_size) - header->frame_size;
+
+	if ((fwrite(&frame, sizeof(frame), 1, rec->f) != 1)
+	 || (fwrite(img->imageData, 1, header->frame_size, rec->f) != header->frame_size)
+	 || (pad && (fwrite(padding, 1, pad, rec->f) != pad)))
+	{
+		goto fail;
+	}
+
+	rec->count++;
+
+	return 0;
+
+fail:
+	CATERR("Failed to write recording: %s\n", strerror(errno));
+	catcierge_recorder_close(rec);
+	return -1;
+}
+
+void catcierge_recorder_close(catcierge_recorder_t *rec)
+{
+	assert(rec);
+
+	if (rec->f)
+	{
+		fclose(rec->f);
+		rec->f = NULL;
+	}
+}
+
+int catcierge_player_open(catcierge_player_t *p, const char *path, int fast, int loop)
+{
+	#ifdef _WIN32
+	CATERR("Playing recordings is not supported on Windows\n");
+	return -1;
+	#else
+	struct stat st;
+	catcierge_recording_header_t *header;
+	assert(p);
+	assert(path);
+
+	memset(p, 0, sizeof(catcierge_player_t));
+	p->fd = -1;
+	p->fast = fast;
+	p->loop = loop;
+
+	if ((p->fd = open(path, O_RDONLY)) < 0)
+	{
+		CATERR("Failed to open recording \"%s\": %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(p->fd, &st) || (st.st_size < (off_t)sizeof(catcierge_recording_header_t)))
+	{
+		CATERR("Invalid recording \"%s\"\n", path);
+		goto fail;
+	}
+
+	p->map_size = st.st_size;
+
+	// Private mapping so that drawing on a frame never changes the file.
+	if ((p->map = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE, p->fd, 0)) == MAP_FAILED)
+	{
+		p->map = NULL;
+		CATERR("Failed to map recording \"%s\": %s\n", path, strerror(errno));
+		goto fail;
+	}
+
+	header = p->header = (catcierge_recording_header_t *)p->map;
+
+	if (memcmp(header->magic, CATCIERGE_RECORDING_MAGIC, sizeof(header->magic))
+	 || (header->version != CATCIERGE_RECORDING_VERSION)
+	 || (header->header_size > p->map_size)
+	 || (header->frame_size != (header->width_step * header->height)))
+	{
+		CATERR("Invalid recording header in \"%s\"\n", path);
+		goto fail;
+	}
+
+	p->stride = catcierge_recording_stride(header);
+	p->frame_count = (p->map_size - header->header_size) / p->stride;
+
+	if (p->frame_count == 0)
+	{
+		CATERR("No frames in recording \"%s\"\n", path);
+		goto fail;
+	}
+
+	cvInitImageHeader(&p->img, cvSize(header->width, header->height),
+		header->depth, header->channels, IPL_ORIGIN_TL, 4);
+
+	if (p->img.widthStep != (int)header->width_step)
+	{
+		CATERR("Unsupported row alignment in recording \"%s\"\n", path);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	catcierge_player_close(p);
+	return -1;
+	#endif // _WIN32
+}
+
+IplImage *catcierge_player_next(catcierge_player_t *p, double *timestamp)
+{
+	catcierge_recording_frame_t *frame;
+	double now;
+	assert(p);
+
+	if (!p->map)
+		return NULL;
+
+	if (p->frame_index >= p->frame_count)
+	{
+		if (!p->loop)
+			return NULL;
+
+		// Continue the recorded time one frame after the last one.
+		frame = (catcierge_recording_frame_t *)(p->map
+				+ p->header->header_size + (p->frame_count - 1) * p->stride);
+		p->loop_offset += frame->timestamp
+				+ ((p->frame_count > 1) ? (frame->timestamp / (p->frame_count - 1)) : 0.1);
+		p->frame_index = 0;
+		p->start = 0.0;
+	}
+
+	frame = (catcierge_recording_frame_t *)(p->map
+			+ p->header->header_size + p->frame_index * p->stride);
+	now = catcierge_timer_now();
+
+	if (p->start == 0.0)
+	{
+		p->start = now - frame->timestamp;
+	}
+
+	if (p->play_start == 0.0)
+	{
+		p->play_start = now;
+	}
+
+	#ifndef _WIN32
+	// Play at the recorded rate.
+	if (!p->fast && ((p->start + frame->timestamp) > now))
+	{
+		usleep((useconds_t)((p->start + frame->timestamp - now) * 1000000.0));
+	}
+	#endif
+
+	p->img.imageData = (char *)(frame + 1);
+	p->img.imageDataOrigin = p->img.imageData;
+	p->frame_index++;
+	p->played++;
+
+	if (timestamp)
+	{
+		*timestamp = p->loop_offset + frame->timestamp;
+	}
+
+	return &p->img;
+}
+
+void catcierge_player_close(catcierge_player_t *p)
+{
+	assert(p);
+
+	#ifndef _WIN32
+	if (p->map)
+	{
+		munmap(p->map, p->map_size);
+	}
+
+	if (p->fd >= 0)
+	{
+		close(p->fd);
+	}
+	#endif
+
+	p->map = NULL;
+	p->header = NULL;
+	p->fd = -1;
+}
+
+// The wall clock time a frame was recorded.
+static void catcierge_player_frame_time(catcierge_player_t *p, double timestamp, struct timeval *tv)
+{
+	double t = (p->header->start_usec / 1000000.0) + timestamp;
+
+	tv->tv_sec = (long)(p->header->start_sec + (uint64_t)t);
+	tv->tv_usec = (long)((t - (uint64_t)t) * 1000000.0);
+}
+
+// Moves the virtual clock to the wall clock time the frame was recorded.
+static void catcierge_player_set_clock(catcierge_player_t *p, double timestamp)
+{
+	struct timeval tv;
+
+	catcierge_player_frame_time(p, timestamp, &tv);
+	catcierge_timer_set_virtual_time(&tv);
+}
+
+const char *catcierge_capture_type_str(catcierge_capture_type_t type)
+{
+	switch (type)
+	{
+		case CAPTURE_CAMERA: return "camera";
+		case CAPTURE_PLAYER: return "player";
+		default: return "unknown";
+	}
+}
+
+int catcierge_capture_frame_is_stable(catcierge_capture_t *cap, const IplImage *img)
+{
+	assert(cap);
+
+	// Played frames point straight into the mapped recording, while camera
+	// frames are overwritten by the next grab.
+	return img && (cap->type == CAPTURE_PLAYER) && (img == &cap->player.img);
+}
+
+int catcierge_capture_set_idle(catcierge_capture_t *cap, int idle)
+{
+	assert(cap);
+	idle = !!idle;
+
+	if ((cap->type != CAPTURE_CAMERA) || cap->recording
+	 || (cap->idle_scale <= 1) || (cap->full_width == 0))
+	{
+		return -1;
+	}
+
+	if (cap->idle == idle)
+	{
+		return 0;
+	}
+
+	cap->idle = idle;
+
+	#ifdef RPI
+	raspiCamCvSetIdleScale(cap->camera, idle ? cap->idle_scale : 1);
+	#else
+	cvSetCaptureProperty(cap->camera, CV_CAP_PROP_FRAME_WIDTH,
+		CATCIERGE_CAPTURE_WIDTH / (idle ? cap->idle_scale : 1));
+	cvSetCaptureProperty(cap->camera, CV_CAP_PROP_FRAME_HEIGHT,
+		CATCIERGE_CAPTURE_HEIGHT / (idle ? cap->idle_scale : 1));
+	#endif
+
+	if (!idle)
+	{
+		cap->waking = 1;
+		cap->wake_start = catcierge_timer_now();
+	}
+
+	return 0;
+}
+
+//
+// The matchers and the obstruction checks all work on gray images and
+// convert color frames on their own, several times per frame. With gray
+// the conversion is done once here instead, into a buffer that is reused
+// for every frame.
+//
+static IplImage *catcierge_capture_to_gray(catcierge_capture_t *cap, IplImage *img)
+{
+	assert(cap);
+	assert(img);
+
+	if (!cap->gray || (img->nChannels != 3))
+	{
+		cap->color_img = NULL;
+		return img;
+	}
+
+	if (cap->gray_img
+	 && ((cap->gray_img->width != img->width)
+	  || (cap->gray_img->height != img->height)))
+	{
+		cvReleaseImage(&cap->gray_img);
+	}
+
+	if (!cap->gray_img
+	 && !(cap->gray_img = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1)))
+	{
+		CATERR("Out of memory\n");
+		return NULL;
+	}
+
+	cvCvtColor(img, cap->gray_img, CV_BGR2GRAY);
+	cap->color_img = cap->keep_color ? img : NULL;
+
+	return cap->gray_img;
+}
+
+IplImage *catcierge_capture_color_frame(catcierge_capture_t *cap, IplImage *img)
+{
+	assert(cap);
+
+	if (img && (img == cap->gray_img) && cap->color_img)
+	{
+		return cap->color_img;
+	}
+
+	return img;
+}
+
+int catcierge_capture_frame_scale(catcierge_capture_t *cap, const IplImage *img)
+{
+	assert(cap);
+	assert(img);
+
+	if ((cap->full_width == 0) || (img->width >= cap->full_width))
+	{
+		return 1;
+	}
+
+	return cap->full_width / img->width;
+}
+
+int catcierge_capture_init(catcierge_capture_t *cap, catcierge_capture_args_t *args)
+{
+	struct timeval tv;
+	assert(cap);
+	assert(args);
+	memset(cap, 0, sizeof(catcierge_capture_t));
+
+	if (args->play_path)
+	{
+		cap->type = CAPTURE_PLAYER;
+
+		if (catcierge_player_open(&cap->player, args->play_path,
+				args->play_fast, args->play_loop))
+		{
+			return -1;
+		}
+
+		CATLOG("Playing %lu frames %dx%d from %s%s\n",
+			(unsigned long)cap->player.frame_count,
+			cap->player.img.width, cap->player.img.height, args->play_path,
+			args->play_fast ? " at max speed" : "");
+
+		// Run the timers on the recorded time, so that the state
+		// machine behaves the same no matter the playback speed.
+		// The recording is older than now, so start the clock at its
+		// beginning instead, before any timer is started.
+		catcierge_timer_set_virtual(1);
+		catcierge_player_frame_time(&cap->player, 0.0, &tv);
+		catcierge_timer_seed_virtual_time(&tv);
+	}
+	else
+	{
+		cap->type = CAPTURE_CAMERA;
+
+		#ifdef RPI
+		cap->camera = raspiCamCvCreateCameraCaptureEx(0, args->rpi_settings);
+		#else
+		cap->camera = cvCreateCameraCapture(0);
+		cvSetCaptureProperty(cap->camera, CV_CAP_PROP_FRAME_WIDTH, CATCIERGE_CAPTURE_WIDTH);
+		cvSetCaptureProperty(cap->camera, CV_CAP_PROP_FRAME_HEIGHT, CATCIERGE_CAPTURE_HEIGHT);
+		#endif
+
+		cap->idle_scale = args->idle_scale;
+	}
+
+	cap->gray = args->gray;
+	cap->keep_color = args->keep_color;
+
+	if (args->record_path)
+	{
+		if (catcierge_recorder_open(&cap->recorder, args->record_path))
+		{
+			catcierge_capture_destroy(cap);
+			return -1;
+		}
+
+		cap->recording = 1;
+		CATLOG("Recording frames to %s\n", args->record_path);
+	}
+
+	return 0;
+}
+
+IplImage *catcierge_capture_query_frame(catcierge_capture_t *cap)
+{
+	IplImage *img = NULL;
+	double timestamp;
+	assert(cap);
+
+	if (cap->type == CAPTURE_PLAYER)
+	{
+		if (!(img = catcierge_player_next(&cap->player, &timestamp)))
+		{
+			cap->eof = 1;
+			return NULL;
+		}
+
+		catcierge_player_set_clock(&cap->player, timestamp);
+	}
+	else
+	{
+		#ifdef RPI
+		img = raspiCamCvQueryFrame(cap->camera);
+		#else
+		img = cvQueryFrame(cap->camera);
+		#endif
+		timestamp = catcierge_timer_now();
+
+		if (img && !cap->idle)
+		{
+			if (cap->full_width == 0)
+			{
+				cap->full_width = img->width;
+			}
+
+			if (cap->waking && (img->width >= cap->full_width))
+			{
+				cap->waking = 0;
+				cap->wake_latency = timestamp - cap->wake_start;
+			}
+		}
+	}
+
+	if (img && cap->recording)
+	{
+		if (catcierge_recorder_write(&cap->recorder, img, timestamp))
+		{
+			CATERR("Stopped recording\n");
+			cap->recording = 0;
+		}
+	}
+
+	if (img)
+	{
+		img = catcierge_capture_to_gray(cap, img);
+	}
+
+	return img;
+}
+
+void catcierge_capture_destroy(catcierge_capture_t *cap)
+{
+	assert(cap);
+
+	if (cap->recording)
+	{
+		CATLOG("Recorded %u frames\n", cap->recorder.count);
+	}
+
+	catcierge_recorder_close(&cap->recorder);
+	cap->recording = 0;
+
+	cvReleaseImage(&cap->gray_img);
+	cap->color_img = NULL;
+
+	if (cap->type == CAPTURE_PLAYER)
+	{
+		if (cap->player.played > 0)
+		{
+			double duration = catcierge_timer_now() - cap->player.play_start;
+			CATLOG("Played %lu frames in %.2f seconds (%.1f fps)\n",
+				(unsigned long)cap->player.played, duration,
+				(duration > 0.0) ? (cap->player.played / duration) : 0.0);
+		}
+
+		cap->player.played = 0;
+		catcierge_player_close(&cap->player);
+		catcierge_timer_set_virtual(0);
+	}
+	else if (cap->camera)
+	{
+		#ifdef RPI
+		raspiCamCvReleaseCapture(&cap->camera);
+		#else
+		cvReleaseCapture(&cap->camera);
+		#endif
+	}
+}
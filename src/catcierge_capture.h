@@ -0,0 +1,178 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_CAPTURE_H__
+#define __CATCIERGE_CAPTURE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <opencv2/imgproc/imgproc_c.h>
+#include <opencv2/highgui/highgui_c.h>
+
+#ifdef RPI
+#include "RaspiCamCV.h"
+#endif
+
+//
+// Recordings are a header followed by fixed size frames, each a small
+// frame header followed by the raw pixel data. Since every frame has the
+// same size the file can be memory mapped and indexed directly, and a
+// recording that was cut short still plays up to the last complete frame.
+//
+#define CATCIERGE_RECORDING_MAGIC "CATCREC"
+#define CATCIERGE_RECORDING_VERSION 1
+#define CATCIERGE_RECORDING_ALIGN 16
+
+typedef struct catcierge_recording_header_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;	// Offset of the first frame.
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;			// IPL_DEPTH_8U and so on.
+	uint32_t channels;
+	uint32_t width_step;	// Bytes per row.
+	uint32_t frame_size;	// Bytes of pixel data per frame.
+	uint64_t start_sec;		// Wall clock time of the first frame.
+	uint32_t start_usec;
+	uint32_t reserved[3];
+} catcierge_recording_header_t;
+
+typedef struct catcierge_recording_frame_s
+{
+	double timestamp;		// Monotonic seconds since the first frame.
+	uint32_t index;
+	uint32_t reserved;
+} catcierge_recording_frame_t;
+
+typedef struct catcierge_recorder_s
+{
+	FILE *f;
+	catcierge_recording_header_t header;
+	double start;
+	uint32_t count;
+} catcierge_recorder_t;
+
+typedef struct catcierge_player_s
+{
+	int fd;
+	unsigned char *map;
+	size_t map_size;
+	catcierge_recording_header_t *header;
+	size_t stride;			// Frame header + padded pixel data.
+	size_t frame_count;
+	size_t frame_index;
+	int fast;				// Don't wait for the recorded time between frames.
+	int loop;				// Start over at the end of the recording.
+	double start;			// When the playback (or the current loop) started.
+	double loop_offset;		// Recorded time of all previous loops.
+	size_t played;			// Total number of frames played.
+	double play_start;
+	IplImage img;			// Points into the mapped recording.
+} catcierge_player_t;
+
+// Frame size asked of cameras other than the Raspberry Pi camera.
+#define CATCIERGE_CAPTURE_WIDTH 320
+#define CATCIERGE_CAPTURE_HEIGHT 240
+
+typedef enum catcierge_capture_type_e
+{
+	CAPTURE_CAMERA = 0,		// Live camera.
+	CAPTURE_PLAYER = 1		// Frames played back from a recording.
+} catcierge_capture_type_t;
+
+typedef struct catcierge_capture_args_s
+{
+	char *record_path;
+	char *play_path;
+	int play_fast;
+	int play_loop;
+	int idle_scale;			// Capture this many times smaller frames while idle, 0 is off.
+	int gray;				// Deliver single channel frames.
+	int keep_color;			// With gray, keep the color frame around for saving.
+	#ifdef RPI
+	RASPIVID_SETTINGS *rpi_settings;
+	#endif
+} catcierge_capture_args_t;
+
+typedef struct catcierge_capture_s
+{
+	catcierge_capture_type_t type;
+
+	#ifdef RPI
+	RaspiCamCvCapture *camera;
+	#else
+	CvCapture *camera;
+	#endif
+
+	catcierge_player_t player;
+	catcierge_recorder_t recorder;
+	int recording;
+	int eof;				// The player reached the end of the recording.
+
+	int idle_scale;			// How many times smaller idle frames are, 0 if not supported.
+	int idle;				// Idle frames have been requested.
+	int waking;				// Full frames have been requested but not arrived yet.
+	int full_width;			// Width of a full resolution frame.
+	double wake_start;		// When full frames were requested.
+	double wake_latency;	// Seconds from requesting full frames until the first one arrived.
+
+	int gray;				// Color frames are converted to gray_img when grabbed.
+	int keep_color;
+	IplImage *gray_img;		// The gray version of the current frame.
+	IplImage *color_img;	// The color frame gray_img was converted from, if kept.
+} catcierge_capture_t;
+
+int catcierge_recorder_open(catcierge_recorder_t *rec, const char *path);
+int catcierge_recorder_write(catcierge_recorder_t *rec, IplImage *img, double timestamp);
+void catcierge_recorder_close(catcierge_recorder_t *rec);
+
+int catcierge_player_open(catcierge_player_t *p, const char *path, int fast, int loop);
+IplImage *catcierge_player_next(catcierge_player_t *p, double *timestamp);
+void catcierge_player_close(catcierge_player_t *p);
+
+int catcierge_capture_init(catcierge_capture_t *cap, catcierge_capture_args_t *args);
+IplImage *catcierge_capture_query_frame(catcierge_capture_t *cap);
+void catcierge_capture_destroy(catcierge_capture_t *cap);
+const char *catcierge_capture_type_str(catcierge_capture_type_t type);
+
+//
+// Idle capture. While nothing is happening only a small part of each frame
+// is looked at, so the camera is asked for frames idle_scale times smaller
+// in each direction. As soon as full frames are requested again the frames
+// already in flight are still small, frame_scale tells them apart and the
+// time until the first full frame arrives is measured in wake_latency.
+//
+// Returns 0 if the request was made, and -1 if the capture can't change
+// its frame size (recordings and while recording, since all frames of
+// a recording must be the same size).
+int catcierge_capture_set_idle(catcierge_capture_t *cap, int idle);
+
+// The color version of the current frame img when the capture converts to
+// gray and keeps the color frames, otherwise img itself.
+IplImage *catcierge_capture_color_frame(catcierge_capture_t *cap, IplImage *img);
+
+// How many times smaller than a full frame img is, 1 for full frames.
+int catcierge_capture_frame_scale(catcierge_capture_t *cap, const IplImage *img);
+
+// Is img a frame from the capture whose pixels stay valid until the capture
+// is destroyed? Such frames can be referenced instead of copied.
+int catcierge_capture_frame_is_stable(catcierge_capture_t *cap, const IplImage *img);
+
+#endif // __CATCIERGE_CAPTURE_H__
@@ -0,0 +1,631 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <assert.h>
+#include <math.h>
+#include "catcierge_dnn_matcher.h"
+#include "catcierge_dnn_wrapper.h"
+#include "catcierge_types.h"
+#include "catcierge_util.h"
+#include "catcierge_log.h"
+#include <opencv2/core/core_c.h>
+#include "cargo.h"
+
+int catcierge_dnn_matcher_init(catcierge_matcher_t **octx,
+		catcierge_matcher_args_t *oargs)
+{
+	catcierge_dnn_matcher_t *ctx = NULL;
+	catcierge_dnn_matcher_args_t *args = (catcierge_dnn_matcher_args_t *)oargs;
+	CvSize size;
+	size_t i;
+	assert(args);
+	assert(octx);
+
+	if (!(*octx = calloc(1, sizeof(catcierge_dnn_matcher_t))))
+	{
+		CATERR("Out of memory!\n");
+		return -1;
+	}
+
+	ctx = (catcierge_dnn_matcher_t *)*octx;
+	ctx->args = args;
+
+	ctx->super.type = MATCHER_DNN;
+	ctx->super.name = "DNN";
+	ctx->super.short_name = "dnn";
+
+	if (!args->model)
+	{
+		CATERR("DNN matcher: No model specified. Use --dnn_model\n");
+		return -1;
+	}
+
+	if ((args->threshold < 0.0) || (args->threshold > 1.0))
+	{
+		CATERR("DNN matcher: --dnn_threshold must be between 0.0 and 1.0\n");
+		return -1;
+	}
+
+	if (args->threads > 0)
+	{
+		cv2Dnn_set_threads(args->threads);
+	}
+
+	if (!(ctx->net = cv2DnnNet_create(args->model, args->config)))
+	{
+		CATERR("Failed to load DNN model: %s\n", args->model);
+		return -1;
+	}
+
+	// Allocate the network inputs up front, matching
+	// only resizes the frames into them.
+	size = cvSize(args->width, args->height);
+
+	if (!(ctx->gray = cvCreateImage(size, 8, 1)))
+	{
+		goto opencv_error;
+	}
+
+	for (i = 0; i <= MATCH_MAX_COUNT; i++)
+	{
+		if (!(ctx->inputs[i] = cvCreateImage(size, 8, 3)))
+		{
+			goto opencv_error;
+		}
+	}
+
+	if (!(ctx->scores = calloc(MATCH_MAX_COUNT * DNN_MAX_CLASSES, sizeof(float))))
+	{
+		CATERR("Out of memory!\n");
+		return -1;
+	}
+
+	ctx->super.debug = args->debug;
+	ctx->super.match = catcierge_dnn_matcher_match;
+	ctx->super.match_group = catcierge_dnn_matcher_match_group;
+	ctx->super.decide = catcierge_dnn_matcher_decide;
+	ctx->super.translate = catcierge_dnn_matcher_translate;
+	ctx->super.reset = catcierge_dnn_matcher_reset;
+
+	return 0;
+opencv_error:
+	CATERR("OpenCV error\n");
+	return -1;
+}
+
+void catcierge_dnn_matcher_destroy(catcierge_matcher_t **octx)
+{
+	catcierge_dnn_matcher_t *ctx;
+	size_t i;
+
+	if (!octx || !(*octx))
+		return;
+
+	ctx = (catcierge_dnn_matcher_t *)*octx;
+
+	if (ctx->net)
+	{
+		cv2DnnNet_destroy(ctx->net);
+		ctx->net = NULL;
+	}
+
+	if (ctx->gray)
+	{
+		cvReleaseImage(&ctx->gray);
+	}
+
+	for (i = 0; i <= MATCH_MAX_COUNT; i++)
+	{
+		if (ctx->inputs[i])
+		{
+			cvReleaseImage(&ctx->inputs[i]);
+		}
+	}
+
+	free(ctx->scores);
+	ctx->scores = NULL;
+
+	free(ctx);
+	*octx = NULL;
+}
+
+void catcierge_dnn_matcher_reset(catcierge_matcher_t *octx)
+{
+	catcierge_dnn_matcher_t *ctx = (catcierge_dnn_matcher_t *)octx;
+	assert(ctx);
+
+	// Drop anything left over from a previous match group.
+	ctx->input_count = 0;
+}
+
+//
+// Resizes the frame into the network input.
+//
+static void catcierge_dnn_matcher_prepare_input(catcierge_dnn_matcher_t *ctx,
+		IplImage *img, IplImage *input)
+{
+	double begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_RESIZE);
+
+	if (img->nChannels == 1)
+	{
+		cvResize(img, ctx->gray, CV_INTER_AREA);
+		cvCvtColor(ctx->gray, input, CV_GRAY2BGR);
+	}
+	else
+	{
+		cvResize(img, input, CV_INTER_AREA);
+	}
+
+	catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_RESIZE, begin);
+}
+
+//
+// Runs the inputs through the network as one batch
+// and sets the prey score of each of them.
+//
+static int catcierge_dnn_matcher_forward(catcierge_dnn_matcher_t *ctx,
+		IplImage **inputs, size_t count, double *prey_scores)
+{
+	catcierge_dnn_matcher_args_t *args = ctx->args;
+	size_t class_count = 0;
+	size_t i;
+	size_t j;
+	float *s;
+	double max;
+	double sum;
+	double begin;
+
+	begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_INFERENCE);
+
+	if (cv2DnnNet_forward(ctx->net, inputs, count,
+			args->scale, args->mean, args->rgb,
+			ctx->scores, DNN_MAX_CLASSES, &class_count))
+	{
+		return -1;
+	}
+
+	catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_INFERENCE, begin);
+
+	if (class_count > DNN_MAX_CLASSES)
+	{
+		CATERR("DNN model has %d outputs, at most %d are supported\n",
+			(int)class_count, DNN_MAX_CLASSES);
+		return -1;
+	}
+
+	// A single output is the prey score itself.
+	if ((class_count != 1) && (args->prey_class >= (int)class_count))
+	{
+		CATERR("DNN prey class %d is out of range, the model has %d outputs\n",
+			args->prey_class, (int)class_count);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		s = &ctx->scores[i * DNN_MAX_CLASSES];
+
+		if (class_count == 1)
+		{
+			prey_scores[i] = s[0];
+		}
+		else if (args->softmax)
+		{
+			max = s[0];
+			for (j = 1; j < class_count; j++)
+			{
+				if (s[j] > max) max = s[j];
+			}
+
+			sum = 0.0;
+			for (j = 0; j < class_count; j++)
+			{
+				sum += exp(s[j] - max);
+			}
+
+			prey_scores[i] = exp(s[args->prey_class] - max) / sum;
+		}
+		else
+		{
+			prey_scores[i] = s[args->prey_class];
+		}
+
+		if (ctx->super.debug) printf("Prey score: %f\n", prey_scores[i]);
+	}
+
+	return 0;
+}
+
+static void catcierge_dnn_matcher_set_result(catcierge_dnn_matcher_t *ctx,
+		match_result_t *result, double prey_score)
+{
+	// Any result above 0.0 is a success.
+	if (prey_score >= ctx->args->threshold)
+	{
+		result->result = 0.0;
+		snprintf(result->description, sizeof(result->description) - 1,
+			"Prey detected, score %.2f", prey_score);
+	}
+	else
+	{
+		result->result = 1.0 - prey_score;
+		snprintf(result->description, sizeof(result->description) - 1,
+			"No prey detected, score %.2f", prey_score);
+	}
+
+	result->success = (result->result > 0.0);
+}
+
+double catcierge_dnn_matcher_match(void *octx,
+		IplImage *img, match_result_t *result, int save_steps)
+{
+	catcierge_dnn_matcher_t *ctx = (catcierge_dnn_matcher_t *)octx;
+	catcierge_dnn_matcher_args_t *args = ctx->args;
+	IplImage *input;
+	double prey_score;
+	assert(ctx);
+	assert(ctx->args);
+	assert(result);
+
+	result->step_img_count = 0;
+	result->description[0] = '\0';
+	result->rect_count = 0;
+
+	// The network can't tell which way the cat is going.
+	result->direction = MATCH_DIR_UNKNOWN;
+
+	// Steps are saved right away, so those are never batched.
+	if (args->batch && !save_steps && (ctx->input_count < MATCH_MAX_COUNT))
+	{
+		catcierge_dnn_matcher_prepare_input(ctx, img, ctx->inputs[ctx->input_count]);
+		ctx->input_count++;
+
+		// The match group hook fills in the result.
+		snprintf(result->description, sizeof(result->description) - 1,
+			"Deferred to the end of the match group");
+		result->deferred = 1;
+		result->result = 0.0;
+		result->success = 0;
+
+		return result->result;
+	}
+
+	// Don't touch the frames waiting for the batch.
+	input = ctx->inputs[MATCH_MAX_COUNT];
+	catcierge_dnn_matcher_prepare_input(ctx, img, input);
+
+	if (save_steps)
+	{
+		catcierge_match_step_add(result, input, "input", "Network input");
+	}
+
+	if (catcierge_dnn_matcher_forward(ctx, &input, 1, &prey_score))
+	{
+		result->result = -1.0;
+		result->success = 0;
+		return result->result;
+	}
+
+	catcierge_dnn_matcher_set_result(ctx, result, prey_score);
+
+	return result->result;
+}
+
+int catcierge_dnn_matcher_match_group(catcierge_matcher_t *octx, match_group_t *mg)
+{
+	catcierge_dnn_matcher_t *ctx = (catcierge_dnn_matcher_t *)octx;
+	double prey_scores[MATCH_MAX_COUNT];
+	match_result_t *result;
+	size_t deferred = 0;
+	size_t i;
+	size_t j;
+	int ret = 0;
+	assert(ctx);
+	assert(mg);
+
+	for (i = 0; i < mg->match_count; i++)
+	{
+		deferred += !!mg->matches[i].result.deferred;
+	}
+
+	if (deferred == 0)
+	{
+		ctx->input_count = 0;
+		return 0;
+	}
+
+	if (deferred != ctx->input_count)
+	{
+		CATERR("DNN matcher: %d deferred matches but %d frames waiting\n",
+			(int)deferred, (int)ctx->input_count);
+		ret = -1;
+	}
+	else if (catcierge_dnn_matcher_forward(ctx, ctx->inputs, ctx->input_count, prey_scores))
+	{
+		ret = -1;
+	}
+
+	// The inputs were added in the same order as the matches.
+	for (i = 0, j = 0; i < mg->match_count; i++)
+	{
+		result = &mg->matches[i].result;
+
+		if (!result->deferred)
+			continue;
+
+		if (ret)
+		{
+			result->result = -1.0;
+			result->success = 0;
+			snprintf(result->description, sizeof(result->description) - 1,
+				"DNN inference failed");
+		}
+		else
+		{
+			catcierge_dnn_matcher_set_result(ctx, result, prey_scores[j++]);
+		}
+	}
+
+	ctx->input_count = 0;
+
+	return ret;
+}
+
+int catcierge_dnn_matcher_decide(void *ctx, match_group_t *mg)
+{
+	assert(mg);
+
+	return mg->success;
+}
+
+static int parse_input_size(cargo_t ctx, void *user, const char *optname,
+                            int argc, char **argv)
+{
+	catcierge_dnn_matcher_args_t *args = (catcierge_dnn_matcher_args_t *)user;
+	int sret = 0;
+
+	if (argc < 1)
+	{
+		cargo_set_error(ctx, 0,
+			"%s requires 1 argument", optname);
+		return -1;
+	}
+
+	sret = sscanf(argv[0], "%dx%d", &args->width, &args->height);
+
+	if ((sret == EOF) || (sret != 2) || (args->width <= 0) || (args->height <= 0))
+	{
+		cargo_set_error(ctx, 0,
+			"Cannot parse %s value \"%s\" expected format: WxH\n", optname, argv[0]);
+		return -1;
+	}
+
+	return 1;
+}
+
+int catcierge_dnn_matcher_args_destroy(catcierge_dnn_matcher_args_t *args)
+{
+	catcierge_xfree(&args->model);
+	catcierge_xfree(&args->config);
+	return 0;
+}
+
+int catcierge_dnn_matcher_add_options(cargo_t cargo,
+										catcierge_dnn_matcher_args_t *args)
+{
+	int ret = 0;
+	assert(cargo);
+	assert(args);
+
+	ret |= cargo_add_group(cargo, 0,
+			"dnn", "DNN matcher settings",
+			"Settings for when --dnn_matcher is used.\n"
+			"A neural network classifies each frame as prey or not, "
+			"using the OpenCV dnn module on the CPU.");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_model",
+			"Path to the network model, for instance an ONNX model. Which "
+			"other formats work depends on the OpenCV version. A small "
+			"quantized model is recommended on a Raspberry Pi.",
+			"s", &args->model);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_config",
+			"Path to the network configuration, if the model format needs one.",
+			"s", &args->config);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_size",
+			NULL,
+			"c", parse_input_size, args);
+	ret |= cargo_set_option_description(cargo,
+			"--dnn_size",
+			"The input size of the network. Default %dx%d.",
+			DNN_DEFAULT_WIDTH, DNN_DEFAULT_HEIGHT);
+	ret |= cargo_set_metavar(cargo,
+			"--dnn_size",
+			"WxH");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_scale",
+			"The pixel values are multiplied by this after the mean "
+			"is subtracted. Default 1/255.",
+			"d", &args->scale);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_mean",
+			"Subtracted from all pixel values before scaling.",
+			"d", &args->mean);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_rgb",
+			"The network expects RGB instead of BGR input.",
+			"b", &args->rgb);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_softmax",
+			"Apply softmax to the network outputs, for models "
+			"that output raw scores.",
+			"b", &args->softmax);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_prey_class",
+			NULL,
+			"i", &args->prey_class);
+	ret |= cargo_set_option_description(cargo,
+			"--dnn_prey_class",
+			"The index of the prey output of the network. Not used "
+			"when the network only has one output. Default %d.",
+			DNN_DEFAULT_PREY_CLASS);
+	ret |= cargo_add_validation(cargo, 0, "--dnn_prey_class",
+								cargo_validate_int_range(0, DNN_MAX_CLASSES - 1));
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_threshold",
+			NULL,
+			"d", &args->threshold);
+	ret |= cargo_set_option_description(cargo,
+			"--dnn_threshold",
+			"Frames with a prey score at or above this fail. Default %.2f.",
+			DNN_DEFAULT_THRESHOLD);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_threads",
+			"The number of threads OpenCV uses, this affects all of OpenCV "
+			"and not only the network. 0 keeps the OpenCV default.",
+			"i", &args->threads);
+	ret |= cargo_add_validation(cargo, 0, "--dnn_threads",
+								cargo_validate_int_range(0, 64));
+
+	ret |= cargo_add_option(cargo, 0,
+			"<dnn> --dnn_batch",
+			"Run all frames of a match group through the network as one "
+			"batch when the lock is decided, instead of one at a time. "
+			"The results of the single matches are only known then. "
+			"Not used when step images are saved.",
+			"b", &args->batch);
+
+	return ret;
+}
+
+catcierge_output_var_t dnn_vars[] =
+{
+	{ "model", "Model given via --dnn_model." },
+	{ "config", "Model configuration given via --dnn_config." },
+	{ "size", "Network input size in the format WxH. Given by --dnn_size." },
+	{ "prey_class", "Value of --dnn_prey_class." },
+	{ "threshold", "Value of --dnn_threshold." },
+	{ "threads", "Value of --dnn_threads." },
+	{ "batch", "Value of --dnn_batch." },
+};
+
+void catcierge_dnn_output_print_usage()
+{
+	size_t i;
+
+	fprintf(stderr, "DNN matcher output variables:\n");
+	fprintf(stderr, "-----------------------------\n");
+
+	for (i = 0; i < sizeof(dnn_vars) / sizeof(dnn_vars[0]); i++)
+	{
+		fprintf(stderr, "%30s   %s\n", dnn_vars[i].name, dnn_vars[i].description);
+	}
+}
+
+const char *catcierge_dnn_matcher_translate(catcierge_matcher_t *octx, const char *var,
+	char *buf, size_t bufsize)
+{
+	catcierge_dnn_matcher_t *ctx = (catcierge_dnn_matcher_t *)octx;
+	assert(ctx);
+
+	if (!strcmp(var, "model"))
+	{
+		return ctx->args->model;
+	}
+
+	if (!strcmp(var, "config"))
+	{
+		return ctx->args->config ? ctx->args->config : "";
+	}
+
+	if (!strcmp(var, "size"))
+	{
+		snprintf(buf, bufsize - 1, "%dx%d",
+			ctx->args->width,
+			ctx->args->height);
+		return buf;
+	}
+
+	if (!strcmp(var, "prey_class"))
+	{
+		snprintf(buf, bufsize - 1, "%d", ctx->args->prey_class);
+		return buf;
+	}
+
+	if (!strcmp(var, "threshold"))
+	{
+		snprintf(buf, bufsize - 1, "%f", ctx->args->threshold);
+		return buf;
+	}
+
+	if (!strcmp(var, "threads"))
+	{
+		snprintf(buf, bufsize - 1, "%d", ctx->args->threads);
+		return buf;
+	}
+
+	if (!strcmp(var, "batch"))
+	{
+		snprintf(buf, bufsize - 1, "%d", ctx->args->batch);
+		return buf;
+	}
+
+	return NULL;
+}
+
+void catcierge_dnn_matcher_print_settings(catcierge_dnn_matcher_args_t *args)
+{
+	assert(args);
+	printf("DNN Matcher:\n");
+	printf("             Model: %s\n", args->model);
+	if (args->config)
+	printf("            Config: %s\n", args->config);
+	printf("        Input size: %dx%d\n", args->width, args->height);
+	printf("             Scale: %f\n", args->scale);
+	printf("              Mean: %f\n", args->mean);
+	printf("               RGB: %d\n", args->rgb);
+	printf("           Softmax: %d\n", args->softmax);
+	printf("        Prey class: %d\n", args->prey_class);
+	printf("         Threshold: %.2f\n", args->threshold);
+	printf("           Threads: %d\n", args->threads);
+	printf("             Batch: %d\n", args->batch);
+	printf("\n");
+}
+
+void catcierge_dnn_matcher_args_init(catcierge_dnn_matcher_args_t *args)
+{
+	assert(args);
+	memset(args, 0, sizeof(catcierge_dnn_matcher_args_t));
+	args->super.type = MATCHER_DNN;
+	args->width = DNN_DEFAULT_WIDTH;
+	args->height = DNN_DEFAULT_HEIGHT;
+	args->scale = DNN_DEFAULT_SCALE;
+	args->prey_class = DNN_DEFAULT_PREY_CLASS;
+	args->threshold = DNN_DEFAULT_THRESHOLD;
+}
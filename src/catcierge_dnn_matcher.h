@@ -0,0 +1,84 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_DNN_MATCHER_H__
+#define __CATCIERGE_DNN_MATCHER_H__
+
+#include <opencv2/imgproc/imgproc_c.h>
+#include <stdio.h>
+#include "catcierge_dnn_wrapper.h"
+#include "catcierge_types.h"
+#include "catcierge_matcher.h"
+#include "cargo.h"
+
+#define DNN_DEFAULT_WIDTH 96
+#define DNN_DEFAULT_HEIGHT 96
+#define DNN_DEFAULT_SCALE (1.0 / 255.0)
+#define DNN_DEFAULT_PREY_CLASS 1
+#define DNN_DEFAULT_THRESHOLD 0.5
+
+// The most outputs per image the network may have.
+#define DNN_MAX_CLASSES 1024
+
+typedef struct catcierge_dnn_matcher_args_s
+{
+	catcierge_matcher_args_t super;
+	char *model;
+	char *config;
+	int width;					// Network input size.
+	int height;
+	double scale;				// Pixel values are multiplied by this...
+	double mean;				// ...after this is subtracted.
+	int rgb;					// The network expects RGB instead of BGR.
+	int softmax;				// Apply softmax to the network outputs.
+	int prey_class;				// Index of the prey output.
+	double threshold;			// Prey scores at or above this are a fail.
+	int threads;				// OpenCV threads, 0 for the default.
+	int batch;					// Run the whole match group as one batch.
+	int debug;
+} catcierge_dnn_matcher_args_t;
+
+typedef struct catcierge_dnn_matcher_s
+{
+	catcierge_matcher_t super;
+	cv2DnnNet *net;
+	IplImage *gray;							// Resized grayscale frame before converting to BGR.
+	IplImage *inputs[MATCH_MAX_COUNT + 1];	// Frames resized to the network input size, the last is for unbatched matches.
+	size_t input_count;						// Frames waiting for the batch.
+	float *scores;							// DNN_MAX_CLASSES outputs per input.
+	catcierge_dnn_matcher_args_t *args;
+} catcierge_dnn_matcher_t;
+
+int catcierge_dnn_matcher_init(catcierge_matcher_t **ctx, catcierge_matcher_args_t *args);
+void catcierge_dnn_matcher_destroy(catcierge_matcher_t **ctx);
+double catcierge_dnn_matcher_match(void *ctx, IplImage *img, match_result_t *result, int save_steps);
+int catcierge_dnn_matcher_match_group(catcierge_matcher_t *ctx, match_group_t *mg);
+int catcierge_dnn_matcher_decide(void *ctx, match_group_t *mg);
+void catcierge_dnn_matcher_reset(catcierge_matcher_t *ctx);
+
+int catcierge_dnn_matcher_add_options(cargo_t cargo,
+										catcierge_dnn_matcher_args_t *args);
+
+int catcierge_dnn_matcher_args_destroy(catcierge_dnn_matcher_args_t *args);
+void catcierge_dnn_matcher_args_init(catcierge_dnn_matcher_args_t *args);
+void catcierge_dnn_matcher_print_settings(catcierge_dnn_matcher_args_t *args);
+const char *catcierge_dnn_matcher_translate(catcierge_matcher_t *octx, const char *var,
+	char *buf, size_t bufsize);
+void catcierge_dnn_output_print_usage();
+
+#endif // __CATCIERGE_DNN_MATCHER_H__
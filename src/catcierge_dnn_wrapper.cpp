@@ -0,0 +1,127 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "opencv2/dnn/dnn.hpp"
+#include "opencv2/core/core_c.h"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+using namespace std;
+using namespace cv;
+using namespace cv::dnn;
+
+#include "catcierge_dnn_wrapper.h"
+
+#ifdef __cplusplus
+extern "C" 
+{
+#endif
+
+cv2DnnNet *cv2DnnNet_create(const char *model, const char *config)
+{
+	Net *net = NULL;
+
+	try
+	{
+		net = new Net(readNet(model, config ? config : ""));
+
+		if (net->empty())
+		{
+			delete net;
+			return NULL;
+		}
+
+		net->setPreferableBackend(DNN_BACKEND_OPENCV);
+		net->setPreferableTarget(DNN_TARGET_CPU);
+	}
+	catch (const cv::Exception &e)
+	{
+		fprintf(stderr, "Failed to load DNN model %s: %s\n", model, e.what());
+		delete net;
+		return NULL;
+	}
+
+	return (cv2DnnNet *)net;
+}
+
+void cv2DnnNet_destroy(cv2DnnNet *n)
+{
+	Net *net = (Net *)n;
+	delete net;
+}
+
+void cv2Dnn_set_threads(int threads)
+{
+	setNumThreads((threads > 0) ? threads : -1);
+}
+
+int cv2DnnNet_forward(cv2DnnNet *n, IplImage **imgs, size_t img_count,
+	double scale, double mean, int swap_rb,
+	float *scores, size_t max_classes, size_t *class_count)
+{
+	size_t i;
+	size_t j;
+	Net *net = (Net *)n;
+	vector<Mat> mats;
+	assert(net);
+	assert(imgs);
+	assert(scores);
+	assert(class_count);
+
+	for (i = 0; i < img_count; i++)
+	{
+		mats.push_back(cvarrToMat(imgs[i]));
+	}
+
+	try
+	{
+		// The images are already the input size, so no resizing or cropping.
+		Mat blob = blobFromImages(mats, scale, Size(),
+						Scalar(mean, mean, mean), swap_rb != 0, false);
+		net->setInput(blob);
+
+		// One row of outputs per image.
+		Mat out = net->forward().reshape(1, (int)img_count);
+		*class_count = out.cols;
+
+		for (i = 0; i < img_count; i++)
+		{
+			const float *row = out.ptr<float>((int)i);
+
+			for (j = 0; (j < (size_t)out.cols) && (j < max_classes); j++)
+			{
+				scores[i * max_classes + j] = row[j];
+			}
+		}
+	}
+	catch (const cv::Exception &e)
+	{
+		fprintf(stderr, "DNN inference failed: %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
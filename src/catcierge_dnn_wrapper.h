@@ -0,0 +1,53 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_DNN_WRAPPER_H__
+#define __CATCIERGE_DNN_WRAPPER_H__
+
+#include <opencv2/imgproc/imgproc_c.h>
+#include <stddef.h>
+
+typedef void cv2DnnNet;
+
+#ifdef __cplusplus
+extern "C" 
+{
+#endif
+
+// Loads a network from a local file, the format is given by the file
+// extension (ONNX, TensorFlow, Caffe...). config is optional.
+// The network always runs on the CPU.
+cv2DnnNet *cv2DnnNet_create(const char *model, const char *config);
+void cv2DnnNet_destroy(cv2DnnNet *n);
+
+// Number of threads OpenCV uses, 0 for the OpenCV default.
+void cv2Dnn_set_threads(int threads);
+
+// Runs the images through the network in a single batch. The images must
+// all be 8-bit 3 channel images of the network input size.
+// The output of image i is put at scores[i * max_classes], and
+// class_count is set to the number of outputs per image.
+int cv2DnnNet_forward(cv2DnnNet *n, IplImage **imgs, size_t img_count,
+	double scale, double mean, int swap_rb,
+	float *scores, size_t max_classes, size_t *class_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CATCIERGE_DNN_WRAPPER_H__
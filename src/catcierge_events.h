@@ -47,6 +47,10 @@ CATCIERGE_DEFINE_EVENT(CATCIERGE_FRAME_OBSTRUCTED, frame_obstructed,
 	"Right after the camera view has been obstructed and the obstruct image "
 	"has been saved.")
 
+CATCIERGE_DEFINE_EVENT(CATCIERGE_ROI_CHANGED, roi_changed,
+	"The back light area moved and --auto_roi_interval changed the "
+	"obstruction ROI.")
+
 #ifdef WITH_RFID
 
 CATCIERGE_DEFINE_EVENT(CATCIERGE_RFID_DETECT, rfid_detect,
@@ -0,0 +1,239 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cargo.h"
+#include "catcierge_config.h"
+#include "catcierge_util.h"
+#include "catcierge_archive.h"
+#include <opencv2/imgproc/imgproc_c.h>
+#include <opencv2/highgui/highgui_c.h>
+
+typedef struct extract_ctx_s
+{
+	char **archive_paths;
+	size_t archive_count;
+	char *output_path;
+	char *filter;
+	int list;
+	int no_steps;
+} extract_ctx_t;
+
+static extract_ctx_t ctx;
+
+static const char *get_frame_type_str(catcierge_archive_frame_type_t type)
+{
+	switch (type)
+	{
+		case CATCIERGE_ARCHIVE_OBSTRUCT: return "obstruct";
+		case CATCIERGE_ARCHIVE_MATCH: return "match";
+		case CATCIERGE_ARCHIVE_STEP: return "step";
+		default: return "unknown";
+	}
+}
+
+static int add_options(cargo_t cargo)
+{
+	int ret = 0;
+
+	ret |= cargo_add_option(cargo, CARGO_OPT_REQUIRED,
+			"--archive",
+			"Archive files written by catcierge_grabber --archive.",
+			"[s]+", &ctx.archive_paths, &ctx.archive_count);
+	ret |= cargo_set_metavar(cargo, "--archive", "PATH");
+
+	ret |= cargo_add_option(cargo, 0,
+			"--list",
+			"Only list the match groups and images in the archives.",
+			"b", &ctx.list);
+
+	ret |= cargo_add_option(cargo, 0,
+			"--output_path --output",
+			"Directory the images are extracted to. "
+			"Defaults to the current directory.",
+			"s", &ctx.output_path);
+	ret |= cargo_set_metavar(cargo, "--output_path", "PATH");
+
+	ret |= cargo_add_option(cargo, 0,
+			"--filter",
+			"Only list or extract images with a name containing this string, "
+			"or match groups with this id.",
+			"s", &ctx.filter);
+
+	ret |= cargo_add_option(cargo, 0,
+			"--no_steps",
+			"Skip the match step images.",
+			"b", &ctx.no_steps);
+
+	return ret;
+}
+
+static int extract_archive(const char *archive_path, size_t *image_count)
+{
+	int ret = 0;
+	size_t i;
+	char path[4096];
+	char time_str[64];
+	time_t t;
+	catcierge_archive_reader_t r;
+	catcierge_archive_record_t *rec;
+	catcierge_archive_frame_t *frame;
+	IplImage *img = NULL;
+	int group_match;
+
+	if (catcierge_archive_reader_open(&r, archive_path))
+	{
+		return -1;
+	}
+
+	while ((rec = catcierge_archive_reader_next(&r)))
+	{
+		t = (time_t)rec->time_sec;
+		strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&t));
+		group_match = ctx.filter && !strcmp(ctx.filter, rec->id);
+
+		if (ctx.list)
+		{
+			printf("%s  %s  (%u images)\n", rec->id, time_str, rec->frame_count);
+		}
+
+		for (i = 0; i < rec->frame_count; i++)
+		{
+			frame = catcierge_archive_get_frame(rec, i);
+
+			if (ctx.no_steps && (frame->type == CATCIERGE_ARCHIVE_STEP))
+				continue;
+
+			if (ctx.filter && !group_match && !strstr(frame->name, ctx.filter))
+				continue;
+
+			if (ctx.list)
+			{
+				printf("  %-8s %4dx%-4d %s %7u bytes  %s\n",
+					get_frame_type_str(frame->type),
+					frame->width, frame->height,
+					(frame->encoding == CATCIERGE_ARCHIVE_RLE) ? "rle" : "raw",
+					frame->size, frame->name);
+				continue;
+			}
+
+			// Don't allow the name to point outside the output directory.
+			if (strchr(frame->name, '/') || strchr(frame->name, '\\'))
+			{
+				fprintf(stderr, "Skipping invalid image name: %s\n", frame->name);
+				continue;
+			}
+
+			snprintf(path, sizeof(path), "%s%s%s",
+				ctx.output_path, catcierge_path_sep(), frame->name);
+
+			if (!(img = catcierge_archive_decode(rec, i)))
+			{
+				fprintf(stderr, "Failed to decode %s\n", frame->name);
+				ret = -1;
+				continue;
+			}
+
+			if (!cvSaveImage(path, img, 0))
+			{
+				fprintf(stderr, "Failed to save %s\n", path);
+				ret = -1;
+			}
+			else
+			{
+				printf("%s\n", path);
+				(*image_count)++;
+			}
+
+			cvReleaseImage(&img);
+		}
+	}
+
+	if (r.pos < r.size)
+	{
+		fprintf(stderr, "%s: Ignoring %lu bytes of truncated or invalid data at the end\n",
+			archive_path, (unsigned long)(r.size - r.pos));
+	}
+
+	catcierge_archive_reader_close(&r);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+	size_t i;
+	size_t image_count = 0;
+	cargo_t cargo;
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	if (cargo_init(&cargo, 0, "%s", argv[0]))
+	{
+		fprintf(stderr, "Failed to init command line parsing\n");
+		return -1;
+	}
+
+	cargo_set_description(cargo,
+		"List or extract the images of catcierge archives as PNG files.");
+
+	if (add_options(cargo))
+	{
+		fprintf(stderr, "Failed to init command line options\n");
+		ret = -1; goto fail;
+	}
+
+	if (cargo_parse(cargo, 0, 1, argc, argv))
+	{
+		ret = -1; goto fail;
+	}
+
+	if (!ctx.output_path && !(ctx.output_path = strdup(".")))
+	{
+		fprintf(stderr, "Out of memory\n");
+		ret = -1; goto fail;
+	}
+
+	if (!ctx.list && catcierge_make_path("%s", ctx.output_path))
+	{
+		fprintf(stderr, "Failed to create output directory %s\n", ctx.output_path);
+		ret = -1; goto fail;
+	}
+
+	for (i = 0; i < ctx.archive_count; i++)
+	{
+		ret |= extract_archive(ctx.archive_paths[i], &image_count);
+	}
+
+	if (!ctx.list)
+	{
+		printf("Extracted %lu images\n", (unsigned long)image_count);
+	}
+
+fail:
+	catcierge_xfree_list(&ctx.archive_paths, &ctx.archive_count);
+	catcierge_xfree(&ctx.output_path);
+	catcierge_xfree(&ctx.filter);
+	cargo_destroy(&cargo);
+
+	return ret;
+}
@@ -0,0 +1,275 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "catcierge_frame.h"
+#include "catcierge_log.h"
+
+void catcierge_frame_pool_init(catcierge_frame_pool_t *pool)
+{
+	assert(pool);
+	memset(pool, 0, sizeof(*pool));
+}
+
+void catcierge_frame_pool_destroy(catcierge_frame_pool_t *pool)
+{
+	catcierge_frame_t *frame;
+	catcierge_frame_t *next;
+	assert(pool);
+
+	if (pool->in_use > 0)
+	{
+		CATERR("%d frames still referenced when destroying the frame pool\n",
+			(int)pool->in_use);
+	}
+
+	for (frame = pool->all; frame; frame = next)
+	{
+		next = frame->all_next;
+
+		if (frame->buf)
+		{
+			cvReleaseImage(&frame->buf);
+		}
+
+		free(frame);
+	}
+
+	memset(pool, 0, sizeof(*pool));
+}
+
+static int catcierge_frame_buf_matches(const IplImage *buf, CvSize size, int depth, int channels)
+{
+	return buf
+		&& (buf->width == size.width)
+		&& (buf->height == size.height)
+		&& (buf->depth == depth)
+		&& (buf->nChannels == channels);
+}
+
+static int catcierge_frame_buf_fits(const IplImage *buf, CvSize size, int depth, int channels)
+{
+	return buf
+		&& (buf->width >= size.width)
+		&& (buf->height >= size.height)
+		&& (buf->depth == depth)
+		&& (buf->nChannels == channels);
+}
+
+//
+// Takes a free frame from the pool. If a buffer is wanted, a free frame
+// owning one of the given format is preferred, otherwise the smallest
+// one large enough to hold it. Failing that any free frame is used before
+// allocating a new one, so the pool never grows beyond the number of
+// frames referenced at the same time.
+//
+static catcierge_frame_t *catcierge_frame_pool_get(catcierge_frame_pool_t *pool,
+								int want_buf, CvSize size, int depth, int channels)
+{
+	catcierge_frame_t *frame = NULL;
+	catcierge_frame_t **it;
+	catcierge_frame_t **best = NULL;
+	catcierge_frame_t **fallback = NULL;
+	IplImage *buf;
+
+	for (it = &pool->free; *it; it = &(*it)->next)
+	{
+		buf = (*it)->buf;
+
+		if (want_buf ? catcierge_frame_buf_matches(buf, size, depth, channels) : !buf)
+		{
+			best = it;
+			break;
+		}
+
+		if (want_buf && catcierge_frame_buf_fits(buf, size, depth, channels)
+			&& (!best || (buf->imageSize < (*best)->buf->imageSize)))
+		{
+			best = it;
+		}
+
+		if (!fallback)
+		{
+			fallback = it;
+		}
+	}
+
+	if (best)
+	{
+		fallback = best;
+	}
+
+	if (fallback)
+	{
+		frame = *fallback;
+		*fallback = frame->next;
+	}
+
+	if (!frame)
+	{
+		if (!(frame = calloc(1, sizeof(catcierge_frame_t))))
+		{
+			CATERR("Out of memory allocating frame\n");
+			return NULL;
+		}
+
+		frame->pool = pool;
+		frame->all_next = pool->all;
+		pool->all = frame;
+		pool->count++;
+	}
+
+	frame->next = NULL;
+	frame->refcount = 1;
+	pool->in_use++;
+
+	return frame;
+}
+
+catcierge_frame_t *catcierge_frame_pool_alloc(catcierge_frame_pool_t *pool, CvSize size, int depth, int channels)
+{
+	catcierge_frame_t *frame;
+	assert(pool);
+
+	if (!(frame = catcierge_frame_pool_get(pool, 1, size, depth, channels)))
+	{
+		return NULL;
+	}
+
+	if (frame->buf && !catcierge_frame_buf_fits(frame->buf, size, depth, channels))
+	{
+		cvReleaseImage(&frame->buf);
+	}
+
+	if (!frame->buf)
+	{
+		if (!(frame->buf = cvCreateImage(size, depth, channels)))
+		{
+			CATERR("Out of memory allocating frame buffer\n");
+			frame->img = NULL;
+			catcierge_frame_unref(&frame);
+			return NULL;
+		}
+
+		pool->allocs++;
+	}
+
+	cvResetImageROI(frame->buf);
+
+	if (catcierge_frame_buf_matches(frame->buf, size, depth, channels))
+	{
+		frame->img = frame->buf;
+	}
+	else
+	{
+		// A view of the top left of the larger buffer, the
+		// rows keep the stride of the buffer.
+		frame->header = *frame->buf;
+		frame->header.width = size.width;
+		frame->header.height = size.height;
+		frame->header.imageSize = frame->buf->widthStep * size.height;
+		frame->header.roi = NULL;
+		frame->header.maskROI = NULL;
+		frame->header.imageId = NULL;
+		frame->header.tileInfo = NULL;
+		frame->img = &frame->header;
+	}
+
+	return frame;
+}
+
+catcierge_frame_t *catcierge_frame_pool_copy(catcierge_frame_pool_t *pool, const IplImage *img)
+{
+	catcierge_frame_t *frame;
+	assert(pool);
+	assert(img);
+
+	if (!(frame = catcierge_frame_pool_alloc(pool,
+			cvSize(img->width, img->height), img->depth, img->nChannels)))
+	{
+		return NULL;
+	}
+
+	frame->img->origin = img->origin;
+	cvCopy(img, frame->img, NULL);
+	pool->copies++;
+
+	return frame;
+}
+
+catcierge_frame_t *catcierge_frame_pool_wrap(catcierge_frame_pool_t *pool, const IplImage *img)
+{
+	catcierge_frame_t *frame;
+	assert(pool);
+	assert(img);
+
+	if (!(frame = catcierge_frame_pool_get(pool, 0, cvSize(img->width, img->height), img->depth, img->nChannels)))
+	{
+		return NULL;
+	}
+
+	frame->header = *img;
+	frame->header.roi = NULL;
+	frame->header.maskROI = NULL;
+	frame->header.imageId = NULL;
+	frame->header.tileInfo = NULL;
+	frame->img = &frame->header;
+	pool->wraps++;
+
+	return frame;
+}
+
+catcierge_frame_t *catcierge_frame_ref(catcierge_frame_t *frame)
+{
+	assert(frame);
+	assert(frame->refcount > 0);
+	frame->refcount++;
+
+	return frame;
+}
+
+void catcierge_frame_unref(catcierge_frame_t **frame)
+{
+	catcierge_frame_t *f;
+	catcierge_frame_pool_t *pool;
+
+	if (!frame || !*frame)
+		return;
+
+	f = *frame;
+	*frame = NULL;
+	assert(f->refcount > 0);
+
+	if (--f->refcount > 0)
+		return;
+
+	// Back to the pool, the buffer is kept for the next snapshot.
+	pool = f->pool;
+	f->img = NULL;
+
+	if (f->header.roi)
+	{
+		cvResetImageROI(&f->header);
+	}
+
+	f->next = pool->free;
+	pool->free = f;
+	pool->in_use--;
+}
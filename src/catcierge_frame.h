@@ -0,0 +1,83 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_FRAME_H__
+#define __CATCIERGE_FRAME_H__
+
+#include <stddef.h>
+#include <opencv2/imgproc/imgproc_c.h>
+
+//
+// Reference counted frame buffers.
+//
+// A snapshot of a frame (the obstruct frame, the match frames) is kept as
+// a reference to a frame instead of a private clone of the image. When the
+// last reference is dropped the buffer goes back to its pool and is reused
+// for the next snapshot of the same format that fits in it, so no image is
+// allocated or freed while matching.
+//
+// Frames whose pixels stay valid for the life of the capture (for instance
+// frames played back from a memory mapped recording) are wrapped without
+// copying anything. Frames from a camera are only valid until the next
+// frame is grabbed and are copied into a pooled buffer instead.
+//
+
+struct catcierge_frame_pool_s;
+
+typedef struct catcierge_frame_s
+{
+	IplImage *img;							// The frame image, either buf or &header.
+	int refcount;
+	IplImage *buf;							// Buffer owned by the frame for copied frames.
+	IplImage header;						// Header pointing at someone else's pixels for wrapped frames,
+											// or at the top left of a larger buf.
+	struct catcierge_frame_pool_s *pool;
+	struct catcierge_frame_s *next;			// Next free frame in the pool.
+	struct catcierge_frame_s *all_next;		// Next frame owned by the pool.
+} catcierge_frame_t;
+
+// A zeroed pool is valid, catcierge_frame_pool_init is only a convenience.
+typedef struct catcierge_frame_pool_s
+{
+	catcierge_frame_t *free;				// Frames that can be reused.
+	catcierge_frame_t *all;					// All frames owned by the pool.
+	size_t count;							// Number of frames in the pool.
+	size_t in_use;							// Frames currently referenced.
+	size_t allocs;							// Image buffers allocated.
+	size_t copies;							// Snapshots that needed a copy.
+	size_t wraps;							// Snapshots that were zero-copy.
+} catcierge_frame_pool_t;
+
+void catcierge_frame_pool_init(catcierge_frame_pool_t *pool);
+void catcierge_frame_pool_destroy(catcierge_frame_pool_t *pool);
+
+// Returns a new frame with an uninitialized buffer of the given format,
+// reusing a free buffer of the same or a larger size if possible.
+catcierge_frame_t *catcierge_frame_pool_alloc(catcierge_frame_pool_t *pool, CvSize size, int depth, int channels);
+
+// Returns a new frame with a copy of img, reusing a free buffer if possible.
+catcierge_frame_t *catcierge_frame_pool_copy(catcierge_frame_pool_t *pool, const IplImage *img);
+
+// Returns a new frame referencing the pixels of img without copying them.
+// The caller guarantees that the pixels outlive the frame.
+catcierge_frame_t *catcierge_frame_pool_wrap(catcierge_frame_pool_t *pool, const IplImage *img);
+
+catcierge_frame_t *catcierge_frame_ref(catcierge_frame_t *frame);
+void catcierge_frame_unref(catcierge_frame_t **frame);
+
+#endif // __CATCIERGE_FRAME_H__
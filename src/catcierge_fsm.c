@@ -20,6 +20,7 @@
 #include "catcierge_args.h"
 #include "catcierge_log.h"
 #include <string.h>
+#include <stddef.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -59,6 +60,14 @@
 void catcierge_trigger_event(catcierge_grb_t *grb, catcierge_event_t e, int execute)
 {
 	catcierge_args_t *args = &grb->args;
+	catcierge_span_t *span = NULL;
+
+	// Only the events of the current match group count towards its
+	// output time. The lockout command is timed as the lock span.
+	if (grb->match_group.active && (e != CATCIERGE_DO_LOCKOUT))
+	{
+		span = &grb->match_group.spans[CATCIERGE_SPAN_OUTPUT];
+	}
 
 	// We use this wrapper function and pass a catcierge_event_t so that if
 	// one specifies an event type that is not defined in "catcierge_events.h"
@@ -69,8 +78,10 @@ void catcierge_trigger_event(catcierge_grb_t *grb, catcierge_event_t e, int exec
 		{																	\
 			char **cmd = NULL;												\
 			size_t count = args->ev_name ## _cmd_count;						\
+			double begin = span ? catcierge_span_begin(span) : 0.0;			\
 			if (execute) cmd = args->ev_name ## _cmd;						\
 			catcierge_output_execute_list(grb, #ev_name, cmd, count);		\
+			if (span) catcierge_span_end(span, begin);						\
 			return;															\
 		}
 	#include "catcierge_events.h"
@@ -127,20 +138,57 @@ void catcierge_set_state(catcierge_grb_t *grb, catcierge_state_func_t new_state)
 #ifdef WITH_RFID
 static int match_allowed_rfid(catcierge_grb_t *grb, const char *rfid_tag)
 {
-	int i;
+	assert(grb);
+	return catcierge_rfid_allowed_check(grb->rfid_allowed, rfid_tag, time(NULL));
+}
+
+int catcierge_load_rfid_allowed(catcierge_grb_t *grb)
+{
 	catcierge_args_t *args;
+	catcierge_rfid_allowed_t *allowed = NULL;
+	catcierge_rfid_allowed_t *old = NULL;
 	assert(grb);
 	args = &grb->args;
 
-	for (i = 0; i < args->rfid_allowed_count; i++)
+	// Build the new set completely before replacing the old one,
+	// so a broken file leaves the current set in place.
+	if (!(allowed = catcierge_rfid_allowed_create()))
 	{
-		if (!strcmp(rfid_tag, args->rfid_allowed[i]))
-		{
-			return 1;
-		}
+		return -1;
+	}
+
+	if (catcierge_rfid_allowed_add_list(allowed, args->rfid_allowed, args->rfid_allowed_count))
+	{
+		goto fail;
 	}
 
+	if (args->rfid_allowed_path
+		&& catcierge_rfid_allowed_load(allowed, args->rfid_allowed_path))
+	{
+		goto fail;
+	}
+
+	catcierge_rfid_allowed_copy_stats(allowed, grb->rfid_allowed);
+
+	old = grb->rfid_allowed;
+	grb->rfid_allowed = allowed;
+	catcierge_rfid_allowed_destroy(&old);
+
+	CATLOG("Loaded %lu allowed RFID tags\n", (unsigned long)allowed->count);
+
 	return 0;
+fail:
+	if (grb->rfid_allowed)
+	{
+		CATERR("Failed to load allowed RFID tags, keeping the old ones\n");
+	}
+	else
+	{
+		CATERR("Failed to load allowed RFID tags\n");
+	}
+
+	catcierge_rfid_allowed_destroy(&allowed);
+	return -1;
 }
 
 static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid_match_t *other, 
@@ -148,6 +196,7 @@ static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid
 						int complete, const char *data, size_t data_len)
 {
 	catcierge_args_t *args;
+	int updated = 0;
 	assert(grb);
 	args = &grb->args;
 
@@ -159,12 +208,16 @@ static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid
 		complete ? "COMPLETE" : "INCOMPLETE",
 		(int)data_len);
 
-	// Update the match if we get a complete tag.
-	if (complete && (data_len > other->data_len))
+	// Update the match if we get a complete tag after a partial read.
+	// Checking if the tag is allowed also counts it as seen, so that
+	// is only done once below.
+	if (complete && !current->complete && (data_len > current->data_len))
 	{
 		strncpy(current->data, data, sizeof(current->data) - 1);
 		current->data_len = data_len;
 		current->complete = complete;
+		current->tv = rfid->tag_tv;
+		updated = 1;
 	}
 
 	// If we have already triggered this reader
@@ -173,6 +226,12 @@ static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid
 	if (current->triggered)
 	{
 		CATLOG("Already triggered!\n");
+
+		if (updated)
+		{
+			current->is_allowed = match_allowed_rfid(grb, current->data);
+		}
+
 		return;
 	}
 
@@ -180,6 +239,14 @@ static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid
 	// TODO: It could be wise to time this out after a while...
 	if (other->triggered)
 	{
+		// Tags are passed on when the complete line has been read,
+		// so go by when the first byte arrived on each reader instead.
+		if (timercmp(&rfid->tag_tv, &other->tv, <))
+		{
+			dir = (dir == MATCH_DIR_IN) ? MATCH_DIR_OUT : MATCH_DIR_IN;
+			dir_str = (dir == MATCH_DIR_IN) ? "IN" : "OUT";
+		}
+
 		grb->rfid_direction = dir;
 		CATLOG("%s RFID: Direction %s\n", rfid->name, dir_str);
 	}
@@ -188,6 +255,7 @@ static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid
 	current->complete = complete;
 	strncpy(current->data, data, sizeof(current->data) - 1);
 	current->data_len = data_len;
+	current->tv = rfid->tag_tv;
 	current->is_allowed = match_allowed_rfid(grb, current->data);
 
 	// TODO: Do we have all RFID vars for this?
@@ -212,7 +280,7 @@ static void rfid_outer_read_cb(catcierge_rfid_t *rfid, int complete, const char
 			MATCH_DIR_OUT, "OUT", rfid, complete, data, data_len);
 }
 
-void catcierge_init_rfid_readers(catcierge_grb_t *grb)
+int catcierge_init_rfid_readers(catcierge_grb_t *grb)
 {
 	catcierge_args_t *args;
 	assert(grb);
@@ -221,6 +289,13 @@ void catcierge_init_rfid_readers(catcierge_grb_t *grb)
 
 	catcierge_rfid_ctx_init(&grb->rfid_ctx);
 
+	// Unlike a reload there is no old set to fall back on,
+	// so don't start with a broken allowed list.
+	if (catcierge_load_rfid_allowed(grb))
+	{
+		return -1;
+	}
+
 	if (args->rfid_inner_path)
 	{
 		memset(&grb->rfid_in_match, 0, sizeof(grb->rfid_in_match));
@@ -238,12 +313,31 @@ void catcierge_init_rfid_readers(catcierge_grb_t *grb)
 	}
 	
 	CATLOG("Initialized RFID readers\n");
+
+	return 0;
+}
+
+void catcierge_destroy_rfid_readers(catcierge_grb_t *grb)
+{
+	catcierge_args_t *args;
+	assert(grb);
+	args = &grb->args;
+
+	catcierge_rfid_ctx_destroy(&grb->rfid_ctx);
+
+	if (args->rfid_inner_path)
+		catcierge_rfid_destroy(&grb->rfid_in);
+
+	if (args->rfid_outer_path)
+		catcierge_rfid_destroy(&grb->rfid_out);
 }
 #endif // WITH_RFID
 
 void catcierge_do_lockout(catcierge_grb_t *grb)
 {
 	catcierge_args_t *args;
+	catcierge_span_t *span = NULL;
+	double begin = 0.0;
 	assert(grb);
 	args = &grb->args;
 
@@ -253,6 +347,14 @@ void catcierge_do_lockout(catcierge_grb_t *grb)
 		return;
 	}
 
+	// A lockout outside of a match group, such as one forced by SIGUSR2,
+	// must not end up in the lock time of the last match group.
+	if (grb->match_group.active)
+	{
+		span = &grb->match_group.spans[CATCIERGE_SPAN_LOCK];
+		begin = catcierge_span_begin(span);
+	}
+
 	if (args->do_lockout_cmd)
 	{
 		catcierge_trigger_event(grb, CATCIERGE_DO_LOCKOUT, 1);
@@ -262,14 +364,19 @@ void catcierge_do_lockout(catcierge_grb_t *grb)
 		catcierge_trigger_event(grb, CATCIERGE_DO_LOCKOUT, 0);
 
 		#ifdef RPI
-		gpio_write(CATCIERGE_LOCKOUT_GPIO, 1);
+		catcierge_gpio_write(&grb->lockout_gpio, 1);
 
 		if (args->backlight_enable)
 		{
-			gpio_write(CATCIERGE_BACKLIGHT_GPIO, 1);
+			catcierge_gpio_write(&grb->backlight_gpio, 1);
 		}
 		#endif // RPI
 	}
+
+	if (span)
+	{
+		catcierge_span_end(span, begin);
+	}
 }
 
 void catcierge_do_unlock(catcierge_grb_t *grb)
@@ -287,11 +394,11 @@ void catcierge_do_unlock(catcierge_grb_t *grb)
 		catcierge_trigger_event(grb, CATCIERGE_DO_UNLOCK, 0);
 
 		#ifdef RPI
-		gpio_write(CATCIERGE_LOCKOUT_GPIO, 0);
+		catcierge_gpio_write(&grb->lockout_gpio, 0);
 		
 		if (args->backlight_enable)
 		{
-			gpio_write(CATCIERGE_BACKLIGHT_GPIO, 1);
+			catcierge_gpio_write(&grb->backlight_gpio, 1);
 		}
 		#endif // RPI
 	}
@@ -306,6 +413,74 @@ static void catcierge_path_reset(catcierge_path_t *path)
 	path->dir[0] = '\0';
 }
 
+//
+// Keeps img around after the next frame is grabbed. Frames that stay valid
+// are only referenced, others are copied into a recycled pool buffer.
+//
+static IplImage *catcierge_snapshot_frame(catcierge_grb_t *grb, IplImage *img, catcierge_frame_t **frame)
+{
+	assert(grb);
+	assert(img);
+	assert(frame);
+
+	catcierge_frame_unref(frame);
+
+	// Snapshots are kept for saving, so save the color frame if there is one.
+	img = catcierge_capture_color_frame(&grb->capture, img);
+
+	if (catcierge_capture_frame_is_stable(&grb->capture, img))
+	{
+		*frame = catcierge_frame_pool_wrap(&grb->frame_pool, img);
+	}
+	else
+	{
+		*frame = catcierge_frame_pool_copy(&grb->frame_pool, img);
+	}
+
+	return *frame ? (*frame)->img : NULL;
+}
+
+static void catcierge_release_snapshot(catcierge_frame_t **frame, IplImage **img)
+{
+	catcierge_frame_unref(frame);
+	*img = NULL;
+}
+
+//
+// The step paths are only needed when saving steps, so they are kept in
+// one block for all the matches of a group instead of in every step.
+//
+catcierge_path_t *catcierge_get_step_path(catcierge_grb_t *grb, size_t match_idx, size_t step_idx)
+{
+	catcierge_path_t *path;
+	assert(grb);
+	assert(match_idx < MATCH_MAX_COUNT);
+	assert(step_idx < MAX_STEPS);
+
+	if (!grb->step_paths)
+	{
+		if (!(grb->step_paths = calloc(MATCH_MAX_COUNT * MAX_STEPS, sizeof(catcierge_path_t))))
+		{
+			CATERR("Out of memory allocating step paths\n");
+			return NULL;
+		}
+	}
+
+	path = &grb->step_paths[match_idx * MAX_STEPS + step_idx];
+	catcierge_path_reset(path);
+
+	return path;
+}
+
+// The steps recorded by the matcher while matching.
+static catcierge_steps_mode_t catcierge_get_match_steps_mode(catcierge_args_t *args)
+{
+	if (!args->save_steps || (args->steps_mode == STEPS_LAZY))
+		return STEPS_OFF;
+
+	return args->steps_mode;
+}
+
 static void catcierge_cleanup_match_steps(catcierge_grb_t *grb, match_result_t *result)
 {
 	int j;
@@ -313,18 +488,13 @@ static void catcierge_cleanup_match_steps(catcierge_grb_t *grb, match_result_t *
 	assert(grb);
 	assert(result);
 
-	for (j = 0; j < MAX_MATCH_RECTS; j++)
+	for (j = 0; j < MAX_STEPS; j++)
 	{
 		step = &result->steps[j];
-
-		if (step->img)
-		{
-			cvReleaseImage(&step->img);
-		}
-
+		catcierge_match_step_release(step);
 		step->description = NULL;
 		step->name = NULL;
-		catcierge_path_reset(&step->path);
+		step->path = NULL;
 	}
 
 	result->step_img_count = 0;
@@ -337,36 +507,42 @@ static void catcierge_cleanup_imgs(catcierge_grb_t *grb)
 
 	for (i = 0; i < MATCH_MAX_COUNT; i++)
 	{
-		if (grb->match_group.matches[i].img)
-		{
-			cvReleaseImage(&grb->match_group.matches[i].img);
-		}
+		catcierge_release_snapshot(&grb->match_group.matches[i].frame,
+									&grb->match_group.matches[i].img);
 
 		catcierge_cleanup_match_steps(grb, &grb->match_group.matches[i].result);
 	}
 
-	if (grb->match_group.obstruct_img)
-	{
-		cvReleaseImage(&grb->match_group.obstruct_img);
-	}
+	catcierge_release_snapshot(&grb->match_group.obstruct_frame,
+								&grb->match_group.obstruct_img);
 }
 
-void catcierge_setup_camera(catcierge_grb_t *grb)
+int catcierge_setup_camera(catcierge_grb_t *grb)
 {
 	assert(grb);
 
 	#ifdef RPI
-	grb->capture = raspiCamCvCreateCameraCaptureEx(0, &grb->args.rpi_settings);
-	#else
-	grb->capture = cvCreateCameraCapture(0);
-	cvSetCaptureProperty(grb->capture, CV_CAP_PROP_FRAME_WIDTH, 320);
-	cvSetCaptureProperty(grb->capture, CV_CAP_PROP_FRAME_HEIGHT, 240);
+	grb->args.capture.rpi_settings = &grb->args.rpi_settings;
 	#endif
 
+	// Color is only worth keeping if some saved image is in color.
+	grb->args.capture.keep_color = grb->args.capture.gray && grb->args.saveimg
+		&& (!grb->args.match_encoding.gray
+		 || (grb->args.save_obstruct_img && !grb->args.obstruct_encoding.gray));
+
+	if (catcierge_capture_init(&grb->capture, &grb->args.capture))
+	{
+		CATERR("Failed to setup %s capture\n",
+			catcierge_capture_type_str(grb->capture.type));
+		return -1;
+	}
+
 	if (grb->args.show)
 	{
 		cvNamedWindow("catcierge", 1);
 	}
+
+	return 0;
 }
 
 void catcierge_destroy_camera(catcierge_grb_t *grb)
@@ -376,11 +552,9 @@ void catcierge_destroy_camera(catcierge_grb_t *grb)
 		cvDestroyWindow("catcierge");
 	}
 
-	#ifdef RPI
-	raspiCamCvReleaseCapture(&grb->capture);
-	#else
-	cvReleaseCapture(&grb->capture);
-	#endif
+	// Snapshots of played frames point into the recording.
+	catcierge_cleanup_imgs(grb);
+	catcierge_capture_destroy(&grb->capture);
 }
 
 int catcierge_drop_root_privileges(const char *user)
@@ -422,27 +596,23 @@ int catcierge_setup_gpio(catcierge_grb_t *grb)
 		return 0;
 	}
 
-	// Set export for pins.
-	if (gpio_export(CATCIERGE_LOCKOUT_GPIO)
-	 || gpio_set_direction(CATCIERGE_LOCKOUT_GPIO, OUT))
+	// The pins are kept open so that toggling the lock is a single write.
+	// Start with the door open and light on.
+	if (catcierge_gpio_open(&grb->lockout_gpio, args->gpio_backend,
+			args->gpio_path, args->lockout_gpio_pin, 0))
 	{
 		CATERR("Failed to export and set direction for door pin\n");
 		ret = -1; goto fail;
 	}
 
-	// Start with the door open and light on.
-	gpio_write(CATCIERGE_LOCKOUT_GPIO, 0);
-
 	if (args->backlight_enable)
 	{
-		if (gpio_export(CATCIERGE_BACKLIGHT_GPIO)
-		 || gpio_set_direction(CATCIERGE_BACKLIGHT_GPIO, OUT))
+		if (catcierge_gpio_open(&grb->backlight_gpio, args->gpio_backend,
+				args->gpio_path, args->backlight_gpio_pin, 1))
 		{
 			CATERR("Failed to export and set direction for backlight pin\n");
 			ret = -1; goto fail;
 		}
-	
-		gpio_write(CATCIERGE_BACKLIGHT_GPIO, 1);
 	}
 
 fail:
@@ -472,13 +642,18 @@ fail:
 
 IplImage *catcierge_get_frame(catcierge_grb_t *grb)
 {
+	IplImage *img;
+	double begin;
 	assert(grb);
 
-	#ifdef RPI
-	return raspiCamCvQueryFrame(grb->capture);
-	#else
-	return cvQueryFrame(grb->capture);
-	#endif	
+	catcierge_span_reset(&grb->frame_span);
+	begin = catcierge_span_begin(&grb->frame_span);
+
+	img = catcierge_capture_query_frame(&grb->capture);
+
+	catcierge_span_end(&grb->frame_span, begin);
+
+	return img;
 }
 
 static int catcierge_calculate_match_id(IplImage *img, match_state_t *m)
@@ -521,33 +696,156 @@ static int caticerge_calculate_matchgroup_id(match_group_t *mg, IplImage *img)
 	return 0;
 }
 
-static void catcierge_process_match_result(catcierge_grb_t *grb, IplImage *img)
+// The filename of a match image without the extension.
+static void catcierge_get_match_base_path(match_state_t *m, size_t match_idx,
+										char *buf, size_t bufsize)
+{
+	// TODO: Enable setting this via template variables instead.
+	snprintf(buf,
+		bufsize - 1,
+		"match_%s_%s__%d",
+		m->result.success ? "" : "fail",
+		m->time_str,
+		(int)(match_idx + 1));
+}
+
+static void catcierge_generate_step_paths(catcierge_grb_t *grb, match_state_t *m, size_t match_idx)
 {
 	size_t j;
+	char base_path[1024];
+	match_step_t *step;
+	char *step_gen_output_path = NULL;
+	catcierge_args_t *args = &grb->args;
+
+	// TODO: Move to init instead.
+	if (!args->steps_output_path)
+	{
+		if (!(args->steps_output_path = strdup(args->output_path)))
+		{
+			CATERR("Out of memory");
+		}
+	}
+
+	catcierge_get_match_base_path(m, match_idx, base_path, sizeof(base_path));
+
+	for (j = 0; j < m->result.step_img_count; j++)
+	{
+		if (!(step_gen_output_path = catcierge_output_generate(&grb->output, grb, args->steps_output_path)))
+		{
+			CATERR("Failed to generate step output path from: \"%s\"\n", args->steps_output_path);
+		}
+
+		step = &m->result.steps[j];
+
+		if (!(step->path = catcierge_get_step_path(grb, match_idx, j)))
+		{
+			free(step_gen_output_path);
+			break;
+		}
+
+		snprintf(step->path->dir, sizeof(step->path->dir) - 1,
+			"%s", step_gen_output_path);
+
+		snprintf(step->path->filename, sizeof(step->path->filename) - 1,
+			"%s_%02d_%s.%s",
+			base_path,
+			(int)j,
+			step->name,
+			catcierge_image_encoding_ext(&args->steps_encoding,
+				step->img ? step->img->nChannels : 1));
+
+		snprintf(step->path->full, sizeof(step->path->full) - 1, "%s%s%s",
+			step->path->dir, catcierge_path_sep(), step->path->filename);
+
+		if (step_gen_output_path)
+		{
+			free(step_gen_output_path);
+			step_gen_output_path = NULL;
+		}
+	}
+}
+
+//
+// In lazy steps mode the matcher records no steps while matching. Before
+// saving, the matcher is run again on each saved match frame, this time
+// recording the steps. The matcher is deterministic so the steps are the
+// same as they would have been.
+//
+static void catcierge_derive_lazy_steps(catcierge_grb_t *grb)
+{
+	int i;
+	size_t j;
+	match_state_t *m;
+	match_result_t *tmp = NULL;
+	catcierge_span_t *stages;
+	assert(grb);
+
+	if (!grb->matcher)
+		return;
+
+	if (!(tmp = calloc(1, sizeof(match_result_t))))
+	{
+		CATERR("Out of memory deriving step images\n");
+		return;
+	}
+
+	// Don't count this as matching time.
+	stages = grb->matcher->stages;
+	grb->matcher->stages = NULL;
+
+	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	{
+		m = &grb->match_group.matches[i];
+
+		if (!m->img || (m->result.step_img_count > 0))
+			continue;
+
+		memset(tmp, 0, offsetof(match_result_t, steps));
+		tmp->step_pool = &grb->frame_pool;
+
+		// Frames can be skipped here, so don't track between them.
+		if (grb->matcher->reset)
+		{
+			grb->matcher->reset(grb->matcher);
+		}
+
+		if (grb->matcher->match(grb->matcher, m->img, tmp, STEPS_FULL) < 0.0)
+		{
+			CATERR("%s matcher: Failed to derive step images\n", grb->matcher->name);
+		}
+
+		// Hand over the step images to the match.
+		for (j = 0; j < tmp->step_img_count; j++)
+		{
+			m->result.steps[j] = tmp->steps[j];
+			memset(&tmp->steps[j], 0, sizeof(match_step_t));
+		}
+
+		m->result.step_img_count = tmp->step_img_count;
+		catcierge_generate_step_paths(grb, m, i);
+	}
+
+	grb->matcher->stages = stages;
+	free(tmp);
+}
+
+//
+// Logs the result of a match and generates the paths it is saved to. This
+// depends on the result, so for deferred results it is done once the
+// matcher has filled them in.
+//
+static void catcierge_report_match_result(catcierge_grb_t *grb, size_t match_idx)
+{
 	catcierge_args_t *args = NULL;
 	match_result_t *res = NULL;
  	match_state_t *m = NULL;
 	assert(grb);
-	assert(img);
-	assert(grb->match_group.match_count <= MATCH_MAX_COUNT);
+	assert(match_idx < MATCH_MAX_COUNT);
 	args = &grb->args;
 
-	m = &grb->match_group.matches[grb->match_group.match_count - 1];
+	m = &grb->match_group.matches[match_idx];
 	res = &m->result;
 
-	// Get time of match and format.
-	m->img = NULL;
-	m->time = time(NULL); // TODO: Get rid of this and use tv.tv_sec instead, same thing.
-	gettimeofday(&m->tv, NULL);
-	get_time_str_fmt(m->time, &m->tv, m->time_str,
-		sizeof(m->time_str), FILENAME_TIME_FORMAT);
-
-	// Calculate match id from time + image data.
-	if (catcierge_calculate_match_id(img, m))
-	{
-		CATERR("Failed to calculate match id!\n");
-	}
-
 	log_printc(stdout, (res->success ? COLOR_GREEN : COLOR_RED),
 		"%sMatch %s - %s (%x%x%x%x%x)\n",
 		res->success ? "" : "No ",
@@ -582,16 +880,14 @@ static void catcierge_process_match_result(catcierge_grb_t *grb, IplImage *img)
 			CATERR("Failed to generate match output path from: \"%s\"\n", args->match_output_path);
 		}
 
-		// TODO: Enable setting this via template variables instead.
-		snprintf(base_path,
-			sizeof(base_path) - 1,
-			"match_%s_%s__%d",
-			res->success ? "" : "fail",
-			m->time_str,
-			(int)grb->match_group.match_count);
+		catcierge_get_match_base_path(m, match_idx,
+			base_path, sizeof(base_path));
 
+		// The snapshot is of the color frame if there is one.
 		snprintf(m->path.dir, sizeof(m->path.dir) - 1, "%s", match_gen_output_path);
-		snprintf(m->path.filename, sizeof(m->path.filename) - 1, "%s.png", base_path);
+		snprintf(m->path.filename, sizeof(m->path.filename) - 1, "%s.%s",
+				 base_path, catcierge_image_encoding_ext(&args->match_encoding,
+					m->img ? m->img->nChannels : 1));
 		snprintf(m->path.full, sizeof(m->path.full) - 1, "%s%s%s",
 				 m->path.dir, catcierge_path_sep(), m->path.filename);
 
@@ -600,51 +896,195 @@ static void catcierge_process_match_result(catcierge_grb_t *grb, IplImage *img)
 			free(match_gen_output_path);
 		}
 
-		m->img = cvCloneImage(img);
 		// TODO: Add option to save the image right away also.
 
-		if (args->save_steps)
+		// In lazy mode the steps don't exist until the images are saved.
+		if (args->save_steps && (args->steps_mode != STEPS_LAZY))
 		{
-			match_step_t *step;
-			char *step_gen_output_path = NULL;
+			catcierge_generate_step_paths(grb, m, match_idx);
+		}
+	}
+}
 
-			// TODO: Move to init instead.
-			if (!args->steps_output_path)
-			{
-				if (!(args->steps_output_path = strdup(args->output_path)))
-				{
-					CATERR("Out of memory");
-				}
-			}
+static void catcierge_process_match_result(catcierge_grb_t *grb, IplImage *img)
+{
+	catcierge_args_t *args = NULL;
+ 	match_state_t *m = NULL;
+	assert(grb);
+	assert(img);
+	assert(grb->match_group.match_count <= MATCH_MAX_COUNT);
+	args = &grb->args;
 
-			for (j = 0; j < m->result.step_img_count; j++)
-			{
-				if (!(step_gen_output_path = catcierge_output_generate(&grb->output, grb, args->steps_output_path)))
-				{
-					CATERR("Failed to generate step output path from: \"%s\"\n", args->steps_output_path);
-				}
+	m = &grb->match_group.matches[grb->match_group.match_count - 1];
 
-				step = &m->result.steps[j];
-				snprintf(step->path.dir, sizeof(step->path.dir) - 1,
-					"%s", step_gen_output_path);
+	// Get time of match and format.
+	catcierge_release_snapshot(&m->frame, &m->img);
+	m->time = catcierge_timer_time(&m->tv);
+	get_time_str_fmt(m->time, &m->tv, m->time_str,
+		sizeof(m->time_str), FILENAME_TIME_FORMAT);
 
-				snprintf(step->path.filename, sizeof(step->path.filename) - 1,
-					"%s_%02d_%s.png",
-					base_path,
-					(int)j,
-					step->name);
+	// Calculate match id from time + image data.
+	if (catcierge_calculate_match_id(img, m))
+	{
+		CATERR("Failed to calculate match id!\n");
+	}
 
-				snprintf(step->path.full, sizeof(step->path.full) - 1, "%s%s%s",
-					step->path.dir, catcierge_path_sep(), step->path.filename);
+	// The frame is gone after the next grab, keep it for saving.
+	if (args->saveimg)
+	{
+		m->img = catcierge_snapshot_frame(grb, img, &m->frame);
+	}
 
-				if (step_gen_output_path)
-				{
-					free(step_gen_output_path);
-					step_gen_output_path = NULL;
-				}
+	if (!m->result.deferred)
+	{
+		catcierge_report_match_result(grb, grb->match_group.match_count - 1);
+	}
+}
+
+//
+// Reports the matches that were deferred by the matcher, now that
+// the match_group hook has filled in their results.
+//
+static void catcierge_report_deferred_matches(catcierge_grb_t *grb)
+{
+	size_t i;
+	match_group_t *mg = &grb->match_group;
+	size_t match_count = mg->match_count;
+
+	for (i = 0; i < match_count; i++)
+	{
+		if (!mg->matches[i].result.deferred)
+			continue;
+
+		mg->matches[i].result.deferred = 0;
+
+		// The outputs refer to the last match as the current one.
+		mg->match_count = i + 1;
+		catcierge_report_match_result(grb, i);
+		catcierge_trigger_event(grb, CATCIERGE_MATCH_DONE, 1);
+	}
+
+	mg->match_count = match_count;
+}
+
+// Adds an image to the archive, converted to grayscale if the encoding says so.
+static int catcierge_archive_add_encoded(catcierge_archive_t *ar, const char *name,
+		catcierge_archive_frame_type_t type, IplImage *img,
+		const catcierge_image_encoding_t *enc)
+{
+	int ret;
+	IplImage *tmp = NULL;
+	IplImage *out;
+
+	if (!(out = catcierge_image_encoding_prepare(enc, img, &tmp)))
+	{
+		return -1;
+	}
+
+	ret = catcierge_archive_add(ar, name, type, out);
+
+	if (tmp)
+	{
+		cvReleaseImage(&tmp);
+	}
+
+	return ret;
+}
+
+// Appends all images of the match group to the archive in one write.
+static int catcierge_archive_images(catcierge_grb_t *grb)
+{
+	int ret = 0;
+	int i;
+	size_t j;
+	char id[48];
+	char *archive_path = NULL;
+	catcierge_args_t *args = &grb->args;
+	match_group_t *mg = &grb->match_group;
+	catcierge_archive_t *ar = &grb->archive;
+	match_state_t *m;
+	match_step_t *step;
+
+	if (!(archive_path = catcierge_output_generate(&grb->output, grb, args->archive_path)))
+	{
+		CATERR("Failed to generate archive path from: \"%s\"\n", args->archive_path);
+		return -1;
+	}
+
+	// A new archive is started whenever the generated path changes.
+	if (!ar->path || strcmp(ar->path, archive_path))
+	{
+		char *dir_end = strrchr(archive_path, catcierge_path_sep()[0]);
+
+		if (dir_end)
+		{
+			*dir_end = '\0';
+			catcierge_make_path("%s", archive_path);
+			*dir_end = catcierge_path_sep()[0];
+		}
+
+		if (catcierge_archive_open(ar, archive_path))
+		{
+			ret = -1; goto fail;
+		}
+
+		CATLOG("Archiving images to %s\n", ar->path);
+	}
+
+	snprintf(id, sizeof(id), "%x%x%x%x%x",
+		mg->sha.Message_Digest[0],
+		mg->sha.Message_Digest[1],
+		mg->sha.Message_Digest[2],
+		mg->sha.Message_Digest[3],
+		mg->sha.Message_Digest[4]);
+
+	if (catcierge_archive_begin(ar, id, &mg->start_tv, 1 + MATCH_MAX_COUNT * (1 + MAX_STEPS)))
+	{
+		ret = -1; goto fail;
+	}
+
+	if (args->save_obstruct_img && mg->obstruct_img)
+	{
+		ret |= catcierge_archive_add_encoded(ar, mg->obstruct_path.filename,
+					CATCIERGE_ARCHIVE_OBSTRUCT, mg->obstruct_img, &args->obstruct_encoding);
+	}
+
+	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	{
+		m = &mg->matches[i];
+
+		if (m->img)
+		{
+			ret |= catcierge_archive_add_encoded(ar, m->path.filename,
+						CATCIERGE_ARCHIVE_MATCH, m->img, &args->match_encoding);
+		}
+
+		if (!args->save_steps)
+			continue;
+
+		for (j = 0; j < m->result.step_img_count; j++)
+		{
+			step = &m->result.steps[j];
+
+			if (step->img && step->path)
+			{
+				ret |= catcierge_archive_add_encoded(ar, step->path->filename,
+							CATCIERGE_ARCHIVE_STEP, step->img, &args->steps_encoding);
 			}
 		}
 	}
+
+	if (ret || catcierge_archive_commit(ar))
+	{
+		ret = -1; goto fail;
+	}
+
+	CATLOG("Archived match group %s to %s\n", id, ar->path);
+
+fail:
+	free(archive_path);
+
+	return ret;
 }
 
 static void catcierge_save_images(catcierge_grb_t *grb, match_direction_t direction)
@@ -654,20 +1094,40 @@ static void catcierge_save_images(catcierge_grb_t *grb, match_direction_t direct
 	match_result_t *res;
 	int i;
 	size_t j;
+	int archived = 0;
 	catcierge_args_t *args;
 	match_step_t *step = NULL;
+	double begin;
 	assert(grb);
 	args = &grb->args;
 
+	begin = catcierge_span_begin(&mg->spans[CATCIERGE_SPAN_SAVE]);
+
+	if (args->save_steps && (args->steps_mode == STEPS_LAZY))
+	{
+		catcierge_derive_lazy_steps(grb);
+	}
+
+	if (args->archive_path)
+	{
+		if (!(archived = !catcierge_archive_images(grb)))
+		{
+			CATERR("Failed to archive images, saving them as separate files instead\n");
+		}
+	}
+
 	if (args->save_obstruct_img)
 	{
-		CATLOG("Saving obstruct image: %s\n", mg->obstruct_path.full);
-		catcierge_make_path(mg->obstruct_path.dir);
-		cvSaveImage(mg->obstruct_path.full, mg->obstruct_img, 0);
+		if (!archived)
+		{
+			CATLOG("Saving obstruct image: %s\n", mg->obstruct_path.full);
+			catcierge_make_path(mg->obstruct_path.dir);
+			catcierge_save_image(mg->obstruct_path.full, mg->obstruct_img, &args->obstruct_encoding);
+		}
 		// TODO: Save obstruct step images as well?
 		// TODO: Add execute event for this?
 
-		cvReleaseImage(&mg->obstruct_img);
+		catcierge_release_snapshot(&mg->obstruct_frame, &mg->obstruct_img);
 	}
 
 	for (i = 0; i < MATCH_MAX_COUNT; i++)
@@ -675,29 +1135,37 @@ static void catcierge_save_images(catcierge_grb_t *grb, match_direction_t direct
 		m = &grb->match_group.matches[i];
 		res = &m->result;
 
-		CATLOG("Saving image %s\n", m->path.full);
-		catcierge_make_path(m->path.dir);
-		cvSaveImage(m->path.full, m->img, 0);
+		if (!archived)
+		{
+			CATLOG("Saving image %s\n", m->path.full);
+			catcierge_make_path(m->path.dir);
+			catcierge_save_image(m->path.full, m->img, &args->match_encoding);
+		}
 
-		if (args->save_steps)
+		if (args->save_steps && !archived)
 		{
 			for (j = 0; j < m->result.step_img_count; j++)
 			{
 				step = &m->result.steps[j];
-				CATLOG("  %02d %-34s  %s\n", (int)j, step->description, step->path.full);
 
-				if (step->img)
+				if (step->img && step->path)
 				{
-					catcierge_make_path(step->path.dir);
-					cvSaveImage(step->path.full, step->img, NULL);
+					CATLOG("  %02d %-34s  %s\n", (int)j, step->description, step->path->full);
+					catcierge_make_path(step->path->dir);
+					catcierge_save_image(step->path->full, step->img, &args->steps_encoding);
 				}
 			}
 		}
 
+		// Don't count the event commands as saving time.
+		catcierge_span_end(&mg->spans[CATCIERGE_SPAN_SAVE], begin);
 		catcierge_trigger_event(grb, CATCIERGE_SAVE_IMG, 1);
+		begin = catcierge_span_begin(&mg->spans[CATCIERGE_SPAN_SAVE]);
 
-		cvReleaseImage(&m->img);
+		catcierge_release_snapshot(&m->frame, &m->img);
 	}
+
+	catcierge_span_end(&mg->spans[CATCIERGE_SPAN_SAVE], begin);
 }
 
 static int catcierge_check_max_consecutive_lockouts(catcierge_grb_t *grb)
@@ -833,7 +1301,7 @@ static void catcierge_show_image(catcierge_grb_t *grb)
 	match_state_t *m;
 	match_result_t *res;
 	IplImage *img;
-	IplImage *tmp_img = NULL;
+	catcierge_frame_t *tmp_frame = NULL;
 	assert(grb);
 	args = &grb->args;
 
@@ -854,7 +1322,11 @@ static void catcierge_show_image(catcierge_grb_t *grb)
 
 			// We don't want to mess with the original image when
 			// drawing the match rects since that might interfer with the match.
-			tmp_img = cvCloneImage(grb->img);
+			// (Or with a snapshot sharing its pixels).
+			if (!(tmp_frame = catcierge_frame_pool_copy(&grb->frame_pool, grb->img)))
+			{
+				return;
+			}
 
 			// TODO: Hmmm this should not be -1 I think?
 			m = &grb->match_group.matches[grb->match_group.match_count - 1];
@@ -869,19 +1341,16 @@ static void catcierge_show_image(catcierge_grb_t *grb)
 			// Always highlight when showing in GUI.
 			for (i = 0; i < res->rect_count; i++)
 			{
-				cvRectangleR(tmp_img, res->match_rects[i], match_color, 2, 8, 0);
+				cvRectangleR(tmp_frame->img, res->match_rects[i], match_color, 2, 8, 0);
 			}
 
-			img = tmp_img;
+			img = tmp_frame->img;
 		}
 
 		cvShowImage("catcierge", img);
 		cvWaitKey(10);
 
-		if (tmp_img)
-		{
-			cvReleaseImage(&tmp_img);
-		}
+		catcierge_frame_unref(&tmp_frame);
 	}
 }
 
@@ -892,6 +1361,7 @@ double catcierge_do_match(catcierge_grb_t *grb)
 	match_group_t *mg = &grb->match_group;
 	match_result_t *result;
 	match_state_t *match;
+	double begin;
 	assert(grb);
 	assert(mg->match_count <= MATCH_MAX_COUNT);
 	args = &grb->args;
@@ -900,13 +1370,22 @@ double catcierge_do_match(catcierge_grb_t *grb)
 	match = &mg->matches[mg->match_count - 1];
 	result = &match->result;
 	catcierge_cleanup_match_steps(grb, result);
-	memset(result, 0, sizeof(match_result_t));
+	memset(result, 0, offsetof(match_result_t, steps));
+	result->description[0] = '\0';
+	result->step_pool = &grb->frame_pool;
+	catcierge_span_reset(&match->span);
 
-	if ((match_res = grb->matcher->match(grb->matcher, grb->img, result, args->save_steps)) < 0.0)
+	begin = catcierge_span_begin(&match->span);
+
+	if ((match_res = grb->matcher->match(grb->matcher, grb->img, result,
+			catcierge_get_match_steps_mode(args))) < 0.0)
 	{
 		CATERR("%s matcher: Error when matching frame!\n", grb->matcher->name);
 	}
 
+	catcierge_span_end(&match->span, begin);
+	catcierge_span_add(&mg->spans[CATCIERGE_SPAN_MATCH], &match->span);
+
 	return match_res;
 }
 
@@ -966,10 +1445,10 @@ static match_direction_t catcierge_guess_overall_direction(catcierge_grb_t *grb)
 
 void catcierge_match_group_start(match_group_t *mg, IplImage *img)
 {
+	int i;
 	assert(mg);
 
-	gettimeofday(&mg->start_tv, NULL);
-	mg->start_time = time(NULL);
+	mg->start_time = catcierge_timer_time(&mg->start_tv);
 
 	memset(&mg->end_tv, 0, sizeof(mg->end_tv));
 	mg->end_time = 0;
@@ -978,6 +1457,12 @@ void catcierge_match_group_start(match_group_t *mg, IplImage *img)
 	catcierge_path_reset(&mg->obstruct_path);
 	mg->match_count = 0;
 	mg->final_decision = 0;
+	mg->active = 1;
+
+	for (i = 0; i < CATCIERGE_SPAN_COUNT; i++)
+	{
+		catcierge_span_reset(&mg->spans[i]);
+	}
 
 	// We base the matchgroup id on the obstruct image + timestamp.
 	caticerge_calculate_matchgroup_id(mg, img);
@@ -991,30 +1476,117 @@ void catcierge_match_group_start(match_group_t *mg, IplImage *img)
 		mg->sha.Message_Digest[4]);
 	CATLOG("\n");
 
-	if (mg->obstruct_img)
-	{
-		cvReleaseImage(&mg->obstruct_img);
-	}
+	catcierge_release_snapshot(&mg->obstruct_frame, &mg->obstruct_img);
 }
 
 void catcierge_match_group_end(match_group_t *mg)
 {
 	assert(mg);
 
-	gettimeofday(&mg->end_tv, NULL);
-	mg->end_time = time(NULL);
+	mg->end_time = catcierge_timer_time(&mg->end_tv);
+}
+
+double catcierge_match_group_lock_latency(match_group_t *mg)
+{
+	catcierge_span_t *capture;
+	catcierge_span_t *lock;
+	assert(mg);
+
+	capture = &mg->spans[CATCIERGE_SPAN_CAPTURE];
+	lock = &mg->spans[CATCIERGE_SPAN_LOCK];
+
+	// No lockout was done for this match group.
+	if ((lock->end == 0.0) || (capture->start == 0.0))
+		return 0.0;
+
+	return (lock->end - capture->start);
+}
+
+static void catcierge_record_span_stats(catcierge_grb_t *grb)
+{
+	match_group_t *mg = &grb->match_group;
+	double lock_latency;
+	int i;
+	assert(grb);
+
+	for (i = 0; i < CATCIERGE_SPAN_COUNT; i++)
+	{
+		if (mg->spans[i].start != 0.0)
+		{
+			catcierge_histogram_add(&grb->span_hist[i], mg->spans[i].duration);
+		}
+	}
+
+	if ((lock_latency = catcierge_match_group_lock_latency(mg)) > 0.0)
+	{
+		CATLOG("Lockout latency from obstruct frame capture: %.2f ms\n",
+			lock_latency * 1000.0);
+		catcierge_histogram_add(&grb->lock_latency_hist, lock_latency);
+	}
+}
+
+void catcierge_print_span_stats(catcierge_grb_t *grb)
+{
+	int i;
+	assert(grb);
+
+	CATLOG("Match group stage timings:\n");
+
+	for (i = 0; i < CATCIERGE_SPAN_COUNT; i++)
+	{
+		catcierge_histogram_print(stdout, &grb->span_hist[i], catcierge_get_span_str(i));
+	}
+
+	catcierge_histogram_print(stdout, &grb->lock_latency_hist, "latency");
+
+	if (grb->wake_latency_hist.count > 0)
+	{
+		catcierge_histogram_print(stdout, &grb->wake_latency_hist, "wake");
+	}
+
+	catcierge_print_mem_stats(grb);
+}
+
+void catcierge_print_mem_stats(catcierge_grb_t *grb)
+{
+	catcierge_mem_stats_t stats;
+	catcierge_mem_stats_t *start = &grb->mem_stats_start;
+	assert(grb);
+
+	catcierge_get_mem_stats(&stats);
+
+	// Growth is relative to when the state machine started, a leak
+	// shows up as a steady climb between the reports.
+	CATLOG("Memory use: RSS %ld kB (%+ld kB), heap %ld kB (%+ld kB)\n",
+		stats.rss_kb, ((start->rss_kb < 0) ? 0 : (stats.rss_kb - start->rss_kb)),
+		stats.heap_kb, ((start->heap_kb < 0) ? 0 : (stats.heap_kb - start->heap_kb)));
 }
 
 void catcierge_decide_lock_status(catcierge_grb_t *grb)
 {
 	match_group_t *mg = &grb->match_group;
 	catcierge_args_t *args = &grb->args;
+	catcierge_span_t *decide_span = &mg->spans[CATCIERGE_SPAN_DECIDE];
+	double begin;
 	assert(grb);
 	int i;
 
+	begin = catcierge_span_begin(decide_span);
+
 	mg->success = 0;
 	mg->success_count = 0;
 
+	// Matchers that batch the frames only have the results now.
+	if (grb->matcher->match_group)
+	{
+		if (grb->matcher->match_group(grb->matcher, mg))
+		{
+			CATERR("%s matcher: Error when matching the match group!\n", grb->matcher->name);
+		}
+
+		catcierge_report_deferred_matches(grb);
+	}
+
 	for (i = 0; i < MATCH_MAX_COUNT; i++)
 	{
 		mg->success_count += !!mg->matches[i].result.success;
@@ -1056,6 +1628,8 @@ void catcierge_decide_lock_status(catcierge_grb_t *grb)
 		}
 	}
 
+	catcierge_span_end(decide_span, begin);
+
 	if (mg->success)
 	{
 		snprintf(mg->description, sizeof(mg->description) - 1, "Everything OK!");
@@ -1111,6 +1685,9 @@ void catcierge_decide_lock_status(catcierge_grb_t *grb)
 
 	catcierge_trigger_event(grb, CATCIERGE_MATCH_GROUP_DONE, 1);
 
+	catcierge_record_span_stats(grb);
+	mg->active = 0;
+
 	assert(mg->match_count <= MATCH_MAX_COUNT);
 }
 
@@ -1122,16 +1699,11 @@ void catcierge_save_obstruct_image(catcierge_grb_t *grb)
 		char time_str[1024];
 		catcierge_args_t *args = &grb->args;
 		match_group_t *mg = &grb->match_group;
+		double begin = catcierge_span_begin(&mg->spans[CATCIERGE_SPAN_SAVE]);
 
-		if (mg->obstruct_img)
-		{
-			cvReleaseImage(&mg->obstruct_img);
-		}
-
-		mg->obstruct_img = cvCloneImage(grb->img);
+		mg->obstruct_img = catcierge_snapshot_frame(grb, grb->img, &mg->obstruct_frame);
 
-		mg->obstruct_time = time(NULL);
-		gettimeofday(&mg->obstruct_tv, NULL);
+		mg->obstruct_time = catcierge_timer_time(&mg->obstruct_tv);
 		get_time_str_fmt(mg->obstruct_time, &mg->obstruct_tv, time_str,
 			sizeof(time_str), FILENAME_TIME_FORMAT);
 
@@ -1152,7 +1724,8 @@ void catcierge_save_obstruct_image(catcierge_grb_t *grb)
 
 		snprintf(mg->obstruct_path.dir, sizeof(mg->obstruct_path.dir) - 1, "%s", gen_output_path);
 		snprintf(mg->obstruct_path.filename, sizeof(mg->obstruct_path.filename) - 1,
-			"match_obstruct_%s.png", time_str);
+			"match_obstruct_%s.%s", time_str,
+			catcierge_image_encoding_ext(&args->obstruct_encoding, mg->obstruct_img->nChannels));
 
 		snprintf(mg->obstruct_path.full, sizeof(mg->obstruct_path.full) - 1, "%s%s%s",
 				 mg->obstruct_path.dir, catcierge_path_sep(), mg->obstruct_path.filename);
@@ -1161,6 +1734,8 @@ void catcierge_save_obstruct_image(catcierge_grb_t *grb)
 		{
 			free(gen_output_path);
 		}
+
+		catcierge_span_end(&mg->spans[CATCIERGE_SPAN_SAVE], begin);
 	}
 }
 
@@ -1171,6 +1746,10 @@ void catcierge_fsm_start(catcierge_grb_t *grb)
 	catcierge_timer_set(&grb->frame_timer, 1.0);
 	catcierge_timer_set(&grb->startup_timer, grb->args.startup_delay);
 	catcierge_timer_start(&grb->startup_timer);
+
+	catcierge_get_mem_stats(&grb->mem_stats_start);
+	catcierge_timer_set(&grb->mem_stats_timer, grb->args.mem_stats_interval);
+	catcierge_timer_start(&grb->mem_stats_timer);
 }
 
 #ifdef WITH_ZMQ
@@ -1388,6 +1967,8 @@ int catcierge_state_matching(catcierge_grb_t *grb)
 
 	grb->match_group.match_count++;
 
+	catcierge_span_add(&mg->spans[CATCIERGE_SPAN_CAPTURE], &grb->frame_span);
+
 	// We have something to match against.
 	if (catcierge_do_match(grb) < 0)
 	{
@@ -1396,7 +1977,11 @@ int catcierge_state_matching(catcierge_grb_t *grb)
 
 	catcierge_process_match_result(grb, grb->img);
 
-	catcierge_trigger_event(grb, CATCIERGE_MATCH_DONE, 1);
+	// Deferred results are reported when the lock is decided.
+	if (!mg->matches[mg->match_count - 1].result.deferred)
+	{
+		catcierge_trigger_event(grb, CATCIERGE_MATCH_DONE, 1);
+	}
 
 	catcierge_show_image(grb);
 
@@ -1413,9 +1998,35 @@ int catcierge_state_matching(catcierge_grb_t *grb)
 	return 0;
 }
 
+static void catcierge_recalibrate_roi(catcierge_grb_t *grb, int scale)
+{
+	CvRect roi;
+	catcierge_args_t *args = &grb->args;
+
+	// The ROI is only ever changed from here, between two obstruction
+	// checks, so the matcher never sees a partially updated one.
+	if (catcierge_autoroi_poll(&grb->autoroi, &args->roi, &roi))
+	{
+		grb->prev_roi = args->roi;
+		args->roi = roi;
+
+		CATLOG("Back light moved, new obstruction ROI: x: %d y: %d w: %d h: %d\n",
+				roi.x, roi.y, roi.width, roi.height);
+
+		catcierge_trigger_event(grb, CATCIERGE_ROI_CHANGED, 1);
+	}
+
+	if (catcierge_autoroi_submit(&grb->autoroi, grb->img, scale) < 0)
+	{
+		CATERR("Failed to start back light recalibration\n");
+	}
+}
+
 int catcierge_state_waiting(catcierge_grb_t *grb)
 {
 	int frame_obstructed;
+	int scale;
+	double begin;
 	catcierge_args_t *args = &grb->args;
 	match_group_t *mg = &grb->match_group;
 	assert(grb);
@@ -1449,21 +2060,96 @@ int catcierge_state_waiting(catcierge_grb_t *grb)
 						args->roi.x, args->roi.y,
 						args->roi.width, args->roi.height);
 		}
+
+		if (args->auto_roi && (args->auto_roi_interval > 0.0))
+		{
+			if (catcierge_autoroi_init(&grb->autoroi, grb->matcher,
+					args->auto_roi_interval, args->auto_roi_tolerance))
+			{
+				CATERR("Failed to start back light recalibration, keeping the ROI fixed\n");
+			}
+		}
+	}
+
+	scale = catcierge_capture_frame_scale(&grb->capture, grb->img);
+
+	if (grb->waking)
+	{
+		// The idle frames already on their way are skipped,
+		// only full frames are matched.
+		if (scale > 1)
+		{
+			return 0;
+		}
+
+		grb->waking = 0;
+		catcierge_histogram_add(&grb->wake_latency_hist, grb->capture.wake_latency);
+		CATLOG("Full frames after %0.1f ms\n", grb->capture.wake_latency * 1000.0);
+	}
+	else if ((grb->capture.idle_scale > 1) && !grb->capture.idle)
+	{
+		if (catcierge_capture_set_idle(&grb->capture, 1))
+		{
+			CATERR("Idle capture is not possible with this capture, turning it off\n");
+			grb->capture.idle_scale = 0;
+		}
 	}
 
 	// Wait until the middle of the frame is black
 	// before we try to match anything.
-	if ((frame_obstructed = grb->matcher->is_obstructed(grb->matcher, grb->img)) < 0)
+	catcierge_span_reset(&grb->obstruct_span);
+	begin = catcierge_span_begin(&grb->obstruct_span);
+
+	grb->matcher->args->frame_scale = scale;
+	frame_obstructed = grb->matcher->is_obstructed(grb->matcher, grb->img);
+	grb->matcher->args->frame_scale = 1;
+
+	if (frame_obstructed < 0)
 	{
 		CATERR("Failed to perform check for obstructed frame\n"); return -1;
 	}
 
+	catcierge_span_end(&grb->obstruct_span, begin);
+
+	if (!frame_obstructed && catcierge_autoroi_active(&grb->autoroi))
+	{
+		catcierge_recalibrate_roi(grb, scale);
+	}
+
+	if (frame_obstructed && (scale > 1))
+	{
+		CATLOG("Something in frame! Switching to full frames...\n");
+
+		if (catcierge_capture_set_idle(&grb->capture, 0))
+		{
+			CATERR("Failed to switch to full frames\n"); return -1;
+		}
+
+		// Keep the capture time of this frame for the lock latency.
+		grb->wake_span = grb->frame_span;
+		grb->waking = 1;
+		return 0;
+	}
+
 	if (frame_obstructed)
 	{
 		CATLOG("Something in frame! Start matching...\n");
 
 		catcierge_match_group_start(mg, grb->img);
 
+		if (grb->matcher->reset)
+		{
+			grb->matcher->reset(grb->matcher);
+		}
+
+		// The lock latency is measured from when the obstructed frame was captured.
+		catcierge_span_add(&mg->spans[CATCIERGE_SPAN_CAPTURE], &grb->frame_span);
+		catcierge_span_add(&mg->spans[CATCIERGE_SPAN_OBSTRUCT], &grb->obstruct_span);
+
+		// Including the idle frame it was first seen in.
+		catcierge_span_add(&mg->spans[CATCIERGE_SPAN_CAPTURE], &grb->wake_span);
+		catcierge_span_reset(&grb->wake_span);
+
 		// Save the obstruct image.
 		catcierge_save_obstruct_image(grb);
 
@@ -1534,6 +2220,11 @@ int catcierge_grabber_init(catcierge_grb_t *grb)
 	assert(grb);
 
 	memset(grb, 0, sizeof(catcierge_grb_t));
+	#ifdef RPI
+	catcierge_gpio_init(&grb->lockout_gpio);
+	catcierge_gpio_init(&grb->backlight_gpio);
+	#endif
+	catcierge_archive_init(&grb->archive);
 	#if 0
 	if (catcierge_args_init(&grb->args))
 	{
@@ -1548,5 +2239,25 @@ void catcierge_grabber_destroy(catcierge_grb_t *grb)
 {
 	// Always make sure we unlock.
 	catcierge_do_unlock(grb);
+	catcierge_autoroi_destroy(&grb->autoroi);
 	catcierge_cleanup_imgs(grb);
+	catcierge_frame_pool_destroy(&grb->frame_pool);
+	catcierge_xfree(&grb->step_paths);
+
+	#ifdef RPI
+	catcierge_gpio_close(&grb->lockout_gpio);
+	catcierge_gpio_close(&grb->backlight_gpio);
+	#endif
+
+	catcierge_archive_destroy(&grb->archive);
+
+	if (grb->span_hist[CATCIERGE_SPAN_CAPTURE].count > 0)
+	{
+		catcierge_print_span_stats(grb);
+	}
+
+	#ifdef WITH_RFID
+	catcierge_rfid_allowed_print_stats(grb->rfid_allowed);
+	catcierge_rfid_allowed_destroy(&grb->rfid_allowed);
+	#endif
 }
@@ -21,6 +21,7 @@
 
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
+#include <signal.h>
 
 #include <catcierge_config.h>
 #include "catcierge_util.h"
@@ -28,6 +29,9 @@
 #include "catcierge_haar_matcher.h"
 #include "catcierge_timer.h"
 #include "catcierge_args.h"
+#include "catcierge_capture.h"
+#include "catcierge_archive.h"
+#include "catcierge_autoroi.h"
 #include "catcierge_types.h"
 #include "catcierge_output_types.h"
 
@@ -43,6 +47,7 @@
 // TODO: Move this to catcierge_types.h instead
 #ifdef WITH_RFID
 #include "catcierge_rfid.h"
+#include "catcierge_rfid_allowed.h"
 
 typedef struct rfid_match_s
 {
@@ -52,6 +57,7 @@ typedef struct rfid_match_s
 	int complete;			// Is the data complete?
 	const char *time_str;	// Time of match.
 	int is_allowed;			// Is the RFID in the allowed list?
+	struct timeval tv;		// When the first byte of the tag arrived (monotonic clock).
 } rfid_match_t;
 #endif // WITH_RFID
 
@@ -74,13 +80,11 @@ typedef struct catcierge_grb_s
 
 	int running;
 
-	#ifdef RPI
-	RaspiCamCvCapture *capture;
-	#else
-	CvCapture *capture;
-	#endif
+	catcierge_capture_t capture;
 
 	IplImage *img; // The current camera frame.
+	catcierge_frame_pool_t frame_pool; // Buffers for frames kept after the next grab.
+	catcierge_path_t *step_paths;	// Paths of saved step images, allocated on first use.
 
 	catcierge_matcher_t *matcher;
 	
@@ -94,7 +98,27 @@ typedef struct catcierge_grb_s
 	catcierge_timer_t frame_timer;
 	catcierge_timer_t startup_timer;
 
+	catcierge_autoroi_t autoroi;	// Recalibrates the --auto_roi area while waiting.
+	CvRect prev_roi;				// The ROI before it was last recalibrated.
+
+	catcierge_span_t frame_span;		// Time spent grabbing the current frame.
+	catcierge_span_t obstruct_span;		// Time spent checking the current frame for obstruction.
+	catcierge_histogram_t span_hist[CATCIERGE_SPAN_COUNT]; // Per stage timings of all match groups.
+	catcierge_histogram_t lock_latency_hist; // Obstruct frame capture until the lock is actuated.
+	catcierge_histogram_t wake_latency_hist; // Switching from idle to full frames.
+	int waking;							// Waiting for full frames after an obstructed idle frame.
+	catcierge_span_t wake_span;			// Capture time of that idle frame.
+	volatile sig_atomic_t print_span_stats; // Set from the signal handler to print the histograms.
+	catcierge_mem_stats_t mem_stats_start;	// Memory use when the state machine started.
+	catcierge_timer_t mem_stats_timer;		// Logs the memory use every --mem_stats_interval.
+
+	#ifdef RPI
+	catcierge_gpio_t lockout_gpio;
+	catcierge_gpio_t backlight_gpio;
+	#endif // RPI
+
 	catcierge_output_t output;
+	catcierge_archive_t archive;		// Saved images are appended here if --archive is used.
 
 	#ifdef WITH_RFID
 	char *rfid_inner_path;
@@ -106,8 +130,8 @@ typedef struct catcierge_grb_s
 	match_direction_t rfid_direction;	// Direction that is determined based on which RFID reader gets triggered first.
 	rfid_match_t rfid_in_match;			// Match struct for the inner RFID reader.
 	rfid_match_t rfid_out_match;		// Match struct for the outer RFID reader.
-	char **rfid_allowed;				// The list of allowed RFID chips.
-	size_t rfid_allowed_count;
+	catcierge_rfid_allowed_t *rfid_allowed;	// The set of allowed RFID chips.
+	volatile sig_atomic_t reload_rfid_allowed; // Set from the signal handler to reload the allowed set.
 	int lock_on_invalid_rfid;			// Should we lock when no or an invalid RFID tag is found?
 	double rfid_lock_time;				// The time after a camera match has been made until we check the RFID readers. (In seconds).
 	int checked_rfid_lock;				// Did we check if we should do an RFID lock during this match timeout?
@@ -133,9 +157,15 @@ int catcierge_setup_gpio(catcierge_grb_t *grb);
 int catcierge_grabber_init(catcierge_grb_t *grb);
 void catcierge_grabber_destroy(catcierge_grb_t *grb);
 #ifdef WITH_RFID
-void catcierge_init_rfid_readers(catcierge_grb_t *grb);
+int catcierge_init_rfid_readers(catcierge_grb_t *grb);
+void catcierge_destroy_rfid_readers(catcierge_grb_t *grb);
+int catcierge_load_rfid_allowed(catcierge_grb_t *grb);
 #endif
-void catcierge_setup_camera(catcierge_grb_t *grb);
+int catcierge_setup_camera(catcierge_grb_t *grb);
+catcierge_path_t *catcierge_get_step_path(catcierge_grb_t *grb, size_t match_idx, size_t step_idx);
+double catcierge_match_group_lock_latency(match_group_t *mg);
+void catcierge_print_span_stats(catcierge_grb_t *grb);
+void catcierge_print_mem_stats(catcierge_grb_t *grb);
 void catcierge_set_state(catcierge_grb_t *grb, catcierge_state_func_t new_state);
 void catcierge_run_state(catcierge_grb_t *grb);
 int catcierge_drop_root_privileges(const char *user);
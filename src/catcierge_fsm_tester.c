@@ -26,17 +26,31 @@
 #include "catcierge_config.h"
 #include "catcierge_args.h"
 #include "catcierge_output.h"
+#include "catcierge_util.h"
 #include "test/catcierge_test_common.h"
 #include "catcierge_strftime.h"
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
 
+#ifndef _WIN32
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#endif
+
 #ifdef WITH_ZMQ
 #include <czmq.h>
 #endif
 
 #define MAX_IMG_PATHS 4
 
+typedef struct fsm_tester_image_s
+{
+	char *path;
+	struct timeval tv;	// Time the image was recorded, 0 if unknown.
+	int index;			// Match index within the match group, -1 if unknown.
+} fsm_tester_image_t;
+
 typedef struct fsm_tester_ctx_s
 {
 	char *img_paths[MAX_IMG_PATHS];
@@ -44,6 +58,13 @@ typedef struct fsm_tester_ctx_s
 	double delay;
 	int keep_running;
 	int keep_obstructing;
+
+	int replay;
+	double frame_interval;
+	char *replay_dir;
+	fsm_tester_image_t *replay_images;
+	size_t replay_count;
+	size_t replay_alloc;
 } fsm_tester_ctx_t;
 
 fsm_tester_ctx_t ctx;
@@ -103,9 +124,326 @@ static int add_fsm_tester_args(catcierge_args_t *args)
 	// uses variables internal to that. But we still group it with these settings.
 	ret |= cargo_group_add_option(cargo, "fsm", "--base_time");
 
+	ret |= cargo_add_group(cargo, 0,
+			"replay", "Replay Settings",
+			"Replay recorded match groups on a virtual clock instead of "
+			"the system clock. Time only advances for each frame that is "
+			"passed to the state machine, so timeouts such as the lockout "
+			"time pass instantly.\n"
+			"The time of each image is taken from its filename as saved by "
+			"catcierge (match_[fail]_%Y-%m-%d_%H_%M_%S.%f__<index>.png), "
+			"for other images and the clear frames in between the clock is "
+			"advanced by --frame_interval.");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<replay> --replay",
+			"Use the virtual clock.",
+			"b", &ctx.replay);
+
+	ctx.frame_interval = 0.1;
+	ret |= cargo_add_option(cargo, 0,
+			"<replay> --frame_interval",
+			"Seconds the virtual clock is advanced for frames without a "
+			"recorded time.",
+			"d", &ctx.frame_interval);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<replay> --replay_dir",
+			"Replay all match groups found in a directory (recursively) "
+			"in the order they were recorded. Implies --replay.",
+			"s", &ctx.replay_dir);
+
 	return ret;
 }
 
+// Parses the recorded time and match index from a saved match image filename
+// such as "match_fail_2014-06-08_15_10_03.123456__0.png".
+static int parse_match_filename(const char *path, struct timeval *tv, int *index)
+{
+	const char *name;
+	const char *idx_str;
+	struct tm tm;
+	long usec = 0;
+	int n = 0;
+	int success;
+
+	memset(tv, 0, sizeof(*tv));
+	*index = -1;
+
+	if (!(name = catcierge_parse_match_filename_label(path, &success)))
+		return -1;
+
+	memset(&tm, 0, sizeof(tm));
+
+	if (sscanf(name, "%4d-%2d-%2d_%2d_%2d_%2d%n",
+		&tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+		&tm.tm_hour, &tm.tm_min, &tm.tm_sec, &n) != 6)
+	{
+		return -1;
+	}
+
+	if (name[n] == '.')
+	{
+		sscanf(&name[n + 1], "%6ld", &usec);
+	}
+
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	tm.tm_isdst = -1;
+
+	if ((tv->tv_sec = mktime(&tm)) == -1)
+	{
+		tv->tv_sec = 0;
+		return -1;
+	}
+
+	tv->tv_usec = usec;
+
+	if ((idx_str = strstr(name, "__")))
+	{
+		*index = atoi(idx_str + 2);
+	}
+
+	return 0;
+}
+
+static int compare_replay_images(const void *a, const void *b)
+{
+	const fsm_tester_image_t *ia = (const fsm_tester_image_t *)a;
+	const fsm_tester_image_t *ib = (const fsm_tester_image_t *)b;
+
+	if (ia->tv.tv_sec != ib->tv.tv_sec)
+		return (ia->tv.tv_sec < ib->tv.tv_sec) ? -1 : 1;
+
+	if (ia->tv.tv_usec != ib->tv.tv_usec)
+		return (ia->tv.tv_usec < ib->tv.tv_usec) ? -1 : 1;
+
+	if (ia->index != ib->index)
+		return (ia->index < ib->index) ? -1 : 1;
+
+	return strcmp(ia->path, ib->path);
+}
+
+#ifndef _WIN32
+static int add_replay_image(const char *path)
+{
+	fsm_tester_image_t *img;
+
+	if (ctx.replay_count == ctx.replay_alloc)
+	{
+		size_t new_alloc = ctx.replay_alloc ? (2 * ctx.replay_alloc) : 256;
+		fsm_tester_image_t *tmp;
+
+		if (!(tmp = realloc(ctx.replay_images, new_alloc * sizeof(fsm_tester_image_t))))
+		{
+			fprintf(stderr, "Out of memory!\n");
+			return -1;
+		}
+
+		ctx.replay_images = tmp;
+		ctx.replay_alloc = new_alloc;
+	}
+
+	img = &ctx.replay_images[ctx.replay_count];
+
+	if (parse_match_filename(path, &img->tv, &img->index))
+	{
+		// Not a match image, the obstruct images are not replayed.
+		return 0;
+	}
+
+	if (!(img->path = strdup(path)))
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+
+	ctx.replay_count++;
+
+	return 0;
+}
+
+static int find_replay_images(const char *dir_path)
+{
+	int ret = 0;
+	DIR *dir = NULL;
+	struct dirent *entry;
+	struct stat st;
+	char path[PATH_MAX];
+
+	if (!(dir = opendir(dir_path)))
+	{
+		fprintf(stderr, "Failed to open directory: %s\n", dir_path);
+		return -1;
+	}
+
+	while (!ret && (entry = readdir(dir)))
+	{
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+
+		if (stat(path, &st))
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+		{
+			ret = find_replay_images(path);
+		}
+		else if (catcierge_is_image_path(path))
+		{
+			ret = add_replay_image(path);
+		}
+	}
+
+	closedir(dir);
+
+	return ret;
+}
+#endif // !_WIN32
+
+static void free_replay_images()
+{
+	size_t i;
+
+	for (i = 0; i < ctx.replay_count; i++)
+	{
+		free(ctx.replay_images[i].path);
+	}
+
+	free(ctx.replay_images);
+	ctx.replay_images = NULL;
+	ctx.replay_count = 0;
+	ctx.replay_alloc = 0;
+}
+
+// Runs the state machine for one frame. When replaying the virtual
+// clock is moved to the time the frame was recorded, or by a fixed
+// interval if that is unknown.
+static void run_frame(IplImage *img, const struct timeval *tv)
+{
+	if (ctx.replay)
+	{
+		if (tv && tv->tv_sec)
+			catcierge_timer_set_virtual_time(tv);
+		else
+			catcierge_timer_advance(ctx.frame_interval);
+	}
+
+	grb.img = img;
+	catcierge_run_state(&grb);
+}
+
+// Feeds clear frames until the state machine is back to waiting.
+static void run_until_waiting(IplImage *clear_img)
+{
+	while (grb.running && (grb.state != catcierge_state_waiting))
+	{
+		run_frame(clear_img, NULL);
+	}
+
+	grb.img = NULL;
+}
+
+static int run_image(const char *path, const struct timeval *tv)
+{
+	IplImage *img = NULL;
+
+	if (!(img = load_image(&grb, path)))
+	{
+		return -1;
+	}
+
+	run_frame(img, tv);
+
+	cvReleaseImage(&img);
+	grb.img = NULL;
+
+	return 0;
+}
+
+// Finds and sorts the match images to replay.
+static int load_replay_dir()
+{
+	#ifdef _WIN32
+	fprintf(stderr, "--replay_dir is not supported on Windows\n");
+	return -1;
+	#else
+	if (find_replay_images(ctx.replay_dir))
+	{
+		return -1;
+	}
+	#endif
+
+	if (ctx.replay_count == 0)
+	{
+		fprintf(stderr, "No match images found in %s\n", ctx.replay_dir);
+		return -1;
+	}
+
+	qsort(ctx.replay_images, ctx.replay_count,
+		sizeof(fsm_tester_image_t), compare_replay_images);
+
+	return 0;
+}
+
+static int replay_dir(IplImage *clear_img)
+{
+	size_t i;
+	size_t j;
+	size_t start;
+	size_t group_count = 0;
+	size_t lockout_count = 0;
+	double begin = catcierge_timer_now();
+	fsm_tester_image_t *imgs = ctx.replay_images;
+
+	for (start = 0; grb.running && (start < ctx.replay_count); start = i)
+	{
+		// A match group is a run of images with increasing match index.
+		for (i = start + 1; i < ctx.replay_count; i++)
+		{
+			if ((imgs[i].index <= imgs[i - 1].index)
+			 || ((i - start) >= MATCH_MAX_COUNT))
+			{
+				break;
+			}
+		}
+
+		printf("Replaying match group %lu (%lu images) %s\n",
+			(unsigned long)group_count + 1, (unsigned long)(i - start), imgs[start].path);
+
+		// The first image obstructs the frame, the match group starts with the next.
+		if (run_image(imgs[start].path, &imgs[start].tv))
+		{
+			return -1;
+		}
+
+		for (j = start; j < i; j++)
+		{
+			if (run_image(imgs[j].path, &imgs[j].tv))
+			{
+				return -1;
+			}
+		}
+
+		if (grb.state == catcierge_state_lockout)
+		{
+			lockout_count++;
+		}
+
+		run_until_waiting(clear_img);
+		group_count++;
+	}
+
+	printf("---------------------------------------------------\n");
+	printf("Replayed %lu match groups (%lu images, %lu lockouts) in %.2f seconds\n",
+		(unsigned long)group_count, (unsigned long)ctx.replay_count,
+		(unsigned long)lockout_count, catcierge_timer_now() - begin);
+
+	return 0;
+}
+
 static void sig_handler(int signo)
 {
 	fprintf(stderr, "Received SIGINT...\n");
@@ -149,13 +487,36 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
-	if (ctx.img_count == 0)
+	if ((ctx.img_count == 0) && !ctx.replay_dir)
 	{
 		cargo_print_usage(args->cargo, 0);
 		fprintf(stderr, "\nNo input images specified!\n\n");
 		ret = -1; goto fail;
 	}
 
+	if (ctx.replay_dir)
+	{
+		ctx.replay = 1;
+	}
+
+	if (ctx.replay)
+	{
+		if (ctx.frame_interval <= 0.0)
+		{
+			fprintf(stderr, "--frame_interval must be larger than 0\n");
+			ret = -1; goto fail;
+		}
+
+		if (args->base_time)
+		{
+			fprintf(stderr, "--base_time can't be used together with the virtual "
+							"clock, the recorded time is used instead\n");
+			ret = -1; goto fail;
+		}
+
+		catcierge_timer_set_virtual(1);
+	}
+
 	printf("Images:\n");
 
 	for (i = 0; i < ctx.img_count; i++)
@@ -192,6 +553,33 @@ int main(int argc, char **argv)
 	catcierge_zmq_init(&grb);
 	#endif
 
+	if (ctx.replay_dir && load_replay_dir())
+	{
+		ret = -1; goto fail;
+	}
+
+	// Start the virtual clock at the first recorded frame, so that
+	// the timers started from here on run on the recorded times.
+	if (ctx.replay)
+	{
+		struct timeval first;
+		int index;
+
+		if (ctx.replay_dir)
+		{
+			first = ctx.replay_images[0].tv;
+		}
+		else
+		{
+			parse_match_filename(ctx.img_paths[0], &first, &index);
+		}
+
+		if (first.tv_sec)
+		{
+			catcierge_timer_seed_virtual_time(&first);
+		}
+	}
+
 	catcierge_fsm_start(&grb);
 	catcierge_timer_start(&grb.frame_timer);
 
@@ -219,38 +607,45 @@ int main(int argc, char **argv)
 
 		while (!catcierge_timer_has_timed_out(&t))
 		{
-			catcierge_run_state(&grb);
+			run_frame(clear_img, NULL);
 		}
 
 		grb.img = NULL;
 	}
 
+	if (ctx.replay_dir)
+	{
+		ret = replay_dir(clear_img);
+		goto fail;
+	}
+
 	// Load the first image and obstruct the frame.
-	if (!(grb.img = load_image(&grb, ctx.img_paths[0])))
+	if (run_image(ctx.img_paths[0], NULL))
 	{
 		ret = -1; goto fail;
 	}
 
-	catcierge_run_state(&grb);
-	cvReleaseImage(&grb.img);
-	grb.img = NULL;
-
 	// Load the match images.
 	for (i = 0; i < ctx.img_count; i++)
 	{
-		if (!(grb.img = load_image(&grb, ctx.img_paths[i])))
+		struct timeval tv;
+		int index;
+		parse_match_filename(ctx.img_paths[i], &tv, &index);
+
+		if (run_image(ctx.img_paths[i], &tv))
 		{
 			ret = -1; goto fail;
 		}
-
-		catcierge_run_state(&grb);
-
-		cvReleaseImage(&grb.img);
-		grb.img = NULL;
 	}
 
+	// On the virtual clock there is no need to wait for the timeouts
+	// in real time, run until we're back to waiting for a new match.
+	if (ctx.keep_running && ctx.replay && !ctx.keep_obstructing)
+	{
+		run_until_waiting(clear_img);
+	}
 	// Keep running so we can test the lockout modes.
-	if (ctx.keep_running)
+	else if (ctx.keep_running)
 	{
 		// Load one of the obstructing images to start with
 		if (!(grb.img = load_image(&grb, ctx.img_paths[0])))
@@ -272,11 +667,12 @@ int main(int argc, char **argv)
 				grb.img = clear_img;
 			}
 
-			catcierge_run_state(&grb);
+			run_frame(grb.img, NULL);
 		}
 	}
 
 fail:
+	free_replay_images();
 	cvReleaseImage(&clear_img);
 	#ifdef WITH_ZMQ
 	catcierge_zmq_destroy(&grb);
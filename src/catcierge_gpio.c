@@ -18,6 +18,8 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
 
 #include "catcierge_config.h"
 
@@ -29,16 +31,25 @@
 #include <fcntl.h>
 #endif
 
+#ifdef CATCIERGE_HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef CATCIERGE_HAVE_LINUX_GPIO_H
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#endif
+
 #include <string.h>
+#include "catcierge_gpio.h"
 #include "catcierge_util.h"
 #include "catcierge_log.h"
 
-static int write_num_to_file(const char *path, int num)
+static int write_str_to_file(const char *path, const char *str)
 {
 	int ret = 0;
-	char buf[16];
 	int fd;
-	ssize_t written;
+	size_t len = strlen(str);
 
 	if ((fd = open(path, O_WRONLY)) < 0)
 	{
@@ -46,11 +57,10 @@ static int write_num_to_file(const char *path, int num)
 		return -1;
 	}
 
-	written = snprintf(buf, sizeof(buf), "%d", num);
-	
-	if (write(fd, buf, strlen(buf)) < 0)
+	if (write(fd, str, len) != (ssize_t)len)
 	{
-		CATERR("Failed to write \"%s\" to %s\n", buf, path);
+		CATERR("Failed to write \"%s\" to %s\n", str, path);
+		ret = -1;
 	}
 
 	close(fd);
@@ -58,9 +68,16 @@ static int write_num_to_file(const char *path, int num)
 	return ret;
 }
 
+static int write_num_to_file(const char *path, int num)
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%d", num);
+	return write_str_to_file(path, buf);
+}
+
 int gpio_export(int pin)
 {
-	if (write_num_to_file("/sys/class/gpio/export", pin))
+	if (write_num_to_file(CATCIERGE_GPIO_SYSFS_ROOT "/export", pin))
 	{
 		CATERR("Failed to open GPIO export for writing\n");
 		return -1;
@@ -71,43 +88,242 @@ int gpio_export(int pin)
 
 int gpio_set_direction(int pin, int direction)
 {
-	int ret = 0;
-	int fd;
-	char *str;
 	char path[256];
-	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", pin);
+	snprintf(path, sizeof(path), CATCIERGE_GPIO_SYSFS_ROOT "/gpio%d/direction", pin);
 
-	if ((fd = open(path, O_WRONLY)) < 0)
+	return write_str_to_file(path, direction ? "in" : "out");
+}
+
+int gpio_write(int pin, int val)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), CATCIERGE_GPIO_SYSFS_ROOT "/gpio%d/value", pin);
+
+	if (write_num_to_file(path, val))
 	{
-		CATERR("Failed to open %s\n", path);
+		CATERR("Failed to write GPIO %d value\n", pin);
 		return -1;
 	}
 
-	str = direction ? "in" : "out";
-	
-	if (write(fd, str, strlen(str)) < 0)
+	return 0;
+}
+
+const char *catcierge_gpio_backend_str(catcierge_gpio_backend_t backend)
+{
+	switch (backend)
 	{
-		CATERR("Failed to write \"%s\" to %s\n", str, path);
-		//ret = -2;
+		case GPIO_BACKEND_SYSFS: return "sysfs";
+		case GPIO_BACKEND_CHARDEV: return "chardev";
+		case GPIO_BACKEND_FAKE: return "fake";
 	}
 
-	close(fd);
+	return "unknown";
+}
+
+void catcierge_gpio_init(catcierge_gpio_t *gpio)
+{
+	memset(gpio, 0, sizeof(catcierge_gpio_t));
+	gpio->fd = -1;
+	gpio->value = -1;
+}
+
+static int create_empty_file(const char *path)
+{
+	FILE *f;
+
+	if (!(f = fopen(path, "w")))
+	{
+		CATERR("Failed to create \"%s\"\n", path);
+		return -1;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+static int catcierge_gpio_open_sysfs(catcierge_gpio_t *gpio, const char *root, int pin)
+{
+	char path[1024];
+
+	snprintf(path, sizeof(path), "%s/gpio%d", root, pin);
+
+	if (gpio->backend == GPIO_BACKEND_FAKE)
+	{
+		// Emulate the kernel creating the pin directory on export.
+		if (catcierge_make_path("%s", path))
+		{
+			CATERR("Failed to create fake GPIO dir %s\n", path);
+			return -1;
+		}
+
+		snprintf(path, sizeof(path), "%s/gpio%d/direction", root, pin);
+
+		if (create_empty_file(path))
+			return -1;
+
+		snprintf(path, sizeof(path), "%s/gpio%d/value", root, pin);
+
+		if (create_empty_file(path))
+			return -1;
+	}
+	else
+	{
+		// Exporting an already exported pin fails, so only
+		// do it if the pin directory doesn't exist yet.
+		if (access(path, F_OK))
+		{
+			snprintf(path, sizeof(path), "%s/export", root);
+
+			if (write_num_to_file(path, pin))
+				return -1;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/gpio%d/direction", root, pin);
+
+	if (write_str_to_file(path, "out"))
+		return -1;
+
+	snprintf(path, sizeof(path), "%s/gpio%d/value", root, pin);
+
+	if ((gpio->fd = open(path, O_WRONLY | O_CLOEXEC)) < 0)
+	{
+		CATERR("Failed to open GPIO value %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int catcierge_gpio_open_chardev(catcierge_gpio_t *gpio, const char *chip, int pin, int value)
+{
+	#ifdef CATCIERGE_HAVE_LINUX_GPIO_H
+	int ret = 0;
+	int chip_fd;
+	struct gpiohandle_request req;
+
+	if ((chip_fd = open(chip, O_RDONLY | O_CLOEXEC)) < 0)
+	{
+		CATERR("Failed to open GPIO chip %s: %s\n", chip, strerror(errno));
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffsets[0] = pin;
+	req.lines = 1;
+	req.flags = GPIOHANDLE_REQUEST_OUTPUT;
+	req.default_values[0] = !!value;
+	strncpy(req.consumer_label, "catcierge", sizeof(req.consumer_label) - 1);
+
+	if (ioctl(chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0)
+	{
+		CATERR("Failed to request GPIO line %d on %s: %s\n", pin, chip, strerror(errno));
+		ret = -1;
+	}
+	else
+	{
+		gpio->fd = req.fd;
+	}
+
+	// The line handle stays valid after the chip is closed.
+	close(chip_fd);
 
 	return ret;
+	#else
+	CATERR("GPIO character device support not available\n");
+	return -1;
+	#endif
 }
 
-int gpio_write(int pin, int val)
+int catcierge_gpio_open(catcierge_gpio_t *gpio, catcierge_gpio_backend_t backend,
+			const char *path, int pin, int value)
 {
-	char path[256];
+	int ret = 0;
+	assert(gpio);
 
-	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", pin);
+	catcierge_gpio_init(gpio);
+	gpio->backend = backend;
+	gpio->pin = pin;
 
-	if (write_num_to_file(path, val))
+	switch (backend)
 	{
-		CATERR("Failed to open GPIO export for writing\n");
+		case GPIO_BACKEND_SYSFS:
+			ret = catcierge_gpio_open_sysfs(gpio, path ? path : CATCIERGE_GPIO_SYSFS_ROOT, pin);
+			break;
+		case GPIO_BACKEND_FAKE:
+			if (!path)
+			{
+				CATERR("The fake GPIO backend needs a directory\n");
+				return -1;
+			}
+			ret = catcierge_gpio_open_sysfs(gpio, path, pin);
+			break;
+		case GPIO_BACKEND_CHARDEV:
+			ret = catcierge_gpio_open_chardev(gpio, path ? path : "/dev/gpiochip0", pin, value);
+			break;
+		default:
+			CATERR("Unknown GPIO backend %d\n", backend);
+			return -1;
+	}
+
+	if (ret || catcierge_gpio_write(gpio, value))
+	{
+		catcierge_gpio_close(gpio);
 		return -1;
 	}
 
+	CATLOG("Opened GPIO %d (%s)\n", pin, catcierge_gpio_backend_str(backend));
+
 	return 0;
 }
 
+int catcierge_gpio_write(catcierge_gpio_t *gpio, int value)
+{
+	assert(gpio);
+	value = !!value;
+
+	if (gpio->fd < 0)
+		return -1;
+
+	if (gpio->backend == GPIO_BACKEND_CHARDEV)
+	{
+		#ifdef CATCIERGE_HAVE_LINUX_GPIO_H
+		struct gpiohandle_data data;
+		memset(&data, 0, sizeof(data));
+		data.values[0] = value;
+
+		if (ioctl(gpio->fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0)
+		{
+			CATERR("Failed to set GPIO %d to %d: %s\n", gpio->pin, value, strerror(errno));
+			return -1;
+		}
+		#endif
+	}
+	else
+	{
+		// Sysfs attributes are always written from the start.
+		if (pwrite(gpio->fd, value ? "1" : "0", 1, 0) != 1)
+		{
+			CATERR("Failed to set GPIO %d to %d: %s\n", gpio->pin, value, strerror(errno));
+			return -1;
+		}
+	}
+
+	gpio->value = value;
+
+	return 0;
+}
+
+void catcierge_gpio_close(catcierge_gpio_t *gpio)
+{
+	assert(gpio);
+
+	if (gpio->fd >= 0)
+	{
+		close(gpio->fd);
+	}
+
+	gpio->fd = -1;
+}
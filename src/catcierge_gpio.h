@@ -22,8 +22,36 @@
 #define IN 1
 #define OUT 0
 
+#define CATCIERGE_GPIO_SYSFS_ROOT "/sys/class/gpio"
+
+typedef enum catcierge_gpio_backend_e
+{
+	GPIO_BACKEND_SYSFS = 0,		// /sys/class/gpio/gpioN/value
+	GPIO_BACKEND_CHARDEV = 1,	// Line handle from /dev/gpiochipN
+	GPIO_BACKEND_FAKE = 2		// Sysfs layout in a normal directory, for tests.
+} catcierge_gpio_backend_t;
+
+//
+// An output pin that is kept open for as long as the program
+// runs, so that changing its value is a single syscall.
+//
+typedef struct catcierge_gpio_s
+{
+	catcierge_gpio_backend_t backend;
+	int pin;
+	int fd;		// Value file for sysfs, line handle for the chardev.
+	int value;	// The last value written.
+} catcierge_gpio_t;
+
 int gpio_export(int pin);
 int gpio_set_direction(int pin, int direction);
 int gpio_write(int pin, int val);
 
+void catcierge_gpio_init(catcierge_gpio_t *gpio);
+int catcierge_gpio_open(catcierge_gpio_t *gpio, catcierge_gpio_backend_t backend,
+			const char *path, int pin, int value);
+int catcierge_gpio_write(catcierge_gpio_t *gpio, int value);
+void catcierge_gpio_close(catcierge_gpio_t *gpio);
+const char *catcierge_gpio_backend_str(catcierge_gpio_backend_t backend);
+
 #endif // __CATCIERGE_GPIO_H__
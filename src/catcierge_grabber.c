@@ -153,6 +153,21 @@ static void sig_handler(int signo)
 			catcierge_state_transition_lockout(&grb);
 			break;
 		}
+		case SIGQUIT:
+		{
+			// Printed from the main loop, since stdio is not signal safe.
+			grb.print_span_stats = 1;
+			break;
+		}
+		#ifdef WITH_RFID
+		case SIGHUP:
+		{
+			// Reloaded from the main loop, so the set is never
+			// swapped while a tag is being looked up.
+			grb.reload_rfid_allowed = 1;
+			break;
+		}
+		#endif // WITH_RFID
 		#endif // _WIN32
 	}
 }
@@ -174,6 +189,18 @@ void setup_sig_handlers()
 	{
 		CATERR("Failed to set SIGUSR2 handler (used to force lockout)\n");
 	}
+
+	if (signal(SIGQUIT, sig_handler) == SIG_ERR)
+	{
+		CATERR("Failed to set SIGQUIT handler (used to print timing stats)\n");
+	}
+
+	#ifdef WITH_RFID
+	if (signal(SIGHUP, sig_handler) == SIG_ERR)
+	{
+		CATERR("Failed to set SIGHUP handler (used to reload allowed RFID tags)\n");
+	}
+	#endif // WITH_RFID
 	#endif // _WIN32
 }
 
@@ -247,7 +274,8 @@ int main(int argc, char **argv)
 	#endif // RPI
 
 	assert((args->matcher_type == MATCHER_TEMPLATE)
-		|| (args->matcher_type == MATCHER_HAAR));
+		|| (args->matcher_type == MATCHER_HAAR)
+		|| (args->matcher_type == MATCHER_DNN));
 
 	if (catcierge_matcher_init(&grb.matcher, catcierge_get_matcher_args(args)))
 	{
@@ -273,10 +301,25 @@ int main(int argc, char **argv)
 	CATLOG("Initialized output templates\n");
 
 	#ifdef WITH_RFID
-	catcierge_init_rfid_readers(&grb);
+	if (catcierge_init_rfid_readers(&grb))
+	{
+		CATERR("Failed to init RFID readers\n");
+		return -1;
+	}
+
+	// Read the serial ports in the background so that tag arrival
+	// times aren't limited by the camera frame rate.
+	if ((args->rfid_inner_path || args->rfid_outer_path)
+		&& catcierge_rfid_ctx_start_thread(&grb.rfid_ctx))
+	{
+		CATERR("Failed to start RFID reader thread, reading RFID in the main loop\n");
+	}
 	#endif
 
-	catcierge_setup_camera(&grb);
+	if (catcierge_setup_camera(&grb))
+	{
+		return -1;
+	}
 
 	#ifdef WITH_ZMQ
 	catcierge_zmq_init(&grb);
@@ -294,8 +337,29 @@ int main(int argc, char **argv)
 			catcierge_timer_start(&grb.frame_timer);
 		}
 
-		// Always feed the RFID readers.
+		if (grb.print_span_stats)
+		{
+			grb.print_span_stats = 0;
+			catcierge_print_span_stats(&grb);
+		}
+
+		if ((grb.args.mem_stats_interval > 0.0)
+			&& catcierge_timer_has_timed_out(&grb.mem_stats_timer))
+		{
+			catcierge_print_mem_stats(&grb);
+			catcierge_timer_start(&grb.mem_stats_timer);
+		}
+
 		#ifdef WITH_RFID
+		if (grb.reload_rfid_allowed)
+		{
+			grb.reload_rfid_allowed = 0;
+			CATLOG("Reloading allowed RFID tags\n");
+			catcierge_load_rfid_allowed(&grb);
+			catcierge_rfid_allowed_print_stats(grb.rfid_allowed);
+		}
+
+		// Always feed the RFID readers.
 		if ((args->rfid_inner_path || args->rfid_outer_path) 
 			&& catcierge_rfid_ctx_service(&grb.rfid_ctx))
 		{
@@ -305,6 +369,12 @@ int main(int argc, char **argv)
 
 		grb.img = catcierge_get_frame(&grb);
 
+		if (grb.capture.eof)
+		{
+			CATLOG("End of recording\n");
+			break;
+		}
+
 		catcierge_run_state(&grb);
 		catcierge_print_spinner(&grb);
 	} while (
@@ -314,6 +384,9 @@ int main(int argc, char **argv)
 		#endif
 		);
 
+	#ifdef WITH_RFID
+	catcierge_destroy_rfid_readers(&grb);
+	#endif
 	catcierge_matcher_destroy(&grb.matcher);
 	catcierge_output_destroy(&grb.output);
 	catcierge_destroy_camera(&grb);
@@ -30,6 +30,7 @@ int catcierge_haar_matcher_init(catcierge_matcher_t **octx,
 {
 	catcierge_haar_matcher_t *ctx = NULL;
 	catcierge_haar_matcher_args_t *args = (catcierge_haar_matcher_args_t *)oargs;
+	size_t i;
 	assert(args);
 	assert(octx);
 
@@ -40,6 +41,7 @@ int catcierge_haar_matcher_init(catcierge_matcher_t **octx,
 	}
 
 	ctx = (catcierge_haar_matcher_t *)*octx;
+	ctx->args = args;
 
 	ctx->super.type = MATCHER_HAAR;
 	ctx->super.name = "Haar Cascade";
@@ -63,6 +65,30 @@ int catcierge_haar_matcher_init(catcierge_matcher_t **octx,
 		return -1;
 	}
 
+	if (args->prey_cascade_count > 0)
+	{
+		if (!(ctx->prey_cascades = calloc(args->prey_cascade_count, sizeof(cv2CascadeClassifier *))))
+		{
+			CATERR("Out of memory!\n");
+			return -1;
+		}
+
+		for (i = 0; i < args->prey_cascade_count; i++)
+		{
+			if (!(ctx->prey_cascades[i] = cv2CascadeClassifier_create()))
+			{
+				CATERR("Failed to create cascade classifier.\n");
+				goto opencv_error;
+			}
+
+			if (cv2CascadeClassifier_load(ctx->prey_cascades[i], args->prey_cascades[i]))
+			{
+				CATERR("Failed to load prey cascade xml: %s\n", args->prey_cascades[i]);
+				return -1;
+			}
+		}
+	}
+
 	if (!(ctx->storage = cvCreateMemStorage(0)))
 	{
 		goto opencv_error;
@@ -84,11 +110,11 @@ int catcierge_haar_matcher_init(catcierge_matcher_t **octx,
 		goto opencv_error;
 	}
 
-	ctx->args = args;
 	ctx->super.debug = args->debug;
 	ctx->super.match = catcierge_haar_matcher_match;
 	ctx->super.decide = catcierge_haar_matcher_decide;
 	ctx->super.translate = catcierge_haar_matcher_translate;
+	ctx->super.reset = catcierge_haar_matcher_reset;
 
 	return 0;
 opencv_error:
@@ -99,6 +125,7 @@ opencv_error:
 void catcierge_haar_matcher_destroy(catcierge_matcher_t **octx)
 {
 	catcierge_haar_matcher_t *ctx;
+	size_t i;
 
 	if (!octx || !(*octx))
 		return;
@@ -111,6 +138,20 @@ void catcierge_haar_matcher_destroy(catcierge_matcher_t **octx)
 		ctx->cascade = NULL;
 	}
 
+	if (ctx->prey_cascades)
+	{
+		for (i = 0; i < ctx->args->prey_cascade_count; i++)
+		{
+			if (ctx->prey_cascades[i])
+			{
+				cv2CascadeClassifier_destroy(ctx->prey_cascades[i]);
+			}
+		}
+
+		free(ctx->prey_cascades);
+		ctx->prey_cascades = NULL;
+	}
+
 	if (ctx->kernel2x2)
 	{
 		cvReleaseStructuringElement(&ctx->kernel2x2);
@@ -135,6 +176,9 @@ void catcierge_haar_matcher_destroy(catcierge_matcher_t **octx)
 		ctx->storage = NULL;
 	}
 
+	catcierge_binmorph_destroy(&ctx->binmorph);
+	catcierge_blob_counter_destroy(&ctx->blobs);
+
 	free(ctx);
 	*octx = NULL;
 }
@@ -186,34 +230,38 @@ match_direction_t catcierge_haar_guess_direction(catcierge_haar_matcher_t *ctx,
 	}
 }
 
-size_t catcierge_haar_matcher_count_contours(catcierge_haar_matcher_t *ctx, CvSeq *contours)
+//
+// Counts the blobs with a big enough area in a binary image. Finding prey
+// only depends on if there is more than one, so it stops counting at 2.
+//
+static int catcierge_haar_matcher_count_blobs(catcierge_haar_matcher_t *ctx, IplImage *img)
 {
-	size_t contour_count = 0;
-	double area;
-	int big_enough = 0;
-	CvSeq *it = NULL;
+	int count;
 	assert(ctx);
-	assert(ctx->args);
 
-	if (!contours)
+	if ((count = catcierge_count_blobs(&ctx->blobs, img, HAAR_MIN_BLOB_AREA, 2)) < 0)
+	{
 		return 0;
+	}
 
-	it = contours;
-	while (it)
-	{
-		area = cvContourArea(it, CV_WHOLE_SEQ, 0);
-		big_enough = (area > 10.0);
-		if (ctx->super.debug) printf("Area: %f %s\n", area, big_enough ? "" : "(too small)");
+	if (ctx->super.debug) printf("Blobs: %d%s\n", count, (count >= 2) ? " or more" : "");
 
-		if (big_enough)
-		{
-			contour_count++;
-		}
+	return count;
+}
 
-		it = it->h_next;
-	}
+//
+// The contours are only needed for drawing. They are kept in the
+// scratch storage which is cleared after each match.
+//
+static CvSeq *catcierge_haar_matcher_find_contours(catcierge_haar_matcher_t *ctx, IplImage *img)
+{
+	CvSeq *contours = NULL;
+	assert(ctx);
+
+	cvFindContours(img, ctx->storage, &contours,
+		sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_NONE, cvPoint(0, 0));
 
-	return contour_count;
+	return contours;
 }
 
 void catcierge_haar_matcher_save_step_image(catcierge_haar_matcher_t *ctx,
@@ -221,39 +269,73 @@ void catcierge_haar_matcher_save_step_image(catcierge_haar_matcher_t *ctx,
 											const char *name, const char *description,
 											int save)
 {
-	match_step_t *step = NULL;
-	CvSize img_size;
-	CvRect roi;
 	assert(result->step_img_count < MAX_STEPS);
 
 	if (ctx->super.debug)
 		cvShowImage(description, img);
 
-	step = &result->steps[result->step_img_count];
+	// Only the final image is kept in summary mode,
+	// see catcierge_haar_matcher_save_final_image.
+	if ((save != STEPS_FULL) && (save != STEPS_LAZY))
+		return;
 
-	if (step->img)
-	{
-		cvReleaseImage(&step->img);
-		step->img = NULL;
-	}
+	// We only want to copy the Region Of Interest (ROI).
+	catcierge_match_step_add(result, img, name, description);
+}
+
+//
+// Draws the final color image with the Haar match and the background
+// contours (if any) on top of img. With all steps enabled the contours
+// on the grayscale ROI are saved as a step before it.
+//
+static void catcierge_haar_matcher_save_final_image(catcierge_haar_matcher_t *ctx,
+											IplImage *img, CvSeq *contours, int prey,
+											match_result_t *result, int save)
+{
+	IplImage *contour_img = NULL;
+	IplImage *final_img = NULL;
+	CvRect roi;
+	CvScalar color;
 
-	// If saving steps is turned off, simply release
-	// any previous step image.
 	if (!save)
 		return;
 
-	// We only want to copy the Region Of Interest (ROI).
 	roi = cvGetImageROI(img);
-	img_size.width = roi.width;
-	img_size.height = roi.height;
 
-	step->img = cvCreateImage(img_size, 8, img->nChannels);
-	cvCopy(img, step->img, NULL);
+	if (contours && (save != STEPS_SUMMARY))
+	{
+		if ((contour_img = catcierge_match_step_begin(result,
+				cvSize(roi.width, roi.height), 8, 1)))
+		{
+			cvCopy(img, contour_img, NULL);
+			cvDrawContours(contour_img, contours, cvScalarAll(255), cvScalarAll(0), 1, 1, 8, cvPoint(0, 0));
+			if (ctx->super.debug) cvShowImage("Background contours", contour_img);
+			catcierge_match_step_end(result, "contours", "Background contours");
+		}
+	}
+
+	if (!(final_img = catcierge_match_step_begin(result, cvSize(img->width, img->height), 8, 3)))
+		return;
+
+	cvResetImageROI(img);
+	cvCvtColor(img, final_img, CV_GRAY2BGR);
+	cvSetImageROI(img, roi);
 
-	step->name = name;
-	step->description = description;
+	if (contours)
+	{
+		cvSetImageROI(final_img, roi);
+		cvDrawContours(final_img, contours, cvScalarAll(255), cvScalarAll(0), 1, 1, 8, cvPoint(0, 0));
+		cvResetImageROI(final_img);
+	}
 
-	result->step_img_count++;
+	if (result->rect_count > 0)
+	{
+		color = prey ? CV_RGB(255, 0, 0) : CV_RGB(0, 255, 0);
+		cvRectangleR(final_img, result->match_rects[0], color, 2, 8, 0);
+	}
+
+	if (ctx->super.debug) cvShowImage("Final image", final_img);
+	catcierge_match_step_end(result, "final", "Final image");
 }
 
 int catcierge_haar_matcher_find_prey_adaptive(catcierge_haar_matcher_t *ctx,
@@ -265,8 +347,10 @@ int catcierge_haar_matcher_find_prey_adaptive(catcierge_haar_matcher_t *ctx,
 	IplImage *open_combined = NULL;
 	IplImage *dilate_combined = NULL;
 	CvSeq *contours = NULL;
-	size_t contour_count = 0;
+	int contour_count = 0;
 	CvSize img_size;
+	double begin;
+	int fused = 0;
 	assert(ctx);
 	assert(img);
 	assert(ctx->args);
@@ -280,65 +364,70 @@ int catcierge_haar_matcher_find_prey_adaptive(catcierge_haar_matcher_t *ctx,
 	// This brings out small details such as a mouse tail that fades
 	// into the background during a global threshold.
 	inv_adpthr_img = cvCreateImage(img_size, 8, 1);
+	begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_THRESHOLD);
 	cvAdaptiveThreshold(img, inv_adpthr_img, 255,
 		CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY_INV, 11, 5);
+	catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_THRESHOLD, begin);
 	catcierge_haar_matcher_save_step_image(ctx,
 		inv_adpthr_img, result, "adp_thresh", "Inverted adaptive threshold", save_steps);
 
-	// Now we can combine the two thresholded images into one.
-	inv_combined = cvCreateImage(img_size, 8, 1);
-	cvAdd(inv_thr_img, inv_adpthr_img, inv_combined, NULL);
-	catcierge_haar_matcher_save_step_image(ctx,
-		inv_combined, result, "inv_combined", "Combined global and adaptive threshold", save_steps);
-
-	// Get rid of noise from the adaptive threshold.
-	open_combined = cvCreateImage(img_size, 8, 1);
-	cvMorphologyEx(inv_combined, open_combined, NULL, ctx->kernel2x2, CV_MOP_OPEN, 2);
-	catcierge_haar_matcher_save_step_image(ctx,
-		open_combined, result, "opened", "Opened image", save_steps);
-
 	dilate_combined = cvCreateImage(img_size, 8, 1);
-	cvDilate(open_combined, dilate_combined, ctx->kernel3x3, 3);
-	catcierge_haar_matcher_save_step_image(ctx,
-		dilate_combined, result, "dilated", "Dilated image", save_steps);
 
-	// Invert back the result so the background is white again.
-	cvNot(dilate_combined, dilate_combined);
-	catcierge_haar_matcher_save_step_image(ctx,
-		dilate_combined, result, "combined", "Combined binary image", save_steps);
+	// Unless the images in between are looked at, combine, open, dilate
+	// and invert in one go on bit packed rows. The result is the same.
+	if (!ctx->super.debug && (save_steps != STEPS_FULL) && (save_steps != STEPS_LAZY))
+	{
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_MORPHOLOGY);
 
-	cvFindContours(dilate_combined, ctx->storage, &contours,
-		sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_NONE, cvPoint(0, 0));
+		// Same kernels as kernel2x2 and kernel3x3 below.
+		fused = !catcierge_binmorph_combine_open_dilate_not(&ctx->binmorph,
+					inv_thr_img, inv_adpthr_img, dilate_combined, 2, 2, 3, 3);
 
-	// If we get more than 1 contour we count it as a prey.
-	contour_count = catcierge_haar_matcher_count_contours(ctx, contours);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_MORPHOLOGY, begin);
+	}
 
-	if (save_steps)
+	if (!fused)
 	{
-		IplImage *img_contour = cvCloneImage(img);
-		IplImage *img_final_color = NULL;
-		CvScalar color;
-
-		cvDrawContours(img_contour, contours, cvScalarAll(255), cvScalarAll(0), 1, 1, 8, cvPoint(0, 0));
+		// Now we can combine the two thresholded images into one.
+		inv_combined = cvCreateImage(img_size, 8, 1);
+		cvAdd(inv_thr_img, inv_adpthr_img, inv_combined, NULL);
 		catcierge_haar_matcher_save_step_image(ctx,
-			img_contour, result, "contours", "Background contours", save_steps);
-
-		// Draw a final color combined image with the Haar detection + contour.
-		cvResetImageROI(img_contour);
+			inv_combined, result, "inv_combined", "Combined global and adaptive threshold", save_steps);
 
-		img_final_color =  cvCreateImage(cvGetSize(img_contour), 8, 3);
+		// Get rid of noise from the adaptive threshold.
+		open_combined = cvCreateImage(img_size, 8, 1);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_MORPHOLOGY);
+		cvMorphologyEx(inv_combined, open_combined, NULL, ctx->kernel2x2, CV_MOP_OPEN, 2);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_MORPHOLOGY, begin);
+		catcierge_haar_matcher_save_step_image(ctx,
+			open_combined, result, "opened", "Opened image", save_steps);
 
-		cvCvtColor(img_contour, img_final_color, CV_GRAY2BGR);
-		color = (contour_count > 1) ? CV_RGB(255, 0, 0) : CV_RGB(0, 255, 0);
-		cvRectangleR(img_final_color, result->match_rects[0], color, 2, 8, 0);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_MORPHOLOGY);
+		cvDilate(open_combined, dilate_combined, ctx->kernel3x3, 3);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_MORPHOLOGY, begin);
+		catcierge_haar_matcher_save_step_image(ctx,
+			dilate_combined, result, "dilated", "Dilated image", save_steps);
 
+		// Invert back the result so the background is white again.
+		cvNot(dilate_combined, dilate_combined);
 		catcierge_haar_matcher_save_step_image(ctx,
-			img_final_color, result, "final", "Final image", save_steps);
+			dilate_combined, result, "combined", "Combined binary image", save_steps);
+	}
 
-		cvReleaseImage(&img_contour);
-		cvReleaseImage(&img_final_color);
+	// If we get more than 1 blob we count it as a prey.
+	begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_CONTOURS);
+	contour_count = catcierge_haar_matcher_count_blobs(ctx, dilate_combined);
+	catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_CONTOURS, begin);
+
+	// Draw a final color combined image with the Haar detection + contour.
+	if (save_steps && (save_steps != STEPS_SUMMARY))
+	{
+		contours = catcierge_haar_matcher_find_contours(ctx, dilate_combined);
 	}
 
+	catcierge_haar_matcher_save_final_image(ctx,
+		img, contours, (contour_count > 1), result, save_steps);
+
 	cvReleaseImage(&inv_adpthr_img);
 	cvReleaseImage(&inv_combined);
 	cvReleaseImage(&open_combined);
@@ -352,54 +441,52 @@ int catcierge_haar_matcher_find_prey(catcierge_haar_matcher_t *ctx,
 									match_result_t *result, int save_steps)
 {
 	catcierge_haar_matcher_args_t *args = ctx->args;
-	IplImage *thr_img2 = NULL;
 	CvSeq *contours = NULL;
-	size_t contour_count = 0;
+	int contour_count = 0;
+	double begin;
 	assert(ctx);
 	assert(img);
 	assert(ctx->args);
 
-	// thr_img is modified by FindContours so we clone it first.
-	thr_img2 = cvCloneImage(thr_img);
-
-	cvFindContours(thr_img, ctx->storage, &contours,
-		sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_NONE, cvPoint(0, 0));
-
-	// If we get more than 1 contour we count it as a prey. At least something
+	// If we get more than 1 blob we count it as a prey. At least something
 	// is intersecting the white are to split up the image.
-	contour_count = catcierge_haar_matcher_count_contours(ctx, contours);
+	begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_CONTOURS);
+	contour_count = catcierge_haar_matcher_count_blobs(ctx, thr_img);
+	catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_CONTOURS, begin);
 
 	// If we don't find any prey 
 	if ((args->prey_steps >= 2) && (contour_count == 1))
 	{
 		IplImage *erod_img = NULL;
 		IplImage *open_img = NULL;
-		CvSeq *contours2 = NULL;
 
-		erod_img = cvCreateImage(cvGetSize(thr_img2), 8, 1);
-		cvErode(thr_img2, erod_img, ctx->kernel3x3, 3);
+		erod_img = cvCreateImage(cvGetSize(thr_img), 8, 1);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_MORPHOLOGY);
+		cvErode(thr_img, erod_img, ctx->kernel3x3, 3);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_MORPHOLOGY, begin);
 		if (ctx->super.debug) cvShowImage("haar eroded img", erod_img);
 
-		open_img = cvCreateImage(cvGetSize(thr_img2), 8, 1);
+		open_img = cvCreateImage(cvGetSize(thr_img), 8, 1);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_MORPHOLOGY);
 		cvMorphologyEx(erod_img, open_img, NULL, ctx->kernel5x1, CV_MOP_OPEN, 1);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_MORPHOLOGY, begin);
 		if (ctx->super.debug) cvShowImage("haar opened img", erod_img);
 
-		cvFindContours(erod_img, ctx->storage, &contours2,
-			sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_NONE, cvPoint(0, 0));
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_CONTOURS);
+		contour_count = catcierge_haar_matcher_count_blobs(ctx, erod_img);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_CONTOURS, begin);
+
 		cvReleaseImage(&erod_img);
 		cvReleaseImage(&open_img);
-
-		contour_count = catcierge_haar_matcher_count_contours(ctx, contours2);
 	}
 
 	if (ctx->super.debug)
 	{
+		contours = catcierge_haar_matcher_find_contours(ctx, thr_img);
 		cvDrawContours(img, contours, cvScalarAll(0), cvScalarAll(0), 1, 1, 8, cvPoint(0, 0));
 		cvShowImage("Haar Contours", img);
 	}
 
-	cvReleaseImage(&thr_img2);
-
 	return (contour_count > 1);
 }
 
@@ -418,6 +505,154 @@ void catcierge_haar_matcher_calculate_roi(catcierge_haar_matcher_t *ctx, CvRect
 	if (roi->x < 0) roi->x = 0;
 }
 
+void catcierge_haar_matcher_reset(catcierge_matcher_t *octx)
+{
+	catcierge_haar_matcher_t *ctx = (catcierge_haar_matcher_t *)octx;
+	assert(ctx);
+
+	// Don't track a head from a previous match group.
+	ctx->track_valid = 0;
+}
+
+//
+// Grows r by percent of its size on each side, clipped to the image.
+//
+static CvRect catcierge_haar_matcher_expand_rect(IplImage *img, CvRect r, int percent)
+{
+	int dx = (r.width * percent) / 100;
+	int dy = (r.height * percent) / 100;
+	int x1 = r.x - dx;
+	int y1 = r.y - dy;
+	int x2 = r.x + r.width + dx;
+	int y2 = r.y + r.height + dy;
+
+	if (x1 < 0) x1 = 0;
+	if (y1 < 0) y1 = 0;
+	if (x2 > img->width) x2 = img->width;
+	if (y2 > img->height) y2 = img->height;
+
+	return cvRect(x1, y1, x2 - x1, y2 - y1);
+}
+
+//
+// Runs a cascade on the given area of the image. The rects
+// that are found are in full image coordinates.
+//
+static int catcierge_haar_matcher_detect(cv2CascadeClassifier *cascade,
+		IplImage *img, CvRect area, CvRect *rects, size_t *rect_count, CvSize *min_size)
+{
+	int ret = 0;
+	int had_roi = (img->roi != NULL);
+	CvRect prev_roi = cvGetImageROI(img);
+	CvSize max_size = cvSize(0, 0);
+	size_t max_count = *rect_count;
+	size_t i;
+
+	cvSetImageROI(img, area);
+
+	if (cv2CascadeClassifier_detectMultiScale(cascade,
+			img, rects, rect_count, 1.1, 3, CV_HAAR_SCALE_IMAGE, min_size, &max_size))
+	{
+		ret = -1;
+	}
+
+	// The count is of all detections, even those that didn't fit.
+	if (*rect_count > max_count)
+	{
+		*rect_count = max_count;
+	}
+
+	for (i = 0; i < *rect_count; i++)
+	{
+		rects[i].x += area.x;
+		rects[i].y += area.y;
+	}
+
+	if (had_roi)
+		cvSetImageROI(img, prev_roi);
+	else
+		cvResetImageROI(img);
+
+	return ret;
+}
+
+//
+// Finds the cat head. With --track the area around the head from the
+// previous match is searched first, the head barely moves between the
+// frames of a match group. The whole frame is searched if it isn't found.
+//
+static int catcierge_haar_matcher_find_head(catcierge_haar_matcher_t *ctx,
+		IplImage *img, match_result_t *result, CvSize *min_size)
+{
+	catcierge_haar_matcher_args_t *args = ctx->args;
+	CvRect area;
+
+	if (args->track && ctx->track_valid)
+	{
+		area = catcierge_haar_matcher_expand_rect(img, ctx->track_rect, args->track_margin);
+		result->rect_count = MAX_MATCH_RECTS;
+
+		if (catcierge_haar_matcher_detect(ctx->cascade, img, area,
+				result->match_rects, &result->rect_count, min_size))
+		{
+			return -1;
+		}
+
+		if (ctx->super.debug) printf("Tracked head %s\n", (result->rect_count > 0) ? "found" : "lost");
+
+		if (result->rect_count > 0)
+			return 0;
+	}
+
+	result->rect_count = MAX_MATCH_RECTS;
+
+	return catcierge_haar_matcher_detect(ctx->cascade, img,
+			cvRect(0, 0, img->width, img->height),
+			result->match_rects, &result->rect_count, min_size);
+}
+
+//
+// Runs the prey cascades around the head in the order they were given.
+// found is set to the index of the first one that finds anything, or -1.
+//
+static int catcierge_haar_matcher_find_prey_cascade(catcierge_haar_matcher_t *ctx,
+		IplImage *img, match_result_t *result, int *found)
+{
+	CvRect rects[MAX_MATCH_RECTS];
+	CvSize min_size = cvSize(0, 0);
+	CvRect area;
+	size_t count;
+	size_t i;
+	double begin;
+
+	*found = -1;
+	area = catcierge_haar_matcher_expand_rect(img,
+			result->match_rects[0], HAAR_PREY_CASCADE_MARGIN);
+
+	for (i = 0; i < ctx->args->prey_cascade_count; i++)
+	{
+		count = MAX_MATCH_RECTS;
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_CASCADE);
+
+		if (catcierge_haar_matcher_detect(ctx->prey_cascades[i],
+				img, area, rects, &count, &min_size))
+		{
+			return -1;
+		}
+
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_CASCADE, begin);
+		if (ctx->super.debug) printf("Prey cascade %d: %d matches\n", (int)i + 1, (int)count);
+
+		if (count > 0)
+		{
+			*found = (int)i;
+			break;
+		}
+	}
+
+	return 0;
+}
+
 double catcierge_haar_matcher_match(void *octx,
 		IplImage *img, match_result_t *result, int save_steps)
 {
@@ -428,17 +663,15 @@ double catcierge_haar_matcher_match(void *octx,
 	IplImage *img_gray = NULL;
 	IplImage *tmp = NULL;
 	IplImage *thr_img = NULL;
-	CvSize max_size;
 	CvSize min_size;
 	int cat_head_found = 0;
+	double begin;
 	assert(ctx);
 	assert(ctx->args);
 	assert(result);
 
 	min_size.width = args->min_width;
 	min_size.height = args->min_height;
-	max_size.width = 0;
-	max_size.height = 0;
 	result->step_img_count = 0;
 	result->description[0] = '\0';
 
@@ -446,7 +679,9 @@ double catcierge_haar_matcher_match(void *octx,
 	if (img->nChannels != 1)
 	{
 		tmp = cvCreateImage(cvGetSize(img), 8, 1);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_GRAYSCALE);
 		cvCvtColor(img, tmp, CV_BGR2GRAY);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_GRAYSCALE, begin);
 		img_gray = tmp;
 	}
 	else
@@ -463,7 +698,9 @@ double catcierge_haar_matcher_match(void *octx,
 	if (args->eq_histogram)
 	{
 		img_eq = cvCreateImage(cvGetSize(img), 8, 1);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_EQUALIZE);
 		cvEqualizeHist(img_gray, img_eq);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_EQUALIZE, begin);
 	}
 	else
 	{
@@ -473,20 +710,28 @@ double catcierge_haar_matcher_match(void *octx,
 	catcierge_haar_matcher_save_step_image(ctx,
 		img_eq, result, "gray", "Grayscale original", save_steps);
 
-	result->rect_count = MAX_MATCH_RECTS;
+	begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_CASCADE);
 
-	if (cv2CascadeClassifier_detectMultiScale(ctx->cascade,
-			img_eq, result->match_rects, &result->rect_count,
-			1.1, 3, CV_HAAR_SCALE_IMAGE, &min_size, &max_size))
+	if (catcierge_haar_matcher_find_head(ctx, img_eq, result, &min_size))
 	{
 		ret = -1.0;
 		goto fail;
 	}
 
+	catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_CASCADE, begin);
+
 	if (ctx->super.debug) printf("Rect count: %d\n", (int)result->rect_count);
 
 	cat_head_found = (result->rect_count > 0);
 
+	// The next match in the match group looks around this head first.
+	ctx->track_valid = cat_head_found;
+
+	if (cat_head_found)
+	{
+		ctx->track_rect = result->match_rects[0];
+	}
+
 	// Even if we don't find a face we count it as a success.
 	// Only when a prey is found we consider it a fail.
 	// Unless args->no_match_is_fail is set.
@@ -502,6 +747,7 @@ double catcierge_haar_matcher_match(void *octx,
 	{
 		int inverted; 
 		int flags;
+		int prey_cascade = -1;
 		CvRect roi;
 		find_prey_f find_prey = NULL;
 
@@ -542,7 +788,9 @@ double catcierge_haar_matcher_match(void *octx,
 		// Both "find prey" and "guess direction" needs
 		// a thresholded image, so perform it before calling those.
 		thr_img = cvCreateImage(cvGetSize(img_eq), 8, 1);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_THRESHOLD);
 		cvThreshold(img_eq, thr_img, 0, 255, flags);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_THRESHOLD, begin);
 		if (ctx->super.debug) cvShowImage("Haar image binary", thr_img);
 
 		catcierge_haar_matcher_save_step_image(ctx,
@@ -560,6 +808,25 @@ double catcierge_haar_matcher_match(void *octx,
 			goto done;
 		}
 
+		if (args->prey_cascade_count > 0)
+		{
+			if (catcierge_haar_matcher_find_prey_cascade(ctx, img_eq, result, &prey_cascade))
+			{
+				ret = -1.0;
+				goto fail;
+			}
+
+			if (prey_cascade >= 0)
+			{
+				if (ctx->super.debug) printf("Found prey!\n");
+				ret = HAAR_FAIL;
+
+				snprintf(result->description, sizeof(result->description) - 1,
+					"Prey detected by prey cascade %d", prey_cascade + 1);
+				goto done;
+			}
+		}
+
 		// Note that thr_img will be modified.
 		if (find_prey(ctx, img_eq, thr_img, result, save_steps))
 		{
@@ -585,9 +852,19 @@ double catcierge_haar_matcher_match(void *octx,
 	}
 
 done:
+	// The adaptive prey method draws the final image itself.
+	if ((save_steps == STEPS_SUMMARY) && (result->step_img_count == 0))
+	{
+		catcierge_haar_matcher_save_final_image(ctx,
+			img_eq, NULL, (ret == HAAR_FAIL), result, save_steps);
+	}
 fail:
 	cvResetImageROI(img);
 
+	// Nothing allocated in the scratch storage outlives the match,
+	// clearing it keeps the memory use flat.
+	cvClearMemStorage(ctx->storage);
+
 	if (args->eq_histogram)
 	{
 		cvReleaseImage(&img_eq);
@@ -732,6 +1009,7 @@ static int parse_prey_method(cargo_t ctx, void *user, const char *optname,
 int catcierge_haar_matcher_args_destroy(catcierge_haar_matcher_args_t *args)
 {
 	catcierge_xfree(&args->cascade);
+	catcierge_xfree_list(&args->prey_cascades, &args->prey_cascade_count);
 	return 0;
 }
 
@@ -799,6 +1077,33 @@ int catcierge_haar_matcher_add_options(cargo_t cargo,
 			"--prey_method",
 			"ADAPTIVE|NORMAL");
 
+	ret |= cargo_add_option(cargo, 0,
+			"<haar> --prey_cascade",
+			"Haar cascades trained to find prey. After a cat head has been "
+			"found, they are run around it in the order given. The first one "
+			"that finds anything counts as prey, without doing the normal "
+			"prey detection.",
+			"[s]+", &args->prey_cascades, &args->prey_cascade_count);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<haar> --track",
+			"Look for the cat head around where it was found in the previous "
+			"frame of the same match first. The whole frame is only searched "
+			"if it isn't found there.",
+			"b", &args->track);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<haar> --track_margin",
+			NULL,
+			"i", &args->track_margin);
+	ret |= cargo_set_option_description(cargo,
+			"--track_margin",
+			"How far the --track search extends on each side of the previous "
+			"cat head, in percent of its size. Default %d.",
+			HAAR_DEFAULT_TRACK_MARGIN);
+	ret |= cargo_add_validation(cargo, 0, "--track_margin",
+								cargo_validate_int_range(0, 400));
+
 	return ret;
 }
 
@@ -819,6 +1124,11 @@ void catcierge_haar_matcher_usage()
 	fprintf(stderr, "                        Normal is simpler and doesn't catch such corner cases as well.\n");
 	fprintf(stderr, " --prey_steps <1-2>     Only applicable for normal prey mode. 2 means a secondary\n");
 	fprintf(stderr, "                        search should be made if no prey is found initially.\n");
+	fprintf(stderr, " --prey_cascade <path> [<path> ...]\n");
+	fprintf(stderr, "                        Haar cascades trained to find prey, run around the cat head in order.\n");
+	fprintf(stderr, " --track                Look for the cat head around the previous match first.\n");
+	fprintf(stderr, " --track_margin <percent>\n");
+	fprintf(stderr, "                        How far the --track search extends around the previous cat head.\n");
 	fprintf(stderr, "\n");
 }
 
@@ -833,6 +1143,9 @@ catcierge_output_var_t haar_vars[] =
 	{ "eq_histogram", "Value of --eq_histogram." },
 	{ "prey_method", "Value of --prey_method." },
 	{ "prey_steps", "Value of --prey_steps." },
+	{ "prey_cascade_count", "The number of cascades given by --prey_cascade." },
+	{ "track", "Value of --track." },
+	{ "track_margin", "Value of --track_margin." },
 };
 
 void catcierge_haar_output_print_usage()
@@ -917,11 +1230,30 @@ const char *catcierge_haar_matcher_translate(catcierge_matcher_t *octx, const ch
 		return buf;
 	}
 
+	if (!strcmp(var, "prey_cascade_count"))
+	{
+		snprintf(buf, bufsize - 1, "%d", (int)ctx->args->prey_cascade_count);
+		return buf;
+	}
+
+	if (!strcmp(var, "track"))
+	{
+		snprintf(buf, bufsize - 1, "%d", ctx->args->track);
+		return buf;
+	}
+
+	if (!strcmp(var, "track_margin"))
+	{
+		snprintf(buf, bufsize - 1, "%d", ctx->args->track_margin);
+		return buf;
+	}
+
 	return NULL;
 }
 
 void catcierge_haar_matcher_print_settings(catcierge_haar_matcher_args_t *args)
 {
+	size_t i;
 	assert(args);
 	printf("Haar Cascade Matcher:\n");
 	printf("           Cascade: %s\n", args->cascade);
@@ -931,6 +1263,11 @@ void catcierge_haar_matcher_print_settings(catcierge_haar_matcher_args_t *args)
 	printf("  No match is fail: %d\n", args->no_match_is_fail);
 	printf("       Prey method: %s\n", args->prey_method == PREY_METHOD_ADAPTIVE ? "Adaptive" : "Normal");
 	printf("        Prey steps: %d\n", args->prey_steps);
+	for (i = 0; i < args->prey_cascade_count; i++)
+	printf("    Prey cascade %d: %s\n", (int)i + 1, args->prey_cascades[i]);
+	printf("             Track: %d\n", args->track);
+	if (args->track)
+	printf("      Track margin: %d%%\n", args->track_margin);
 	printf("\n");
 }
 
@@ -947,6 +1284,7 @@ void catcierge_haar_matcher_args_init(catcierge_haar_matcher_args_t *args)
 	args->no_match_is_fail = 0;
 	args->prey_steps = 2;
 	args->prey_method = PREY_METHOD_ADAPTIVE;
+	args->track_margin = HAAR_DEFAULT_TRACK_MARGIN;
 }
 
 void catcierge_haar_matcher_set_debug(catcierge_haar_matcher_t *ctx, int debug)
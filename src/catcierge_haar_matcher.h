@@ -24,6 +24,7 @@
 #include "catcierge_haar_wrapper.h"
 #include "catcierge_types.h"
 #include "catcierge_matcher.h"
+#include "catcierge_morph.h"
 #include "cargo.h"
 
 #define HAAR_FAIL 0.0
@@ -31,6 +32,14 @@
 #define HAAR_SUCCESS_NO_HEAD 2.0 // Used to be 0.998 
 #define HAAR_SUCCESS_NO_HEAD_IS_FAIL 3.0 // 0.999
 
+// Blobs in the thresholded prey area smaller than this are ignored.
+#define HAAR_MIN_BLOB_AREA 10.0
+
+#define HAAR_DEFAULT_TRACK_MARGIN 50 // Percent of the head size.
+
+// The prey cascades search this far around the head, in percent of its size.
+#define HAAR_PREY_CASCADE_MARGIN 50
+
 typedef enum catcierge_haar_prey_method_e
 {
 	PREY_METHOD_ADAPTIVE,
@@ -50,18 +59,28 @@ typedef struct catcierge_haar_matcher_args_s
 	int no_match_is_fail;
 	catcierge_haar_prey_method_t prey_method;
 	int prey_steps;
+	char **prey_cascades;		// Cascades that detect prey directly, run in this order.
+	size_t prey_cascade_count;
+	int track;					// Look for the head around the previous match first.
+	int track_margin;			// Percent of the head size the track window extends on each side.
 	int debug;
 } catcierge_haar_matcher_args_t;
 
 typedef struct catcierge_haar_matcher_s
 {
 	catcierge_matcher_t super;
-	CvMemStorage *storage;
+	CvMemStorage *storage;			// Scratch storage, cleared after each match.
 	IplConvKernel *kernel2x2;
 	IplConvKernel *kernel3x3;
 	IplConvKernel *kernel5x1;
+	catcierge_binmorph_t binmorph;	// Bit packed buffers for the adaptive prey morphology.
+	catcierge_blob_counter_t blobs;	// Counts the blobs when looking for prey.
 
 	cv2CascadeClassifier *cascade;
+	cv2CascadeClassifier **prey_cascades;
+
+	int track_valid;				// Is track_rect from the previous match in the match group?
+	CvRect track_rect;				// The head found in the previous match.
 
 	catcierge_haar_matcher_args_t *args;
 } catcierge_haar_matcher_t;
@@ -73,6 +92,7 @@ int catcierge_haar_matcher_init(catcierge_matcher_t **ctx, catcierge_matcher_arg
 void catcierge_haar_matcher_destroy(catcierge_matcher_t **ctx);
 double catcierge_haar_matcher_match(void *ctx, IplImage *img, match_result_t *result, int save_steps);
 int catcierge_haar_matcher_decide(void *ctx, match_group_t *mg);
+void catcierge_haar_matcher_reset(catcierge_matcher_t *ctx);
 void catcierge_haar_matcher_set_debug(catcierge_haar_matcher_t *ctx, int debug);
 
 int catcierge_haar_matcher_add_options(cargo_t cargo,
@@ -33,15 +33,12 @@ int catcierge_nocolor = 0;
 
 char *get_time_str_fmt(time_t t, struct timeval *tv, char *time_str, size_t len, const char *fmt)
 {
-	struct tm tm;
-	localtime_r(&t, &tm);
-
 	if (!fmt)
 	{
 		fmt = "%Y-%m-%d %H:%M:%S.%f";
 	}
 
-	if (catcierge_strftime(time_str, len, fmt, &tm, tv))
+	if (!catcierge_strftime_time(time_str, len, fmt, t, tv))
 	{
 		return NULL;
 	}
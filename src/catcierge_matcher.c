@@ -19,6 +19,8 @@
 
 #include "catcierge_config.h"
 #include <stdio.h>
+#include <assert.h>
+#include <string.h>
 
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
@@ -31,7 +33,11 @@
 #include "catcierge_matcher.h"
 #include "catcierge_template_matcher.h"
 #include "catcierge_haar_matcher.h"
+#ifdef WITH_DNN
+#include "catcierge_dnn_matcher.h"
+#endif
 #include "catcierge_log.h"
+#include "catcierge_timer.h"
 
 int catcierge_matcher_init(catcierge_matcher_t **ctx, catcierge_matcher_args_t *args)
 {
@@ -51,13 +57,28 @@ int catcierge_matcher_init(catcierge_matcher_t **ctx, catcierge_matcher_args_t *
 			return -1;
 		}
 	}
+	#ifdef WITH_DNN
+	else if (args->type == MATCHER_DNN)
+	{
+		if (catcierge_dnn_matcher_init(ctx, args))
+		{
+			return -1;
+		}
+	}
+	#endif // WITH_DNN
 	else
 	{
 		CATERR("Failed to init matcher. Invalid matcher type given\n");
 		return -1;
 	}
 
-	if (!(*ctx)->is_obstructed)
+	if (args->obstruct_method == OBSTRUCT_METHOD_BACKGROUND)
+	{
+		catcierge_bg_model_init(&(*ctx)->obstruct_bg,
+			args->obstruct_bg_rate, args->obstruct_bg_thr, args->obstruct_bg_scale);
+		(*ctx)->is_obstructed = catcierge_is_frame_obstructed_bg;
+	}
+	else if (!(*ctx)->is_obstructed)
 	{
 		(*ctx)->is_obstructed = catcierge_is_frame_obstructed;
 	}
@@ -73,6 +94,8 @@ void catcierge_matcher_destroy(catcierge_matcher_t **ctx)
 	{
 		catcierge_matcher_t *c = *ctx;
 
+		catcierge_bg_model_destroy(&c->obstruct_bg);
+
 		if (c->type == MATCHER_TEMPLATE)
 		{
 			catcierge_template_matcher_destroy(ctx);
@@ -81,12 +104,178 @@ void catcierge_matcher_destroy(catcierge_matcher_t **ctx)
 		{
 			catcierge_haar_matcher_destroy(ctx);
 		}
+		#ifdef WITH_DNN
+		else if (c->type == MATCHER_DNN)
+		{
+			catcierge_dnn_matcher_destroy(ctx);
+		}
+		#endif // WITH_DNN
 	}
 
 	*ctx = NULL;
 }
 
+const char *catcierge_matcher_stage_str(catcierge_matcher_stage_t stage)
+{
+	switch (stage)
+	{
+		case MATCHER_STAGE_GRAYSCALE: return "grayscale";
+		case MATCHER_STAGE_EQUALIZE: return "equalize";
+		case MATCHER_STAGE_CASCADE: return "cascade";
+		case MATCHER_STAGE_THRESHOLD: return "threshold";
+		case MATCHER_STAGE_MORPHOLOGY: return "morphology";
+		case MATCHER_STAGE_CONTOURS: return "contours";
+		case MATCHER_STAGE_TEMPLATE: return "template";
+		case MATCHER_STAGE_RESIZE: return "resize";
+		case MATCHER_STAGE_INFERENCE: return "inference";
+		default: return "unknown";
+	}
+}
+
+double catcierge_matcher_stage_begin(catcierge_matcher_t *ctx, catcierge_matcher_stage_t stage)
+{
+	assert(ctx);
+	assert((stage >= 0) && (stage < MATCHER_STAGE_COUNT));
+
+	if (!ctx->stages)
+		return 0.0;
+
+	return catcierge_span_begin(&ctx->stages[stage]);
+}
+
+void catcierge_matcher_stage_end(catcierge_matcher_t *ctx, catcierge_matcher_stage_t stage, double begin)
+{
+	assert(ctx);
+	assert((stage >= 0) && (stage < MATCHER_STAGE_COUNT));
+
+	if (!ctx->stages)
+		return;
+
+	catcierge_span_end(&ctx->stages[stage], begin);
+}
+
+//
+// Returns the image for the next step of the result for the matcher to
+// draw into. It is taken from the step pool of the result if it has one,
+// so the buffers are reused between matches. The step is added to the
+// result by catcierge_match_step_end.
+//
+IplImage *catcierge_match_step_begin(match_result_t *result, CvSize size, int depth, int channels)
+{
+	match_step_t *step;
+	assert(result);
+	assert(result->step_img_count < MAX_STEPS);
+
+	step = &result->steps[result->step_img_count];
+	catcierge_match_step_release(step);
+
+	if (result->step_pool)
+	{
+		if ((step->frame = catcierge_frame_pool_alloc(result->step_pool, size, depth, channels)))
+		{
+			step->img = step->frame->img;
+		}
+	}
+	else
+	{
+		step->img = cvCreateImage(size, depth, channels);
+	}
+
+	return step->img;
+}
+
+void catcierge_match_step_end(match_result_t *result, const char *name, const char *description)
+{
+	match_step_t *step;
+	assert(result);
+	assert(result->step_img_count < MAX_STEPS);
+
+	step = &result->steps[result->step_img_count];
+	assert(step->img);
+	step->name = name;
+	step->description = description;
+
+	result->step_img_count++;
+}
+
+// Adds a copy of the Region Of Interest (ROI) of img as the next step.
+int catcierge_match_step_add(match_result_t *result, IplImage *img, const char *name, const char *description)
+{
+	IplImage *step_img;
+	CvRect roi;
+	assert(img);
+
+	roi = cvGetImageROI(img);
+
+	if (!(step_img = catcierge_match_step_begin(result,
+			cvSize(roi.width, roi.height), img->depth, img->nChannels)))
+	{
+		return -1;
+	}
+
+	cvCopy(img, step_img, NULL);
+	catcierge_match_step_end(result, name, description);
+
+	return 0;
+}
+
+void catcierge_match_step_release(match_step_t *step)
+{
+	assert(step);
+
+	if (step->frame)
+	{
+		catcierge_frame_unref(&step->frame);
+		step->img = NULL;
+	}
+	else if (step->img)
+	{
+		cvReleaseImage(&step->img);
+	}
+}
+
+int catcierge_parse_steps_mode(const char *str)
+{
+	if (!strcasecmp(str, "full"))
+		return STEPS_FULL;
+	else if (!strcasecmp(str, "summary"))
+		return STEPS_SUMMARY;
+	else if (!strcasecmp(str, "lazy"))
+		return STEPS_LAZY;
+
+	return -1;
+}
+
+const char *catcierge_steps_mode_str(catcierge_steps_mode_t mode)
+{
+	switch (mode)
+	{
+		case STEPS_OFF: return "off";
+		case STEPS_FULL: return "full";
+		case STEPS_SUMMARY: return "summary";
+		case STEPS_LAZY: return "lazy";
+		default: return "unknown";
+	}
+}
+
 int catcierge_get_back_light_area(catcierge_matcher_t *ctx, IplImage *img, CvRect *r)
+{
+	int ret;
+	CvMemStorage *storage = NULL;
+
+	if (!(storage = cvCreateMemStorage(0)))
+	{
+		return -1;
+	}
+
+	ret = catcierge_find_back_light_area(ctx, img, r, storage);
+	cvReleaseMemStorage(&storage);
+
+	return ret;
+}
+
+int catcierge_find_back_light_area(catcierge_matcher_t *ctx, IplImage *img,
+									CvRect *r, CvMemStorage *storage)
 {
 	int ret = 0;
 	CvSeq *contours = NULL;
@@ -97,15 +286,12 @@ int catcierge_get_back_light_area(catcierge_matcher_t *ctx, IplImage *img, CvRec
 	IplImage *img_gray = NULL;
 	IplImage *img_thr = NULL;
 	IplImage *img_eq = NULL;
-	CvMemStorage *storage = NULL;
 	catcierge_matcher_args_t *args = ctx->args;
 	assert(ctx);
 	assert(r);
+	assert(storage);
 
-	if (!(storage = cvCreateMemStorage(0)))
-	{
-		return -1;
-	}
+	cvClearMemStorage(storage);
 
 	// Only covert to grayscale if needed.
 	if (img->nChannels != 1)
@@ -193,88 +379,180 @@ fail:
 
 	cvReleaseImage(&img_thr);
 	cvReleaseImage(&img_eq);
-	cvReleaseMemStorage(&storage);
 
 	return ret;
 }
 
-int catcierge_is_frame_obstructed(catcierge_matcher_t *ctx, IplImage *img)
+int catcierge_parse_obstruct_method(const char *str)
+{
+	if (!strcmp(str, "threshold")) return OBSTRUCT_METHOD_THRESHOLD;
+	if (!strcmp(str, "background")) return OBSTRUCT_METHOD_BACKGROUND;
+	return -1;
+}
+
+const char *catcierge_obstruct_method_str(catcierge_obstruct_method_t method)
+{
+	switch (method)
+	{
+		case OBSTRUCT_METHOD_THRESHOLD: return "threshold";
+		case OBSTRUCT_METHOD_BACKGROUND: return "background";
+		default: return "unknown";
+	}
+}
+
+static int catcierge_matcher_frame_scale(catcierge_matcher_t *ctx)
+{
+	return (ctx->args->frame_scale > 1) ? ctx->args->frame_scale : 1;
+}
+
+static CvRect catcierge_scale_rect(CvRect r, int scale)
+{
+	return cvRect(r.x / scale, r.y / scale, r.width / scale, r.height / scale);
+}
+
+CvRect catcierge_get_obstruct_rect(catcierge_matcher_t *ctx, IplImage *img)
 {
 	CvSize size;
 	int w;
 	int h;
 	int x;
 	int y;
-	int sum;
-	IplImage *tmp = NULL;
-	IplImage *tmp2 = NULL;
-	CvRect orig_roi = cvGetImageROI(img);
 	CvRect *roi;
 	assert(ctx);
 
 	roi = ctx->args->roi;
 
-	if (roi && (roi->width != 0) && (roi->height != 0))
-	{
-		cvSetImageROI(img, *roi);
-	}
-
 	// Get a suitable Region Of Interest (ROI)
 	// in the center of the image.
 	// (This should contain only the white background)
 
-	size = cvGetSize(img);
+	if (roi && (roi->width != 0) && (roi->height != 0))
+	{
+		size = cvSize(roi->width, roi->height);
+	}
+	else
+	{
+		size = cvGetSize(img);
+		size.width *= catcierge_matcher_frame_scale(ctx);
+		size.height *= catcierge_matcher_frame_scale(ctx);
+	}
+
 	w = (int)(size.width / 2);
 	h = (int)(size.height * 0.1);
 	x = (roi ? roi->x : 0) + (size.width - w) / 2;
 	y = (roi ? roi->y : 0) + (size.height - h) / 2;
 
-	cvSetImageROI(img, cvRect(x, y, w, h));
+	return cvRect(x, y, w, h);
+}
 
-	// Only covert to grayscale if needed.
-	if (img->nChannels != 1)
+int catcierge_is_frame_obstructed_bg(catcierge_matcher_t *ctx, IplImage *img)
+{
+	assert(ctx);
+	assert(img);
+
+	return catcierge_bg_model_update(&ctx->obstruct_bg, img,
+				catcierge_get_obstruct_rect(ctx, img),
+				catcierge_matcher_frame_scale(ctx));
+}
+
+int catcierge_count_obstruct_pixels(IplImage *img, CvRect r, int step)
+{
+	int x;
+	int y;
+	int x_end;
+	int y_end;
+	int count = 0;
+	int channels;
+	unsigned char *row;
+	assert(img);
+
+	if (step < 1)
 	{
-		tmp = cvCreateImage(cvSize(w, h), 8, 1);
-		cvCvtColor(img, tmp, CV_BGR2GRAY);
+		step = 1;
 	}
-	else
+
+	// Clip to the image the same way cvSetImageROI does.
+	x_end = r.x + r.width;
+	y_end = r.y + r.height;
+	if (x_end > img->width) x_end = img->width;
+	if (y_end > img->height) y_end = img->height;
+	if (r.x < 0) r.x = 0;
+	if (r.y < 0) r.y = 0;
+	channels = img->nChannels;
+
+	for (y = r.y; y < y_end; y += step)
 	{
-		tmp = img;
+		row = (unsigned char *)img->imageData + y * img->widthStep;
+
+		if (channels == 1)
+		{
+			for (x = r.x; x < x_end; x += step)
+			{
+				count += (row[x] <= CATCIERGE_OBSTRUCT_DARK_LEVEL);
+			}
+		}
+		else
+		{
+			// Same fixed point BGR to gray conversion as cvCvtColor.
+			for (x = r.x; x < x_end; x += step)
+			{
+				unsigned char *p = &row[x * channels];
+				int gray = (p[0] * 1868 + p[1] * 9617 + p[2] * 4899 + (1 << 13)) >> 14;
+				count += (gray <= CATCIERGE_OBSTRUCT_DARK_LEVEL);
+			}
+		}
 	}
 
-	// Get a binary image and sum the pixel values.
-	tmp2 = cvCreateImage(cvSize(w, h), 8, 1);
-	cvThreshold(tmp, tmp2, 90, 255, CV_THRESH_BINARY_INV);
+	return count;
+}
+
+int catcierge_is_frame_obstructed_decimated(catcierge_matcher_t *ctx,
+		IplImage *img, int decimation, int *escalated)
+{
+	int estimate;
+	int scale;
+	int step;
+	CvRect r;
+	assert(ctx);
+	assert(img);
 
-	sum = (int)cvSum(tmp2).val[0] / 255;
+	// Idle frames are smaller, but the pixel limit is for full frames.
+	scale = catcierge_matcher_frame_scale(ctx);
+	r = catcierge_scale_rect(catcierge_get_obstruct_rect(ctx, img), scale);
+	step = decimation / scale;
 
-	#if 0
+	if (escalated)
 	{
-		// NOTE! Since this function this runs very often, this should
-		// only ever be turned on while developing, it will spam ALOT.
-		//cvRectangleR(img, cvRect(x, y, w, h), CV_RGB(255, 0, 0), 2, 8, 0);
-		cvShowImage("obstruct_roi", img);
-
-		printf("\nroi: x: %d, y: %d, w: %d, h:%d\n",
-			roi.x, roi.y, roi.width, roi.height);
-		printf("size: w: %d, h: %d\n", size.width, size.height);
-		printf("x: %d, y: %d, w: %d, h: %d\n", x, y, w, h);
-
-		printf("Sum: %d\n", sum);
-		cvShowImage("obstruct", tmp2);
-		//cvWaitKey(0);
+		*escalated = 0;
 	}
-	#endif
-
-	cvSetImageROI(img, orig_roi);
 
-	if (img->nChannels != 1)
+	// Look at every decimation:th pixel and row first, and only count
+	// every pixel when the estimate is too close to call.
+	if (step > 1)
 	{
-		cvReleaseImage(&tmp);
+		estimate = catcierge_count_obstruct_pixels(img, r, step)
+					* step * step * scale * scale;
+
+		if ((estimate < (CATCIERGE_OBSTRUCT_MIN_PIXELS / 2))
+		 || (estimate > (CATCIERGE_OBSTRUCT_MIN_PIXELS * 2)))
+		{
+			return (estimate > CATCIERGE_OBSTRUCT_MIN_PIXELS);
+		}
+
+		if (escalated)
+		{
+			*escalated = 1;
+		}
 	}
 
-	cvReleaseImage(&tmp2);
+	return ((catcierge_count_obstruct_pixels(img, r, 1) * scale * scale)
+			> CATCIERGE_OBSTRUCT_MIN_PIXELS);
+}
+
+int catcierge_is_frame_obstructed(catcierge_matcher_t *ctx, IplImage *img)
+{
+	assert(ctx);
 
-	// Spiders and other 1 pixel creatures need not bother!
-	return ((int)sum > 200);
+	return catcierge_is_frame_obstructed_decimated(ctx, img,
+				ctx->args->obstruct_decimation, NULL);
 }
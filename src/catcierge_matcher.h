@@ -23,9 +23,11 @@
 #include <opencv2/highgui/highgui_c.h>
 
 #include "catcierge_types.h"
+#include "catcierge_obstruct.h"
 
 #define DEFAULT_AUTOROI_THR 90
 #define DEFAULT_MIN_BACKLIGHT 10000
+#define DEFAULT_AUTOROI_TOLERANCE 8
 
 struct catcierge_matcher_s;
 
@@ -39,6 +41,25 @@ typedef const char *(*catcierge_matcher_translate_func_t)(struct catcierge_match
 
 typedef int (*catcierge_is_obstruct_func_t)(struct catcierge_matcher_s *ctx, IplImage *img);
 
+typedef int (*catcierge_match_group_func_t)(struct catcierge_matcher_s *ctx, match_group_t *mg);
+
+typedef void (*catcierge_matcher_reset_func_t)(struct catcierge_matcher_s *ctx);
+
+// Stages of the matcher algorithms that can be timed.
+typedef enum catcierge_matcher_stage_e
+{
+	MATCHER_STAGE_GRAYSCALE,
+	MATCHER_STAGE_EQUALIZE,
+	MATCHER_STAGE_CASCADE,
+	MATCHER_STAGE_THRESHOLD,
+	MATCHER_STAGE_MORPHOLOGY,
+	MATCHER_STAGE_CONTOURS,
+	MATCHER_STAGE_TEMPLATE,
+	MATCHER_STAGE_RESIZE,
+	MATCHER_STAGE_INFERENCE,
+	MATCHER_STAGE_COUNT
+} catcierge_matcher_stage_t;
+
 typedef struct catcierge_matcher_args_s
 {
 	catcierge_matcher_type_t type;
@@ -46,6 +67,12 @@ typedef struct catcierge_matcher_args_s
 	int auto_roi_thr;
 	int min_backlight;
 	int save_auto_roi_img;
+	catcierge_obstruct_method_t obstruct_method;
+	int obstruct_bg_rate;
+	int obstruct_bg_thr;
+	int obstruct_bg_scale;
+	int obstruct_decimation;
+	int frame_scale;		// Frames are this many times smaller than the ROI coordinates (idle capture).
 } catcierge_matcher_args_t;
 
 typedef struct catcierge_matcher_s
@@ -58,14 +85,49 @@ typedef struct catcierge_matcher_s
 	catcierge_decide_func_t decide;
 	catcierge_matcher_translate_func_t translate;
 	catcierge_is_obstruct_func_t is_obstructed;
+	catcierge_matcher_reset_func_t reset; // Called when a new match group starts, may be NULL.
+	catcierge_match_group_func_t match_group; // Called before the lock is decided, may be NULL.
 	catcierge_matcher_args_t *args;
+	catcierge_span_t *stages;	// MATCHER_STAGE_COUNT stage timings, only recorded when set.
+	catcierge_bg_model_t obstruct_bg; // Used by --obstruct_method background.
 } catcierge_matcher_t;
 
+IplImage *catcierge_match_step_begin(match_result_t *result, CvSize size, int depth, int channels);
+void catcierge_match_step_end(match_result_t *result, const char *name, const char *description);
+int catcierge_match_step_add(match_result_t *result, IplImage *img, const char *name, const char *description);
+void catcierge_match_step_release(match_step_t *step);
+int catcierge_parse_steps_mode(const char *str);
+const char *catcierge_steps_mode_str(catcierge_steps_mode_t mode);
+
 int catcierge_get_back_light_area(catcierge_matcher_t *ctx, IplImage *img, CvRect *r);
+
+// Same as catcierge_get_back_light_area but reuses the given storage,
+// which is cleared first, instead of creating a new one.
+int catcierge_find_back_light_area(catcierge_matcher_t *ctx, IplImage *img,
+									CvRect *r, CvMemStorage *storage);
+// The strip checked for obstruction, in full frame coordinates.
+CvRect catcierge_get_obstruct_rect(catcierge_matcher_t *ctx, IplImage *img);
 int catcierge_is_frame_obstructed(struct catcierge_matcher_s *ctx, IplImage *img);
 
+// Counts the pixels in r dark enough to block the back light, only looking
+// at every step:th pixel of every step:th row.
+int catcierge_count_obstruct_pixels(IplImage *img, CvRect r, int step);
+
+// The threshold obstruction check. With a decimation above 1 a decimated
+// estimate is used unless it is near the decision boundary, escalated is
+// set if the full resolution count was needed.
+int catcierge_is_frame_obstructed_decimated(catcierge_matcher_t *ctx,
+		IplImage *img, int decimation, int *escalated);
+int catcierge_is_frame_obstructed_bg(struct catcierge_matcher_s *ctx, IplImage *img);
+int catcierge_parse_obstruct_method(const char *str);
+const char *catcierge_obstruct_method_str(catcierge_obstruct_method_t method);
+
 int catcierge_matcher_init(catcierge_matcher_t **ctx, catcierge_matcher_args_t *args);
 void catcierge_matcher_destroy(catcierge_matcher_t **ctx);
 
+const char *catcierge_matcher_stage_str(catcierge_matcher_stage_t stage);
+double catcierge_matcher_stage_begin(catcierge_matcher_t *ctx, catcierge_matcher_stage_t stage);
+void catcierge_matcher_stage_end(catcierge_matcher_t *ctx, catcierge_matcher_stage_t stage, double begin);
+
 
 #endif // __CATCIERGE_MATCHER_H__
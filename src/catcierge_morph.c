@@ -0,0 +1,690 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "catcierge_morph.h"
+#include "catcierge_log.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CATCIERGE_BINMORPH_NEON
+#endif
+
+#define WORD_BITS 64
+
+void catcierge_binmorph_destroy(catcierge_binmorph_t *m)
+{
+	assert(m);
+	free(m->bits);
+	m->bits = NULL;
+	m->size = 0;
+}
+
+// A rectangle kernel of size applied iterations times is the same
+// as a single bigger rectangle (pixels outside are ignored).
+static int catcierge_binmorph_box(int size, int iterations)
+{
+	if ((size <= 1) || (iterations <= 0))
+	{
+		return 1;
+	}
+
+	return size + (size - 1) * (iterations - 1);
+}
+
+// Bit x of every word set if pixel x of a or b is set.
+static void catcierge_binmorph_pack(uint64_t *row, const unsigned char *a,
+									const unsigned char *b, int width)
+{
+	int x = 0;
+	int i;
+	uint64_t w;
+
+	for (i = 0; (x + WORD_BITS) <= width; i++)
+	{
+		w = 0;
+
+		#if defined(__SSE2__)
+		{
+			int k;
+			__m128i zero = _mm_setzero_si128();
+
+			for (k = 0; k < WORD_BITS; k += 16)
+			{
+				__m128i v = _mm_or_si128(
+					_mm_loadu_si128((const __m128i *)(a + x + k)),
+					_mm_loadu_si128((const __m128i *)(b + x + k)));
+				unsigned int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+				w |= (uint64_t)(~zeros & 0xFFFF) << k;
+			}
+		}
+		#elif defined(CATCIERGE_BINMORPH_NEON)
+		{
+			int k;
+			static const uint8_t weights[16] =
+				{ 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+			uint8x16_t wv = vld1q_u8(weights);
+
+			for (k = 0; k < WORD_BITS; k += 16)
+			{
+				uint8x16_t v = vorrq_u8(vld1q_u8(a + x + k), vld1q_u8(b + x + k));
+				uint8x16_t m = vandq_u8(vtstq_u8(v, v), wv);
+				uint8x8_t p = vpadd_u8(vget_low_u8(m), vget_high_u8(m));
+				p = vpadd_u8(p, p);
+				p = vpadd_u8(p, p);
+				w |= (uint64_t)vget_lane_u16(vreinterpret_u16_u8(p), 0) << k;
+			}
+		}
+		#else
+		{
+			int k;
+
+			for (k = 0; k < WORD_BITS; k++)
+			{
+				w |= (uint64_t)((a[x + k] | b[x + k]) != 0) << k;
+			}
+		}
+		#endif
+
+		row[i] = w;
+		x += WORD_BITS;
+	}
+
+	if (x < width)
+	{
+		w = 0;
+
+		for (; x < width; x++)
+		{
+			w |= (uint64_t)((a[x] | b[x]) != 0) << (x % WORD_BITS);
+		}
+
+		row[i] = w;
+	}
+}
+
+// dst pixel x = 0 if bit x is set, 255 if not.
+static void catcierge_binmorph_unpack_not(unsigned char *dst, const uint64_t *row, int width)
+{
+	int x = 0;
+	int i;
+	uint64_t w;
+
+	for (i = 0; (x + WORD_BITS) <= width; i++)
+	{
+		w = row[i];
+
+		#if defined(__SSE2__)
+		{
+			int k;
+			__m128i sel = _mm_set_epi32(0x80402010, 0x08040201, 0x80402010, 0x08040201);
+			__m128i zero = _mm_setzero_si128();
+
+			for (k = 0; k < WORD_BITS; k += 16)
+			{
+				unsigned int lo = (unsigned int)(w >> k) & 0xFF;
+				unsigned int hi = (unsigned int)(w >> (k + 8)) & 0xFF;
+				__m128i v = _mm_set_epi32((int)(hi * 0x01010101), (int)(hi * 0x01010101),
+										(int)(lo * 0x01010101), (int)(lo * 0x01010101));
+				_mm_storeu_si128((__m128i *)(dst + x + k),
+					_mm_cmpeq_epi8(_mm_and_si128(v, sel), zero));
+			}
+		}
+		#elif defined(CATCIERGE_BINMORPH_NEON)
+		{
+			int k;
+			static const uint8_t weights[16] =
+				{ 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+			uint8x16_t wv = vld1q_u8(weights);
+
+			for (k = 0; k < WORD_BITS; k += 16)
+			{
+				uint8x16_t v = vcombine_u8(vdup_n_u8((uint8_t)(w >> k)),
+											vdup_n_u8((uint8_t)(w >> (k + 8))));
+				vst1q_u8(dst + x + k, vmvnq_u8(vtstq_u8(v, wv)));
+			}
+		}
+		#else
+		{
+			int k;
+
+			for (k = 0; k < WORD_BITS; k++)
+			{
+				dst[x + k] = ((w >> k) & 1) ? 0 : 255;
+			}
+		}
+		#endif
+
+		x += WORD_BITS;
+	}
+
+	for (; x < width; x++)
+	{
+		dst[x] = ((row[x / WORD_BITS] >> (x % WORD_BITS)) & 1) ? 0 : 255;
+	}
+}
+
+// dst bit x = src bit x + n, fill for the bits past the end of the row.
+static void catcierge_binmorph_shr(uint64_t *dst, const uint64_t *src,
+									int words, int n, uint64_t fill)
+{
+	int i;
+	int q = n / WORD_BITS;
+	int r = n % WORD_BITS;
+	uint64_t lo;
+	uint64_t hi;
+
+	for (i = 0; i < words; i++)
+	{
+		lo = ((i + q) < words) ? src[i + q] : fill;
+
+		if (r == 0)
+		{
+			dst[i] = lo;
+			continue;
+		}
+
+		hi = ((i + q + 1) < words) ? src[i + q + 1] : fill;
+		dst[i] = (lo >> r) | (hi << (WORD_BITS - r));
+	}
+}
+
+// Erodes (AND) or dilates (OR) a row with a box of width pixels starting
+// at each pixel. Windows of 1, 2, 4... pixels are doubled up and the last
+// one overlaps, so it takes log2(width) shifts.
+static void catcierge_binmorph_row(uint64_t *row, uint64_t *tmp, int words, int width, int dilate)
+{
+	int i;
+	int c = 1;
+	int n;
+	uint64_t fill = dilate ? 0 : ~(uint64_t)0;
+
+	while (c < width)
+	{
+		n = ((c * 2) <= width) ? c : (width - c);
+		catcierge_binmorph_shr(tmp, row, words, n, fill);
+
+		for (i = 0; i < words; i++)
+		{
+			row[i] = dilate ? (row[i] | tmp[i]) : (row[i] & tmp[i]);
+		}
+
+		c += n;
+	}
+}
+
+// The top left pixel of the ROI.
+static unsigned char *catcierge_binmorph_origin(const IplImage *img, CvRect *r)
+{
+	*r = cvGetImageROI(img);
+	return (unsigned char *)img->imageData + (size_t)r->y * img->widthStep + r->x;
+}
+
+int catcierge_binmorph_combine_open_dilate_not(catcierge_binmorph_t *m,
+		const IplImage *a, const IplImage *b, IplImage *dst,
+		int open_size, int open_iterations,
+		int dilate_size, int dilate_iterations)
+{
+	int x;
+	int y;
+	int k;
+	int i;
+	int width;
+	int height;
+	int words;
+	int erode_box;
+	int dilate_box;
+	size_t size;
+	uint64_t *rows;
+	uint64_t *tmp;
+	uint64_t *acc;
+	uint64_t pad;
+	CvRect ra;
+	CvRect rb;
+	CvRect rdst;
+	const unsigned char *pa;
+	const unsigned char *pb;
+	unsigned char *pdst;
+	assert(m);
+	assert(a);
+	assert(b);
+	assert(dst);
+
+	pa = catcierge_binmorph_origin(a, &ra);
+	pb = catcierge_binmorph_origin(b, &rb);
+	pdst = catcierge_binmorph_origin(dst, &rdst);
+	width = ra.width;
+	height = ra.height;
+
+	if ((rb.width != width) || (rb.height != height)
+	 || (rdst.width != width) || (rdst.height != height)
+	 || (a->nChannels != 1) || (b->nChannels != 1) || (dst->nChannels != 1)
+	 || (a->depth != IPL_DEPTH_8U) || (b->depth != IPL_DEPTH_8U)
+	 || (dst->depth != IPL_DEPTH_8U))
+	{
+		CATERR("Binary morphology needs 8-bit gray images of the same size\n");
+		return -1;
+	}
+
+	if ((width <= 0) || (height <= 0))
+	{
+		return 0;
+	}
+
+	words = (width + WORD_BITS - 1) / WORD_BITS;
+	size = (size_t)words * (height + 2);
+
+	if (m->size < size)
+	{
+		uint64_t *bits;
+
+		if (!(bits = realloc(m->bits, size * sizeof(uint64_t))))
+		{
+			CATERR("Out of memory\n");
+			return -1;
+		}
+
+		m->bits = bits;
+		m->size = size;
+	}
+
+	rows = m->bits;
+	tmp = rows + (size_t)words * height;
+	acc = tmp + words;
+
+	// The bits past the width in the last word of each row.
+	x = width % WORD_BITS;
+	pad = x ? (~(uint64_t)0 << x) : 0;
+
+	// The erosion and the two dilations are boxes with the anchor in the
+	// top left corner, so they add up to one erosion and one dilation.
+	erode_box = catcierge_binmorph_box(open_size, open_iterations);
+	dilate_box = erode_box + catcierge_binmorph_box(dilate_size, dilate_iterations) - 1;
+
+	// Combine and erode the rows.
+	for (y = 0; y < height; y++)
+	{
+		uint64_t *row = rows + (size_t)y * words;
+
+		catcierge_binmorph_pack(row,
+			pa + (size_t)y * a->widthStep, pb + (size_t)y * b->widthStep, width);
+
+		// Pixels past the end are ignored by the erosion.
+		row[words - 1] |= pad;
+		catcierge_binmorph_row(row, tmp, words, erode_box, 0);
+	}
+
+	// Erode the columns and dilate the rows. Each row is only needed by
+	// the rows above it, so the result can replace it.
+	for (y = 0; y < height; y++)
+	{
+		uint64_t *row = rows + (size_t)y * words;
+
+		memcpy(acc, row, words * sizeof(uint64_t));
+
+		for (k = 1; (k < erode_box) && ((y + k) < height); k++)
+		{
+			const uint64_t *next = row + (size_t)k * words;
+
+			for (i = 0; i < words; i++)
+			{
+				acc[i] &= next[i];
+			}
+		}
+
+		// Pixels past the end are ignored by the dilation as well.
+		acc[words - 1] &= ~pad;
+		catcierge_binmorph_row(acc, tmp, words, dilate_box, 1);
+		memcpy(row, acc, words * sizeof(uint64_t));
+	}
+
+	// Dilate the columns and invert.
+	for (y = 0; y < height; y++)
+	{
+		uint64_t *row = rows + (size_t)y * words;
+
+		memcpy(acc, row, words * sizeof(uint64_t));
+
+		for (k = 1; (k < dilate_box) && ((y + k) < height); k++)
+		{
+			const uint64_t *next = row + (size_t)k * words;
+
+			for (i = 0; i < words; i++)
+			{
+				acc[i] |= next[i];
+			}
+		}
+
+		catcierge_binmorph_unpack_not(pdst + (size_t)y * dst->widthStep, acc, width);
+	}
+
+	return 0;
+}
+
+void catcierge_blob_counter_destroy(catcierge_blob_counter_t *bc)
+{
+	assert(bc);
+	free(bc->blobs);
+	free(bc->runs);
+	memset(bc, 0, sizeof(*bc));
+}
+
+static int catcierge_blob_find(catcierge_blob_t *blobs, int label)
+{
+	int root = label;
+	int next;
+
+	while (blobs[root].parent != root)
+	{
+		root = blobs[root].parent;
+	}
+
+	// Path compression.
+	while (blobs[label].parent != root)
+	{
+		next = blobs[label].parent;
+		blobs[label].parent = root;
+		label = next;
+	}
+
+	return root;
+}
+
+static int catcierge_blob_union(catcierge_blob_t *blobs, int a, int b)
+{
+	catcierge_blob_t *ra;
+	catcierge_blob_t *rb;
+
+	a = catcierge_blob_find(blobs, a);
+	b = catcierge_blob_find(blobs, b);
+
+	if (a == b)
+	{
+		return a;
+	}
+
+	// Keep the lower label, so the region outside stays label 0.
+	if (b < a)
+	{
+		int tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	ra = &blobs[a];
+	rb = &blobs[b];
+	rb->parent = a;
+	ra->area += rb->area;
+	ra->perimeter += rb->perimeter;
+
+	if (rb->last_row > ra->last_row)
+	{
+		ra->last_row = rb->last_row;
+	}
+
+	if (ra->enclosing < 0)
+	{
+		ra->enclosing = rb->enclosing;
+	}
+
+	return a;
+}
+
+// Splits row y into alternating runs of unset and set pixels. The first
+// and last rows and columns are treated as unset.
+static int catcierge_blob_row_runs(catcierge_blob_run_t *runs,
+								const unsigned char *row, int width, int y, int height)
+{
+	int count = 0;
+	int x = 0;
+	int set;
+	int start;
+
+	while (x < width)
+	{
+		start = x;
+		set = (y > 0) && (y < (height - 1)) && (x > 0) && (x < (width - 1)) && (row[x] != 0);
+
+		do
+		{
+			x++;
+		}
+		while ((x < width)
+			&& (set == ((y > 0) && (y < (height - 1)) && (x < (width - 1)) && (row[x] != 0))));
+
+		runs[count].start = start;
+		runs[count].end = x - 1;
+		runs[count].set = set;
+		runs[count].label = -1;
+		count++;
+	}
+
+	return count;
+}
+
+static int catcierge_blob_new(catcierge_blob_counter_t *bc, size_t *count, int hole)
+{
+	catcierge_blob_t *b;
+
+	if (*count >= bc->blob_size)
+	{
+		size_t size = bc->blob_size ? (bc->blob_size * 2) : 256;
+
+		if (!(b = realloc(bc->blobs, size * sizeof(catcierge_blob_t))))
+		{
+			return -1;
+		}
+
+		bc->blobs = b;
+		bc->blob_size = size;
+	}
+
+	b = &bc->blobs[*count];
+	memset(b, 0, sizeof(*b));
+	b->parent = (int)*count;
+	b->hole = hole;
+	b->enclosing = -1;
+
+	return (int)(*count)++;
+}
+
+// The area inside the contour through the centers of the border pixels.
+static double catcierge_blob_area(const catcierge_blob_t *b)
+{
+	// Pick's theorem for a region with straight borders. For a hole the
+	// contour goes through the pixels around it and cuts their corners.
+	if (b->hole)
+	{
+		return b->area + (b->perimeter / 2.0) - 1.0;
+	}
+
+	return b->area - (b->perimeter / 2.0) + 1.0;
+}
+
+int catcierge_count_blobs(catcierge_blob_counter_t *bc, const IplImage *img,
+						double min_area, int max_count)
+{
+	int count = 0;
+	int y;
+	int i;
+	int j;
+	int first;
+	int width;
+	int height;
+	int prev_count;
+	int cur_count;
+	int overlap;
+	int connected;
+	size_t blob_count = 0;
+	CvRect r;
+	const unsigned char *origin;
+	catcierge_blob_run_t *prev;
+	catcierge_blob_run_t *cur;
+	catcierge_blob_run_t *tmp;
+	catcierge_blob_t *b;
+	assert(bc);
+	assert(img);
+
+	if ((img->nChannels != 1) || (img->depth != IPL_DEPTH_8U))
+	{
+		CATERR("Blob counting needs an 8-bit gray image\n");
+		return -1;
+	}
+
+	origin = catcierge_binmorph_origin(img, &r);
+	width = r.width;
+	height = r.height;
+
+	// Everything is on the border.
+	if ((width < 3) || (height < 3))
+	{
+		return 0;
+	}
+
+	// A row has at most width runs.
+	if (bc->run_size < (size_t)(2 * width))
+	{
+		if (!(tmp = realloc(bc->runs, 2 * width * sizeof(catcierge_blob_run_t))))
+		{
+			CATERR("Out of memory\n");
+			return -1;
+		}
+
+		bc->runs = tmp;
+		bc->run_size = 2 * width;
+	}
+
+	prev = bc->runs;
+	cur = bc->runs + width;
+
+	// The first row is the unset region outside everything, label 0.
+	prev_count = catcierge_blob_row_runs(prev, origin, width, 0, height);
+	if ((prev[0].label = catcierge_blob_new(bc, &blob_count, 1)) < 0)
+		goto out_of_memory;
+	bc->blobs[0].area = width;
+
+	for (y = 1; y < height; y++)
+	{
+		cur_count = catcierge_blob_row_runs(cur,
+			origin + (size_t)y * img->widthStep, width, y, height);
+
+		first = 0;
+
+		// Join the runs with the overlapping runs of the same kind in the
+		// row above. Set pixels are 8-connected so they also join diagonally.
+		for (i = 0; i < cur_count; i++)
+		{
+			catcierge_blob_run_t *c = &cur[i];
+			int reach = c->set ? 1 : 0;
+			overlap = 0;
+			connected = 0;
+
+			while ((first < prev_count) && (prev[first].end < (c->start - 1)))
+			{
+				first++;
+			}
+
+			for (j = first; (j < prev_count) && (prev[j].start <= (c->end + 1)); j++)
+			{
+				catcierge_blob_run_t *p = &prev[j];
+				int lo;
+				int hi;
+
+				if ((p->set != c->set)
+				 || (p->end < (c->start - reach))
+				 || (p->start > (c->end + reach)))
+				{
+					continue;
+				}
+
+				c->label = (c->label < 0) ? catcierge_blob_find(bc->blobs, p->label)
+							: catcierge_blob_union(bc->blobs, c->label, p->label);
+
+				// Pixels on top of each other don't have an edge between them.
+				lo = (p->start > c->start) ? p->start : c->start;
+				hi = (p->end < c->end) ? p->end : c->end;
+				overlap += (hi >= lo) ? (hi - lo + 1) : 0;
+				connected = 1;
+			}
+
+			if (!connected && ((c->label = catcierge_blob_new(bc, &blob_count, !c->set)) < 0))
+			{
+				goto out_of_memory;
+			}
+
+			b = &bc->blobs[catcierge_blob_find(bc->blobs, c->label)];
+			b->area += c->end - c->start + 1;
+			b->perimeter += 2 + 2 * (c->end - c->start + 1) - 2 * overlap;
+			b->last_row = y;
+
+			// The run to the left of the first run of a region
+			// is part of the region around it.
+			if ((b->enclosing < 0) && (i > 0))
+			{
+				b->enclosing = cur[i - 1].label;
+			}
+		}
+
+		// Regions in the row above that didn't continue into this row are done.
+		for (j = 0; j < prev_count; j++)
+		{
+			b = &bc->blobs[catcierge_blob_find(bc->blobs, prev[j].label)];
+
+			if (b->last_row != (y - 1))
+			{
+				continue;
+			}
+
+			b->last_row = -1;
+
+			// The contour of the region around it goes around this one
+			// as well, so its area includes this one.
+			if (b->enclosing >= 0)
+			{
+				catcierge_blob_t *e = &bc->blobs[catcierge_blob_find(bc->blobs, b->enclosing)];
+				e->area += b->area;
+				e->perimeter -= b->perimeter;
+			}
+
+			if (catcierge_blob_area(b) > min_area)
+			{
+				count++;
+
+				if ((max_count > 0) && (count >= max_count))
+				{
+					return count;
+				}
+			}
+		}
+
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+		prev_count = cur_count;
+	}
+
+	return count;
+
+out_of_memory:
+	CATERR("Out of memory\n");
+	return -1;
+}
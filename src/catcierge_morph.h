@@ -0,0 +1,117 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_MORPH_H__
+#define __CATCIERGE_MORPH_H__
+
+#include <stdint.h>
+#include <opencv2/imgproc/imgproc_c.h>
+
+//
+// Binary morphology on bit packed rows.
+//
+// The adaptive prey detection combines two thresholded images, opens the
+// result to get rid of noise, dilates it and inverts it, which with OpenCV
+// is four full passes over the image each with its own output image. All
+// of the images are binary, so here every row is packed into 64 pixels per
+// word and the whole chain is done with word wide AND, OR and shifts on a
+// bit plane that fits in the cache, in three passes over the rows.
+//
+// The kernels are rectangles with the anchor in the top left corner, the
+// same as cvCreateStructuringElementEx(n, n, 0, 0, CV_SHAPE_RECT), and
+// pixels outside the image are ignored, the same as the OpenCV default
+// border. So the output is identical to the OpenCV chain.
+//
+
+typedef struct catcierge_binmorph_s
+{
+	uint64_t *bits;		// Packed rows followed by two scratch rows.
+	size_t size;		// Words allocated in bits.
+} catcierge_binmorph_t;
+
+void catcierge_binmorph_destroy(catcierge_binmorph_t *m);
+
+// dst = NOT dilate(open(a OR b)), for images that are 0 or 255.
+//
+// Same as:
+//   cvAdd(a, b, tmp, NULL);
+//   cvMorphologyEx(tmp, tmp2, NULL, open_kernel, CV_MOP_OPEN, open_iterations);
+//   cvDilate(tmp2, dst, dilate_kernel, dilate_iterations);
+//   cvNot(dst, dst);
+//
+// All images must be 8-bit single channel, with ROIs of the same size.
+// Returns 0 on success and -1 on error.
+int catcierge_binmorph_combine_open_dilate_not(catcierge_binmorph_t *m,
+		const IplImage *a, const IplImage *b, IplImage *dst,
+		int open_size, int open_iterations,
+		int dilate_size, int dilate_iterations);
+
+//
+// Counting blobs in a binary image.
+//
+// Finding the contours of a binary image only to count the ones with a big
+// enough area traces every border pixel by pixel into a CvMemStorage. Here
+// the image is scanned once as runs of set and unset pixels, the runs are
+// joined into regions with union-find, and a region is counted as soon as
+// the scan has passed its last row. The scan stops as soon as enough
+// regions have been counted.
+//
+// What is counted is the same as cvFindContours with CV_RETR_LIST finds:
+// the 8-connected regions of set pixels, and the 4-connected regions of
+// unset pixels enclosed by them (holes). Pixels on the image border are
+// treated as unset, the same as cvFindContours does. The area of a region
+// is the area inside its contour through the centers of the border pixels,
+// as given by cvContourArea. It is worked out from the number of pixels
+// and pixel edges, which is exact for borders made of horizontal and
+// vertical lines and within a pixel or so for diagonal ones.
+//
+
+typedef struct catcierge_blob_s
+{
+	int parent;			// Union-find parent, itself for roots.
+	int hole;			// A region of unset pixels.
+	int last_row;		// Last row with a run in the region, -1 when counted.
+	int enclosing;		// A run label of the region around it.
+	long area;			// Pixels, including the closed regions inside it.
+	long perimeter;		// Pixel edges, not including those of closed regions inside it.
+} catcierge_blob_t;
+
+typedef struct catcierge_blob_run_s
+{
+	int start;
+	int end;			// Inclusive.
+	int set;			// Run of set pixels.
+	int label;
+} catcierge_blob_run_t;
+
+typedef struct catcierge_blob_counter_s
+{
+	catcierge_blob_t *blobs;		// One per run that starts a new region.
+	size_t blob_size;
+	catcierge_blob_run_t *runs;		// The runs of the previous and current row.
+	size_t run_size;
+} catcierge_blob_counter_t;
+
+void catcierge_blob_counter_destroy(catcierge_blob_counter_t *bc);
+
+// Counts the regions of img with an area bigger than min_area, stopping at
+// max_count if it is above 0. Returns the count or -1 on error.
+int catcierge_count_blobs(catcierge_blob_counter_t *bc, const IplImage *img,
+						double min_area, int max_count);
+
+#endif // __CATCIERGE_MORPH_H__
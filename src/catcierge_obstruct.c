@@ -0,0 +1,239 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "catcierge_obstruct.h"
+#include "catcierge_log.h"
+
+void catcierge_bg_model_init(catcierge_bg_model_t *bg, int rate, int thr, int scale)
+{
+	assert(bg);
+	memset(bg, 0, sizeof(*bg));
+	bg->rate = rate;
+	bg->thr = thr;
+	bg->scale = (scale < 1) ? 1 : scale;
+}
+
+static void catcierge_bg_model_free(catcierge_bg_model_t *bg)
+{
+	if (bg->gray != bg->small)
+	{
+		cvReleaseImage(&bg->gray);
+	}
+
+	bg->gray = NULL;
+	cvReleaseImage(&bg->small);
+	free(bg->bg);
+	bg->bg = NULL;
+	bg->width = 0;
+	bg->height = 0;
+	bg->learned = 0;
+}
+
+void catcierge_bg_model_destroy(catcierge_bg_model_t *bg)
+{
+	assert(bg);
+	catcierge_bg_model_free(bg);
+}
+
+void catcierge_bg_model_reset(catcierge_bg_model_t *bg)
+{
+	assert(bg);
+	bg->learned = 0;
+}
+
+static int catcierge_bg_model_alloc_images(catcierge_bg_model_t *bg,
+									int width, int height, int channels)
+{
+	if (!(bg->small = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, channels)))
+	{
+		return -1;
+	}
+
+	if (channels == 1)
+	{
+		bg->gray = bg->small;
+	}
+	else if (!(bg->gray = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1)))
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static int catcierge_bg_model_alloc(catcierge_bg_model_t *bg,
+									int width, int height, int channels)
+{
+	if (bg->bg && (bg->width == width) && (bg->height == height))
+	{
+		if (bg->small->nChannels == channels)
+		{
+			return 0;
+		}
+
+		// Idle frames can be gray, keep the learned background.
+		if (bg->gray != bg->small)
+		{
+			cvReleaseImage(&bg->gray);
+		}
+
+		cvReleaseImage(&bg->small);
+		bg->gray = NULL;
+
+		if (catcierge_bg_model_alloc_images(bg, width, height, channels))
+		{
+			goto fail;
+		}
+
+		return 0;
+	}
+
+	catcierge_bg_model_free(bg);
+
+	if (!(bg->bg = calloc((size_t)width * height, sizeof(uint16_t))))
+	{
+		goto fail;
+	}
+
+	if (catcierge_bg_model_alloc_images(bg, width, height, channels))
+	{
+		goto fail;
+	}
+
+	bg->width = width;
+	bg->height = height;
+
+	return 0;
+
+fail:
+	CATERR("Out of memory\n");
+	catcierge_bg_model_free(bg);
+	return -1;
+}
+
+int catcierge_bg_model_update(catcierge_bg_model_t *bg, IplImage *img,
+								CvRect r, int frame_scale)
+{
+	int x;
+	int y;
+	int v;
+	int shift;
+	int obstructed;
+	uint16_t *b;
+	unsigned char *row;
+	CvRect orig_roi;
+	assert(bg);
+	assert(img);
+
+	if ((r.width <= 0) || (r.height <= 0))
+	{
+		return 0;
+	}
+
+	// The cells are laid out in full frame coordinates, so that the
+	// background is kept when switching to smaller idle frames.
+	if (frame_scale < 1)
+	{
+		frame_scale = 1;
+	}
+
+	// The background of another area says nothing about this one.
+	if ((r.x != bg->rect.x) || (r.y != bg->rect.y)
+		|| (r.width != bg->rect.width) || (r.height != bg->rect.height))
+	{
+		catcierge_bg_model_reset(bg);
+		bg->rect = r;
+	}
+
+	if (catcierge_bg_model_alloc(bg,
+			(r.width < bg->scale) ? 1 : (r.width / bg->scale),
+			(r.height < bg->scale) ? 1 : (r.height / bg->scale),
+			img->nChannels))
+	{
+		return -1;
+	}
+
+	// Average each cell, then convert the few remaining pixels to gray.
+	orig_roi = cvGetImageROI(img);
+	cvSetImageROI(img, cvRect(r.x / frame_scale, r.y / frame_scale,
+						r.width / frame_scale, r.height / frame_scale));
+	cvResize(img, bg->small, CV_INTER_AREA);
+	cvSetImageROI(img, orig_roi);
+
+	if (bg->gray != bg->small)
+	{
+		cvCvtColor(bg->small, bg->gray, CV_BGR2GRAY);
+	}
+
+	if (!bg->learned)
+	{
+		for (y = 0; y < bg->height; y++)
+		{
+			row = (unsigned char *)bg->gray->imageData + y * bg->gray->widthStep;
+			b = &bg->bg[y * bg->width];
+
+			for (x = 0; x < bg->width; x++)
+			{
+				b[x] = (uint16_t)(row[x] << 8);
+			}
+		}
+
+		bg->learned = 1;
+		bg->changed = 0;
+		return 0;
+	}
+
+	bg->changed = 0;
+
+	for (y = 0; y < bg->height; y++)
+	{
+		row = (unsigned char *)bg->gray->imageData + y * bg->gray->widthStep;
+		b = &bg->bg[y * bg->width];
+
+		for (x = 0; x < bg->width; x++)
+		{
+			// Only count cells that got darker, something in front
+			// of the back light blocks it.
+			if (((b[x] >> 8) - row[x]) > bg->thr)
+			{
+				bg->changed++;
+			}
+		}
+	}
+
+	obstructed = (bg->changed * bg->scale * bg->scale) > CATCIERGE_OBSTRUCT_MIN_PIXELS;
+	shift = bg->rate + (obstructed ? CATCIERGE_BG_OBSTRUCTED_RATE_SHIFT : 0);
+
+	for (y = 0; y < bg->height; y++)
+	{
+		row = (unsigned char *)bg->gray->imageData + y * bg->gray->widthStep;
+		b = &bg->bg[y * bg->width];
+
+		for (x = 0; x < bg->width; x++)
+		{
+			v = b[x];
+			v += ((row[x] << 8) - v) / (1 << shift);
+			b[x] = (uint16_t)v;
+		}
+	}
+
+	return obstructed;
+}
@@ -0,0 +1,83 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_OBSTRUCT_H__
+#define __CATCIERGE_OBSTRUCT_H__
+
+#include <stdint.h>
+#include <opencv2/imgproc/imgproc_c.h>
+
+//
+// Background model for detecting if the frame is obstructed.
+//
+// Instead of a fixed gray level the area that is checked for obstruction
+// is compared to a running average of how it looks when it is clear. The
+// area is downsampled into cells of scale x scale pixels, and each cell
+// of the background moves 1/2^rate of the way towards every clear frame
+// (in 8.8 fixed point), so slow changes in the lighting are followed
+// instead of triggering a match group. While the frame is obstructed the
+// background is only updated very slowly, so something that stays in the
+// frame is eventually accepted as background.
+//
+
+#define DEFAULT_OBSTRUCT_BG_RATE 5
+#define DEFAULT_OBSTRUCT_BG_THR 40
+#define DEFAULT_OBSTRUCT_BG_SCALE 4
+
+// How many more bits the update rate is shifted by for obstructed frames.
+#define CATCIERGE_BG_OBSTRUCTED_RATE_SHIFT 6
+
+// Number of changed pixels (in the full resolution frame) for the frame
+// to be considered obstructed. Spiders and other 1 pixel creatures need not bother!
+#define CATCIERGE_OBSTRUCT_MIN_PIXELS 200
+
+// Gray level at or below which a pixel blocks the back light, for the
+// threshold obstruction check.
+#define CATCIERGE_OBSTRUCT_DARK_LEVEL 90
+
+#define DEFAULT_OBSTRUCT_DECIMATION 4
+
+typedef struct catcierge_bg_model_s
+{
+	int rate;			// The background moves 1/2^rate towards each clear frame.
+	int thr;			// Gray levels a cell must be darker than the background.
+	int scale;			// Cells are scale x scale pixels of the frame.
+	int width;			// Width of the model in cells.
+	int height;			// Height of the model in cells.
+	uint16_t *bg;		// Background gray levels in 8.8 fixed point.
+	IplImage *small;	// The frame downsampled to the cell size.
+	IplImage *gray;		// Grayscale version of small (same as small for gray frames).
+	int learned;		// Has the background been initialized from a frame?
+	CvRect rect;		// The area of the frame the background was learned from.
+	int changed;		// Cells darker than the background in the last frame.
+} catcierge_bg_model_t;
+
+void catcierge_bg_model_init(catcierge_bg_model_t *bg, int rate, int thr, int scale);
+void catcierge_bg_model_destroy(catcierge_bg_model_t *bg);
+
+// Forget the background, the next frame is learned as is.
+void catcierge_bg_model_reset(catcierge_bg_model_t *bg);
+
+// Compares the area r of img to the background and updates the background.
+// r is in full frame coordinates and img is frame_scale times smaller.
+// The background is learned again when r changes, for instance with the ROI.
+// Returns 1 if the area is obstructed, 0 if not and -1 on error.
+int catcierge_bg_model_update(catcierge_bg_model_t *bg, IplImage *img,
+								CvRect r, int frame_scale);
+
+#endif // __CATCIERGE_OBSTRUCT_H__
@@ -64,6 +64,9 @@ catcierge_output_var_t vars[] =
 	{ "steps_output_path", "The output path specified via --steps_output_path." },
 	{ "obstruct_output_path", "The output path specified via --obstruct_output_path." },
 	{ "template_output_path", "The output path specified via --template_output_path." },
+	{ "archive_path", "The archive the images are saved to if --archive is used." },
+	{ "roi", "The obstruction ROI as \"X Y WIDTH HEIGHT\"." },
+	{ "prev_roi", "The obstruction ROI before it was last changed by --auto_roi_interval." },
 	{ "match_group_id", "Match group ID."},
 	{ "match_group_start_time", "Match group start time."},
 	{ "match_group_end_time", "Match group end time."},
@@ -75,6 +78,8 @@ catcierge_output_var_t vars[] =
 	{ "match_group_direction", "The match group direction (based on all match directions)."},
 	{ "match_group_count", "Match group count o matches so far."},
 	{ "match_group_max_count", "Match group max number of matches that will be made."},
+	{ "match_group_span_<stage>", "Milliseconds spent in a match group stage: capture, obstruct, match, decide, lock, save or output."},
+	{ "match_group_lock_latency", "Milliseconds from capturing the obstruct frame until the lock was actuated (0 if no lockout)."},
 	{ "obstruct_filename", "Filename for the obstruct image for the current match group." },
 	{ "obstruct_path", "Path for the obstruct image (excluding filename)."},
 	{ "matchcur_*", "Gets the current match while matching. "},
@@ -87,6 +92,7 @@ catcierge_output_var_t vars[] =
 	{ "match#_description", "Description of match #." },
 	{ "match#_result", "Result for match #." },
 	{ "match#_time", "Time of match #." },
+	{ "match#_span", "Milliseconds the matcher spent on match #." },
 	{ "match#_step#_filename", "Image filename for match step # for match #."},
 	{ "match#_step#_path", "Image path for match step # for match # (excluding filename)."},
 	{ "match#_step#_name", "Short name for match step # for match #."},
@@ -640,31 +646,22 @@ static char *catcierge_get_time_var_format(const char *var,
 	char *buf, size_t bufsize, const char *default_fmt, time_t t, struct timeval *tv)
 {
 	int ret;
-	char *fmt = NULL;
+	char fmt[1024];
 	const char *var_fmt = var + 4;
 	assert(!strncmp(var, "time", 4));
 
 	if (*var_fmt == ':')
 	{
-		char *s = NULL;
 		var_fmt++;
-
-		if (!(fmt = strdup(var_fmt)))
-		{
-			CATERR("Out of memory!\n"); return NULL;
-		}
-
+		snprintf(fmt, sizeof(fmt), "%s", var_fmt);
 		catcierge_replace_time_format_char(fmt);
 	}
 	else
 	{
-		if (!(fmt = strdup(default_fmt)))
-		{
-			CATERR("Out of memory!\n"); return NULL;
-		}
+		snprintf(fmt, sizeof(fmt), "%s", default_fmt);
 	}
 
-	ret = catcierge_strftime(buf, bufsize - 1, fmt, localtime(&t), tv);
+	ret = catcierge_strftime_time(buf, bufsize - 1, fmt, t, tv);
 
 	if (!ret)
 	{
@@ -672,11 +669,6 @@ static char *catcierge_get_time_var_format(const char *var,
 		buf = NULL;
 	}
 
-	if (fmt)
-	{
-		free(fmt);
-	}
-
 	return buf;
 }
 
@@ -1040,9 +1032,9 @@ const char *_catcierge_output_translate(catcierge_grb_t *grb,
 	if (!strncmp(var, "time", 4))
 	{
 		struct timeval tv;
-		gettimeofday(&tv, NULL);
+		time_t t = catcierge_timer_time(&tv);
 		return catcierge_get_time_var_format(var, buf, bufsize,
-			"%Y-%m-%d %H:%M:%S.%f", time(NULL), &tv);
+			"%Y-%m-%d %H:%M:%S.%f", t, &tv);
 	}
 
 	if (!strcmp(var, "state"))
@@ -1099,6 +1091,18 @@ const char *_catcierge_output_translate(catcierge_grb_t *grb,
 	CHECK_OUTPUT_PATH_VAR(var, obstruct_output_path);
 	CHECK_OUTPUT_PATH_VAR(var, template_output_path);
 
+	if (!strcmp(var, "archive_path"))
+	{
+		return grb->archive.path ? grb->archive.path : "";
+	}
+
+	if (!strcmp(var, "roi") || !strcmp(var, "prev_roi"))
+	{
+		CvRect *r = (var[0] == 'r') ? &grb->args.roi : &grb->prev_roi;
+		snprintf(buf, bufsize - 1, "%d %d %d %d", r->x, r->y, r->width, r->height);
+		return buf;
+	}
+
 	if (!strcmp(var, "matcher"))
 	{
 		return grb->matcher->short_name;
@@ -1214,6 +1218,30 @@ const char *_catcierge_output_translate(catcierge_grb_t *grb,
 		return buf;
 	}
 
+	if (!strncmp(var, "match_group_span_", 17))
+	{
+		const char *subvar = var + 17;
+		int i;
+
+		for (i = 0; i < CATCIERGE_SPAN_COUNT; i++)
+		{
+			if (!strcmp(subvar, catcierge_get_span_str(i)))
+			{
+				snprintf(buf, bufsize - 1, "%.2f", mg->spans[i].duration * 1000.0);
+				return buf;
+			}
+		}
+
+		CATERR("Output: Unknown match group span %s\n", subvar);
+		return NULL;
+	}
+
+	if (!strcmp(var, "match_group_lock_latency"))
+	{
+		snprintf(buf, bufsize - 1, "%.2f", catcierge_match_group_lock_latency(mg) * 1000.0);
+		return buf;
+	}
+
 	if (!strcmp(var, "obstruct_filename"))
 	{
 		return mg->obstruct_path.filename;
@@ -1315,6 +1343,11 @@ const char *_catcierge_output_translate(catcierge_grb_t *grb,
 			return catcierge_get_time_var_format(subvar, buf, bufsize,
 					"%Y-%m-%d %H:%M:%S.%f", m->time, &m->tv);
 		}
+		else if (!strcmp(subvar, "span"))
+		{
+			snprintf(buf, bufsize - 1, "%.2f", m->span.duration * 1000.0);
+			return buf;
+		}
 		else if (!strcmp(subvar, "step_count"))
 		{
 			snprintf(buf, bufsize - 1, "%d", (int)m->result.step_img_count);
@@ -1350,11 +1383,11 @@ const char *_catcierge_output_translate(catcierge_grb_t *grb,
 
 			if (!strcmp(stepvar, "path"))
 			{
-				return catcierge_get_path(grb, var, &step->path, buf, bufsize);
+				return step->path ? catcierge_get_path(grb, var, step->path, buf, bufsize) : "";
 			}
 			else if (!strcmp(stepvar, "filename"))
 			{
-				return step->path.filename;
+				return step->path ? step->path->filename : "";
 			}
 			else if (!strcmp(stepvar, "name"))
 			{
@@ -41,10 +41,17 @@ typedef int mode_t;
 #define gmtime_r(t, tm) gmtime_s(tm, t)
 #define localtime_r(t, tm) localtime_s(tm, t)
 #define strndup catcierge_strndup
+#define strtok_r strtok_s
 
 #include "win32/gettimeofday.h"
 #endif // _WIN32
 
+#ifdef _MSC_VER
+#define CATCIERGE_THREAD_LOCAL __declspec(thread)
+#else
+#define CATCIERGE_THREAD_LOCAL __thread
+#endif
+
 #if (!defined (va_copy))
 	#define va_copy(dest, src) (dest) = (src)
 #endif
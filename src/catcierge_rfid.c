@@ -46,6 +46,93 @@ const char *catcierge_rfid_error_str(int errorcode)
 	return catcierge_rfid_errors[errorcode % (sizeof(catcierge_rfid_errors) / sizeof(char *))];
 }
 
+void catcierge_rfid_framer_init(catcierge_rfid_framer_t *framer)
+{
+	assert(framer);
+	memset(framer, 0, sizeof(catcierge_rfid_framer_t));
+}
+
+static int catcierge_rfid_framer_is_full(catcierge_rfid_framer_t *framer)
+{
+	return ((framer->head - framer->tail) >= CATCIERGE_RFID_FRAME_COUNT);
+}
+
+size_t catcierge_rfid_framer_feed(catcierge_rfid_framer_t *framer,
+			const char *data, size_t len, const struct timeval *tv)
+{
+	size_t i;
+	catcierge_rfid_frame_t *line;
+	assert(framer);
+	assert(data);
+	assert(tv);
+
+	line = &framer->line;
+
+	for (i = 0; i < len; i++)
+	{
+		char c = data[i];
+
+		if ((c == '\r') || (c == '\n'))
+		{
+			if (framer->discarding)
+			{
+				framer->discarding = 0;
+				continue;
+			}
+
+			// Ignore empty lines, this also makes CRLF a single terminator.
+			if (line->len == 0)
+				continue;
+
+			// Stop and let the caller pop some frames before we go on.
+			if (catcierge_rfid_framer_is_full(framer))
+				break;
+
+			line->data[line->len] = '\0';
+			framer->frames[framer->head % CATCIERGE_RFID_FRAME_COUNT] = *line;
+			framer->head++;
+			framer->line_count++;
+			line->len = 0;
+			continue;
+		}
+
+		if (framer->discarding)
+			continue;
+
+		if (line->len == 0)
+		{
+			line->tv = *tv;
+		}
+
+		if (line->len >= (sizeof(line->data) - 1))
+		{
+			// We've lost sync with the reader, skip to the next line.
+			framer->overlong_count++;
+			framer->discarding = 1;
+			line->len = 0;
+			continue;
+		}
+
+		line->data[line->len++] = c;
+	}
+
+	return i;
+}
+
+int catcierge_rfid_framer_pop(catcierge_rfid_framer_t *framer, catcierge_rfid_frame_t *frame)
+{
+	assert(framer);
+	assert(frame);
+
+	if (framer->head == framer->tail)
+		return 0;
+
+	*frame = framer->frames[framer->tail % CATCIERGE_RFID_FRAME_COUNT];
+	framer->tail++;
+
+	return 1;
+}
+
 int catcierge_rfid_init(const char *name, catcierge_rfid_t *rfid, 
 			const char *serial_path, catcierge_rfid_read_f read_cb, void *user)
 {
@@ -54,9 +141,12 @@ int catcierge_rfid_init(const char *name, catcierge_rfid_t *rfid,
 	rfid->fd = -1;
 	rfid->cb = read_cb;
 	rfid->user = user;
-	rfid->bytes_read = 0;
-	rfid->offset = 0;
 	rfid->state = CAT_DISCONNECTED;
+	rfid->tag_count = 0;
+	rfid->incomplete_count = 0;
+	rfid->error_count = 0;
+	memset(&rfid->tag_tv, 0, sizeof(rfid->tag_tv));
+	catcierge_rfid_framer_init(&rfid->framer);
 
 	return 0;
 }
@@ -72,51 +162,80 @@ void catcierge_rfid_destroy(catcierge_rfid_t *rfid)
 	}
 
 	CATLOG("Disconnected %s RFID reader (%s)\n", rfid->name, rfid->serial_path);
+	CATLOG("  %lu tags, %lu incomplete, %lu reader errors, %lu overlong lines\n",
+		rfid->tag_count, rfid->incomplete_count,
+		rfid->error_count, rfid->framer.overlong_count);
 
 	rfid->state = CAT_DISCONNECTED;
 }
 
-static int catcierge_rfid_read(catcierge_rfid_t *rfid)
+static void catcierge_rfid_get_time(struct timeval *tv)
 {
-	int ret = 0;
-	int is_error = 0;
-	int errorcode;
-	const char *error_msg = NULL;
+	struct timespec ts;
 
-	if ((rfid->bytes_read = read(rfid->fd, rfid->buf, 
-								sizeof(rfid->buf) - 1)) < 0)
-	{
-		if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
-		{
-			CATERR("%s RFID Reader: Read error %d, %s\n", rfid->name, errno, strerror(errno));
-			ret = -1;
-			goto fail;
-		}
+	// Use the monotonic clock so that tag ordering isn't
+	// affected by the wall clock being adjusted.
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+}
 
-		CATERR("%s RFID Reader: Need more\n");
-		// TODO: Add CAT_NEED_MORE state here and handle that.
-		return -1;
+static void catcierge_rfid_push_event(catcierge_rfid_context_t *ctx,
+		catcierge_rfid_t *rfid, int complete, catcierge_rfid_frame_t *frame)
+{
+	catcierge_rfid_event_t *ev;
+	size_t tail = __atomic_load_n(&ctx->event_tail, __ATOMIC_ACQUIRE);
+	size_t head = ctx->event_head;
+
+	if ((head - tail) >= CATCIERGE_RFID_EVENT_COUNT)
+	{
+		ctx->dropped_events++;
+		CATERR("%s RFID Reader: Event queue full, dropping tag %s\n", rfid->name, frame->data);
+		return;
 	}
 
-	// Get rid of any trailing CRLF.
-	if (rfid->buf[rfid->bytes_read - 1] == '\n') rfid->bytes_read--;
-	if (rfid->buf[rfid->bytes_read - 1] == '\r') rfid->bytes_read--;
+	ev = &ctx->events[head % CATCIERGE_RFID_EVENT_COUNT];
+	ev->rfid = rfid;
+	ev->complete = complete;
+	ev->frame = *frame;
 
-	rfid->buf[rfid->bytes_read] = '\0';
-	CATLOG("%s RFID Reader: %ld bytes: %s\n", rfid->name, rfid->bytes_read, rfid->buf);
+	__atomic_store_n(&ctx->event_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void catcierge_rfid_dispatch_events(catcierge_rfid_context_t *ctx)
+{
+	catcierge_rfid_event_t *ev;
+	size_t head = __atomic_load_n(&ctx->event_head, __ATOMIC_ACQUIRE);
+	size_t tail = ctx->event_tail;
 
-	if (rfid->bytes_read == 0)
+	while (tail != head)
 	{
-		// TODO: EOF, do something special here?
-		return 0;
+		ev = &ctx->events[tail % CATCIERGE_RFID_EVENT_COUNT];
+
+		ev->rfid->tag_tv = ev->frame.tv;
+		ev->rfid->cb(ev->rfid, ev->complete, ev->frame.data, ev->frame.len, ev->rfid->user);
+
+		tail++;
+		__atomic_store_n(&ctx->event_tail, tail, __ATOMIC_RELEASE);
 	}
+}
+
+static void catcierge_rfid_handle_line(catcierge_rfid_context_t *ctx,
+		catcierge_rfid_t *rfid, catcierge_rfid_frame_t *frame)
+{
+	int is_error = 0;
+	int errorcode;
+	const char *error_msg = NULL;
+
+	CATLOG("%s RFID Reader: %d bytes: %s\n", rfid->name, (int)frame->len, frame->data);
 
 	// Check for error.
-	if (rfid->buf[0] == '?')
+	if (frame->data[0] == '?')
 	{
 		is_error = 1;
-		errorcode = atoi(&rfid->buf[1]);
+		errorcode = atoi(&frame->data[1]);
 		error_msg = catcierge_rfid_error_str(errorcode);
+		rfid->error_count++;
 
 		CATERR("%s RFID reader: error %d on read, %s\n", 
 				rfid->name, errorcode, error_msg);
@@ -132,8 +251,22 @@ static int catcierge_rfid_read(catcierge_rfid_t *rfid)
 	{
 		if (!is_error)
 		{
-			int complete = (rfid->bytes_read >= 15);
-			rfid->cb(rfid, complete, rfid->buf, rfid->bytes_read, rfid->user);
+			int complete = (frame->len >= CATCIERGE_RFID_MIN_TAG_LEN);
+
+			if (complete)
+				rfid->tag_count++;
+			else
+				rfid->incomplete_count++;
+
+			if (ctx->threaded)
+			{
+				catcierge_rfid_push_event(ctx, rfid, complete, frame);
+			}
+			else
+			{
+				rfid->tag_tv = frame->tv;
+				rfid->cb(rfid, complete, frame->data, frame->len, rfid->user);
+			}
 		}
 		else
 		{
@@ -144,11 +277,65 @@ static int catcierge_rfid_read(catcierge_rfid_t *rfid)
 	{
 		CATERR("%s RFID Reader: Invalid state on read, %d\n", rfid->name, rfid->state);
 	}
+}
+
+//
+// Closes a reader that was unplugged or failed, so that it is no longer
+// selected on. The other reader keeps working.
+//
+static void catcierge_rfid_disconnect(catcierge_rfid_t *rfid, const char *reason)
+{
+	if (rfid->fd < 0)
+		return;
+
+	CATERR("%s RFID Reader: %s, disconnecting %s\n", rfid->name, reason, rfid->serial_path);
 
-fail:
-	rfid->bytes_read = 0;
-	rfid->offset = 0;
-	return ret;
+	close(rfid->fd);
+	rfid->fd = -1;
+	rfid->state = CAT_DISCONNECTED;
+}
+
+static int catcierge_rfid_read(catcierge_rfid_context_t *ctx, catcierge_rfid_t *rfid)
+{
+	char buf[256];
+	ssize_t bytes_read;
+	size_t offset = 0;
+	struct timeval tv;
+	catcierge_rfid_frame_t frame;
+
+	if ((bytes_read = read(rfid->fd, buf, sizeof(buf))) < 0)
+	{
+		if ((errno != EWOULDBLOCK) && (errno != EAGAIN) && (errno != EINTR))
+		{
+			catcierge_rfid_disconnect(rfid, strerror(errno));
+		}
+
+		// Nothing available yet, any partial line is kept in the framer.
+		return 0;
+	}
+
+	if (bytes_read == 0)
+	{
+		// The fd would stay readable, so select would never block again.
+		catcierge_rfid_disconnect(rfid, "End of file");
+		return 0;
+	}
+
+	catcierge_rfid_get_time(&tv);
+
+	// A single read can contain several lines, or only a part of one.
+	while (offset < (size_t)bytes_read)
+	{
+		offset += catcierge_rfid_framer_feed(&rfid->framer,
+					&buf[offset], bytes_read - offset, &tv);
+
+		while (catcierge_rfid_framer_pop(&rfid->framer, &frame))
+		{
+			catcierge_rfid_handle_line(ctx, rfid, &frame);
+		}
+	}
+
+	return 0;
 }
 
 static void _set_maxfd(catcierge_rfid_context_t *ctx)
@@ -170,28 +357,25 @@ static void _set_maxfd(catcierge_rfid_context_t *ctx)
 int catcierge_rfid_ctx_init(catcierge_rfid_context_t *ctx)
 {
 	memset(ctx, 0, sizeof(catcierge_rfid_context_t));
+	ctx->wakeup_pipe[0] = -1;
+	ctx->wakeup_pipe[1] = -1;
 	return 0;
 }
 
 int catcierge_rfid_ctx_destroy(catcierge_rfid_context_t *ctx)
 {
+	catcierge_rfid_ctx_stop_thread(ctx);
 	memset(ctx, 0, sizeof(catcierge_rfid_context_t));
 	return 0;
 }
 
-int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx)
+static int catcierge_rfid_ctx_select(catcierge_rfid_context_t *ctx, struct timeval *tv)
 {
 	int i;
 	int res = 0;
-	struct timeval tv = {0, 0};
 
 	_set_maxfd(ctx);
 
-	if (!ctx->rfids[RFID_IN] && !ctx->rfids[RFID_OUT])
-	{
-		return -1;
-	}
-
 	FD_ZERO(&ctx->readfs);
 
 	for (i = 0; i < RFID_COUNT; i++)
@@ -202,16 +386,33 @@ int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx)
 		}
 	}
 
-	if (!(res = select(ctx->maxfd, &ctx->readfs, NULL, NULL, &tv)))
+	if (ctx->threaded)
+	{
+		FD_SET(ctx->wakeup_pipe[0], &ctx->readfs);
+
+		if (ctx->wakeup_pipe[0] >= ctx->maxfd)
+		{
+			ctx->maxfd = ctx->wakeup_pipe[0] + 1;
+		}
+	}
+
+	if ((res = select(ctx->maxfd, &ctx->readfs, NULL, NULL, tv)) <= 0)
 	{
+		if ((res < 0) && (errno != EINTR))
+		{
+			CATERR("RFID select error %d, %s\n", errno, strerror(errno));
+			return -1;
+		}
+
 		return 0; // No input available.
 	}
 
 	for (i = 0; i < RFID_COUNT; i++)
 	{
-		if (ctx->rfids[i] && FD_ISSET(ctx->rfids[i]->fd, &ctx->readfs))
+		if (ctx->rfids[i] && (ctx->rfids[i]->fd > 0)
+			&& FD_ISSET(ctx->rfids[i]->fd, &ctx->readfs))
 		{
-			if (catcierge_rfid_read(ctx->rfids[i]) < 0)
+			if (catcierge_rfid_read(ctx, ctx->rfids[i]) < 0)
 			{
 				return -1;
 			}
@@ -221,6 +422,114 @@ int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx)
 	return 0;
 }
 
+static void *catcierge_rfid_thread(void *arg)
+{
+	catcierge_rfid_context_t *ctx = arg;
+
+	CATLOG("RFID reader thread started\n");
+
+	while (1)
+	{
+		// Block until either reader has data.
+		if (catcierge_rfid_ctx_select(ctx, NULL) < 0)
+		{
+			CATERR("Failed to read RFID readers, stopping RFID thread\n");
+			break;
+		}
+
+		if (FD_ISSET(ctx->wakeup_pipe[0], &ctx->readfs))
+		{
+			break;
+		}
+	}
+
+	CATLOG("RFID reader thread stopped\n");
+
+	return NULL;
+}
+
+int catcierge_rfid_ctx_start_thread(catcierge_rfid_context_t *ctx)
+{
+	assert(ctx);
+
+	if (ctx->threaded)
+		return 0;
+
+	if (!ctx->rfids[RFID_IN] && !ctx->rfids[RFID_OUT])
+		return -1;
+
+	if (pipe(ctx->wakeup_pipe) < 0)
+	{
+		CATERR("Failed to create RFID thread pipe %d, %s\n", errno, strerror(errno));
+		return -1;
+	}
+
+	ctx->event_head = 0;
+	ctx->event_tail = 0;
+	ctx->threaded = 1;
+
+	if (pthread_create(&ctx->thread, NULL, catcierge_rfid_thread, ctx))
+	{
+		CATERR("Failed to create RFID reader thread\n");
+		ctx->threaded = 0;
+		close(ctx->wakeup_pipe[0]);
+		close(ctx->wakeup_pipe[1]);
+		ctx->wakeup_pipe[0] = -1;
+		ctx->wakeup_pipe[1] = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+void catcierge_rfid_ctx_stop_thread(catcierge_rfid_context_t *ctx)
+{
+	assert(ctx);
+
+	if (!ctx->threaded)
+		return;
+
+	if (write(ctx->wakeup_pipe[1], "x", 1) < 0)
+	{
+		CATERR("Failed to wake up RFID thread %d, %s\n", errno, strerror(errno));
+	}
+
+	pthread_join(ctx->thread, NULL);
+	ctx->threaded = 0;
+
+	close(ctx->wakeup_pipe[0]);
+	close(ctx->wakeup_pipe[1]);
+	ctx->wakeup_pipe[0] = -1;
+	ctx->wakeup_pipe[1] = -1;
+
+	// Deliver anything that was read before we stopped.
+	catcierge_rfid_dispatch_events(ctx);
+
+	if (ctx->dropped_events)
+	{
+		CATERR("RFID thread dropped %lu events\n", ctx->dropped_events);
+	}
+}
+
+int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx)
+{
+	struct timeval tv = {0, 0};
+
+	if (!ctx->rfids[RFID_IN] && !ctx->rfids[RFID_OUT])
+	{
+		return -1;
+	}
+
+	// The reader thread does the reading, just pass on what it has queued.
+	if (ctx->threaded)
+	{
+		catcierge_rfid_dispatch_events(ctx);
+		return 0;
+	}
+
+	return catcierge_rfid_ctx_select(ctx, &tv);
+}
+
 void catcierge_rfid_ctx_set_inner(catcierge_rfid_context_t *ctx, catcierge_rfid_t *rfid)
 {
 	assert(ctx);
@@ -31,9 +31,16 @@
 #include <termios.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include <pthread.h>
 
 #define EXAMPLE_RFID_STR "999_000000001007" //_1_0_AEC4_000000"
 
+#define CATCIERGE_RFID_MIN_TAG_LEN 15	// Tag lines shorter than this are incomplete reads.
+#define CATCIERGE_RFID_LINE_MAX 128		// Longest line we accept from a reader.
+#define CATCIERGE_RFID_FRAME_COUNT 8	// Number of framed lines that can be queued per reader.
+#define CATCIERGE_RFID_EVENT_COUNT 32	// Number of tag events queued between the reader thread and the consumer.
+
 typedef struct catcierge_rfid_s catcierge_rfid_t;
 
 typedef void (*catcierge_rfid_read_f)(catcierge_rfid_t *rfid, int complete, const char *data, size_t data_len, void *user);
@@ -43,34 +50,85 @@ typedef enum catcierge_rfid_state_e
 	CAT_ERROR = -1,
 	CAT_DISCONNECTED = 0,
 	CAT_CONNECTED = 1,
-	CAT_AWAITING_TAG = 2,
-	CAT_NEED_MORE = 3
+	CAT_AWAITING_TAG = 2
 } catcierge_rfid_state_t;
 
 const char *catcierge_rfid_error_str(int errorcode);
 
+// A single CRLF terminated line received from a reader.
+typedef struct catcierge_rfid_frame_s
+{
+	char data[CATCIERGE_RFID_LINE_MAX];
+	size_t len;
+	struct timeval tv;		// Arrival time of the first byte of the line (monotonic clock).
+} catcierge_rfid_frame_t;
+
+//
+// Incremental line framer. The serial port gives no guarantees
+// on how the reader output is split up between reads, so bytes
+// are accumulated across reads and complete lines are queued
+// in a ring buffer until they are popped.
+//
+typedef struct catcierge_rfid_framer_s
+{
+	catcierge_rfid_frame_t frames[CATCIERGE_RFID_FRAME_COUNT];
+	size_t head;					// Number of frames pushed.
+	size_t tail;					// Number of frames popped.
+	catcierge_rfid_frame_t line;	// The line currently being received.
+	int discarding;					// Skip bytes until the next line terminator.
+	unsigned long line_count;		// Number of lines framed.
+	unsigned long overlong_count;	// Lines discarded for being too long.
+} catcierge_rfid_framer_t;
+
+void catcierge_rfid_framer_init(catcierge_rfid_framer_t *framer);
+size_t catcierge_rfid_framer_feed(catcierge_rfid_framer_t *framer,
+			const char *data, size_t len, const struct timeval *tv);
+int catcierge_rfid_framer_pop(catcierge_rfid_framer_t *framer, catcierge_rfid_frame_t *frame);
+
 struct catcierge_rfid_s
 {
 	char name[256];
 	const char *serial_path;
 	int fd;
-	ssize_t bytes_read;
-	ssize_t offset;
-	char buf[1024];
+	catcierge_rfid_framer_t framer;
+	struct timeval tag_tv;			// Arrival time of the tag passed to the read callback.
 	catcierge_rfid_read_f cb;
 	void *user;
 	catcierge_rfid_state_t state;
+	unsigned long tag_count;		// Number of complete tags read.
+	unsigned long incomplete_count;	// Number of tags that were only partially read.
+	unsigned long error_count;		// Number of error replies from the reader.
 };
 
 #define RFID_IN 0
 #define RFID_OUT 1
 #define RFID_COUNT 2
 
+// A tag read by the RFID thread waiting to be passed on to the read callback.
+typedef struct catcierge_rfid_event_s
+{
+	catcierge_rfid_t *rfid;
+	int complete;
+	catcierge_rfid_frame_t frame;
+} catcierge_rfid_event_t;
+
 typedef struct catcierge_rfid_context_s
 {
 	fd_set readfs;
 	int maxfd;
 	catcierge_rfid_t *rfids[RFID_COUNT];
+
+	// When the reader thread is running the serial ports are read
+	// as soon as data arrives, and the tags are queued until
+	// catcierge_rfid_ctx_service is called. The queue has a single
+	// producer and consumer so it needs no locking.
+	int threaded;
+	pthread_t thread;
+	int wakeup_pipe[2];						// Used to stop the reader thread.
+	catcierge_rfid_event_t events[CATCIERGE_RFID_EVENT_COUNT];
+	size_t event_head;						// Only written by the reader thread.
+	size_t event_tail;						// Only written by the consumer.
+	unsigned long dropped_events;			// Events lost because the queue was full.
 } catcierge_rfid_context_t;
 
 int catcierge_rfid_init(const char *name, catcierge_rfid_t *rfid, 
@@ -84,5 +142,7 @@ int catcierge_rfid_open(catcierge_rfid_t *rfid);
 int catcierge_rfid_write_rat(catcierge_rfid_t *rfid);
 int catcierge_rfid_ctx_init(catcierge_rfid_context_t *ctx);
 int catcierge_rfid_ctx_destroy(catcierge_rfid_context_t *ctx);
+int catcierge_rfid_ctx_start_thread(catcierge_rfid_context_t *ctx);
+void catcierge_rfid_ctx_stop_thread(catcierge_rfid_context_t *ctx);
 
 #endif // __CATCIERGE_RFID_H__
@@ -0,0 +1,257 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include "catcierge_rfid_allowed.h"
+#include "catcierge_util.h"
+#include "catcierge_log.h"
+
+//
+// The readers report FDX-B tags as "<country>_<national id>", optionally
+// followed by extra fields such as "_1_0_AEC4_000000". Only the country
+// and national id identify the animal, so the rest is dropped together
+// with any whitespace, and letters are made uppercase.
+//
+int catcierge_rfid_allowed_normalize(char *dst, size_t dst_len, const char *tag)
+{
+	size_t len = 0;
+	int separators = 0;
+	assert(dst);
+	assert(tag);
+
+	tag = catcierge_skip_whitespace(tag);
+
+	while (*tag && !isspace((unsigned char)*tag))
+	{
+		if ((*tag == '_') && (++separators >= 2))
+			break;
+
+		if (len >= (dst_len - 1))
+		{
+			dst[0] = '\0';
+			return -1;
+		}
+
+		dst[len++] = toupper((unsigned char)*tag);
+		tag++;
+	}
+
+	dst[len] = '\0';
+
+	return (len > 0) ? 0 : -1;
+}
+
+catcierge_rfid_allowed_t *catcierge_rfid_allowed_create()
+{
+	catcierge_rfid_allowed_t *allowed = NULL;
+
+	if (!(allowed = calloc(1, sizeof(catcierge_rfid_allowed_t))))
+	{
+		CATERR("Out of memory\n");
+		return NULL;
+	}
+
+	return allowed;
+}
+
+void catcierge_rfid_allowed_destroy(catcierge_rfid_allowed_t **allowed)
+{
+	catcierge_rfid_allowed_tag_t *it;
+	catcierge_rfid_allowed_tag_t *tmp;
+
+	if (!allowed || !*allowed)
+		return;
+
+	HASH_ITER(hh, (*allowed)->tags, it, tmp)
+	{
+		HASH_DEL((*allowed)->tags, it);
+		free(it);
+	}
+
+	free(*allowed);
+	*allowed = NULL;
+}
+
+int catcierge_rfid_allowed_add(catcierge_rfid_allowed_t *allowed, const char *tag)
+{
+	char key[CATCIERGE_RFID_TAG_MAX];
+	catcierge_rfid_allowed_tag_t *it = NULL;
+	assert(allowed);
+
+	if (catcierge_rfid_allowed_normalize(key, sizeof(key), tag))
+	{
+		CATERR("Invalid RFID tag \"%s\"\n", tag);
+		return -1;
+	}
+
+	HASH_FIND_STR(allowed->tags, key, it);
+
+	if (it)
+	{
+		// Duplicates are harmless.
+		return 0;
+	}
+
+	if (!(it = calloc(1, sizeof(*it))))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	strcpy(it->tag, key);
+	HASH_ADD_STR(allowed->tags, tag, it);
+	allowed->count++;
+
+	return 0;
+}
+
+int catcierge_rfid_allowed_add_list(catcierge_rfid_allowed_t *allowed, char **tags, size_t count)
+{
+	size_t i;
+	assert(allowed);
+
+	for (i = 0; i < count; i++)
+	{
+		if (catcierge_rfid_allowed_add(allowed, tags[i]))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int catcierge_rfid_allowed_load(catcierge_rfid_allowed_t *allowed, const char *path)
+{
+	int ret = 0;
+	char *contents = NULL;
+	char *line = NULL;
+	char *saveptr = NULL;
+	int linenum = 0;
+	assert(allowed);
+	assert(path);
+
+	if (!(contents = catcierge_read_file(path)))
+	{
+		CATERR("Failed to read RFID allow list \"%s\"\n", path);
+		return -1;
+	}
+
+	// One tag per line, everything after a # is a comment.
+	for (line = strtok_r(contents, "\n", &saveptr);
+		line;
+		line = strtok_r(NULL, "\n", &saveptr))
+	{
+		char *comment;
+		linenum++;
+
+		if ((comment = strchr(line, '#')))
+			*comment = '\0';
+
+		if (!*catcierge_skip_whitespace(line))
+			continue;
+
+		if (catcierge_rfid_allowed_add(allowed, line))
+		{
+			CATERR("%s:%d: Failed to add RFID tag\n", path, linenum);
+			ret = -1; goto fail;
+		}
+	}
+
+fail:
+	free(contents);
+
+	return ret;
+}
+
+catcierge_rfid_allowed_tag_t *catcierge_rfid_allowed_find(catcierge_rfid_allowed_t *allowed, const char *tag)
+{
+	char key[CATCIERGE_RFID_TAG_MAX];
+	catcierge_rfid_allowed_tag_t *it = NULL;
+
+	if (!allowed)
+		return NULL;
+
+	if (catcierge_rfid_allowed_normalize(key, sizeof(key), tag))
+		return NULL;
+
+	HASH_FIND_STR(allowed->tags, key, it);
+
+	return it;
+}
+
+int catcierge_rfid_allowed_check(catcierge_rfid_allowed_t *allowed, const char *tag, time_t now)
+{
+	catcierge_rfid_allowed_tag_t *it;
+
+	if (!(it = catcierge_rfid_allowed_find(allowed, tag)))
+		return 0;
+
+	it->seen_count++;
+	it->last_seen = now;
+
+	return 1;
+}
+
+void catcierge_rfid_allowed_copy_stats(catcierge_rfid_allowed_t *dst, catcierge_rfid_allowed_t *src)
+{
+	catcierge_rfid_allowed_tag_t *it;
+	catcierge_rfid_allowed_tag_t *found;
+	catcierge_rfid_allowed_tag_t *tmp;
+	assert(dst);
+
+	if (!src)
+		return;
+
+	HASH_ITER(hh, src->tags, it, tmp)
+	{
+		HASH_FIND_STR(dst->tags, it->tag, found);
+
+		if (found)
+		{
+			found->seen_count = it->seen_count;
+			found->last_seen = it->last_seen;
+		}
+	}
+}
+
+void catcierge_rfid_allowed_print_stats(catcierge_rfid_allowed_t *allowed)
+{
+	char time_str[64];
+	catcierge_rfid_allowed_tag_t *it;
+	catcierge_rfid_allowed_tag_t *tmp;
+
+	if (!allowed)
+		return;
+
+	CATLOG("Allowed RFID tags (%lu):\n", (unsigned long)allowed->count);
+
+	HASH_ITER(hh, allowed->tags, it, tmp)
+	{
+		if (it->last_seen)
+			strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&it->last_seen));
+		else
+			strcpy(time_str, "never");
+
+		CATLOG("  %s  seen %lu times, last %s\n", it->tag, it->seen_count, time_str);
+	}
+}
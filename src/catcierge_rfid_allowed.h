@@ -0,0 +1,54 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2015
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_RFID_ALLOWED_H__
+#define __CATCIERGE_RFID_ALLOWED_H__
+
+#include <time.h>
+#include "uthash.h"
+
+#define CATCIERGE_RFID_TAG_MAX 64
+
+// An allowed RFID tag, and statistics on when it was last seen.
+typedef struct catcierge_rfid_allowed_tag_s
+{
+	char tag[CATCIERGE_RFID_TAG_MAX];	// Normalized tag, used as hash key.
+	unsigned long seen_count;			// Number of times the tag has been read.
+	time_t last_seen;					// When the tag was last read (0 = never).
+	UT_hash_handle hh;
+} catcierge_rfid_allowed_tag_t;
+
+typedef struct catcierge_rfid_allowed_s
+{
+	catcierge_rfid_allowed_tag_t *tags;
+	size_t count;
+} catcierge_rfid_allowed_t;
+
+int catcierge_rfid_allowed_normalize(char *dst, size_t dst_len, const char *tag);
+
+catcierge_rfid_allowed_t *catcierge_rfid_allowed_create();
+void catcierge_rfid_allowed_destroy(catcierge_rfid_allowed_t **allowed);
+int catcierge_rfid_allowed_add(catcierge_rfid_allowed_t *allowed, const char *tag);
+int catcierge_rfid_allowed_add_list(catcierge_rfid_allowed_t *allowed, char **tags, size_t count);
+int catcierge_rfid_allowed_load(catcierge_rfid_allowed_t *allowed, const char *path);
+catcierge_rfid_allowed_tag_t *catcierge_rfid_allowed_find(catcierge_rfid_allowed_t *allowed, const char *tag);
+int catcierge_rfid_allowed_check(catcierge_rfid_allowed_t *allowed, const char *tag, time_t now);
+void catcierge_rfid_allowed_copy_stats(catcierge_rfid_allowed_t *dst, catcierge_rfid_allowed_t *src);
+void catcierge_rfid_allowed_print_stats(catcierge_rfid_allowed_t *allowed);
+
+#endif // __CATCIERGE_RFID_ALLOWED_H__
@@ -30,6 +30,39 @@
 
 long catcierge_base_time_diff;
 
+// A part of a format string. Either a plain strftime format
+// or the %f sub-second field (fmt == NULL).
+typedef struct catcierge_strftime_segment_s
+{
+	const char *fmt;	// Points into parts, starts with a padding space.
+	size_t out_offset;	// Rendered text for the cached second.
+	size_t out_len;
+} catcierge_strftime_segment_t;
+
+typedef struct catcierge_strftime_fmt_s
+{
+	char fmt[CATCIERGE_STRFTIME_MAX_FMT];		// The format string, used as key.
+	char parts[CATCIERGE_STRFTIME_MAX_FMT + 2];	// NUL separated segment formats.
+	catcierge_strftime_segment_t segments[CATCIERGE_STRFTIME_MAX_SEGMENTS];
+	size_t segment_count;
+	int rendered;								// Is out valid for rendered_t?
+	time_t rendered_t;
+	char out[CATCIERGE_STRFTIME_MAX_OUT];
+} catcierge_strftime_fmt_t;
+
+typedef struct catcierge_strftime_cache_s
+{
+	catcierge_strftime_fmt_t fmts[CATCIERGE_STRFTIME_CACHE_SIZE];
+	size_t count;
+	size_t next;		// Next entry to replace when the cache is full.
+	int have_tm;
+	time_t tm_t;		// The second tm was broken down for.
+	struct tm tm;
+} catcierge_strftime_cache_t;
+
+// Per thread so that the RFID reader thread can log safely.
+static CATCIERGE_THREAD_LOCAL catcierge_strftime_cache_t catcierge_strftime_cache;
+
 void catcierge_strftime_set_base_diff(long time_diff)
 {
 	catcierge_base_time_diff = time_diff;
@@ -48,11 +81,8 @@ static void _catcierge_invalid_param_handler(const wchar_t *expression,
 }
 #endif // _WIN32
 
-int catcierge_strftime(char *dst, size_t dst_len, const char *fmt, const struct tm *tm, struct timeval *tv)
+static void catcierge_strftime_setup()
 {
-	int ret = -1;
-	char *tmp_fmt = NULL;
-
 	#if _WIN32
 	// As described in the documentation for strftime on windows:
 	//   http://msdn.microsoft.com/fr-fr/library/fe06s4ak(v=vs.80).aspx
@@ -72,97 +102,319 @@ int catcierge_strftime(char *dst, size_t dst_len, const char *fmt, const struct
 	_CrtSetReportMode(_CRT_ASSERT, 0);
 
 	#endif // _WIN32
+}
+
+// Length of the conversion specifier at s, so that we never split one.
+static size_t catcierge_strftime_spec_len(const char *s)
+{
+	if ((s[0] != '%') || !s[1])
+		return 1;
+
+	// %Ey %Od and friends.
+	if (((s[1] == 'E') || (s[1] == 'O')) && s[2])
+		return 3;
+
+	return 2;
+}
+
+//
+// Renders a segment format to dst + *len. The format starts with a
+// padding space so that strftime never returns 0 for a successful
+// but empty result (%p is empty in some locales), the space is
+// then removed. Returns -1 if the result did not fit.
+//
+static int catcierge_strftime_segment(char *dst, size_t dst_len, size_t *len,
+	const char *fmt, const struct tm *tm)
+{
+	size_t ret;
+	assert(fmt[0] == ' ');
+
+	if (!fmt[1])
+		return 0;
+
+	if ((dst_len - *len) < 2)
+		return -1;
+
+	if (!(ret = strftime(&dst[*len], dst_len - *len, fmt, tm)))
+		return -1;
+
+	memmove(&dst[*len], &dst[*len + 1], ret);
+	*len += ret - 1;
+
+	return 0;
+}
+
+static int catcierge_strftime_usec(char *dst, size_t dst_len, size_t *len,
+	const struct timeval *tv)
+{
+	int ret;
+	size_t count = dst_len - *len;
+
+	ret = snprintf(&dst[*len], count, "%06ld", (long int)tv->tv_usec);
+
+	if ((ret < 0) || ((size_t)ret >= count))
+		return -1;
+
+	*len += ret;
+
+	return 0;
+}
+
+static int catcierge_strftime_append(char *dst, size_t dst_len, size_t *len,
+	const char *src, size_t src_len)
+{
+	if ((*len + src_len) >= dst_len)
+		return -1;
+
+	memcpy(&dst[*len], src, src_len);
+	*len += src_len;
+	dst[*len] = '\0';
+
+	return 0;
+}
+
+//
+// Format without any caching, for formats that do not fit in the cache.
+// The strftime parts are collected in a stack buffer between each %f
+// so that nothing needs to be allocated.
+//
+static int catcierge_strftime_render(char *dst, size_t dst_len, const char *fmt,
+	const struct tm *tm, const struct timeval *tv)
+{
+	char seg[CATCIERGE_STRFTIME_MAX_FMT];
+	size_t seg_len = 1;
+	size_t len = 0;
+	size_t n;
+	const char *s = fmt;
+
+	seg[0] = ' ';
+
+	while (1)
+	{
+		int is_usec = tv && (s[0] == '%') && (s[1] == 'f');
+		n = catcierge_strftime_spec_len(s);
+
+		// Flush the collected format on %f, at the end or when full.
+		if (is_usec || !*s || ((seg_len + n) >= sizeof(seg)))
+		{
+			seg[seg_len] = '\0';
+
+			if (catcierge_strftime_segment(dst, dst_len, &len, seg, tm))
+				return 0;
+
+			seg_len = 1;
+		}
+
+		if (!*s)
+			break;
+
+		if (is_usec)
+		{
+			if (catcierge_strftime_usec(dst, dst_len, &len, tv))
+				return 0;
+
+			s += 2;
+			continue;
+		}
+
+		memcpy(&seg[seg_len], s, n);
+		seg_len += n;
+		s += n;
+	}
+
+	return (int)len;
+}
+
+int catcierge_strftime(char *dst, size_t dst_len, const char *fmt, const struct tm *tm, struct timeval *tv)
+{
+	struct tm base_tm;
+
+	if (!dst || !dst_len)
+		return 0;
+
+	catcierge_strftime_setup();
+	dst[0] = '\0';
 
 	if (catcierge_base_time_diff)
 	{
 		time_t t;
 		struct tm tmp_tm = *tm;
-		tv->tv_sec -= catcierge_base_time_diff;
 		t = mktime(&tmp_tm);
 		t -= catcierge_base_time_diff;
-		if (!(tm = localtime(&t)))
+		localtime_r(&t, &base_tm);
+		tm = &base_tm;
+	}
+
+	return catcierge_strftime_render(dst, dst_len, fmt, tm, tv);
+}
+
+static int catcierge_strftime_parse(catcierge_strftime_fmt_t *f, const char *fmt)
+{
+	const char *s = fmt;
+	char *p = f->parts;
+	size_t n;
+
+	if (strlen(fmt) >= sizeof(f->fmt))
+		return -1;
+
+	strcpy(f->fmt, fmt);
+	f->rendered = 0;
+	f->segment_count = 1;
+	f->segments[0].fmt = p;
+	*p++ = ' ';
+
+	while (*s)
+	{
+		if ((s[0] == '%') && (s[1] == 'f'))
 		{
-			goto fail;
+			if ((f->segment_count + 2) > CATCIERGE_STRFTIME_MAX_SEGMENTS)
+				return -1;
+
+			// End the current strftime segment, add the %f
+			// and start a new one. This takes the place of the "%f".
+			*p++ = '\0';
+			f->segments[f->segment_count++].fmt = NULL;
+			f->segments[f->segment_count++].fmt = p;
+			*p++ = ' ';
+			s += 2;
+			continue;
 		}
+
+		n = catcierge_strftime_spec_len(s);
+		memcpy(p, s, n);
+		p += n;
+		s += n;
 	}
 
-	// Add millisecond formatting (uses %f as python).
-	if (tv)
+	*p = '\0';
+
+	return 0;
+}
+
+static catcierge_strftime_fmt_t *catcierge_strftime_get_fmt(catcierge_strftime_cache_t *c, const char *fmt)
+{
+	size_t i;
+	catcierge_strftime_fmt_t *f;
+
+	for (i = 0; i < c->count; i++)
 	{
-		size_t i;
-		size_t j;
-		int val_len;
-		size_t len = strlen(fmt) + 1;
-		size_t tmp_len = 2 * len;
+		if (!strcmp(c->fmts[i].fmt, fmt))
+			return &c->fmts[i];
+	}
 
-		if (!(tmp_fmt = malloc(sizeof(char) * tmp_len)))
-		{
+	if (c->count < CATCIERGE_STRFTIME_CACHE_SIZE)
+	{
+		f = &c->fmts[c->count];
+	}
+	else
+	{
+		f = &c->fmts[c->next];
+		c->next = (c->next + 1) % CATCIERGE_STRFTIME_CACHE_SIZE;
+	}
+
+	if (catcierge_strftime_parse(f, fmt))
+	{
+		// Leave an empty (but valid) entry behind.
+		f->fmt[0] = '\0';
+		f->segment_count = 0;
+		return NULL;
+	}
+
+	if (c->count < CATCIERGE_STRFTIME_CACHE_SIZE)
+		c->count++;
+
+	return f;
+}
+
+static int catcierge_strftime_prerender(catcierge_strftime_fmt_t *f, time_t t, const struct tm *tm)
+{
+	size_t i;
+	size_t len = 0;
+	catcierge_strftime_segment_t *seg;
+
+	f->rendered = 0;
+
+	for (i = 0; i < f->segment_count; i++)
+	{
+		seg = &f->segments[i];
+
+		if (!seg->fmt)
+			continue;
+
+		seg->out_offset = len;
+
+		if (catcierge_strftime_segment(f->out, sizeof(f->out), &len, seg->fmt, tm))
 			return -1;
-		}
 
-		i = 0;
-		j = 0;
-		while (i < len)
-		{
-			if (!strncmp(&fmt[i], "%f", 2))
-			{
-				while (1)
-				{
-					size_t count = tmp_len - j;
-					val_len = snprintf(&tmp_fmt[j], count - 1, "%06ld", (long int)tv->tv_usec);
-
-					// On Windows snprintf_s returns -1 when the buffer was too small.
-					// Since we cast this -1 to an unsigned int (size_t) below, it will
-					// go through the normal realloc.
-					// The unix implementation instead does the following:
-					// "If the output was truncated due to this limit then the return
-					//  value is the number of characters (excluding the terminating null byte)
-					//  which would have been written to the final string if enough space had
-					//  been available."
-					#ifndef _WIN32
-					if ((val_len < 0))
-					{
-						goto fail;
-					}
-					else
-					#endif
-					if ((size_t)val_len >= count)
-					{
-						// Truncated expand the buffer.
-						tmp_len *= 2;
-
-						if (!(tmp_fmt = realloc(tmp_fmt, tmp_len)))
-						{
-							goto fail;
-						}
-					}
-					else
-					{
-						break;
-					}
-				}
-
-				j += val_len; // Skip the expanded value.
-				i += 2; // Skip the %f
-			}
-			else
-			{
-				tmp_fmt[j++] = fmt[i++];
-			}
-		}
+		seg->out_len = len - seg->out_offset;
+	}
+
+	f->rendered = 1;
+	f->rendered_t = t;
+
+	return 0;
+}
+
+int catcierge_strftime_time(char *dst, size_t dst_len, const char *fmt, time_t t, const struct timeval *tv)
+{
+	catcierge_strftime_cache_t *c = &catcierge_strftime_cache;
+	catcierge_strftime_fmt_t *f;
+	catcierge_strftime_segment_t *seg;
+	size_t len = 0;
+	size_t i;
+
+	if (!dst || !dst_len)
+		return 0;
+
+	catcierge_strftime_setup();
+	dst[0] = '\0';
 
-		tmp_fmt[j] = '\0';
+	t -= catcierge_base_time_diff;
 
-		fmt = tmp_fmt;
+	// The broken down time only changes once a second.
+	if (!c->have_tm || (c->tm_t != t))
+	{
+		localtime_r(&t, &c->tm);
+		c->tm_t = t;
+		c->have_tm = 1;
+	}
+
+	// Formats that are too long or too complex are rendered directly.
+	if (!(f = catcierge_strftime_get_fmt(c, fmt)))
+	{
+		return catcierge_strftime_render(dst, dst_len, fmt, &c->tm, tv);
 	}
 
-	ret = strftime(dst, dst_len, fmt, tm);
+	if (!f->rendered || (f->rendered_t != t))
+	{
+		if (catcierge_strftime_prerender(f, t, &c->tm))
+		{
+			return catcierge_strftime_render(dst, dst_len, fmt, &c->tm, tv);
+		}
+	}
 
-fail:
-	if (tmp_fmt)
+	for (i = 0; i < f->segment_count; i++)
 	{
-		free(tmp_fmt);
+		seg = &f->segments[i];
+
+		if (seg->fmt)
+		{
+			if (catcierge_strftime_append(dst, dst_len, &len,
+				&f->out[seg->out_offset], seg->out_len))
+				return 0;
+		}
+		else if (tv)
+		{
+			if (catcierge_strftime_usec(dst, dst_len, &len, tv))
+				return 0;
+		}
+		else
+		{
+			// No sub-second time, leave it as is like strftime does.
+			if (catcierge_strftime_append(dst, dst_len, &len, "%f", 2))
+				return 0;
+		}
 	}
 
-	return ret;
+	return (int)len;
 }
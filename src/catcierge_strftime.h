@@ -22,8 +22,21 @@
 #include <time.h>
 #include <stdlib.h>
 
+#define CATCIERGE_STRFTIME_CACHE_SIZE 16	// Number of pre-parsed formats kept per thread.
+#define CATCIERGE_STRFTIME_MAX_FMT 128		// Longer formats are parsed on each call instead.
+#define CATCIERGE_STRFTIME_MAX_SEGMENTS 16	// Max number of %f + 1 segments in a format.
+#define CATCIERGE_STRFTIME_MAX_OUT 256		// Max rendered length that is cached.
+
 int catcierge_strftime(char *dst, size_t dst_len, const char *fmt, const struct tm *tm, struct timeval *tv);
 
+//
+// Formats the time t (with sub-seconds from tv) as local time.
+// The broken down time and the rendered format string are cached
+// for the current second, so that usually only the %f field is
+// rendered. Returns the length of the result, 0 on failure.
+//
+int catcierge_strftime_time(char *dst, size_t dst_len, const char *fmt, time_t t, const struct timeval *tv);
+
 void catcierge_strftime_set_base_diff(long time_diff);
 
 #endif // __CATCIERGE_STRFTIME_H__
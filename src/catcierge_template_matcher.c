@@ -37,6 +37,7 @@ static int _catcierge_prepare_img(catcierge_template_matcher_t *ctx, const IplIm
 	const IplImage *img_gray = NULL;
 	IplImage *tmp = NULL;
 	//IplImage *tmp2 = NULL;
+	double begin;
 	assert(ctx);
 	assert(ctx->kernel);
 	assert(src != dst);
@@ -44,7 +45,9 @@ static int _catcierge_prepare_img(catcierge_template_matcher_t *ctx, const IplIm
 	if (src->nChannels != 1)
 	{
 		tmp = cvCreateImage(cvGetSize(src), 8, 1);
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_GRAYSCALE);
 		cvCvtColor(src, tmp, CV_BGR2GRAY);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_GRAYSCALE, begin);
 		img_gray = tmp;
 	}
 	else
@@ -67,10 +70,12 @@ static int _catcierge_prepare_img(catcierge_template_matcher_t *ctx, const IplIm
 	else
 	#endif
 	{
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_THRESHOLD);
 		cvThreshold(img_gray, dst,
 					ctx->low_binary_thresh,
 					ctx->high_binary_thresh,
 					CV_THRESH_BINARY);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_THRESHOLD, begin);
 	}
 
 	if (src->nChannels != 1)
@@ -137,11 +142,6 @@ int catcierge_template_matcher_init(catcierge_matcher_t **octx,
 		}
 	}
 
-	if (!(ctx->storage = cvCreateMemStorage(0)))
-	{
-		return -1;
-	}
-
 	if (!(ctx->kernel = cvCreateStructuringElementEx(3, 3, 0, 0, CV_SHAPE_RECT, NULL)))
 	{
 		return -1;
@@ -236,12 +236,6 @@ void catcierge_template_matcher_destroy(catcierge_matcher_t **octx)
 		ctx->flipped_snouts = NULL;
 	}
 
-	if (ctx->storage)
-	{
-		cvReleaseMemStorage(&ctx->storage);
-		ctx->storage = NULL;
-	}
-
 	if (ctx->kernel)
 	{
 		cvReleaseStructuringElement(&ctx->kernel);
@@ -281,6 +275,7 @@ double catcierge_template_matcher_match(void *octx,
 	double max_val;
 	double match_sum = 0.0;
 	double match_avg = 0.0;
+	double begin;
 	size_t i;
 	catcierge_template_matcher_t *ctx = (catcierge_template_matcher_t *)octx;
 	assert(ctx);
@@ -324,8 +319,10 @@ double catcierge_template_matcher_match(void *octx,
 
 		// Try to match the snout with the image.
 		// If we find it, the max_val should be close to 1.0
+		begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_TEMPLATE);
 		cvMatchTemplate(img_cpy, ctx->snouts[i], ctx->matchres[i], CV_TM_CCOEFF_NORMED);
 		cvMinMaxLoc(ctx->matchres[i], &min_val, &max_val, &min_loc, &max_loc, NULL);
+		catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_TEMPLATE, begin);
 
 		if (ctx->super.debug)
 		{
@@ -355,8 +352,10 @@ double catcierge_template_matcher_match(void *octx,
 		for (i = 0; i < ctx->snout_count; i++)
 		{
 			snout_size = cvGetSize(ctx->flipped_snouts[i]);
+			begin = catcierge_matcher_stage_begin(&ctx->super, MATCHER_STAGE_TEMPLATE);
 			cvMatchTemplate(img_cpy, ctx->flipped_snouts[i], ctx->matchres[i], CV_TM_CCOEFF_NORMED);
 			cvMinMaxLoc(ctx->matchres[i], &min_val, &max_val, &min_loc, &max_loc, NULL);
+			catcierge_matcher_stage_end(&ctx->super, MATCHER_STAGE_TEMPLATE, begin);
 
 			match_sum += max_val;
 
@@ -45,7 +45,6 @@ typedef struct catcierge_template_matcher_args_s
 typedef struct catcierge_template_matcher_s
 {
 	catcierge_matcher_t super;
-	CvMemStorage *storage;
 	int width;
 	int height;
 	IplImage **snouts;
@@ -26,10 +26,16 @@
 #include "catcierge_util.h"
 #include "catcierge_types.h"
 #include "catcierge_args.h"
+#include "catcierge_timer.h"
+#include "catcierge_archive.h"
 #ifdef _WIN32
 #include <process.h>
 #else
 #include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #endif
 #include <time.h>
 
@@ -46,6 +52,10 @@ typedef struct tester_ctx_s
 	int test_matchable;
 	int debug;
 	int preload;
+
+	int batch;
+	int threads;
+	int queue_size;
 } tester_ctx_t;
 
 tester_ctx_t ctx;
@@ -97,9 +107,512 @@ static int add_options(catcierge_args_t *args)
 			"so the speed is not affected by disk IO at the time of the matching.",
 			"b", &ctx.preload);
 
+	ret |= cargo_add_group(cargo, 0,
+			"batch", "Batch Settings",
+			"Settings for re-validating large archives of saved match images. "
+			"The images are read by a prefetch thread and matched by a pool of "
+			"worker threads with one matcher each. The expected outcome is taken "
+			"from the filename as saved by catcierge: \"match_fail_...\" for a "
+			"failed match and \"match__...\" for a successful one.");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<batch> --batch",
+			"Run in batch mode. Directories given to --images are "
+			"searched recursively for images. Archives (" CATCIERGE_ARCHIVE_EXT ") "
+			"written using --archive can also be given, the match images "
+			"in them are used.",
+			"b", &ctx.batch);
+
+	#ifndef _WIN32
+	ctx.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	#endif
+	if (ctx.threads < 1) ctx.threads = 1;
+	ret |= cargo_add_option(cargo, 0,
+			"<batch> --threads",
+			"Number of worker threads in batch mode. Defaults to the number of CPUs.",
+			"i", &ctx.threads);
+	ret |= cargo_add_validation(cargo, 0,
+			"--threads",
+			cargo_validate_int_range(1, 256));
+
+	ret |= cargo_add_option(cargo, 0,
+			"<batch> --queue_size",
+			"Max number of images read ahead of the workers in batch mode. "
+			"Defaults to twice the number of threads.",
+			"i", &ctx.queue_size);
+	ret |= cargo_add_validation(cargo, 0,
+			"--queue_size",
+			cargo_validate_int_range(0, 100000));
+
 	return ret;
 }
 
+// Expected match success from a saved match image filename, -1 if unknown.
+static int get_expected_from_filename(const char *path)
+{
+	int success;
+
+	if (!catcierge_parse_match_filename_label(path, &success))
+		return -1;
+
+	return success;
+}
+
+#ifndef _WIN32
+
+typedef struct batch_item_s
+{
+	char *path;
+	CvMat *data;	// The encoded image file.
+	IplImage *img;	// Or an already decoded image from an archive.
+} batch_item_t;
+
+typedef struct batch_stats_s
+{
+	size_t matrix[2][2];	// [expected][result] where 1 = ok, 0 = fail.
+	size_t unlabeled[2];	// [result] for images without an expected outcome.
+	size_t errors;
+} batch_stats_t;
+
+typedef struct batch_ctx_s
+{
+	catcierge_args_t *args;
+
+	// Bounded queue between the prefetch thread and the workers.
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	batch_item_t *items;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	int done;				// The prefetch thread has queued everything.
+
+	batch_stats_t stats;	// Worker stats are merged in here when done.
+	size_t read_errors;
+} batch_ctx_t;
+
+static void batch_push(batch_ctx_t *b, batch_item_t *item)
+{
+	pthread_mutex_lock(&b->lock);
+
+	while (b->count == b->capacity)
+	{
+		pthread_cond_wait(&b->not_full, &b->lock);
+	}
+
+	b->items[(b->head + b->count) % b->capacity] = *item;
+	b->count++;
+
+	pthread_cond_signal(&b->not_empty);
+	pthread_mutex_unlock(&b->lock);
+}
+
+// Returns 0 when the queue is empty and nothing more will be added.
+static int batch_pop(batch_ctx_t *b, batch_item_t *item)
+{
+	int ret = 0;
+	pthread_mutex_lock(&b->lock);
+
+	while ((b->count == 0) && !b->done)
+	{
+		pthread_cond_wait(&b->not_empty, &b->lock);
+	}
+
+	if (b->count > 0)
+	{
+		*item = b->items[b->head];
+		b->head = (b->head + 1) % b->capacity;
+		b->count--;
+		ret = 1;
+		pthread_cond_signal(&b->not_full);
+	}
+
+	pthread_mutex_unlock(&b->lock);
+
+	return ret;
+}
+
+static CvMat *batch_read_file(const char *path)
+{
+	FILE *f = NULL;
+	CvMat *data = NULL;
+	long size;
+
+	if (!(f = fopen(path, "rb")))
+	{
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+
+	if (size > 0)
+	{
+		data = cvCreateMat(1, (int)size, CV_8UC1);
+
+		if (fread(data->data.ptr, 1, size, f) != (size_t)size)
+		{
+			cvReleaseMat(&data);
+		}
+	}
+
+	fclose(f);
+
+	return data;
+}
+
+// Queues the match images of all match groups in an archive.
+static void batch_queue_archive(batch_ctx_t *b, const char *path)
+{
+	size_t i;
+	char name[4096];
+	batch_item_t item;
+	catcierge_archive_reader_t r;
+	catcierge_archive_record_t *rec;
+	catcierge_archive_frame_t *frame;
+
+	if (catcierge_archive_reader_open(&r, path))
+	{
+		b->read_errors++;
+		return;
+	}
+
+	while ((rec = catcierge_archive_reader_next(&r)))
+	{
+		for (i = 0; i < rec->frame_count; i++)
+		{
+			frame = catcierge_archive_get_frame(rec, i);
+
+			if (frame->type != CATCIERGE_ARCHIVE_MATCH)
+				continue;
+
+			// The name is what the file would have been called, so the
+			// expected outcome can be taken from it as usual.
+			snprintf(name, sizeof(name), "%s/%s", path, frame->name);
+			memset(&item, 0, sizeof(item));
+
+			if (!(item.img = catcierge_archive_decode(rec, i)))
+			{
+				fprintf(stderr, "Failed to decode image: %s\n", name);
+				b->read_errors++;
+				continue;
+			}
+
+			if (!(item.path = strdup(name)))
+			{
+				fprintf(stderr, "Out of memory!\n");
+				cvReleaseImage(&item.img);
+				b->read_errors++;
+				continue;
+			}
+
+			batch_push(b, &item);
+		}
+	}
+
+	catcierge_archive_reader_close(&r);
+}
+
+static void batch_queue_file(batch_ctx_t *b, const char *path)
+{
+	batch_item_t item;
+
+	if (catcierge_is_archive_path(path))
+	{
+		batch_queue_archive(b, path);
+		return;
+	}
+
+	memset(&item, 0, sizeof(item));
+
+	if (!(item.data = batch_read_file(path)))
+	{
+		fprintf(stderr, "Failed to read image: %s\n", path);
+		b->read_errors++;
+		return;
+	}
+
+	if (!(item.path = strdup(path)))
+	{
+		fprintf(stderr, "Out of memory!\n");
+		cvReleaseMat(&item.data);
+		b->read_errors++;
+		return;
+	}
+
+	batch_push(b, &item);
+}
+
+static void batch_queue_dir(batch_ctx_t *b, const char *dir_path)
+{
+	DIR *dir = NULL;
+	struct dirent *entry;
+	struct stat st;
+	char path[PATH_MAX];
+
+	if (!(dir = opendir(dir_path)))
+	{
+		fprintf(stderr, "Failed to open directory: %s\n", dir_path);
+		b->read_errors++;
+		return;
+	}
+
+	while ((entry = readdir(dir)))
+	{
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+
+		if (stat(path, &st))
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+		{
+			batch_queue_dir(b, path);
+		}
+		else if (catcierge_is_image_path(path) || catcierge_is_archive_path(path))
+		{
+			batch_queue_file(b, path);
+		}
+	}
+
+	closedir(dir);
+}
+
+static void *batch_prefetch_thread(void *user)
+{
+	batch_ctx_t *b = (batch_ctx_t *)user;
+	struct stat st;
+	size_t i;
+
+	for (i = 0; i < ctx.img_count; i++)
+	{
+		if (!stat(ctx.img_paths[i], &st) && S_ISDIR(st.st_mode))
+		{
+			batch_queue_dir(b, ctx.img_paths[i]);
+		}
+		else
+		{
+			batch_queue_file(b, ctx.img_paths[i]);
+		}
+	}
+
+	pthread_mutex_lock(&b->lock);
+	b->done = 1;
+	pthread_cond_broadcast(&b->not_empty);
+	pthread_mutex_unlock(&b->lock);
+
+	return NULL;
+}
+
+static void *batch_worker_thread(void *user)
+{
+	batch_ctx_t *b = (batch_ctx_t *)user;
+	catcierge_matcher_t *matcher = NULL;
+	match_result_t *result = NULL;
+	batch_stats_t stats;
+	batch_item_t item;
+	IplImage *img = NULL;
+	int expected;
+
+	memset(&stats, 0, sizeof(stats));
+
+	if (!(result = calloc(1, sizeof(match_result_t))))
+	{
+		fprintf(stderr, "Out of memory!\n");
+	}
+	else if (catcierge_matcher_init(&matcher, catcierge_get_matcher_args(b->args)))
+	{
+		fprintf(stderr, "Failed to init matcher for worker\n");
+	}
+
+	// Keep consuming even if the init failed so the prefetch thread never blocks.
+	while (batch_pop(b, &item))
+	{
+		if (item.img)
+		{
+			img = item.img;
+			item.img = NULL;
+		}
+		else if (item.data)
+		{
+			img = cvDecodeImage(item.data, CV_LOAD_IMAGE_COLOR);
+		}
+
+		if (!matcher || !img)
+		{
+			fprintf(stderr, "Failed to load image: %s\n", item.path);
+			stats.errors++;
+		}
+		else
+		{
+			memset(result, 0, sizeof(match_result_t));
+
+			// The batch images are not from the same match.
+			if (matcher->reset)
+			{
+				matcher->reset(matcher);
+			}
+
+			if (matcher->match(matcher, img, result, 0) < 0)
+			{
+				fprintf(stderr, "Something went wrong when matching image: %s\n", item.path);
+				stats.errors++;
+			}
+			else
+			{
+				int success = !!result->success;
+
+				if ((expected = get_expected_from_filename(item.path)) < 0)
+				{
+					stats.unlabeled[success]++;
+				}
+				else
+				{
+					stats.matrix[expected][success]++;
+
+					if (expected != success)
+					{
+						printf("Expected %s got %s (%s): %s\n",
+							expected ? "ok" : "fail", success ? "ok" : "fail",
+							result->description, item.path);
+					}
+				}
+			}
+		}
+
+		cvReleaseImage(&img);
+		cvReleaseMat(&item.data);
+		free(item.path);
+	}
+
+	catcierge_matcher_destroy(&matcher);
+	free(result);
+
+	pthread_mutex_lock(&b->lock);
+	b->stats.matrix[0][0] += stats.matrix[0][0];
+	b->stats.matrix[0][1] += stats.matrix[0][1];
+	b->stats.matrix[1][0] += stats.matrix[1][0];
+	b->stats.matrix[1][1] += stats.matrix[1][1];
+	b->stats.unlabeled[0] += stats.unlabeled[0];
+	b->stats.unlabeled[1] += stats.unlabeled[1];
+	b->stats.errors += stats.errors;
+	pthread_mutex_unlock(&b->lock);
+
+	return NULL;
+}
+
+static void batch_print_summary(batch_ctx_t *b, double duration)
+{
+	batch_stats_t *s = &b->stats;
+	size_t labeled = s->matrix[0][0] + s->matrix[0][1] + s->matrix[1][0] + s->matrix[1][1];
+	size_t total = labeled + s->unlabeled[0] + s->unlabeled[1];
+
+	printf("---------------------------------------------------\n");
+	printf("%lu images matched in %.2f seconds (%.1f images/s) using %d threads\n",
+		(unsigned long)total, duration, (duration > 0.0) ? (total / duration) : 0.0, ctx.threads);
+	printf("\n");
+	printf("                 result ok   result fail\n");
+	printf("expected ok    %11lu %13lu\n",
+		(unsigned long)s->matrix[1][1], (unsigned long)s->matrix[1][0]);
+	printf("expected fail  %11lu %13lu\n",
+		(unsigned long)s->matrix[0][1], (unsigned long)s->matrix[0][0]);
+	printf("unlabeled      %11lu %13lu\n",
+		(unsigned long)s->unlabeled[1], (unsigned long)s->unlabeled[0]);
+	printf("\n");
+
+	if (labeled > 0)
+	{
+		printf("Accuracy: %.2f%% (%lu of %lu labeled images)\n",
+			100.0 * (s->matrix[0][0] + s->matrix[1][1]) / labeled,
+			(unsigned long)(s->matrix[0][0] + s->matrix[1][1]), (unsigned long)labeled);
+	}
+
+	printf("Errors: %lu\n", (unsigned long)(s->errors + b->read_errors));
+}
+
+static int run_batch(catcierge_args_t *args)
+{
+	int ret = 0;
+	int i;
+	int started = 0;
+	int prefetch_started = 0;
+	double start;
+	pthread_t prefetch_thread;
+	pthread_t *workers = NULL;
+	batch_ctx_t b;
+
+	memset(&b, 0, sizeof(b));
+	b.args = args;
+	b.capacity = ctx.queue_size ? ctx.queue_size : (2 * ctx.threads);
+
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.not_empty, NULL);
+	pthread_cond_init(&b.not_full, NULL);
+
+	if (!(b.items = calloc(b.capacity, sizeof(batch_item_t)))
+	 || !(workers = calloc(ctx.threads, sizeof(pthread_t))))
+	{
+		fprintf(stderr, "Out of memory!\n");
+		ret = -1; goto fail;
+	}
+
+	// The workers already use all cores, don't let OpenCV start more threads.
+	cvSetNumThreads(1);
+
+	start = catcierge_timer_now();
+
+	for (i = 0; i < ctx.threads; i++)
+	{
+		if (pthread_create(&workers[i], NULL, batch_worker_thread, &b))
+		{
+			fprintf(stderr, "Failed to start worker thread\n");
+			ret = -1; break;
+		}
+
+		started++;
+	}
+
+	if (started && !pthread_create(&prefetch_thread, NULL, batch_prefetch_thread, &b))
+	{
+		prefetch_started = 1;
+		pthread_join(prefetch_thread, NULL);
+	}
+	else
+	{
+		fprintf(stderr, "Failed to start prefetch thread\n");
+		ret = -1;
+
+		pthread_mutex_lock(&b.lock);
+		b.done = 1;
+		pthread_cond_broadcast(&b.not_empty);
+		pthread_mutex_unlock(&b.lock);
+	}
+
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	if (prefetch_started)
+	{
+		batch_print_summary(&b, catcierge_timer_now() - start);
+	}
+
+fail:
+	free(workers);
+	free(b.items);
+	pthread_cond_destroy(&b.not_full);
+	pthread_cond_destroy(&b.not_empty);
+	pthread_mutex_destroy(&b.lock);
+
+	return ret;
+}
+#endif // !_WIN32
+
 int main(int argc, char **argv)
 {
 	int ret = 0;
@@ -139,6 +652,23 @@ int main(int argc, char **argv)
 		ret = -1; goto fail;
 	}
 
+	if (ctx.batch)
+	{
+		#ifdef _WIN32
+		fprintf(stderr, "Batch mode is not supported on Windows\n");
+		ret = -1;
+		#else
+		if (ctx.show || ctx.save || ctx.test_matchable || ctx.preload)
+		{
+			fprintf(stderr, "Note that --test_show, --test_save, --test_obstructed "
+							"and --preload are ignored in batch mode\n");
+		}
+
+		ret = run_batch(&args);
+		#endif
+		goto fail;
+	}
+
 	// Create output directory.
 	if (ctx.save)
 	{
@@ -229,6 +759,11 @@ int main(int argc, char **argv)
 
 			printf("  Image size: %dx%d\n", img_size.width, img_size.height);
 
+			// The images are not from the same match.
+			if (matcher->reset)
+			{
+				matcher->reset(matcher);
+			}
 
 			if ((match_res = matcher->match(matcher, img, &result, 0)) < 0)
 			{
@@ -24,6 +24,80 @@
 #include <stdio.h>
 #include <math.h>
 
+static int catcierge_virtual_clock_enabled;
+static int catcierge_virtual_clock_seeded; // Has the clock been set since it was enabled?
+static struct timeval catcierge_virtual_clock;
+
+void catcierge_timer_set_virtual(int enable)
+{
+	catcierge_virtual_clock_enabled = 0;
+	catcierge_virtual_clock_seeded = 0;
+
+	if (enable)
+	{
+		gettimeofday(&catcierge_virtual_clock, NULL);
+		catcierge_virtual_clock_enabled = 1;
+	}
+}
+
+void catcierge_timer_seed_virtual_time(const struct timeval *tv)
+{
+	assert(tv);
+
+	catcierge_virtual_clock = *tv;
+	catcierge_virtual_clock_seeded = 1;
+}
+
+int catcierge_timer_is_virtual()
+{
+	return catcierge_virtual_clock_enabled;
+}
+
+void catcierge_timer_set_virtual_time(const struct timeval *tv)
+{
+	assert(tv);
+
+	// Recordings are usually older than the time the clock was enabled.
+	if (!catcierge_virtual_clock_seeded)
+	{
+		catcierge_timer_seed_virtual_time(tv);
+		return;
+	}
+
+	if ((tv->tv_sec > catcierge_virtual_clock.tv_sec)
+	 || ((tv->tv_sec == catcierge_virtual_clock.tv_sec)
+	  && (tv->tv_usec > catcierge_virtual_clock.tv_usec)))
+	{
+		catcierge_virtual_clock = *tv;
+	}
+}
+
+void catcierge_timer_advance(double seconds)
+{
+	long usec;
+
+	if (seconds <= 0.0)
+		return;
+
+	catcierge_virtual_clock_seeded = 1;
+
+	usec = catcierge_virtual_clock.tv_usec + (long)((seconds - floor(seconds)) * 1000000.0);
+	catcierge_virtual_clock.tv_sec += (long)floor(seconds) + (usec / 1000000);
+	catcierge_virtual_clock.tv_usec = usec % 1000000;
+}
+
+time_t catcierge_timer_time(struct timeval *tv)
+{
+	if (catcierge_virtual_clock_enabled)
+	{
+		if (tv) *tv = catcierge_virtual_clock;
+		return (time_t)catcierge_virtual_clock.tv_sec;
+	}
+
+	if (tv) gettimeofday(tv, NULL);
+	return time(NULL);
+}
+
 // TODO: Replace this with a monotonic timer version instead!
 void catcierge_timer_reset(catcierge_timer_t *t)
 {
@@ -42,8 +116,8 @@ void catcierge_timer_start(catcierge_timer_t *t)
 {
 	assert(t);
 
-	gettimeofday(&t->start, NULL);
-	gettimeofday(&t->end, NULL);
+	catcierge_timer_time(&t->start);
+	t->end = t->start;
 }
 
 double catcierge_timer_get(catcierge_timer_t *t)
@@ -52,7 +126,7 @@ double catcierge_timer_get(catcierge_timer_t *t)
 	if (t->start.tv_sec == 0)
 		return 0.0;
 
-	gettimeofday(&t->end, NULL);
+	catcierge_timer_time(&t->end);
 
 	return (double)(t->end.tv_sec - t->start.tv_sec) +
 			((t->end.tv_usec - t->start.tv_usec) / 1000000.0);
@@ -69,3 +143,155 @@ int catcierge_timer_has_timed_out(catcierge_timer_t *t)
 	assert(t);
 	return (round(catcierge_timer_get(t)) >= t->timeout);
 }
+
+double catcierge_timer_now()
+{
+	#if defined(_WIN32) || !defined(CLOCK_MONOTONIC)
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (tv.tv_usec / 1000000.0);
+	#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+	#endif
+}
+
+void catcierge_span_reset(catcierge_span_t *s)
+{
+	assert(s);
+	memset(s, 0, sizeof(catcierge_span_t));
+}
+
+double catcierge_span_begin(catcierge_span_t *s)
+{
+	double now = catcierge_timer_now();
+	assert(s);
+
+	if (s->start == 0.0)
+	{
+		s->start = now;
+	}
+
+	return now;
+}
+
+void catcierge_span_end(catcierge_span_t *s, double begin)
+{
+	assert(s);
+	s->end = catcierge_timer_now();
+	s->duration += s->end - begin;
+}
+
+void catcierge_span_add(catcierge_span_t *dst, const catcierge_span_t *src)
+{
+	assert(dst);
+	assert(src);
+
+	if (src->start == 0.0)
+		return;
+
+	if ((dst->start == 0.0) || (src->start < dst->start))
+		dst->start = src->start;
+
+	if (src->end > dst->end)
+		dst->end = src->end;
+
+	dst->duration += src->duration;
+}
+
+void catcierge_histogram_reset(catcierge_histogram_t *h)
+{
+	assert(h);
+	memset(h, 0, sizeof(catcierge_histogram_t));
+}
+
+void catcierge_histogram_add(catcierge_histogram_t *h, double seconds)
+{
+	double ms = seconds * 1000.0;
+	double limit = 1.0;
+	int i = 0;
+	assert(h);
+
+	while ((ms >= limit) && (i < (CATCIERGE_HISTOGRAM_BUCKETS - 1)))
+	{
+		limit *= 2.0;
+		i++;
+	}
+
+	h->buckets[i]++;
+
+	if ((h->count == 0) || (ms < h->min))
+		h->min = ms;
+
+	if ((h->count == 0) || (ms > h->max))
+		h->max = ms;
+
+	h->sum += ms;
+	h->count++;
+}
+
+double catcierge_histogram_percentile(catcierge_histogram_t *h, double percentile)
+{
+	size_t wanted;
+	size_t seen = 0;
+	double limit = 1.0;
+	int i;
+	assert(h);
+
+	if (h->count == 0)
+		return 0.0;
+
+	wanted = (size_t)ceil(h->count * (percentile / 100.0));
+
+	if (wanted == 0)
+		wanted = 1;
+
+	for (i = 0; i < CATCIERGE_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+
+		if (seen >= wanted)
+			break;
+
+		limit *= 2.0;
+	}
+
+	// The last bucket has no upper bound.
+	return (limit > h->max) ? h->max : limit;
+}
+
+void catcierge_histogram_print(FILE *fd, catcierge_histogram_t *h, const char *name)
+{
+	double limit = 1.0;
+	int i;
+	assert(h);
+	assert(name);
+
+	if (h->count == 0)
+	{
+		fprintf(fd, "%-10s no samples\n", name);
+		return;
+	}
+
+	fprintf(fd, "%-10s n: %lu  min: %.2f  avg: %.2f  max: %.2f  p50: <%.0f  p95: <%.0f  p99: <%.0f ms\n",
+		name, (unsigned long)h->count, h->min, h->sum / h->count, h->max,
+		catcierge_histogram_percentile(h, 50.0),
+		catcierge_histogram_percentile(h, 95.0),
+		catcierge_histogram_percentile(h, 99.0));
+
+	for (i = 0; i < CATCIERGE_HISTOGRAM_BUCKETS; i++)
+	{
+		if (h->buckets[i])
+		{
+			double low = (i == 0) ? 0.0 : (limit / 2.0);
+
+			if (i == (CATCIERGE_HISTOGRAM_BUCKETS - 1))
+				fprintf(fd, "  %6.0f+        ms: %lu\n", low, (unsigned long)h->buckets[i]);
+			else
+				fprintf(fd, "  %6.0f - %-6.0f ms: %lu\n", low, limit, (unsigned long)h->buckets[i]);
+		}
+
+		limit *= 2.0;
+	}
+}
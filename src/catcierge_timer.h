@@ -21,6 +21,7 @@
 
 #include "catcierge_util.h"
 #include <time.h>
+#include <stdio.h>
 
 #ifdef _WIN32
 #include "win32/gettimeofday.h"
@@ -48,5 +49,63 @@ void catcierge_timer_set(catcierge_timer_t *t, double timeout);
 
 int catcierge_timer_has_timed_out(catcierge_timer_t *t);
 
+// Monotonic time in seconds, only useful for measuring durations.
+double catcierge_timer_now();
+
+// When the virtual clock is enabled all timers and event timestamps use it
+// instead of the system clock. It only moves when advanced explicitly, which
+// lets recorded events be replayed faster than real time.
+// It starts out at the current system time.
+void catcierge_timer_set_virtual(int enable);
+
+int catcierge_timer_is_virtual();
+
+// Sets the virtual clock to any time, such as the start of a recording.
+// Timers should be started after this, not before.
+void catcierge_timer_seed_virtual_time(const struct timeval *tv);
+
+// Sets the virtual clock, it is never moved backwards. Unless the clock has
+// been seeded or advanced since it was enabled, this seeds it instead.
+void catcierge_timer_set_virtual_time(const struct timeval *tv);
+
+void catcierge_timer_advance(double seconds);
+
+// Current time of the virtual or system clock.
+// Fills in tv if given and returns the same time as a time_t.
+time_t catcierge_timer_time(struct timeval *tv);
+
+void catcierge_span_reset(catcierge_span_t *s);
+
+// Enter a span, returns the current time that is passed to catcierge_span_end.
+double catcierge_span_begin(catcierge_span_t *s);
+
+void catcierge_span_end(catcierge_span_t *s, double begin);
+
+// Merge the time spent in one span into another.
+void catcierge_span_add(catcierge_span_t *dst, const catcierge_span_t *src);
+
+// Histogram with power of 2 millisecond buckets:
+// [0, 1), [1, 2), [2, 4) ... and everything above goes into the last.
+#define CATCIERGE_HISTOGRAM_BUCKETS 16
+
+typedef struct catcierge_histogram_s
+{
+	size_t buckets[CATCIERGE_HISTOGRAM_BUCKETS];
+	size_t count;
+	double sum;
+	double min;
+	double max;
+} catcierge_histogram_t;
+
+void catcierge_histogram_reset(catcierge_histogram_t *h);
+
+// Add a sample in seconds.
+void catcierge_histogram_add(catcierge_histogram_t *h, double seconds);
+
+// Upper bound in milliseconds of the bucket the given percentile falls into.
+double catcierge_histogram_percentile(catcierge_histogram_t *h, double percentile);
+
+void catcierge_histogram_print(FILE *fd, catcierge_histogram_t *h, const char *name);
+
 
 #endif // __CATCIERGE_TIMER_H__
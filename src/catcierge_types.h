@@ -25,6 +25,7 @@
 #include <time.h>
 
 #include "catcierge_platform.h"
+#include "catcierge_frame.h"
 #include "sha1.h"
 
 #define MATCH_MAX_COUNT 4 // The number of matches to perform before deciding the lock state.
@@ -59,7 +60,8 @@ typedef enum direction_e
 typedef enum catcierge_matcher_type_e
 {
 	MATCHER_TEMPLATE,
-	MATCHER_HAAR
+	MATCHER_HAAR,
+	MATCHER_DNN
 } catcierge_matcher_type_t;
 
 typedef enum catcierge_lockout_method_s
@@ -69,7 +71,42 @@ typedef enum catcierge_lockout_method_s
 	OBSTRUCT_OR_TIMER_3 = 3
 } catcierge_lockout_method_t;
 
+typedef enum catcierge_image_format_e
+{
+	IMAGE_FORMAT_PNG = 0,
+	IMAGE_FORMAT_JPEG = 1,
+	IMAGE_FORMAT_WEBP = 2,
+	IMAGE_FORMAT_RAW = 3			// Binary PGM/PPM without any compression.
+} catcierge_image_format_t;
+
+#define CATCIERGE_IMAGE_LEVEL_DEFAULT -1
+
+// How a category of saved images (obstruct, match, steps) is encoded.
+typedef struct catcierge_image_encoding_s
+{
+	catcierge_image_format_t format;
+	int level;						// PNG compression (0-9), JPEG/WebP quality (1-100) or CATCIERGE_IMAGE_LEVEL_DEFAULT.
+	int gray;						// Convert color images to 8-bit grayscale before saving.
+} catcierge_image_encoding_t;
+
 #define MAX_STEPS 24
+
+// How the matchers record step images. The value is passed to the
+// matchers as save_steps, so STEPS_OFF must be 0.
+typedef enum catcierge_steps_mode_e
+{
+	STEPS_OFF = 0,					// No step images.
+	STEPS_FULL = 1,					// Every step of the matcher.
+	STEPS_SUMMARY = 2,				// Only the final annotated image.
+	STEPS_LAZY = 3					// Nothing while matching, the steps are re-derived from the match frame when saved.
+} catcierge_steps_mode_t;
+// How catcierge_is_frame_obstructed decides if something is in the frame.
+typedef enum catcierge_obstruct_method_e
+{
+	OBSTRUCT_METHOD_THRESHOLD = 0,	// Enough dark pixels in the middle of the frame.
+	OBSTRUCT_METHOD_BACKGROUND = 1	// Darker than a learned model of the clear frame.
+} catcierge_obstruct_method_t;
+
 #define MAX_MATCH_RECTS 24
 
 typedef struct catcierge_path_s
@@ -79,40 +116,69 @@ typedef struct catcierge_path_s
 	char dir[2048];			// Directory.
 } catcierge_path_t;
 
+// A timed stage of the match pipeline. Times are taken from a
+// monotonic clock (see catcierge_timer_now) and are in seconds.
+// A span can be entered several times, the duration is accumulated.
+typedef struct catcierge_span_s
+{
+	double start;					// First time the span was entered.
+	double end;						// Last time the span was left.
+	double duration;				// Total time spent in the span.
+} catcierge_span_t;
+
+typedef enum catcierge_span_id_e
+{
+	CATCIERGE_SPAN_CAPTURE,			// Grabbing frames from the camera.
+	CATCIERGE_SPAN_OBSTRUCT,		// Obstruction detection.
+	CATCIERGE_SPAN_MATCH,			// Running the matcher on the frames.
+	CATCIERGE_SPAN_DECIDE,			// Deciding the lock status.
+	CATCIERGE_SPAN_LOCK,			// Lock actuation (GPIO write or lockout command).
+	CATCIERGE_SPAN_SAVE,			// Saving images.
+	CATCIERGE_SPAN_OUTPUT,			// Template generation and event commands.
+	CATCIERGE_SPAN_COUNT
+} catcierge_span_id_t;
+
 typedef struct match_step_s
 {
 	IplImage *img;
-	catcierge_path_t path;
+	catcierge_frame_t *frame;		// Pooled buffer backing img, if any.
+	catcierge_path_t *path;			// Where the step image is saved. Only set when saving steps.
 	const char *name;
 	const char *description;
 } match_step_t;
 
 // TODO: Maybe merge this with match_state_t.
 // This struct is passed to the matcher algorithm.
+// Everything up to steps is reset before each match, so keep
+// that part small. The rest is only used when saving/reporting.
 typedef struct match_result_s
 {
 	double result;
 	int success;
-	char description[2048];
-	CvRect match_rects[MAX_MATCH_RECTS];
-	size_t rect_count;
 	match_direction_t direction;
-	match_step_t steps[MAX_STEPS];	// Step by step images+description for the matching algorithm.
+	size_t rect_count;
+	CvRect match_rects[MAX_MATCH_RECTS];
+	int deferred;					// The result is filled in by the match_group hook of the matcher.
 	size_t step_img_count;			// The number of step images.
+	match_step_t steps[MAX_STEPS];	// Step by step images+description for the matching algorithm.
+	char description[256];
+	catcierge_frame_pool_t *step_pool; // Step images are taken from here if set.
 } match_result_t;
 
 // The state of a single match.
 typedef struct match_state_s
 {
 	catcierge_path_t path;			// Path info where to save the image.
-	IplImage *img;					// A cached image of the match frame.
+	IplImage *img;					// The match frame, points into frame.
+	catcierge_frame_t *frame;		// Reference to the match frame.
 	struct timeval tv;
 	time_t time;					// We need this on Windows. 
 									// Since tv_sec in struct timeval is a long (32-bit) and time_t
 									// might be a 64-bit integer.
-	char time_str[1024];			// Time string of match (used in image filename).
+	char time_str[64];				// Time string of match (used in image filename).
 	match_result_t result;			// Updated by the matcher algorithm.
 	SHA1Context sha;				// Used to generate match ID.
+	catcierge_span_t span;			// Time spent running the matcher.
 } match_state_t;
 
 typedef struct match_group_s
@@ -131,10 +197,14 @@ typedef struct match_group_s
 	struct timeval end_tv;
 	time_t end_time;
 
-	IplImage *obstruct_img;
+	IplImage *obstruct_img;			// The obstruct frame, points into obstruct_frame.
+	catcierge_frame_t *obstruct_frame;
 	catcierge_path_t obstruct_path;
 	struct timeval obstruct_tv;
 	time_t obstruct_time;
+
+	catcierge_span_t spans[CATCIERGE_SPAN_COUNT]; // Pipeline stage timings.
+	int active;						// From the obstructed frame until the lock decision is done.
 } match_group_t;
 
 #endif // __CATCIERGE_TYPES_H__
@@ -30,6 +30,9 @@
 #ifdef CATCIERGE_HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
+#ifdef CATCIERGE_HAVE_MALLOC_H
+#include <malloc.h>
+#endif
 #include <time.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -204,6 +207,21 @@ const char *catcierge_get_direction_str(match_direction_t dir)
 	}
 }
 
+const char *catcierge_get_span_str(catcierge_span_id_t span)
+{
+	switch (span)
+	{
+		case CATCIERGE_SPAN_CAPTURE: return "capture";
+		case CATCIERGE_SPAN_OBSTRUCT: return "obstruct";
+		case CATCIERGE_SPAN_MATCH: return "match";
+		case CATCIERGE_SPAN_DECIDE: return "decide";
+		case CATCIERGE_SPAN_LOCK: return "lock";
+		case CATCIERGE_SPAN_SAVE: return "save";
+		case CATCIERGE_SPAN_OUTPUT: return "output";
+		default: return "unknown";
+	}
+}
+
 const char *catcierge_get_left_right_str(direction_t dir)
 {
 	switch (dir)
@@ -772,3 +790,306 @@ char *catcierge_strndup(const char *s, size_t n)
 	return (char *)memcpy(result, s, len);
 }
 
+int catcierge_is_image_path(const char *path)
+{
+	const char *exts[] = { ".png", ".jpg", ".jpeg", ".webp", ".bmp", ".pgm", ".ppm", ".tif", ".tiff" };
+	const char *ext = strrchr(path, '.');
+	size_t i;
+
+	if (!ext)
+		return 0;
+
+	for (i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+	{
+		if (!strcasecmp(ext, exts[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
+const char *catcierge_parse_match_filename_label(const char *path, int *success)
+{
+	const char *name = strrchr(path, '/');
+	const char *name2 = strrchr(path, '\\');
+	assert(success);
+
+	if (name2 > name)
+		name = name2;
+
+	name = name ? (name + 1) : path;
+
+	if (!strncmp(name, "match_fail_", 11))
+	{
+		*success = 0;
+		return name + 11;
+	}
+
+	if (!strncmp(name, "match__", 7))
+	{
+		*success = 1;
+		return name + 7;
+	}
+
+	return NULL;
+}
+
+// CV_IMWRITE_WEBP_QUALITY is missing from older OpenCV 2.4 headers.
+#define CATCIERGE_IMWRITE_WEBP_QUALITY 64
+
+void catcierge_image_encoding_init(catcierge_image_encoding_t *enc)
+{
+	assert(enc);
+	enc->format = IMAGE_FORMAT_PNG;
+	enc->level = CATCIERGE_IMAGE_LEVEL_DEFAULT;
+	enc->gray = 0;
+}
+
+const char *catcierge_image_format_str(catcierge_image_format_t format)
+{
+	switch (format)
+	{
+		case IMAGE_FORMAT_PNG: return "png";
+		case IMAGE_FORMAT_JPEG: return "jpeg";
+		case IMAGE_FORMAT_WEBP: return "webp";
+		case IMAGE_FORMAT_RAW: return "raw";
+		default: return "unknown";
+	}
+}
+
+//
+// Parses an encoding of the form FORMAT[:LEVEL][:gray], for instance
+// "png", "png:1", "jpeg:85:gray" or "raw:gray".
+//
+int catcierge_image_encoding_parse(catcierge_image_encoding_t *enc, const char *str)
+{
+	int ret = 0;
+	char *s = NULL;
+	char *tok;
+	char *end;
+	char *saveptr = NULL;
+	long level;
+	int min_level;
+	int max_level;
+	catcierge_image_encoding_t tmp;
+	assert(enc);
+
+	if (!str || !(s = strdup(str)))
+	{
+		return -1;
+	}
+
+	catcierge_image_encoding_init(&tmp);
+
+	if (!(tok = strtok_r(s, ":", &saveptr)))
+	{
+		ret = -1; goto fail;
+	}
+
+	if (!strcasecmp(tok, "png"))
+		tmp.format = IMAGE_FORMAT_PNG;
+	else if (!strcasecmp(tok, "jpeg") || !strcasecmp(tok, "jpg"))
+		tmp.format = IMAGE_FORMAT_JPEG;
+	else if (!strcasecmp(tok, "webp"))
+		tmp.format = IMAGE_FORMAT_WEBP;
+	else if (!strcasecmp(tok, "raw"))
+		tmp.format = IMAGE_FORMAT_RAW;
+	else
+	{
+		ret = -1; goto fail;
+	}
+
+	min_level = (tmp.format == IMAGE_FORMAT_PNG) ? 0 : 1;
+	max_level = (tmp.format == IMAGE_FORMAT_PNG) ? 9 : 100;
+
+	while ((tok = strtok_r(NULL, ":", &saveptr)))
+	{
+		if (!strcasecmp(tok, "gray") || !strcasecmp(tok, "grey"))
+		{
+			tmp.gray = 1;
+			continue;
+		}
+
+		// Raw images have no compression level.
+		if (tmp.format == IMAGE_FORMAT_RAW)
+		{
+			ret = -1; goto fail;
+		}
+
+		errno = 0;
+		level = strtol(tok, &end, 10);
+
+		if (errno || (end == tok) || (*end != '\0')
+			|| (level < min_level) || (level > max_level))
+		{
+			ret = -1; goto fail;
+		}
+
+		tmp.level = (int)level;
+	}
+
+	*enc = tmp;
+
+fail:
+	free(s);
+
+	return ret;
+}
+
+const char *catcierge_image_encoding_ext(const catcierge_image_encoding_t *enc, int channels)
+{
+	assert(enc);
+
+	switch (enc->format)
+	{
+		case IMAGE_FORMAT_JPEG: return "jpg";
+		case IMAGE_FORMAT_WEBP: return "webp";
+		case IMAGE_FORMAT_RAW: return (enc->gray || (channels == 1)) ? "pgm" : "ppm";
+		case IMAGE_FORMAT_PNG:
+		default: return "png";
+	}
+}
+
+const char *catcierge_image_encoding_str(const catcierge_image_encoding_t *enc, char *buf, size_t bufsize)
+{
+	char level[16] = "";
+	assert(enc);
+	assert(buf);
+
+	if (enc->level != CATCIERGE_IMAGE_LEVEL_DEFAULT)
+	{
+		snprintf(level, sizeof(level), ":%d", enc->level);
+	}
+
+	snprintf(buf, bufsize, "%s%s%s",
+		catcierge_image_format_str(enc->format),
+		level,
+		enc->gray ? ":gray" : "");
+
+	return buf;
+}
+
+//
+// Returns the image that should be encoded. If the encoding forces
+// grayscale and the image is in color, a converted copy is returned
+// in *tmp which the caller must release.
+//
+IplImage *catcierge_image_encoding_prepare(const catcierge_image_encoding_t *enc, IplImage *img, IplImage **tmp)
+{
+	assert(enc);
+	assert(img);
+	assert(tmp);
+	*tmp = NULL;
+
+	if (!enc->gray || (img->nChannels != 3))
+	{
+		return img;
+	}
+
+	if (!(*tmp = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1)))
+	{
+		return NULL;
+	}
+
+	cvCvtColor(img, *tmp, CV_BGR2GRAY);
+
+	return *tmp;
+}
+
+int catcierge_save_image(const char *path, IplImage *img, const catcierge_image_encoding_t *enc)
+{
+	int ret = 0;
+	int params[3] = { 0, 0, 0 };
+	IplImage *tmp = NULL;
+	IplImage *out = NULL;
+	assert(path);
+	assert(enc);
+
+	if (!img)
+	{
+		return -1;
+	}
+
+	if (!(out = catcierge_image_encoding_prepare(enc, img, &tmp)))
+	{
+		CATERR("Out of memory converting %s to grayscale\n", path);
+		return -1;
+	}
+
+	switch (enc->format)
+	{
+		case IMAGE_FORMAT_PNG:
+			params[0] = CV_IMWRITE_PNG_COMPRESSION;
+			params[1] = enc->level;
+			break;
+		case IMAGE_FORMAT_JPEG:
+			params[0] = CV_IMWRITE_JPEG_QUALITY;
+			params[1] = enc->level;
+			break;
+		case IMAGE_FORMAT_WEBP:
+			params[0] = CATCIERGE_IMWRITE_WEBP_QUALITY;
+			params[1] = enc->level;
+			break;
+		case IMAGE_FORMAT_RAW:
+			params[0] = CV_IMWRITE_PXM_BINARY;
+			params[1] = 1;
+			break;
+	}
+
+	// Let the encoder pick its own default.
+	if ((enc->format != IMAGE_FORMAT_RAW)
+		&& (enc->level == CATCIERGE_IMAGE_LEVEL_DEFAULT))
+	{
+		params[0] = 0;
+	}
+
+	if (!cvSaveImage(path, out, params))
+	{
+		CATERR("Failed to save image %s\n", path);
+		ret = -1;
+	}
+
+	if (tmp)
+	{
+		cvReleaseImage(&tmp);
+	}
+
+	return ret;
+}
+
+void catcierge_get_mem_stats(catcierge_mem_stats_t *stats)
+{
+	#if defined(__linux__)
+	FILE *f = NULL;
+	long pages = 0;
+	#endif
+	assert(stats);
+
+	stats->rss_kb = -1;
+	stats->heap_kb = -1;
+
+	#if defined(__linux__)
+	// The second field is the resident set size in pages.
+	if ((f = fopen("/proc/self/statm", "r")))
+	{
+		if (fscanf(f, "%*s %ld", &pages) == 1)
+		{
+			stats->rss_kb = pages * (sysconf(_SC_PAGESIZE) / 1024);
+		}
+
+		fclose(f);
+	}
+	#endif
+
+	#if defined(CATCIERGE_HAVE_MALLOC_H) && defined(__GLIBC__)
+	{
+		// Includes both the main arena and mmapped chunks.
+		#if (__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 33))
+		struct mallinfo2 mi = mallinfo2();
+		#else
+		struct mallinfo mi = mallinfo();
+		#endif
+		stats->heap_kb = (long)((mi.uordblks + mi.hblkhd) / 1024);
+	}
+	#endif
+}
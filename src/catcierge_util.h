@@ -30,6 +30,7 @@ void catcierge_reset_cursor_position();
 int catcierge_make_path(const char *pathname, ...);
 
 const char *catcierge_get_direction_str(match_direction_t dir);
+const char *catcierge_get_span_str(catcierge_span_id_t span);
 const char *catcierge_get_left_right_str(direction_t dir);
 
 const char *catcierge_skip_whitespace(const char *it);
@@ -54,4 +55,29 @@ int catcierge_split(char *str, char delim, char ***array, size_t *length);
 
 char *catcierge_strndup(const char *s, size_t n);
 
+int catcierge_is_image_path(const char *path);
+
+// Saved match images are prefixed with "match_fail_" or "match__" depending
+// on the result. Sets success to that label and returns the rest of the file
+// name, or NULL if it has no such prefix.
+const char *catcierge_parse_match_filename_label(const char *path, int *success);
+
+void catcierge_image_encoding_init(catcierge_image_encoding_t *enc);
+int catcierge_image_encoding_parse(catcierge_image_encoding_t *enc, const char *str);
+const char *catcierge_image_format_str(catcierge_image_format_t format);
+const char *catcierge_image_encoding_ext(const catcierge_image_encoding_t *enc, int channels);
+const char *catcierge_image_encoding_str(const catcierge_image_encoding_t *enc, char *buf, size_t bufsize);
+IplImage *catcierge_image_encoding_prepare(const catcierge_image_encoding_t *enc, IplImage *img, IplImage **tmp);
+int catcierge_save_image(const char *path, IplImage *img, const catcierge_image_encoding_t *enc);
+
+typedef struct catcierge_mem_stats_s
+{
+	long rss_kb;		// Resident set size, -1 if unknown.
+	long heap_kb;		// Heap in use by malloc, -1 if unknown.
+} catcierge_mem_stats_t;
+
+// Samples the memory usage of the process. Used to spot slow leaks
+// that only show after running for weeks.
+void catcierge_get_mem_stats(catcierge_mem_stats_t *stats);
+
 #endif // __CATCIERGE_UTIL_H__
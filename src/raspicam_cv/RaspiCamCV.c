@@ -90,6 +90,10 @@ typedef struct _RASPIVID_STATE
 	IplImage *py, *pu, *pv;
 	IplImage *pu_big, *pv_big, *yuvImage,* dstImage;
 
+	int idle_scale;			/// Set by the caller, frames are only downscaled gray while above 1.
+	int frame_idle_scale;	/// The idle scale the last frame was copied with.
+	IplImage *idleImage;	/// Downscaled Y plane returned while idle.
+
 	VCOS_SEMAPHORE_T capture_sem;
 	VCOS_SEMAPHORE_T capture_done_sem;
    
@@ -175,8 +179,13 @@ static void video_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffe
 			int h4 = h / 4;
 
 			memcpy(state->py->imageData, buffer->data, w * h);	// read Y
+
+			// Changing the MMAL port format means disabling the port and
+			// rebuilding its buffer pool, which takes much longer than a
+			// frame. So idle frames are made smaller here instead.
+			state->frame_idle_scale = state->idle_scale;
 		
-			if (settings->graymode == 0)
+			if ((settings->graymode == 0) && (state->frame_idle_scale <= 1))
 			{
 				memcpy(state->pu->imageData, buffer->data + w * h, w * h4); // read U
 				memcpy(state->pv->imageData, buffer->data + w * h + w * h4, w * h4); // read v
@@ -553,6 +562,8 @@ void raspiCamCvReleaseCapture(RaspiCamCvCapture ** capture)
 		cvReleaseImage(&state->py);
 	}
 
+	cvReleaseImage(&state->idleImage);
+
 	if (settings->graymode == 0) {
 		cvReleaseImage(&state->pu_big);
 		cvReleaseImage(&state->pv_big);
@@ -585,12 +596,38 @@ void raspiCamCvSetCaptureProperty(RaspiCamCvCapture * capture, int property_id,
 	}
 }
 
+void raspiCamCvSetIdleScale(RaspiCamCvCapture * capture, int scale)
+{
+	RASPIVID_STATE *state = capture->pState;
+	state->idle_scale = scale;
+}
+
 IplImage * raspiCamCvQueryFrame(RaspiCamCvCapture * capture)
 {
 	RASPIVID_STATE * state = capture->pState;
 	vcos_semaphore_post(&state->capture_sem);
 	vcos_semaphore_wait(&state->capture_done_sem);
 
+	if (state->frame_idle_scale > 1)
+	{
+		int w = state->settings.width / state->frame_idle_scale;
+		int h = state->settings.height / state->frame_idle_scale;
+
+		if (state->idleImage
+		 && ((state->idleImage->width != w) || (state->idleImage->height != h)))
+		{
+			cvReleaseImage(&state->idleImage);
+		}
+
+		if (!state->idleImage)
+		{
+			state->idleImage = cvCreateImage(cvSize(w, h), IPL_DEPTH_8U, 1);
+		}
+
+		cvResize(state->py, state->idleImage, CV_INTER_NN);
+		return state->idleImage;
+	}
+
 	if (state->settings.graymode == 0)
 	{
 		cvResize(state->pu, state->pu_big, CV_INTER_NN);
@@ -42,6 +42,11 @@ void raspiCamCvReleaseCapture(RaspiCamCvCapture ** capture);
 void raspiCamCvSetCaptureProperty(RaspiCamCvCapture * capture, int property_id, double value);
 IplImage * raspiCamCvQueryFrame(RaspiCamCvCapture * capture);
 
+// While the scale is above 1 only the Y plane of each frame is copied and
+// raspiCamCvQueryFrame returns it as a gray image scale times smaller.
+// Takes effect from the next frame.
+void raspiCamCvSetIdleScale(RaspiCamCvCapture * capture, int scale);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,241 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+#include "catcierge_archive.h"
+
+#define TEST_ARCHIVE "archive_test.cca"
+
+static char *run_rle_tests()
+{
+	char *return_message = NULL;
+	unsigned char src[1000];
+	unsigned char enc[1100];
+	unsigned char dec[1000];
+	size_t len;
+	size_t i;
+
+	// Long runs, short runs and literals.
+	memset(src, 0, 300);
+	memset(src + 300, 255, 300);
+	for (i = 600; i < 1000; i++)
+		src[i] = (unsigned char)((i * 7) ^ (i >> 2));
+	src[700] = src[701] = src[702] = 3;
+
+	len = catcierge_archive_rle_encode(src, sizeof(src), enc);
+	catcierge_test_STATUS("Encoded %d bytes to %d", (int)sizeof(src), (int)len);
+	mu_assertf("Expected RLE to compress", len < sizeof(src));
+	mu_assertf("Failed to decode", !catcierge_archive_rle_decode(enc, len, dec, sizeof(dec)));
+	mu_assertf("Expected same data after decoding", !memcmp(src, dec, sizeof(src)));
+
+	mu_assertf("Expected too small output to fail",
+		catcierge_archive_rle_decode(enc, len, dec, sizeof(dec) - 1));
+	mu_assertf("Expected truncated input to fail",
+		catcierge_archive_rle_decode(enc, len - 1, dec, sizeof(dec)));
+
+cleanup:
+	return return_message;
+}
+
+static char *run_write_read_tests()
+{
+	char *return_message = NULL;
+	catcierge_archive_t ar;
+	catcierge_archive_reader_t r;
+	catcierge_archive_record_t *rec;
+	catcierge_archive_frame_t *frame;
+	struct timeval tv;
+	IplImage *flat = NULL;
+	IplImage *noise = NULL;
+	IplImage *img = NULL;
+	FILE *f = NULL;
+	int x, y;
+
+	catcierge_archive_init(&ar);
+	memset(&r, 0, sizeof(r));
+	remove(TEST_ARCHIVE);
+
+	// Odd width so the rows are padded in the image but not in the archive.
+	flat = cvCreateImage(cvSize(35, 21), IPL_DEPTH_8U, 1);
+	cvSet(flat, cvScalarAll(255), NULL);
+
+	noise = cvCreateImage(cvSize(35, 21), IPL_DEPTH_8U, 3);
+
+	for (y = 0; y < noise->height; y++)
+	{
+		for (x = 0; x < noise->widthStep; x++)
+		{
+			noise->imageData[y * noise->widthStep + x] = (char)(rand() & 0xFF);
+		}
+	}
+
+	tv.tv_sec = 1434146225;
+	tv.tv_usec = 1234;
+
+	mu_assertf("Failed to open archive", !catcierge_archive_open(&ar, TEST_ARCHIVE));
+
+	mu_assertf("Failed to begin record", !catcierge_archive_begin(&ar, "abc123", &tv, 8));
+	mu_assertf("Failed to add frame",
+		!catcierge_archive_add(&ar, "match__2015-06-12_22_17_05.001234__1.png", CATCIERGE_ARCHIVE_MATCH, noise));
+	mu_assertf("Failed to add frame",
+		!catcierge_archive_add(&ar, "match__2015-06-12_22_17_05.001234__1_00_thresh.png", CATCIERGE_ARCHIVE_STEP, flat));
+	mu_assertf("Failed to commit", !catcierge_archive_commit(&ar));
+
+	mu_assertf("Failed to begin record", !catcierge_archive_begin(&ar, "def456", &tv, 1));
+	mu_assertf("Failed to add frame", !catcierge_archive_add(&ar, "obstruct.png", CATCIERGE_ARCHIVE_OBSTRUCT, flat));
+	mu_assertf("Expected too many frames to fail",
+		catcierge_archive_add(&ar, "too_many.png", CATCIERGE_ARCHIVE_STEP, flat));
+	mu_assertf("Failed to commit", !catcierge_archive_commit(&ar));
+	mu_assertf("Expected 2 records", ar.record_count == 2);
+	catcierge_archive_destroy(&ar);
+
+	// Simulate a crash in the middle of writing a record.
+	mu_assertf("Failed to open archive", (f = fopen(TEST_ARCHIVE, "ab")));
+	fwrite(CATCIERGE_ARCHIVE_MAGIC, 1, 4, f);
+	fwrite(&tv, 1, sizeof(tv), f);
+	fclose(f);
+
+	mu_assertf("Failed to open reader", !catcierge_archive_reader_open(&r, TEST_ARCHIVE));
+
+	mu_assertf("Expected first record", (rec = catcierge_archive_reader_next(&r)));
+	mu_assertf("Expected id", !strcmp(rec->id, "abc123"));
+	mu_assertf("Expected time", (rec->time_sec == 1434146225) && (rec->time_usec == 1234));
+	mu_assertf("Expected 2 frames", rec->frame_count == 2);
+
+	frame = catcierge_archive_get_frame(rec, 0);
+	catcierge_test_STATUS("%s %s %u bytes", frame->name,
+		(frame->encoding == CATCIERGE_ARCHIVE_RLE) ? "rle" : "raw", frame->size);
+	mu_assertf("Expected match frame", frame->type == CATCIERGE_ARCHIVE_MATCH);
+	mu_assertf("Expected noise to be stored raw", frame->encoding == CATCIERGE_ARCHIVE_RAW);
+	mu_assertf("Failed to decode", (img = catcierge_archive_decode(rec, 0)));
+	mu_assertf("Expected same size", (img->width == 35) && (img->height == 21) && (img->nChannels == 3));
+
+	for (y = 0; y < img->height; y++)
+	{
+		mu_assertf("Expected same pixels", !memcmp(img->imageData + y * img->widthStep,
+				noise->imageData + y * noise->widthStep, noise->width * 3));
+	}
+
+	cvReleaseImage(&img);
+
+	frame = catcierge_archive_get_frame(rec, 1);
+	catcierge_test_STATUS("%s %s %u bytes", frame->name,
+		(frame->encoding == CATCIERGE_ARCHIVE_RLE) ? "rle" : "raw", frame->size);
+	mu_assertf("Expected flat image to be RLE encoded", frame->encoding == CATCIERGE_ARCHIVE_RLE);
+	mu_assertf("Failed to decode", (img = catcierge_archive_decode(rec, 1)));
+	mu_assertf("Expected white pixel", (unsigned char)img->imageData[20 * img->widthStep + 34] == 255);
+	cvReleaseImage(&img);
+
+	mu_assertf("Expected second record", (rec = catcierge_archive_reader_next(&r)));
+	mu_assertf("Expected id", !strcmp(rec->id, "def456"));
+	mu_assertf("Expected 1 frame", rec->frame_count == 1);
+	frame = catcierge_archive_get_frame(rec, 0);
+	mu_assertf("Expected name", !strcmp(frame->name, "obstruct.png"));
+
+	mu_assertf("Expected truncated record to be ignored", !catcierge_archive_reader_next(&r));
+	mu_assertf("Expected truncated data left", r.pos < r.size);
+
+cleanup:
+	cvReleaseImage(&img);
+	cvReleaseImage(&flat);
+	cvReleaseImage(&noise);
+	catcierge_archive_destroy(&ar);
+	catcierge_archive_reader_close(&r);
+	remove(TEST_ARCHIVE);
+
+	return return_message;
+}
+
+static char *run_recover_tests()
+{
+	char *return_message = NULL;
+	catcierge_archive_t ar;
+	catcierge_archive_reader_t r;
+	catcierge_archive_record_t *rec;
+	IplImage *flat = NULL;
+	FILE *f = NULL;
+	size_t size;
+
+	catcierge_archive_init(&ar);
+	memset(&r, 0, sizeof(r));
+	remove(TEST_ARCHIVE);
+
+	flat = cvCreateImage(cvSize(32, 16), IPL_DEPTH_8U, 1);
+	cvSet(flat, cvScalarAll(255), NULL);
+
+	mu_assertf("Failed to open archive", !catcierge_archive_open(&ar, TEST_ARCHIVE));
+	mu_assertf("Expected an empty archive", ar.size == 0);
+	mu_assertf("Failed to begin record", !catcierge_archive_begin(&ar, "before", NULL, 1));
+	mu_assertf("Failed to add frame", !catcierge_archive_add(&ar, "before.png", CATCIERGE_ARCHIVE_MATCH, flat));
+	mu_assertf("Failed to commit", !catcierge_archive_commit(&ar));
+	size = ar.size;
+	catcierge_archive_destroy(&ar);
+
+	// Simulate a crash in the middle of writing a record.
+	mu_assertf("Failed to open archive", (f = fopen(TEST_ARCHIVE, "ab")));
+	fwrite(CATCIERGE_ARCHIVE_MAGIC, 1, 4, f);
+	fwrite(&size, 1, sizeof(size), f);
+	fclose(f);
+	f = NULL;
+
+	// The partial record must not end up in front of the new one.
+	mu_assertf("Failed to open archive", !catcierge_archive_open(&ar, TEST_ARCHIVE));
+	catcierge_test_STATUS("Recovered archive size %d, expected %d", (int)ar.size, (int)size);
+	mu_assertf("Expected the partial record to be removed", ar.size == size);
+	mu_assertf("Failed to begin record", !catcierge_archive_begin(&ar, "after", NULL, 1));
+	mu_assertf("Failed to add frame", !catcierge_archive_add(&ar, "after.png", CATCIERGE_ARCHIVE_MATCH, flat));
+	mu_assertf("Failed to commit", !catcierge_archive_commit(&ar));
+	catcierge_archive_destroy(&ar);
+
+	mu_assertf("Failed to open reader", !catcierge_archive_reader_open(&r, TEST_ARCHIVE));
+	mu_assertf("Expected first record", (rec = catcierge_archive_reader_next(&r)));
+	mu_assertf("Expected id", !strcmp(rec->id, "before"));
+	mu_assertf("Expected second record", (rec = catcierge_archive_reader_next(&r)));
+	mu_assertf("Expected id", !strcmp(rec->id, "after"));
+	mu_assertf("Expected no more records", !catcierge_archive_reader_next(&r));
+	mu_assertf("Expected nothing left", r.pos == r.size);
+	catcierge_archive_reader_close(&r);
+
+	// Other files are left alone.
+	mu_assertf("Failed to open file", (f = fopen(TEST_ARCHIVE, "wb")));
+	fprintf(f, "not an archive");
+	fclose(f);
+	f = NULL;
+
+	mu_assertf("Expected to fail opening a non-archive", catcierge_archive_open(&ar, TEST_ARCHIVE));
+	mu_assertf("Failed to open reader", !catcierge_archive_reader_open(&r, TEST_ARCHIVE));
+	mu_assertf("Expected the file to be untouched", r.size == strlen("not an archive"));
+
+cleanup:
+	if (f) fclose(f);
+	cvReleaseImage(&flat);
+	catcierge_archive_destroy(&ar);
+	catcierge_archive_reader_close(&r);
+	remove(TEST_ARCHIVE);
+
+	return return_message;
+}
+
+int TEST_catcierge_archive(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	catcierge_test_HEADLINE("TEST_catcierge_archive");
+
+	CATCIERGE_RUN_TEST((e = run_rle_tests()),
+		"Run length encoding",
+		"Run length encoding", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_write_read_tests()),
+		"Write and read archive",
+		"Write and read archive", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_recover_tests()),
+		"Append after a crash",
+		"Append after a crash", &ret);
+
+	return ret;
+}
@@ -500,6 +500,60 @@ static char *run_catcierge_parse_test()
 		PARSE_ARGV_END();
 	}
 
+	// DNN matcher settings.
+	#ifdef WITH_DNN
+	{
+		PARSE_ARGV_START(0, &args, "catcierge", "--dnn", "--dnn_model", "/path/to/prey.onnx");
+		mu_assert("Expected dnn matcher", args.matcher_type == MATCHER_DNN);
+		mu_assert("Expected dnn_model == /path/to/prey.onnx",
+			args.dnn.model && !strcmp(args.dnn.model, "/path/to/prey.onnx"));
+		mu_assert("Expected the default input size",
+			(args.dnn.width == DNN_DEFAULT_WIDTH) && (args.dnn.height == DNN_DEFAULT_HEIGHT));
+		mu_assert("Expected the default threshold", args.dnn.threshold == DNN_DEFAULT_THRESHOLD);
+		mu_assert("Expected dnn matcher args",
+			catcierge_get_matcher_args(&args) == (catcierge_matcher_args_t *)&args.dnn);
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(1, &args, "catcierge", "--dnn", "--dnn_model");
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(1, &args, "catcierge", "--dnn", "--haar");
+		PARSE_ARGV_END();
+
+		PARSE_ARGV_START(0, &args, "catcierge", "--dnn", "--dnn_size", "64x48");
+		mu_assert("Expected dnn_size == 64x48",
+			(args.dnn.width == 64) && (args.dnn.height == 48));
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(1, &args, "catcierge", "--dnn", "--dnn_size", "0x48");
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(1, &args, "catcierge", "--dnn", "--dnn_size", "abc");
+		PARSE_ARGV_END();
+
+		PARSE_ARGV_START(0, &args, "catcierge", "--dnn",
+			"--dnn_scale", "1.0", "--dnn_mean", "127.5", "--dnn_rgb", "--dnn_softmax");
+		mu_assert("Expected dnn_scale == 1.0", args.dnn.scale == 1.0);
+		mu_assert("Expected dnn_mean == 127.5", args.dnn.mean == 127.5);
+		mu_assert("Expected dnn_rgb == 1", args.dnn.rgb == 1);
+		mu_assert("Expected dnn_softmax == 1", args.dnn.softmax == 1);
+		PARSE_ARGV_END();
+
+		PARSE_ARGV_START(0, &args, "catcierge", "--dnn",
+			"--dnn_prey_class", "3", "--dnn_threshold", "0.7");
+		mu_assert("Expected dnn_prey_class == 3", args.dnn.prey_class == 3);
+		mu_assert("Expected dnn_threshold == 0.7", args.dnn.threshold == 0.7);
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(1, &args, "catcierge", "--dnn", "--dnn_prey_class", "-1");
+		PARSE_ARGV_END();
+
+		PARSE_ARGV_START(0, &args, "catcierge", "--dnn", "--dnn_threads", "2", "--dnn_batch");
+		mu_assert("Expected dnn_threads == 2", args.dnn.threads == 2);
+		mu_assert("Expected dnn_batch == 1", args.dnn.batch == 1);
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(1, &args, "catcierge", "--dnn", "--dnn_threads", "100");
+		PARSE_ARGV_END();
+	}
+	#else
+	catcierge_test_SKIPPED("Skipping DNN args (not compiled)");
+	#endif // WITH_DNN
+
 	PARSE_ARGV_START(1, &args, "catcierge", "--cmdhelp");
 	PARSE_ARGV_END();
 
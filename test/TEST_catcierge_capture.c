@@ -0,0 +1,309 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+#include "catcierge_capture.h"
+#include "catcierge_timer.h"
+
+#define TEST_RECORDING "capture_test.rec"
+#define TEST_FRAME_COUNT 3
+#define TEST_RECORDING_START 1434139037 // 2015-06-12
+
+#ifndef _WIN32
+static char *run_record_play_tests()
+{
+	char *return_message = NULL;
+	IplImage *frames[TEST_FRAME_COUNT];
+	IplImage *img = NULL;
+	catcierge_recorder_t rec;
+	catcierge_player_t player;
+	double timestamp;
+	int i;
+
+	memset(frames, 0, sizeof(frames));
+	memset(&rec, 0, sizeof(rec));
+	memset(&player, 0, sizeof(player));
+	player.fd = -1;
+
+	// Odd width so that the rows are padded.
+	for (i = 0; i < TEST_FRAME_COUNT; i++)
+	{
+		frames[i] = cvCreateImage(cvSize(33, 20), IPL_DEPTH_8U, 3);
+		cvSet(frames[i], cvScalarAll(10 * (i + 1)), NULL);
+	}
+
+	mu_assertf("Failed to open recorder", !catcierge_recorder_open(&rec, TEST_RECORDING));
+
+	for (i = 0; i < TEST_FRAME_COUNT; i++)
+	{
+		mu_assertf("Failed to record frame", !catcierge_recorder_write(&rec, frames[i], 100.0 + 0.5 * i));
+	}
+
+	catcierge_recorder_close(&rec);
+	mu_assertf("Expected 3 recorded frames", rec.count == TEST_FRAME_COUNT);
+
+	mu_assertf("Failed to open player", !catcierge_player_open(&player, TEST_RECORDING, 1, 0));
+	mu_assertf("Expected 3 frames", player.frame_count == TEST_FRAME_COUNT);
+
+	for (i = 0; i < TEST_FRAME_COUNT; i++)
+	{
+		mu_assertf("Expected a frame", (img = catcierge_player_next(&player, &timestamp)));
+		catcierge_test_STATUS("Frame %d at %0.2f seconds", i, timestamp);
+		mu_assertf("Expected recorded timestamp", timestamp == (0.5 * i));
+		mu_assertf("Expected same size", (img->width == 33) && (img->height == 20));
+		mu_assertf("Expected same channels", img->nChannels == 3);
+		mu_assertf("Expected same pixels", !memcmp(img->imageData,
+					frames[i]->imageData, frames[i]->imageSize));
+	}
+
+	mu_assertf("Expected end of recording", !catcierge_player_next(&player, &timestamp));
+	catcierge_player_close(&player);
+
+	// The recorded time keeps increasing when looping.
+	mu_assertf("Failed to open player", !catcierge_player_open(&player, TEST_RECORDING, 1, 1));
+
+	for (i = 0; i < (2 * TEST_FRAME_COUNT); i++)
+	{
+		mu_assertf("Expected a frame", (img = catcierge_player_next(&player, &timestamp)));
+	}
+
+	catcierge_test_STATUS("Looped to %0.2f seconds", timestamp);
+	mu_assertf("Expected looped timestamp", timestamp == 2.5);
+
+cleanup:
+	catcierge_recorder_close(&rec);
+	catcierge_player_close(&player);
+
+	for (i = 0; i < TEST_FRAME_COUNT; i++)
+	{
+		cvReleaseImage(&frames[i]);
+	}
+
+	remove(TEST_RECORDING);
+
+	return return_message;
+}
+
+static char *run_invalid_recording_tests()
+{
+	char *return_message = NULL;
+	catcierge_player_t player;
+	FILE *f = NULL;
+
+	memset(&player, 0, sizeof(player));
+	player.fd = -1;
+
+	mu_assertf("Expected missing recording to fail",
+		catcierge_player_open(&player, "capture_test_missing.rec", 1, 0));
+
+	mu_assertf("Failed to create file", (f = fopen(TEST_RECORDING, "wb")));
+	fprintf(f, "This is not a recording, but it is long enough to have a header.....");
+	fclose(f);
+
+	mu_assertf("Expected invalid recording to fail",
+		catcierge_player_open(&player, TEST_RECORDING, 1, 0));
+	mu_assertf("Expected no frames", !catcierge_player_next(&player, NULL));
+
+cleanup:
+	catcierge_player_close(&player);
+	remove(TEST_RECORDING);
+
+	return return_message;
+}
+
+// Changes the wall clock time a recording was made.
+static int set_recording_start(const char *path, uint64_t start_sec)
+{
+	int ret = 0;
+	FILE *f = NULL;
+	catcierge_recording_header_t header;
+
+	if (!(f = fopen(path, "r+b")))
+		return -1;
+
+	if (fread(&header, sizeof(header), 1, f) != 1)
+	{
+		ret = -1; goto fail;
+	}
+
+	header.start_sec = start_sec;
+	header.start_usec = 0;
+
+	if (fseek(f, 0, SEEK_SET) || (fwrite(&header, sizeof(header), 1, f) != 1))
+	{
+		ret = -1; goto fail;
+	}
+
+fail:
+	fclose(f);
+	return ret;
+}
+
+static char *run_capture_player_tests()
+{
+	char *return_message = NULL;
+	catcierge_recorder_t rec;
+	catcierge_capture_t cap;
+	catcierge_capture_args_t args;
+	IplImage *frame = NULL;
+	struct timeval tv;
+	catcierge_timer_t t;
+	time_t start;
+	int i;
+
+	memset(&rec, 0, sizeof(rec));
+	memset(&cap, 0, sizeof(cap));
+	memset(&args, 0, sizeof(args));
+	cap.player.fd = -1;
+
+	frame = cvCreateImage(cvSize(32, 24), IPL_DEPTH_8U, 1);
+	cvSet(frame, cvScalarAll(255), NULL);
+
+	mu_assertf("Failed to open recorder", !catcierge_recorder_open(&rec, TEST_RECORDING));
+
+	// A minute between the frames.
+	for (i = 0; i < TEST_FRAME_COUNT; i++)
+	{
+		mu_assertf("Failed to record frame", !catcierge_recorder_write(&rec, frame, 60.0 * i));
+	}
+
+	catcierge_recorder_close(&rec);
+
+	// Pretend it was recorded in 2015.
+	mu_assertf("Failed to patch the recording time", !set_recording_start(TEST_RECORDING, TEST_RECORDING_START));
+
+	args.play_path = TEST_RECORDING;
+	args.play_fast = 1;
+	mu_assertf("Failed to init capture", !catcierge_capture_init(&cap, &args));
+	mu_assertf("Expected player capture", cap.type == CAPTURE_PLAYER);
+	mu_assertf("Expected the virtual clock", catcierge_timer_is_virtual());
+
+	// The clock starts at the recording, so timers started now run on it.
+	start = catcierge_timer_time(&tv);
+	catcierge_test_STATUS("Virtual clock starts at %ld", (long)start);
+	mu_assertf("Expected the clock to start at the recording", start == TEST_RECORDING_START);
+
+	catcierge_timer_reset(&t);
+	catcierge_timer_set(&t, 90.0);
+	catcierge_timer_start(&t);
+
+	mu_assertf("Expected a frame", catcierge_capture_query_frame(&cap));
+	mu_assertf("Expected the first frame time", catcierge_timer_time(NULL) == TEST_RECORDING_START);
+
+	for (i = 1; i < TEST_FRAME_COUNT; i++)
+	{
+		mu_assertf("Expected a frame", catcierge_capture_query_frame(&cap));
+	}
+
+	catcierge_test_STATUS("Virtual clock advanced %d seconds", (int)(catcierge_timer_time(NULL) - start));
+	mu_assertf("Expected the virtual clock to follow the recording",
+		(catcierge_timer_time(NULL) - start) == 120);
+	mu_assertf("Expected the timer to time out during playback", catcierge_timer_has_timed_out(&t));
+
+	mu_assertf("Expected end of recording", !catcierge_capture_query_frame(&cap));
+	mu_assertf("Expected eof", cap.eof);
+
+	catcierge_capture_destroy(&cap);
+	mu_assertf("Expected the system clock after destroy", !catcierge_timer_is_virtual());
+
+cleanup:
+	catcierge_recorder_close(&rec);
+	catcierge_capture_destroy(&cap);
+	cvReleaseImage(&frame);
+	remove(TEST_RECORDING);
+
+	return return_message;
+}
+
+static char *run_capture_gray_tests()
+{
+	char *return_message = NULL;
+	catcierge_recorder_t rec;
+	catcierge_capture_t cap;
+	catcierge_capture_args_t args;
+	IplImage *frame = NULL;
+	IplImage *img = NULL;
+	int keep_color;
+
+	memset(&rec, 0, sizeof(rec));
+	memset(&cap, 0, sizeof(cap));
+	memset(&args, 0, sizeof(args));
+	cap.player.fd = -1;
+
+	frame = cvCreateImage(cvSize(32, 24), IPL_DEPTH_8U, 3);
+	cvSet(frame, CV_RGB(200, 200, 200), NULL);
+
+	mu_assertf("Failed to open recorder", !catcierge_recorder_open(&rec, TEST_RECORDING));
+	mu_assertf("Failed to record frame", !catcierge_recorder_write(&rec, frame, 0.0));
+	catcierge_recorder_close(&rec);
+
+	for (keep_color = 0; keep_color <= 1; keep_color++)
+	{
+		catcierge_test_STATUS("Keep color %d", keep_color);
+
+		args.play_path = TEST_RECORDING;
+		args.play_fast = 1;
+		args.gray = 1;
+		args.keep_color = keep_color;
+		mu_assertf("Failed to init capture", !catcierge_capture_init(&cap, &args));
+
+		mu_assertf("Expected a frame", (img = catcierge_capture_query_frame(&cap)));
+		mu_assertf("Expected a gray frame", img->nChannels == 1);
+		mu_assertf("Expected the same size", (img->width == 32) && (img->height == 24));
+		mu_assertf("Expected the gray level", (unsigned char)img->imageData[12 * img->widthStep + 16] == 200);
+
+		if (keep_color)
+		{
+			mu_assertf("Expected the color frame",
+				catcierge_capture_color_frame(&cap, img) == &cap.player.img);
+		}
+		else
+		{
+			mu_assertf("Expected no color frame",
+				catcierge_capture_color_frame(&cap, img) == img);
+		}
+
+		catcierge_capture_destroy(&cap);
+	}
+
+cleanup:
+	catcierge_recorder_close(&rec);
+	catcierge_capture_destroy(&cap);
+	cvReleaseImage(&frame);
+	remove(TEST_RECORDING);
+
+	return return_message;
+}
+#endif // _WIN32
+
+int TEST_catcierge_capture(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	catcierge_test_HEADLINE("TEST_catcierge_capture");
+
+	#ifndef _WIN32
+	CATCIERGE_RUN_TEST((e = run_record_play_tests()),
+		"Record and play",
+		"Record and play", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_invalid_recording_tests()),
+		"Invalid recordings",
+		"Invalid recordings", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_capture_player_tests()),
+		"Capture from a recording",
+		"Capture from a recording", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_capture_gray_tests()),
+		"Gray capture",
+		"Gray capture", &ret);
+	#else
+	catcierge_test_SKIPPED("Playing recordings not supported on Windows\n");
+	#endif
+
+	return ret;
+}
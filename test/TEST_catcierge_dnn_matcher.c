@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "catcierge_config.h"
+#include "catcierge_fsm.h"
+#include "minunit.h"
+#include "catcierge_test_config.h"
+#include "catcierge_test_helpers.h"
+#include "catcierge_args.h"
+#include "catcierge_types.h"
+#include <opencv2/imgproc/imgproc_c.h>
+#include <opencv2/highgui/highgui_c.h>
+#include "catcierge_test_common.h"
+
+#ifdef WITH_DNN
+#include "catcierge_dnn_matcher.h"
+
+#define TEST_MODEL "dnn_test.prototxt"
+
+//
+// A network without any weights, so it can be written here. It outputs
+// the average of each color channel, so with the default 1/255 scale
+// the prey score is the brightness of the frame: white frames are
+// prey and black frames are not.
+//
+static int write_test_model()
+{
+	FILE *f;
+
+	if (!(f = fopen(TEST_MODEL, "w")))
+		return -1;
+
+	fprintf(f,
+		"name: \"catcierge_test\"\n"
+		"input: \"data\"\n"
+		"input_shape { dim: 1 dim: 3 dim: 16 dim: 16 }\n"
+		"layer {\n"
+		"  name: \"pool\"\n"
+		"  type: \"Pooling\"\n"
+		"  bottom: \"data\"\n"
+		"  top: \"pool\"\n"
+		"  pooling_param { pool: AVE global_pooling: true }\n"
+		"}\n");
+
+	fclose(f);
+
+	return 0;
+}
+
+static void init_test_args(catcierge_dnn_matcher_args_t *args, int batch)
+{
+	catcierge_dnn_matcher_args_init(args);
+	args->model = strdup(TEST_MODEL);
+	args->width = 16;
+	args->height = 16;
+	args->batch = batch;
+}
+
+static char *run_match_tests()
+{
+	char *return_message = NULL;
+	catcierge_dnn_matcher_args_t args;
+	catcierge_matcher_t *matcher = NULL;
+	match_result_t result;
+	IplImage *white = NULL;
+	IplImage *black = NULL;
+
+	init_test_args(&args, 0);
+	white = create_clear_image();
+	black = create_black_image();
+
+	mu_assertf("Failed to write test model", !write_test_model());
+	mu_assertf("Failed to init DNN matcher",
+		!catcierge_matcher_init(&matcher, (catcierge_matcher_args_t *)&args));
+	catcierge_dnn_matcher_print_settings(&args);
+
+	memset(&result, 0, sizeof(result));
+	matcher->match(matcher, white, &result, 0);
+	catcierge_test_STATUS("White: %f %s", result.result, result.description);
+	mu_assertf("Expected white to be prey", !result.success);
+	mu_assertf("Expected the result right away", !result.deferred);
+
+	memset(&result, 0, sizeof(result));
+	matcher->match(matcher, black, &result, 0);
+	catcierge_test_STATUS("Black: %f %s", result.result, result.description);
+	mu_assertf("Expected black not to be prey", result.success);
+	mu_assertf("Expected an unknown direction", result.direction == MATCH_DIR_UNKNOWN);
+
+	// The prey class must exist.
+	args.prey_class = 3;
+	memset(&result, 0, sizeof(result));
+	mu_assertf("Expected an error for a missing prey class",
+		matcher->match(matcher, black, &result, 0) < 0.0);
+	args.prey_class = DNN_DEFAULT_PREY_CLASS;
+
+cleanup:
+	catcierge_matcher_destroy(&matcher);
+	catcierge_dnn_matcher_args_destroy(&args);
+	cvReleaseImage(&white);
+	cvReleaseImage(&black);
+	remove(TEST_MODEL);
+
+	return return_message;
+}
+
+static char *run_match_group_tests()
+{
+	char *return_message = NULL;
+	catcierge_dnn_matcher_args_t args;
+	catcierge_matcher_t *matcher = NULL;
+	catcierge_dnn_matcher_t *ctx;
+	match_group_t *mg = NULL;
+	match_result_t *result;
+	IplImage *white = NULL;
+	IplImage *black = NULL;
+	size_t i;
+
+	init_test_args(&args, 1);
+	white = create_clear_image();
+	black = create_black_image();
+
+	mu_assertf("Out of memory", (mg = calloc(1, sizeof(match_group_t))));
+	mu_assertf("Failed to write test model", !write_test_model());
+	mu_assertf("Failed to init DNN matcher",
+		!catcierge_matcher_init(&matcher, (catcierge_matcher_args_t *)&args));
+	ctx = (catcierge_dnn_matcher_t *)matcher;
+	mu_assertf("Expected a match group hook", matcher->match_group);
+
+	// Every other frame is prey.
+	matcher->reset(matcher);
+
+	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	{
+		result = &mg->matches[i].result;
+		matcher->match(matcher, (i % 2) ? white : black, result, 0);
+		mg->match_count++;
+
+		mu_assertf("Expected the result to be deferred", result->deferred);
+		mu_assertf("Expected the frame to wait for the batch", ctx->input_count == (i + 1));
+	}
+
+	mu_assertf("Expected the batch to run", !matcher->match_group(matcher, mg));
+	mu_assertf("Expected no frames waiting", ctx->input_count == 0);
+
+	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	{
+		result = &mg->matches[i].result;
+		catcierge_test_STATUS("Match %d: %f %s", (int)i + 1, result->result, result->description);
+		mu_assertf("Expected the results in match order", result->success == !(i % 2));
+	}
+
+	// Steps are never batched.
+	memset(&mg->matches[0].result, 0, sizeof(match_result_t));
+	matcher->match(matcher, black, &mg->matches[0].result, STEPS_SUMMARY);
+	mu_assertf("Expected no deferred result when saving steps", !mg->matches[0].result.deferred);
+	mu_assertf("Expected no frames waiting", ctx->input_count == 0);
+	catcierge_match_step_release(&mg->matches[0].result.steps[0]);
+
+	// A new match group drops the frames waiting from the last one,
+	// which leaves the deferred results without frames.
+	memset(mg, 0, sizeof(match_group_t));
+
+	for (i = 0; i < 2; i++)
+	{
+		matcher->match(matcher, black, &mg->matches[i].result, 0);
+		mg->match_count++;
+	}
+
+	matcher->reset(matcher);
+	mu_assertf("Expected the frames to be dropped", ctx->input_count == 0);
+	mu_assertf("Expected an error for missing frames", matcher->match_group(matcher, mg));
+
+	for (i = 0; i < 2; i++)
+	{
+		result = &mg->matches[i].result;
+		catcierge_test_STATUS("Match %d: %f %s", (int)i + 1, result->result, result->description);
+		mu_assertf("Expected the match to fail", !result->success && (result->result < 0.0));
+	}
+
+cleanup:
+	catcierge_matcher_destroy(&matcher);
+	catcierge_dnn_matcher_args_destroy(&args);
+	cvReleaseImage(&white);
+	cvReleaseImage(&black);
+	free(mg);
+	remove(TEST_MODEL);
+
+	return return_message;
+}
+
+//
+// Runs a match group with --dnn_batch through the state machine, the
+// saved match images must be named after the real results.
+//
+static char *run_fsm_batch_tests(int prey)
+{
+	char *return_message = NULL;
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	match_state_t *m;
+	IplImage *frame = NULL;
+	const char *expected_prefix = prey ? "match_fail_" : "match__";
+	int i;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init_vars(args);
+
+	args->matcher_type = MATCHER_DNN;
+	init_test_args(&args->dnn, 1);
+	args->saveimg = 1;
+	free(args->output_path);
+	args->output_path = strdup("./test_dnn_batch");
+	mu_assertf("Out of memory", args->output_path);
+	catcierge_make_path(args->output_path);
+
+	mu_assertf("Failed to write test model", !write_test_model());
+	mu_assertf("Failed to init DNN matcher",
+		!catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->dnn));
+
+	grb.running = 1;
+	catcierge_set_state(&grb, catcierge_state_waiting);
+
+	// Obstruct the frame to start matching.
+	load_test_image_and_run(&grb, 1, 1);
+	mu_assertf("Expected MATCHING state", (grb.state == catcierge_state_matching));
+
+	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	{
+		mu_assertf("Out of memory", (frame = prey ? create_clear_image() : create_black_image()));
+		grb.img = frame;
+		catcierge_run_state(&grb);
+		grb.img = NULL;
+		cvReleaseImage(&frame);
+
+		if (i < (MATCH_MAX_COUNT - 1))
+		{
+			mu_assertf("Expected the result to be deferred",
+				grb.match_group.matches[i].result.deferred);
+		}
+	}
+
+	mu_assertf("Expected the lock decision",
+		grb.state == (prey ? catcierge_state_lockout : catcierge_state_keepopen));
+
+	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	{
+		m = &grb.match_group.matches[i];
+		catcierge_test_STATUS("%s: %s", m->path.filename, m->result.description);
+		mu_assertf("Expected the result to be reported", !m->result.deferred);
+		mu_assertf("Expected the real result", m->result.success == !prey);
+		mu_assertf("Expected the file name to match the result",
+			!strncmp(m->path.filename, expected_prefix, strlen(expected_prefix)));
+	}
+
+cleanup:
+	cvReleaseImage(&frame);
+	catcierge_matcher_destroy(&grb.matcher);
+	catcierge_args_destroy_vars(args);
+	catcierge_grabber_destroy(&grb);
+	remove(TEST_MODEL);
+
+	return return_message;
+}
+#endif // WITH_DNN
+
+int TEST_catcierge_dnn_matcher(int argc, char **argv)
+{
+	int ret = 0;
+	#ifdef WITH_DNN
+	char *e = NULL;
+	#endif
+
+	catcierge_test_HEADLINE("TEST_catcierge_dnn_matcher");
+
+	#ifdef WITH_DNN
+	CATCIERGE_RUN_TEST((e = run_match_tests()),
+		"DNN matcher",
+		"Match single frames", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_match_group_tests()),
+		"DNN matcher batches",
+		"Match a match group as one batch", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_fsm_batch_tests(0)),
+		"DNN matcher batches in the state machine, no prey",
+		"Deferred results are reported after the batch", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_fsm_batch_tests(1)),
+		"DNN matcher batches in the state machine, prey",
+		"Deferred results are reported after the batch", &ret);
+	#else
+	catcierge_test_SKIPPED("DNN matcher not compiled");
+	#endif // WITH_DNN
+
+	return ret;
+}
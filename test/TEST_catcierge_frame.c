@@ -0,0 +1,203 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+#include "catcierge_frame.h"
+
+static char *run_copy_tests()
+{
+	char *return_message = NULL;
+	catcierge_frame_pool_t pool;
+	catcierge_frame_t *a = NULL;
+	catcierge_frame_t *b = NULL;
+	catcierge_frame_t *c = NULL;
+	IplImage *img = NULL;
+	IplImage *small = NULL;
+	char *buf;
+
+	catcierge_frame_pool_init(&pool);
+
+	img = cvCreateImage(cvSize(32, 16), IPL_DEPTH_8U, 3);
+	small = cvCreateImage(cvSize(8, 8), IPL_DEPTH_8U, 1);
+	cvSet(img, cvScalarAll(7), NULL);
+
+	mu_assertf("Failed to copy frame", (a = catcierge_frame_pool_copy(&pool, img)));
+	mu_assertf("Expected a copy", a->img != img);
+	mu_assertf("Expected same pixels", !memcmp(a->img->imageData, img->imageData, img->imageSize));
+	mu_assertf("Expected 1 frame in use", pool.in_use == 1);
+	buf = a->img->imageData;
+
+	// A second reference keeps the frame alive.
+	b = catcierge_frame_ref(a);
+	mu_assertf("Expected the same frame", b == a);
+	catcierge_frame_unref(&a);
+	mu_assertf("Expected unref to clear the pointer", a == NULL);
+	mu_assertf("Expected frame still in use", pool.in_use == 1);
+	mu_assertf("Expected pixels still valid", b->img && (b->img->imageData == buf));
+	catcierge_frame_unref(&b);
+	mu_assertf("Expected no frames in use", pool.in_use == 0);
+
+	// The buffer is recycled for the next frame of the same format.
+	mu_assertf("Failed to copy frame", (a = catcierge_frame_pool_copy(&pool, img)));
+	mu_assertf("Expected the buffer to be reused", a->img->imageData == buf);
+	mu_assertf("Expected a single allocation", pool.allocs == 1);
+
+	// ... but not while it is still referenced.
+	mu_assertf("Failed to copy frame", (b = catcierge_frame_pool_copy(&pool, img)));
+	mu_assertf("Expected a different buffer", b->img->imageData != buf);
+	mu_assertf("Expected two allocations", pool.allocs == 2);
+
+	// A different format gets its own buffer.
+	mu_assertf("Failed to copy frame", (c = catcierge_frame_pool_copy(&pool, small)));
+	mu_assertf("Expected grayscale frame", c->img->nChannels == 1);
+	mu_assertf("Expected three allocations", pool.allocs == 3);
+	mu_assertf("Expected three frames in use", pool.in_use == 3);
+	mu_assertf("Expected three copies", pool.copies == 4);
+
+	// A smaller frame of the same format is a view of a free buffer.
+	buf = c->img->imageData;
+	catcierge_frame_unref(&a);
+	catcierge_frame_unref(&b);
+	catcierge_frame_unref(&c);
+	mu_assertf("Failed to allocate frame", (a = catcierge_frame_pool_alloc(&pool, cvSize(5, 5), IPL_DEPTH_8U, 1)));
+	mu_assertf("Expected the requested size", (a->img->width == 5) && (a->img->height == 5));
+	mu_assertf("Expected the larger buffer to be reused", a->img->imageData == buf);
+	mu_assertf("Expected the pool not to grow", pool.count == 3);
+	mu_assertf("Expected no new buffer", pool.allocs == 3);
+
+	// Free frames of another format are reused rather than growing the pool.
+	mu_assertf("Failed to allocate frame", (b = catcierge_frame_pool_alloc(&pool, cvSize(64, 64), IPL_DEPTH_8U, 1)));
+	mu_assertf("Expected the requested size", (b->img->width == 64) && (b->img->height == 64));
+	mu_assertf("Expected the pool not to grow", pool.count == 3);
+	mu_assertf("Expected a new buffer", pool.allocs == 4);
+
+cleanup:
+	catcierge_frame_unref(&a);
+	catcierge_frame_unref(&b);
+	catcierge_frame_unref(&c);
+	catcierge_frame_pool_destroy(&pool);
+	cvReleaseImage(&img);
+	cvReleaseImage(&small);
+
+	return return_message;
+}
+
+//
+// The step images of a match differ in size from match to match, once
+// the pool has buffers of the largest size nothing more is allocated.
+//
+static char *run_match_series_tests()
+{
+	char *return_message = NULL;
+	catcierge_frame_pool_t pool;
+	catcierge_frame_t *frames[4 * 3];
+	size_t warm_allocs = 0;
+	size_t count = sizeof(frames) / sizeof(frames[0]);
+	size_t i;
+	int group;
+	int w;
+	int h;
+
+	catcierge_frame_pool_init(&pool);
+	memset(frames, 0, sizeof(frames));
+
+	for (group = 0; group < 10; group++)
+	{
+		// 4 matches of 3 steps each are referenced until the group is done.
+		for (i = 0; i < count; i++)
+		{
+			w = group ? (160 - (int)((group * 13 + i * 7) % 40)) : 160;
+			h = group ? (120 - (int)((group * 5 + i * 3) % 30)) : 120;
+
+			mu_assertf("Failed to allocate frame",
+				(frames[i] = catcierge_frame_pool_alloc(&pool, cvSize(w, h), IPL_DEPTH_8U, (i % 3) ? 1 : 3)));
+			mu_assertf("Expected the requested size",
+				(frames[i]->img->width == w) && (frames[i]->img->height == h));
+			cvSet(frames[i]->img, cvScalarAll(group), NULL);
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			catcierge_frame_unref(&frames[i]);
+		}
+
+		if (group == 0)
+		{
+			warm_allocs = pool.allocs;
+		}
+
+		catcierge_test_STATUS("Match group %d: %d allocations", group + 1, (int)pool.allocs);
+		mu_assertf("Expected no allocations after the first match group", pool.allocs == warm_allocs);
+	}
+
+	mu_assertf("Expected one buffer per frame", warm_allocs == count);
+	mu_assertf("Expected no frames in use", pool.in_use == 0);
+
+cleanup:
+	for (i = 0; i < count; i++)
+	{
+		catcierge_frame_unref(&frames[i]);
+	}
+
+	catcierge_frame_pool_destroy(&pool);
+
+	return return_message;
+}
+
+static char *run_wrap_tests()
+{
+	char *return_message = NULL;
+	catcierge_frame_pool_t pool;
+	catcierge_frame_t *a = NULL;
+	catcierge_frame_t *b = NULL;
+	IplImage *img = NULL;
+
+	catcierge_frame_pool_init(&pool);
+
+	img = cvCreateImage(cvSize(32, 16), IPL_DEPTH_8U, 1);
+
+	// Wrapped frames share the pixels of the source image.
+	mu_assertf("Failed to wrap frame", (a = catcierge_frame_pool_wrap(&pool, img)));
+	mu_assertf("Expected a separate header", a->img != img);
+	mu_assertf("Expected shared pixels", a->img->imageData == img->imageData);
+	mu_assertf("Expected same size", (a->img->width == 32) && (a->img->height == 16));
+	mu_assertf("Expected no allocations", pool.allocs == 0);
+	mu_assertf("Expected one wrap", pool.wraps == 1);
+
+	// The frame itself is recycled.
+	catcierge_frame_unref(&a);
+	mu_assertf("Failed to wrap frame", (b = catcierge_frame_pool_wrap(&pool, img)));
+	mu_assertf("Expected a single pooled frame", pool.count == 1);
+
+cleanup:
+	catcierge_frame_unref(&a);
+	catcierge_frame_unref(&b);
+	catcierge_frame_pool_destroy(&pool);
+	cvReleaseImage(&img);
+
+	return return_message;
+}
+
+int TEST_catcierge_frame(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	catcierge_test_HEADLINE("TEST_catcierge_frame");
+
+	CATCIERGE_RUN_TEST((e = run_copy_tests()),
+		"Copied frames",
+		"Copied frames are reference counted and recycled", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_match_series_tests()),
+		"Frames of varying size",
+		"No allocations for smaller frames", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_wrap_tests()),
+		"Wrapped frames",
+		"Wrapped frames share the pixels", &ret);
+
+	return ret;
+}
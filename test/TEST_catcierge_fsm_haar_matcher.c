@@ -12,7 +12,7 @@
 #include <opencv2/highgui/highgui_c.h>
 #include "catcierge_test_common.h"
 
-static char *run_success_tests()
+static char *run_success_tests(int track)
 {
 	int i;
 	int j;
@@ -26,6 +26,7 @@ static char *run_success_tests()
 	args->saveimg = 0;
 	args->matcher_type = MATCHER_HAAR;
 	args->haar.cascade = strdup(CATCIERGE_CASCADE);
+	args->haar.track = track;
 
 	if (catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->haar))
 	{
@@ -65,7 +66,7 @@ static char *run_success_tests()
 	return NULL;
 }
 
-static char *run_failure_tests(catcierge_haar_prey_method_t prey_method)
+static char *run_failure_tests(catcierge_haar_prey_method_t prey_method, int track)
 {
 	int i;
 	int j;
@@ -84,6 +85,7 @@ static char *run_failure_tests(catcierge_haar_prey_method_t prey_method)
 	args->haar.prey_method = prey_method;
 	args->haar.prey_steps = 2;
 	args->haar.cascade = strdup(CATCIERGE_CASCADE);
+	args->haar.track = track;
 
 	#ifdef CATCIERGE_GUI_TESTS
 	args->show = 1;
@@ -193,6 +195,226 @@ static char *run_save_steps_test()
 	return NULL;
 }
 
+static char *run_steps_mode_test(catcierge_steps_mode_t mode)
+{
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	size_t expected[MATCH_MAX_COUNT] = { 11, 11, 4, 11 };
+	match_result_t *res;
+	int i;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init_vars(args);
+
+	args->matcher_type = MATCHER_HAAR;
+	args->ok_matches_needed = 3;
+
+	catcierge_haar_matcher_args_init(&args->haar);
+	args->haar.prey_method = PREY_METHOD_ADAPTIVE;
+	args->haar.prey_steps = 2;
+	args->haar.cascade = strdup(CATCIERGE_CASCADE);
+
+	args->save_steps = 1;
+	args->steps_mode = mode;
+	args->saveimg = 1;
+	free(args->output_path);
+	args->output_path = strdup("./test_save_steps");
+	mu_assert("Out of memory", args->output_path);
+	catcierge_make_path(args->output_path);
+
+	if (catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->haar))
+	{
+		return "Failed to init catcierge lib!\n";
+	}
+
+	catcierge_test_STATUS("Test steps mode %s", catcierge_steps_mode_str(mode));
+
+	grb.running = 1;
+	catcierge_set_state(&grb, catcierge_state_waiting);
+
+	load_test_image_and_run(&grb, 1, 1);
+	load_test_image_and_run(&grb, 10, 1);
+
+	res = &grb.match_group.matches[0].result;
+	catcierge_test_STATUS("Step image count after first match: %d", (int)res->step_img_count);
+
+	if (mode == STEPS_LAZY)
+	{
+		mu_assert("Expected no step images while matching", res->step_img_count == 0);
+	}
+
+	load_test_image_and_run(&grb, 10, 2);
+	load_test_image_and_run(&grb, 6, 2); // Going out.
+	load_test_image_and_run(&grb, 10, 1);
+
+	// The match group has been saved by now.
+	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	{
+		res = &grb.match_group.matches[i].result;
+		catcierge_test_STATUS("Match %d step image count: %d", i, (int)res->step_img_count);
+
+		if (mode == STEPS_SUMMARY)
+		{
+			mu_assert("Expected a single step image", res->step_img_count == 1);
+			mu_assert("Expected the final image", !strcmp(res->steps[0].name, "final"));
+			mu_assert("Expected a color image", res->steps[0].img && (res->steps[0].img->nChannels == 3));
+		}
+		else
+		{
+			mu_assert("Expected derived step images", res->step_img_count == expected[i]);
+			mu_assert("Expected a step path", res->steps[0].path != NULL);
+		}
+
+		mu_assert("Got non-NULL image for unused step image",
+			res->steps[res->step_img_count].img == NULL);
+	}
+
+	catcierge_matcher_destroy(&grb.matcher);
+	catcierge_args_destroy_vars(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_prey_cascade_tests()
+{
+	catcierge_matcher_t *plain = NULL;
+	catcierge_matcher_t *cascaded = NULL;
+	catcierge_haar_matcher_args_t plain_args;
+	catcierge_haar_matcher_args_t cascaded_args;
+	match_result_t result;
+	IplImage *img = NULL;
+	int prey_free_count = 0;
+	int i;
+	int j;
+
+	catcierge_haar_matcher_args_init(&plain_args);
+	plain_args.cascade = strdup(CATCIERGE_CASCADE);
+	mu_assert("Out of memory", plain_args.cascade);
+
+	// Using the head cascade as the prey cascade, every frame
+	// where the normal prey detection runs should now fail.
+	catcierge_haar_matcher_args_init(&cascaded_args);
+	cascaded_args.cascade = strdup(CATCIERGE_CASCADE);
+	cascaded_args.prey_cascades = calloc(1, sizeof(char *));
+	mu_assert("Out of memory", cascaded_args.cascade && cascaded_args.prey_cascades);
+	cascaded_args.prey_cascades[0] = strdup(CATCIERGE_CASCADE);
+	cascaded_args.prey_cascade_count = 1;
+
+	mu_assert("Failed to init matcher",
+		!catcierge_matcher_init(&plain, (catcierge_matcher_args_t *)&plain_args));
+	mu_assert("Failed to init matcher with a prey cascade",
+		!catcierge_matcher_init(&cascaded, (catcierge_matcher_args_t *)&cascaded_args));
+
+	catcierge_haar_matcher_print_settings(&cascaded_args);
+
+	for (j = 6; j <= 9; j++)
+	{
+		for (i = 1; i <= 4; i++)
+		{
+			mu_assert("Failed to load test image", (img = open_test_image(j, i)));
+
+			memset(&result, 0, sizeof(result));
+			plain->match(plain, img, &result, 0);
+
+			if (result.success && !strcmp(result.description, "No prey detected"))
+			{
+				prey_free_count++;
+
+				memset(&result, 0, sizeof(result));
+				cascaded->match(cascaded, img, &result, 0);
+				catcierge_test_STATUS("Series %d image %d: %s", j, i, result.description);
+				mu_assert("Expected the prey cascade to find prey", !result.success);
+			}
+
+			cvReleaseImage(&img);
+		}
+	}
+
+	mu_assert("Expected frames where prey detection was done", prey_free_count > 0);
+
+	catcierge_matcher_destroy(&plain);
+	catcierge_matcher_destroy(&cascaded);
+	catcierge_haar_matcher_args_destroy(&plain_args);
+	catcierge_haar_matcher_args_destroy(&cascaded_args);
+
+	return NULL;
+}
+
+static char *run_output_span_tests()
+{
+	char *return_message = NULL;
+	int i;
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	match_group_t *mg = &grb.match_group;
+	catcierge_span_t span;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init_vars(args);
+
+	catcierge_haar_matcher_args_init(&args->haar);
+	args->saveimg = 0;
+	args->matcher_type = MATCHER_HAAR;
+	args->haar.cascade = strdup(CATCIERGE_CASCADE);
+
+	mu_assertf("Failed to init catcierge lib!",
+		!catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->haar));
+
+	grb.running = 1;
+	catcierge_set_state(&grb, catcierge_state_waiting);
+	mu_assertf("Expected no output time outside of a match group",
+		mg->spans[CATCIERGE_SPAN_OUTPUT].start == 0.0);
+
+	load_test_image_and_run(&grb, 6, 1);
+	mu_assertf("Expected an active match group", mg->active);
+
+	for (i = 1; i <= 4; i++)
+	{
+		load_test_image_and_run(&grb, 6, i);
+	}
+
+	mu_assertf("Expected KEEP OPEN state", (grb.state == catcierge_state_keepopen));
+	mu_assertf("Expected the match group to be done", !mg->active);
+	mu_assertf("Expected the output time of the match group",
+		mg->spans[CATCIERGE_SPAN_OUTPUT].start != 0.0);
+
+	// The events after the match group don't belong to it.
+	span = mg->spans[CATCIERGE_SPAN_OUTPUT];
+	load_test_image_and_run(&grb, 1, 5);
+	mu_assertf("Expected WAITING state", (grb.state == catcierge_state_waiting));
+	mu_assertf("Expected the output time to be unchanged",
+		!memcmp(&span, &mg->spans[CATCIERGE_SPAN_OUTPUT], sizeof(span)));
+
+	// The lockout command is part of the lock time only.
+	mg->active = 1;
+	catcierge_span_reset(&mg->spans[CATCIERGE_SPAN_OUTPUT]);
+	catcierge_span_reset(&mg->spans[CATCIERGE_SPAN_LOCK]);
+	catcierge_do_lockout(&grb);
+	mu_assertf("Expected the lockout to be lock time",
+		mg->spans[CATCIERGE_SPAN_LOCK].start != 0.0);
+	mu_assertf("Expected the lockout command not to be output time",
+		mg->spans[CATCIERGE_SPAN_OUTPUT].start == 0.0);
+	catcierge_do_unlock(&grb);
+	mu_assertf("Expected other events to be output time",
+		mg->spans[CATCIERGE_SPAN_OUTPUT].start != 0.0);
+	mg->active = 0;
+
+	// A forced lockout outside of a match group leaves its lock time alone.
+	span = mg->spans[CATCIERGE_SPAN_LOCK];
+	catcierge_do_lockout(&grb);
+	mu_assertf("Expected the lock time to be unchanged",
+		!memcmp(&span, &mg->spans[CATCIERGE_SPAN_LOCK], sizeof(span)));
+	catcierge_do_unlock(&grb);
+
+cleanup:
+	catcierge_matcher_destroy(&grb.matcher);
+	catcierge_args_destroy_vars(args);
+	catcierge_grabber_destroy(&grb);
+
+	return return_message;
+}
+
 int TEST_catcierge_fsm_haar_matcher(int argc, char **argv)
 {
 	char *e = NULL;
@@ -201,22 +423,46 @@ int TEST_catcierge_fsm_haar_matcher(int argc, char **argv)
 
 	catcierge_haar_matcher_usage();
 
-	CATCIERGE_RUN_TEST((e = run_success_tests()),
+	CATCIERGE_RUN_TEST((e = run_success_tests(0)),
 		"Run success tests. Without obstruct",
 		"Success match without obstruct", &ret);
 
-	CATCIERGE_RUN_TEST((e = run_failure_tests(PREY_METHOD_NORMAL)),
+	CATCIERGE_RUN_TEST((e = run_success_tests(1)),
+		"Run success tests. Tracking the head",
+		"Success match with tracking", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_failure_tests(PREY_METHOD_NORMAL, 0)),
 		"Run failure tests. Normal prey matching",
 		"Failure tests with Normal prey matching", &ret);
 
-	CATCIERGE_RUN_TEST((e = run_failure_tests(PREY_METHOD_ADAPTIVE)),
+	CATCIERGE_RUN_TEST((e = run_failure_tests(PREY_METHOD_ADAPTIVE, 0)),
 		"Run failure tests. Adaptive prey matching",
 		"Failure tests with Adaptive prey matching", &ret);
 
+	CATCIERGE_RUN_TEST((e = run_failure_tests(PREY_METHOD_ADAPTIVE, 1)),
+		"Run failure tests. Tracking the head",
+		"Failure tests with tracking", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_prey_cascade_tests()),
+		"Run prey cascade tests",
+		"Prey cascade", &ret);
+
 	CATCIERGE_RUN_TEST((e = run_save_steps_test()),
 		"Run save steps tests. Adaptive prey matching",
 		"Save steps tests", &ret);
 
+	CATCIERGE_RUN_TEST((e = run_steps_mode_test(STEPS_SUMMARY)),
+		"Run summary steps mode tests",
+		"Summary steps mode", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_steps_mode_test(STEPS_LAZY)),
+		"Run lazy steps mode tests",
+		"Lazy steps mode", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_output_span_tests()),
+		"Run output span tests",
+		"Output span", &ret);
+
 	if (ret)
 	{
 		catcierge_test_FAILURE("One or more tests failed");
@@ -121,7 +121,7 @@ static char *run_rfid_pseudo_tests(rfid_pseudo_test_conf_t *conf)
 		mu_assertf("Failed to parse command line", ret == 0);
 	}
 
-	catcierge_init_rfid_readers(&grb);
+	mu_assertf("Failed to init RFID readers", !catcierge_init_rfid_readers(&grb));
 
 	// Ensure the RFID readers have been initialized.
 	{
@@ -152,6 +152,7 @@ static char *run_rfid_pseudo_tests(rfid_pseudo_test_conf_t *conf)
 		{
 			catcierge_test_STATUS("Emulate outer tag: %s", conf->outer_tag);
 			write_rfid_master(out_master, conf->outer_tag);
+			write_rfid_master(out_master, "\r\n");
 			mu_assertf("Failed to service RFID", !catcierge_rfid_ctx_service(&grb.rfid_ctx));
 			//sleep(1);
 		}
@@ -172,6 +173,7 @@ static char *run_rfid_pseudo_tests(rfid_pseudo_test_conf_t *conf)
 		{
 			catcierge_test_STATUS("Emulate inner tag: %s", conf->inner_tag);
 			write_rfid_master(in_master, conf->inner_tag);
+			write_rfid_master(in_master, "\r\n");
 			mu_assertf("Failed to service RFID", !catcierge_rfid_ctx_service(&grb.rfid_ctx));
 		}
 
@@ -208,6 +210,106 @@ cleanup:
 }
 
 
+static char *run_rfid_allowed_file_tests()
+{
+	char *return_message = NULL;
+	const char *path = "fsm_rfid_allowed_test.txt";
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	catcierge_rfid_allowed_t *allowed;
+	FILE *f;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	remove(path);
+
+	// A missing file at startup is fatal.
+	args->rfid_allowed_path = strdup(path);
+	mu_assertf("Out of memory", args->rfid_allowed_path);
+	mu_assertf("Expected a missing allowed file to fail at startup",
+		catcierge_init_rfid_readers(&grb) != 0);
+	mu_assertf("Expected no allowed tags", !grb.rfid_allowed);
+
+	mu_assertf("Failed to open test file", (f = fopen(path, "w")));
+	fprintf(f, "999_000000001007\n");
+	fclose(f);
+
+	mu_assertf("Failed to init RFID readers", !catcierge_init_rfid_readers(&grb));
+	mu_assertf("Expected 1 allowed tag", grb.rfid_allowed && (grb.rfid_allowed->count == 1));
+	allowed = grb.rfid_allowed;
+
+	// ... while a reload keeps the old set.
+	remove(path);
+	mu_assertf("Expected the reload to fail", catcierge_load_rfid_allowed(&grb) != 0);
+	mu_assertf("Expected the old allowed tags to be kept", grb.rfid_allowed == allowed);
+
+cleanup:
+	catcierge_destroy_rfid_readers(&grb);
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+	remove(path);
+
+	return return_message;
+}
+
+//
+// Every complete tag read must only be counted as seen once,
+// also when it follows a partial read on the same reader.
+//
+static char *run_rfid_seen_count_tests()
+{
+	char *return_message = NULL;
+	const char *tag = "999_000000001007";
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	catcierge_rfid_t *rfid = &grb.rfid_in;
+	catcierge_rfid_allowed_tag_t *it;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+
+	// The serial port doesn't exist, the read callback is called directly.
+	args->rfid_inner_path = strdup("./fsm_rfid_no_such_port");
+	mu_assertf("Out of memory", args->rfid_inner_path);
+	args->rfid_allowed = calloc(1, sizeof(char *));
+	mu_assertf("Out of memory", args->rfid_allowed);
+	args->rfid_allowed[0] = strdup(tag);
+	mu_assertf("Out of memory", args->rfid_allowed[0]);
+	args->rfid_allowed_count = 1;
+
+	mu_assertf("Failed to init RFID readers", !catcierge_init_rfid_readers(&grb));
+	mu_assertf("Expected the allowed tag", (it = catcierge_rfid_allowed_find(grb.rfid_allowed, tag)));
+
+	// A complete tag straight away.
+	rfid->cb(rfid, 1, tag, strlen(tag), rfid->user);
+	catcierge_test_STATUS("Seen count %lu", it->seen_count);
+	mu_assertf("Expected the complete tag to be allowed", grb.rfid_in_match.is_allowed);
+	mu_assertf("Expected the tag to be seen once", it->seen_count == 1);
+
+	// A complete tag after a partial one.
+	memset(&grb.rfid_in_match, 0, sizeof(grb.rfid_in_match));
+	it->seen_count = 0;
+
+	rfid->cb(rfid, 0, "999_000000", 10, rfid->user);
+	mu_assertf("Expected the partial tag not to be allowed", !grb.rfid_in_match.is_allowed);
+	mu_assertf("Expected the partial tag not to be seen", it->seen_count == 0);
+
+	rfid->cb(rfid, 1, tag, strlen(tag), rfid->user);
+	catcierge_test_STATUS("Seen count %lu", it->seen_count);
+	mu_assertf("Expected the complete tag to be allowed", grb.rfid_in_match.is_allowed);
+	mu_assertf("Expected the tag to be seen once", it->seen_count == 1);
+
+	rfid->cb(rfid, 1, tag, strlen(tag), rfid->user);
+	mu_assertf("Expected the tag to be seen once", it->seen_count == 1);
+
+cleanup:
+	catcierge_destroy_rfid_readers(&grb);
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return return_message;
+}
+
 typedef struct rfid_test_conf_s
 {
 	const char *description;
@@ -417,6 +519,14 @@ int TEST_catcierge_fsm_rfid(int argc, char **argv)
 		}
 	}
 
+	CATCIERGE_RUN_TEST((e = run_rfid_allowed_file_tests()),
+		"Allowed RFID file",
+		"Allowed RFID file", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_rfid_seen_count_tests()),
+		"Allowed RFID seen count",
+		"A tag is seen once per read", &ret);
+
 	#if 1
 	// Run tests for the lockout logic.
 	// These only tests the rfid code inside of catcierge_fsm.c,
@@ -0,0 +1,94 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifndef _WIN32
+#include "catcierge_gpio.h"
+
+static int read_gpio_file(const char *root, int pin, const char *name, char *buf, size_t len)
+{
+	FILE *f;
+	size_t n;
+	char path[1024];
+
+	snprintf(path, sizeof(path), "%s/gpio%d/%s", root, pin, name);
+
+	if (!(f = fopen(path, "r")))
+		return -1;
+
+	n = fread(buf, 1, len - 1, f);
+	buf[n] = '\0';
+	fclose(f);
+
+	return 0;
+}
+
+static char *run_fake_gpio_tests()
+{
+	char *return_message = NULL;
+	char buf[16];
+	const char *root = "gpio_fake_test";
+	catcierge_gpio_t gpio;
+
+	catcierge_gpio_init(&gpio);
+	mu_assertf("Expected write to closed GPIO to fail", catcierge_gpio_write(&gpio, 1) != 0);
+
+	mu_assertf("Expected fake backend without a directory to fail",
+		catcierge_gpio_open(&gpio, GPIO_BACKEND_FAKE, NULL, 4, 0) != 0);
+
+	mu_assertf("Failed to open fake GPIO",
+		!catcierge_gpio_open(&gpio, GPIO_BACKEND_FAKE, root, 4, 0));
+
+	mu_assertf("Failed to read direction", !read_gpio_file(root, 4, "direction", buf, sizeof(buf)));
+	mu_assertf("Expected direction out", !strcmp(buf, "out"));
+
+	mu_assertf("Failed to read value", !read_gpio_file(root, 4, "value", buf, sizeof(buf)));
+	catcierge_test_STATUS("Initial value: %s\n", buf);
+	mu_assertf("Expected initial value 0", !strcmp(buf, "0"));
+
+	mu_assertf("Failed to write GPIO", !catcierge_gpio_write(&gpio, 1));
+	mu_assertf("Failed to read value", !read_gpio_file(root, 4, "value", buf, sizeof(buf)));
+	mu_assertf("Expected value 1", !strcmp(buf, "1"));
+	mu_assertf("Expected last value 1", gpio.value == 1);
+
+	// Values are always written at the start of the file.
+	mu_assertf("Failed to write GPIO", !catcierge_gpio_write(&gpio, 0));
+	mu_assertf("Failed to write GPIO", !catcierge_gpio_write(&gpio, 0));
+	mu_assertf("Failed to read value", !read_gpio_file(root, 4, "value", buf, sizeof(buf)));
+	mu_assertf("Expected value 0", !strcmp(buf, "0"));
+
+	catcierge_gpio_close(&gpio);
+	mu_assertf("Expected fd to be closed", gpio.fd == -1);
+	mu_assertf("Expected write to closed GPIO to fail", catcierge_gpio_write(&gpio, 1) != 0);
+
+cleanup:
+	catcierge_gpio_close(&gpio);
+	remove("gpio_fake_test/gpio4/value");
+	remove("gpio_fake_test/gpio4/direction");
+	remove("gpio_fake_test/gpio4");
+	remove("gpio_fake_test");
+
+	return return_message;
+}
+#endif // _WIN32
+
+int TEST_catcierge_gpio(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	catcierge_test_HEADLINE("TEST_catcierge_gpio");
+
+	#ifndef _WIN32
+	CATCIERGE_RUN_TEST((e = run_fake_gpio_tests()),
+		"Fake GPIO backend",
+		"Fake GPIO backend", &ret);
+	#else
+	catcierge_test_SKIPPED("GPIO not supported on Windows\n");
+	#endif
+
+	return ret;
+}
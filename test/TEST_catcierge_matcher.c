@@ -164,6 +164,356 @@ static char *run_backlight_tests()
 	return NULL;
 }
 
+static int wait_for_autoroi(catcierge_autoroi_t *ar, const CvRect *cur, CvRect *roi)
+{
+	int i;
+	int changed = 0;
+
+	// The search runs in the background, so poll until it is done.
+	for (i = 0; (i < 500) && !changed && ar->busy; i++)
+	{
+		if (!(changed = catcierge_autoroi_poll(ar, cur, roi)))
+		{
+			usleep(10000);
+		}
+	}
+
+	return changed;
+}
+
+static char *run_background_roi_tests()
+{
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	catcierge_autoroi_t ar;
+	IplImage *img = NULL;
+	CvRect backlight = cvRect(40, 40, 200, 150);
+	CvRect cur = cvRect(0, 0, 0, 0);
+	CvRect roi;
+	int ret;
+
+	catcierge_test_HEADLINE("Background back light recalibration tests");
+
+	catcierge_grabber_init(&grb);
+	{
+		catcierge_args_init(args, "background_roi_tests");
+		args->saveimg = 0;
+		args->matcher_type = MATCHER_HAAR;
+		args->haar.cascade = strdup(CATCIERGE_CASCADE);
+		mu_assert("Out of memory", args->haar.cascade);
+		args->haar.super.min_backlight = 2000;
+
+		if (catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->haar))
+		{
+			return "Failed to init catcierge lib!\n";
+		}
+
+		ret = catcierge_autoroi_init(&ar, grb.matcher, 0.0, 4);
+		mu_assert("Failed to init back light recalibration", ret == 0);
+
+		img = create_black_image();
+		cvRectangleR(img, backlight, CV_RGB(255, 255, 255), CV_FILLED, 8, 0);
+
+		catcierge_test_STATUS("Find the back light from scratch");
+		mu_assert("Expected the frame to be taken", catcierge_autoroi_submit(&ar, img, 1) == 1);
+		mu_assert("Expected a busy worker to not take another frame",
+			catcierge_autoroi_submit(&ar, img, 1) == 0);
+		mu_assert("Expected a new roi", wait_for_autoroi(&ar, &cur, &roi));
+		catcierge_test_STATUS("  Backlight ROI: x = %d, y = %d, w = %d, h = %d",
+			roi.x, roi.y, roi.width, roi.height);
+		mu_assert("Expected the roi to cover the back light",
+			!catcierge_roi_differs(&roi, &backlight, 2));
+		cur = roi;
+
+		catcierge_test_STATUS("Same back light does not change the roi");
+		mu_assert("Expected the frame to be taken", catcierge_autoroi_submit(&ar, img, 1) == 1);
+		mu_assert("Expected the roi to stay", !wait_for_autoroi(&ar, &cur, &roi));
+		mu_assert("Expected the search to finish", !ar.busy);
+
+		catcierge_test_STATUS("Back light moved beyond the tolerance");
+		cvSet(img, CV_RGB(0, 0, 0), NULL);
+		backlight.x += 20;
+		cvRectangleR(img, backlight, CV_RGB(255, 255, 255), CV_FILLED, 8, 0);
+		mu_assert("Expected the frame to be taken", catcierge_autoroi_submit(&ar, img, 1) == 1);
+		mu_assert("Expected a new roi", wait_for_autoroi(&ar, &cur, &roi));
+		mu_assert("Expected the roi to follow the back light",
+			!catcierge_roi_differs(&roi, &backlight, 2));
+		cur = roi;
+
+		catcierge_test_STATUS("Broken back light keeps the roi");
+		cvSet(img, CV_RGB(0, 0, 0), NULL);
+		mu_assert("Expected the frame to be taken", catcierge_autoroi_submit(&ar, img, 1) == 1);
+		mu_assert("Expected the roi to stay", !wait_for_autoroi(&ar, &cur, &roi));
+
+		catcierge_test_STATUS("Tolerance");
+		mu_assert("Expected same rect to not differ", !catcierge_roi_differs(&cur, &cur, 0));
+		roi = cur;
+		roi.width += 4;
+		mu_assert("Expected 4 pixels to be within tolerance", !catcierge_roi_differs(&cur, &roi, 4));
+		roi.width++;
+		mu_assert("Expected 5 pixels to be outside tolerance", catcierge_roi_differs(&cur, &roi, 4));
+		catcierge_test_SUCCESS("Recalibrated back light as expected\n");
+
+		catcierge_autoroi_destroy(&ar);
+		cvReleaseImage(&img);
+		catcierge_matcher_destroy(&grb.matcher);
+		catcierge_args_destroy(args);
+	}
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_obstruct_background_tests()
+{
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	IplImage *img = NULL;
+	CvRect r;
+	int level;
+	int ret;
+
+	catcierge_test_HEADLINE("Background model obstruction tests");
+
+	catcierge_grabber_init(&grb);
+	{
+		catcierge_args_init(args, "obstruct_background_tests");
+		args->saveimg = 0;
+		args->matcher_type = MATCHER_HAAR;
+		args->haar.cascade = strdup(CATCIERGE_CASCADE);
+		mu_assert("Out of memory", args->haar.cascade);
+		args->obstruct_method = OBSTRUCT_METHOD_BACKGROUND;
+
+		if (catcierge_matcher_init(&grb.matcher, catcierge_get_matcher_args(args)))
+		{
+			return "Failed to init catcierge lib!\n";
+		}
+
+		mu_assert("Expected the background obstruct check",
+			grb.matcher->is_obstructed == catcierge_is_frame_obstructed_bg);
+
+		img = create_clear_image();
+		r = catcierge_get_obstruct_rect(grb.matcher, img);
+
+		catcierge_test_STATUS("Learn the clear frame");
+		ret = grb.matcher->is_obstructed(grb.matcher, img);
+		mu_assert("Expected clear frame", ret == 0);
+
+		// A fixed threshold of 90 would trigger long before the end of this.
+		catcierge_test_STATUS("Slowly dim the back light");
+		for (level = 255; level >= 60; level--)
+		{
+			cvSet(img, CV_RGB(level, level, level), NULL);
+			ret = grb.matcher->is_obstructed(grb.matcher, img);
+			ret |= grb.matcher->is_obstructed(grb.matcher, img);
+			mu_assert("Expected clear frame while dimming", ret == 0);
+		}
+
+		mu_assert("Expected the threshold check to be obstructed",
+			catcierge_is_frame_obstructed(grb.matcher, img) == 1);
+
+		catcierge_test_STATUS("Something dark in front of the back light");
+		cvRectangleR(img, r, CV_RGB(0, 0, 0), CV_FILLED, 8, 0);
+		ret = grb.matcher->is_obstructed(grb.matcher, img);
+		mu_assert("Expected obstructed frame", ret == 1);
+
+		catcierge_test_STATUS("Clear again");
+		cvSet(img, CV_RGB(60, 60, 60), NULL);
+		ret = grb.matcher->is_obstructed(grb.matcher, img);
+		mu_assert("Expected clear frame", ret == 0);
+
+		catcierge_test_STATUS("A few dark pixels are not enough");
+		cvRectangleR(img, cvRect(r.x, r.y, 8, 8), CV_RGB(0, 0, 0), CV_FILLED, 8, 0);
+		ret = grb.matcher->is_obstructed(grb.matcher, img);
+		mu_assert("Expected clear frame", ret == 0);
+
+		catcierge_test_STATUS("Learn the left half of the back light");
+		cvSet(img, CV_RGB(255, 255, 255), NULL);
+		cvRectangleR(img, cvRect(160, 0, 160, 240), CV_RGB(120, 120, 120), CV_FILLED, 8, 0);
+		args->roi = cvRect(0, 0, 160, 240);
+		ret = grb.matcher->is_obstructed(grb.matcher, img);
+		ret |= grb.matcher->is_obstructed(grb.matcher, img);
+		mu_assert("Expected clear frame", ret == 0);
+
+		// Compared to the bright left half this would be obstructed.
+		catcierge_test_STATUS("The ROI moves to the dimmer right half");
+		args->roi = cvRect(160, 0, 160, 240);
+		ret = grb.matcher->is_obstructed(grb.matcher, img);
+		mu_assert("Expected the background to be learned again", ret == 0);
+
+		r = catcierge_get_obstruct_rect(grb.matcher, img);
+		cvRectangleR(img, r, CV_RGB(0, 0, 0), CV_FILLED, 8, 0);
+		ret = grb.matcher->is_obstructed(grb.matcher, img);
+		mu_assert("Expected obstructed frame", ret == 1);
+		catcierge_test_SUCCESS("Background model followed the lighting as expected\n");
+
+		cvReleaseImage(&img);
+		catcierge_matcher_destroy(&grb.matcher);
+		catcierge_args_destroy(args);
+	}
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static int count_dark_pixels_opencv(IplImage *img, CvRect r)
+{
+	int sum;
+	IplImage *gray = cvCreateImage(cvSize(r.width, r.height), 8, 1);
+	IplImage *thr = cvCreateImage(cvSize(r.width, r.height), 8, 1);
+
+	cvSetImageROI(img, r);
+	cvCvtColor(img, gray, CV_BGR2GRAY);
+	cvResetImageROI(img);
+	cvThreshold(gray, thr, CATCIERGE_OBSTRUCT_DARK_LEVEL, 255, CV_THRESH_BINARY_INV);
+	sum = (int)cvSum(thr).val[0] / 255;
+
+	cvReleaseImage(&gray);
+	cvReleaseImage(&thr);
+
+	return sum;
+}
+
+static char *run_obstruct_decimation_tests()
+{
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	IplImage *img = NULL;
+	CvRect r;
+	int i;
+	int exact;
+	int fast;
+	int escalated;
+	int sizes[] = { 0, 4, 10, 13, 16, 20, 40, 80 };
+
+	catcierge_test_HEADLINE("Decimated obstruction tests");
+
+	catcierge_grabber_init(&grb);
+	{
+		catcierge_args_init(args, "obstruct_decimation_tests");
+		args->saveimg = 0;
+		args->matcher_type = MATCHER_HAAR;
+		args->haar.cascade = strdup(CATCIERGE_CASCADE);
+		mu_assert("Out of memory", args->haar.cascade);
+
+		if (catcierge_matcher_init(&grb.matcher, catcierge_get_matcher_args(args)))
+		{
+			return "Failed to init catcierge lib!\n";
+		}
+
+		img = create_clear_image();
+		r = catcierge_get_obstruct_rect(grb.matcher, img);
+
+		// Dark squares of growing size, around the 200 pixel boundary.
+		for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+		{
+			cvSet(img, CV_RGB(255, 255, 255), NULL);
+
+			if (sizes[i] > 0)
+			{
+				cvRectangleR(img, cvRect(r.x + 4, r.y + 4, sizes[i], sizes[i]),
+					CV_RGB(60, 60, 60), CV_FILLED, 8, 0);
+			}
+
+			catcierge_test_STATUS("%dx%d dark square", sizes[i], sizes[i]);
+
+			mu_assert("Expected the same count as the OpenCV threshold",
+				catcierge_count_obstruct_pixels(img, r, 1) == count_dark_pixels_opencv(img, r));
+
+			exact = catcierge_is_frame_obstructed_decimated(grb.matcher, img, 1, NULL);
+			fast = catcierge_is_frame_obstructed_decimated(grb.matcher, img, 4, &escalated);
+			catcierge_test_STATUS("  exact %d, decimated %d, escalated %d", exact, fast, escalated);
+
+			mu_assert("Expected the decimated check to agree", exact == fast);
+			mu_assert("Expected the decision",
+				exact == ((sizes[i] * sizes[i]) > CATCIERGE_OBSTRUCT_MIN_PIXELS));
+		}
+
+		catcierge_test_SUCCESS("Decimated obstruction check agrees\n");
+
+		cvReleaseImage(&img);
+		catcierge_matcher_destroy(&grb.matcher);
+		catcierge_args_destroy(args);
+	}
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_obstruct_idle_scale_tests()
+{
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+	IplImage *img = NULL;
+	IplImage *small = NULL;
+	CvRect r;
+	CvRect small_r;
+	int i;
+	int full;
+	int idle;
+	int sizes[] = { 0, 10, 20, 40 };
+
+	catcierge_test_HEADLINE("Idle scale obstruction tests");
+
+	catcierge_grabber_init(&grb);
+	{
+		catcierge_args_init(args, "obstruct_idle_scale_tests");
+		args->saveimg = 0;
+		args->matcher_type = MATCHER_HAAR;
+		args->haar.cascade = strdup(CATCIERGE_CASCADE);
+		mu_assert("Out of memory", args->haar.cascade);
+
+		if (catcierge_matcher_init(&grb.matcher, catcierge_get_matcher_args(args)))
+		{
+			return "Failed to init catcierge lib!\n";
+		}
+
+		img = create_clear_image();
+		small = cvCreateImage(cvSize(img->width / 2, img->height / 2), img->depth, img->nChannels);
+		mu_assert("Out of memory", small);
+		r = catcierge_get_obstruct_rect(grb.matcher, img);
+
+		for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+		{
+			cvSet(img, CV_RGB(255, 255, 255), NULL);
+
+			if (sizes[i] > 0)
+			{
+				cvRectangleR(img, cvRect(r.x + 4, r.y + 4, sizes[i], sizes[i]),
+					CV_RGB(60, 60, 60), CV_FILLED, 8, 0);
+			}
+
+			cvResize(img, small, CV_INTER_AREA);
+
+			full = grb.matcher->is_obstructed(grb.matcher, img);
+
+			// The obstruct rect is in full frame coordinates
+			// also when looking at the smaller idle frame.
+			grb.matcher->args->frame_scale = 2;
+			small_r = catcierge_get_obstruct_rect(grb.matcher, small);
+			mu_assert("Expected the same obstruct rect for the idle frame",
+				!catcierge_roi_differs(&r, &small_r, 0));
+			idle = grb.matcher->is_obstructed(grb.matcher, small);
+			grb.matcher->args->frame_scale = 1;
+
+			catcierge_test_STATUS("%dx%d dark square: full %d, idle %d",
+				sizes[i], sizes[i], full, idle);
+
+			mu_assert("Expected the idle frame to agree with the full frame", full == idle);
+		}
+
+		catcierge_test_SUCCESS("Idle frames are checked like full frames\n");
+
+		cvReleaseImage(&small);
+		cvReleaseImage(&img);
+		catcierge_matcher_destroy(&grb.matcher);
+		catcierge_args_destroy(args);
+	}
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
 int TEST_catcierge_matcher(int argc, char **argv)
 {
 	int ret = 0;
@@ -174,6 +524,22 @@ int TEST_catcierge_matcher(int argc, char **argv)
 		"Run back light tests.",
 		"Back light tests", &ret);
 
+	CATCIERGE_RUN_TEST((e = run_background_roi_tests()),
+		"Run background back light recalibration tests.",
+		"Background back light tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_obstruct_background_tests()),
+		"Run background model obstruction tests.",
+		"Background obstruction tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_obstruct_decimation_tests()),
+		"Run decimated obstruction tests.",
+		"Decimated obstruction tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_obstruct_idle_scale_tests()),
+		"Run idle scale obstruction tests.",
+		"Idle scale obstruction tests", &ret);
+
 	CATCIERGE_RUN_TEST((e = run_delayed_start_tests()),
 		"Run delayed start tests.",
 		"Delayed start tests", &ret);
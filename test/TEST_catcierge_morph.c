@@ -0,0 +1,328 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+#include "catcierge_test_config.h"
+#include "catcierge_fsm.h"
+#include "catcierge_test_common.h"
+#include "catcierge_morph.h"
+
+//
+// Runs the OpenCV chain from the adaptive prey detection and the fused
+// binary morphology on a and b, and returns the number of pixels that differ.
+//
+static int compare_to_opencv(catcierge_binmorph_t *m, IplImage *a, IplImage *b)
+{
+	int diff = -1;
+	CvSize size = cvGetSize(a);
+	IplConvKernel *kernel2x2 = cvCreateStructuringElementEx(2, 2, 0, 0, CV_SHAPE_RECT, NULL);
+	IplConvKernel *kernel3x3 = cvCreateStructuringElementEx(3, 3, 0, 0, CV_SHAPE_RECT, NULL);
+	IplImage *combined = cvCreateImage(size, 8, 1);
+	IplImage *opened = cvCreateImage(size, 8, 1);
+	IplImage *expected = cvCreateImage(size, 8, 1);
+	IplImage *fused = cvCreateImage(size, 8, 1);
+
+	cvAdd(a, b, combined, NULL);
+	cvMorphologyEx(combined, opened, NULL, kernel2x2, CV_MOP_OPEN, 2);
+	cvDilate(opened, expected, kernel3x3, 3);
+	cvNot(expected, expected);
+
+	if (!catcierge_binmorph_combine_open_dilate_not(m, a, b, fused, 2, 2, 3, 3))
+	{
+		cvCmp(expected, fused, combined, CV_CMP_NE);
+		diff = cvCountNonZero(combined);
+	}
+
+	cvReleaseImage(&combined);
+	cvReleaseImage(&opened);
+	cvReleaseImage(&expected);
+	cvReleaseImage(&fused);
+	cvReleaseStructuringElement(&kernel2x2);
+	cvReleaseStructuringElement(&kernel3x3);
+
+	return diff;
+}
+
+static IplImage *create_noise_image(CvSize size, int percent)
+{
+	int x;
+	int y;
+	IplImage *img = cvCreateImage(size, 8, 1);
+
+	for (y = 0; y < size.height; y++)
+	{
+		for (x = 0; x < size.width; x++)
+		{
+			img->imageData[y * img->widthStep + x] = ((rand() % 100) < percent) ? 255 : 0;
+		}
+	}
+
+	return img;
+}
+
+static char *run_random_tests()
+{
+	char *return_message = NULL;
+	catcierge_binmorph_t m;
+	IplImage *a = NULL;
+	IplImage *b = NULL;
+	int i;
+	int j;
+	int diff;
+	// Widths around the 64 pixel words.
+	CvSize sizes[] =
+	{
+		{ 1, 1 }, { 7, 5 }, { 63, 9 }, { 64, 10 }, { 65, 11 },
+		{ 129, 20 }, { 17, 1 }, { 1, 17 }, { 320, 240 }
+	};
+	int percents[] = { 5, 50, 90 };
+
+	memset(&m, 0, sizeof(m));
+	srand(1234);
+
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+	{
+		for (j = 0; j < (int)(sizeof(percents) / sizeof(percents[0])); j++)
+		{
+			a = create_noise_image(sizes[i], percents[j]);
+			b = create_noise_image(sizes[i], percents[j] / 3);
+
+			diff = compare_to_opencv(&m, a, b);
+			catcierge_test_STATUS("%dx%d %d%% set: %d pixels differ",
+				sizes[i].width, sizes[i].height, percents[j], diff);
+			mu_assertf("Expected the same output as OpenCV", diff == 0);
+
+			cvReleaseImage(&a);
+			cvReleaseImage(&b);
+		}
+	}
+
+cleanup:
+	cvReleaseImage(&a);
+	cvReleaseImage(&b);
+	catcierge_binmorph_destroy(&m);
+
+	return return_message;
+}
+
+static char *run_corpus_tests()
+{
+	char *return_message = NULL;
+	catcierge_binmorph_t m;
+	IplImage *img = NULL;
+	IplImage *thr = NULL;
+	IplImage *adp = NULL;
+	CvRect roi;
+	int series;
+	int i;
+	int diff;
+
+	memset(&m, 0, sizeof(m));
+
+	for (series = 1; series <= 14; series++)
+	{
+		for (i = 1; i <= 4; i++)
+		{
+			mu_assertf("Failed to load test image", (img = open_test_image(series, i)));
+
+			// The lower half, the same part as the prey detection looks at.
+			roi = cvRect(0, img->height / 2, img->width, img->height / 2);
+			cvSetImageROI(img, roi);
+
+			thr = cvCreateImage(cvSize(roi.width, roi.height), 8, 1);
+			adp = cvCreateImage(cvSize(roi.width, roi.height), 8, 1);
+			cvThreshold(img, thr, 0, 255, CV_THRESH_BINARY_INV | CV_THRESH_OTSU);
+			cvAdaptiveThreshold(img, adp, 255,
+				CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY_INV, 11, 5);
+
+			diff = compare_to_opencv(&m, thr, adp);
+			catcierge_test_STATUS("  %d pixels differ", diff);
+			mu_assertf("Expected the same output as OpenCV", diff == 0);
+
+			cvReleaseImage(&thr);
+			cvReleaseImage(&adp);
+			cvReleaseImage(&img);
+		}
+	}
+
+cleanup:
+	cvReleaseImage(&thr);
+	cvReleaseImage(&adp);
+	cvReleaseImage(&img);
+	catcierge_binmorph_destroy(&m);
+
+	return return_message;
+}
+
+//
+// Counts the contours with an area above min_area the way the
+// haar matcher used to, as a reference for the blob counter.
+//
+static int count_opencv_contours(IplImage *img, double min_area)
+{
+	int count = 0;
+	CvMemStorage *storage = cvCreateMemStorage(0);
+	IplImage *tmp = cvCloneImage(img);
+	CvSeq *it = NULL;
+
+	cvFindContours(tmp, storage, &it,
+		sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_NONE, cvPoint(0, 0));
+
+	while (it)
+	{
+		if (cvContourArea(it, CV_WHOLE_SEQ, 0) > min_area)
+		{
+			count++;
+		}
+
+		it = it->h_next;
+	}
+
+	cvReleaseImage(&tmp);
+	cvReleaseMemStorage(&storage);
+
+	return count;
+}
+
+static char *run_blob_shape_tests()
+{
+	char *return_message = NULL;
+	catcierge_blob_counter_t bc;
+	IplImage *img = NULL;
+	int count;
+	int i;
+	typedef struct blob_shape_s
+	{
+		const char *name;
+		CvRect outer;
+		CvRect hole;
+		int expected;
+	} blob_shape_t;
+	// Contour areas are measured between the border pixel centers.
+	blob_shape_t shapes[] =
+	{
+		{ "4x4 square (area 9)", { 10, 10, 4, 4 }, { 0, 0, 0, 0 }, 0 },
+		{ "4x5 rectangle (area 12)", { 10, 10, 4, 5 }, { 0, 0, 0, 0 }, 1 },
+		{ "1 pixel line (area 0)", { 10, 10, 30, 1 }, { 0, 0, 0, 0 }, 0 },
+		{ "Ring with a 3x3 hole", { 10, 10, 9, 9 }, { 13, 13, 3, 3 }, 2 },
+		{ "Ring with a 1x1 hole", { 10, 10, 9, 9 }, { 14, 14, 1, 1 }, 1 }
+	};
+
+	memset(&bc, 0, sizeof(bc));
+	img = cvCreateImage(cvSize(64, 48), 8, 1);
+
+	for (i = 0; i < (int)(sizeof(shapes) / sizeof(shapes[0])); i++)
+	{
+		cvZero(img);
+		cvRectangle(img, cvPoint(shapes[i].outer.x, shapes[i].outer.y),
+			cvPoint(shapes[i].outer.x + shapes[i].outer.width - 1,
+					shapes[i].outer.y + shapes[i].outer.height - 1),
+			cvScalarAll(255), CV_FILLED, 8, 0);
+
+		if (shapes[i].hole.width > 0)
+		{
+			cvRectangle(img, cvPoint(shapes[i].hole.x, shapes[i].hole.y),
+				cvPoint(shapes[i].hole.x + shapes[i].hole.width - 1,
+						shapes[i].hole.y + shapes[i].hole.height - 1),
+				cvScalarAll(0), CV_FILLED, 8, 0);
+		}
+
+		count = catcierge_count_blobs(&bc, img, 10.0, 10);
+		catcierge_test_STATUS("%s: %d blobs", shapes[i].name, count);
+		mu_assertf("Unexpected blob count", count == shapes[i].expected);
+		mu_assertf("Expected the same count as OpenCV",
+			count == count_opencv_contours(img, 10.0));
+	}
+
+	// Three separate blobs, but counting stops at max_count.
+	cvZero(img);
+	cvRectangle(img, cvPoint(2, 2), cvPoint(10, 10), cvScalarAll(255), CV_FILLED, 8, 0);
+	cvRectangle(img, cvPoint(20, 2), cvPoint(30, 10), cvScalarAll(255), CV_FILLED, 8, 0);
+	cvRectangle(img, cvPoint(40, 2), cvPoint(50, 10), cvScalarAll(255), CV_FILLED, 8, 0);
+
+	count = catcierge_count_blobs(&bc, img, 10.0, 10);
+	mu_assertf("Expected 3 blobs", count == 3);
+	count = catcierge_count_blobs(&bc, img, 10.0, 2);
+	catcierge_test_STATUS("Stopped counting at %d blobs", count);
+	mu_assertf("Expected counting to stop at 2", count == 2);
+
+cleanup:
+	cvReleaseImage(&img);
+	catcierge_blob_counter_destroy(&bc);
+
+	return return_message;
+}
+
+static char *run_blob_corpus_tests()
+{
+	char *return_message = NULL;
+	catcierge_blob_counter_t bc;
+	IplImage *img = NULL;
+	IplImage *thr = NULL;
+	CvRect roi;
+	int series;
+	int i;
+	int count;
+	int expected;
+
+	memset(&bc, 0, sizeof(bc));
+
+	for (series = 1; series <= 14; series++)
+	{
+		for (i = 1; i <= 4; i++)
+		{
+			mu_assertf("Failed to load test image", (img = open_test_image(series, i)));
+
+			roi = cvRect(0, img->height / 2, img->width, img->height / 2);
+			cvSetImageROI(img, roi);
+
+			thr = cvCreateImage(cvSize(roi.width, roi.height), 8, 1);
+			cvThreshold(img, thr, 0, 255, CV_THRESH_BINARY_INV | CV_THRESH_OTSU);
+
+			// Only whether there is more than one blob decides prey.
+			count = catcierge_count_blobs(&bc, thr, 10.0, 2);
+			expected = count_opencv_contours(thr, 10.0);
+			catcierge_test_STATUS("  %d blobs, %d contours", count, expected);
+			mu_assertf("Expected the same prey decision as OpenCV",
+				(count > 1) == (expected > 1));
+
+			cvReleaseImage(&thr);
+			cvReleaseImage(&img);
+		}
+	}
+
+cleanup:
+	cvReleaseImage(&thr);
+	cvReleaseImage(&img);
+	catcierge_blob_counter_destroy(&bc);
+
+	return return_message;
+}
+
+int TEST_catcierge_morph(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	catcierge_test_HEADLINE("TEST_catcierge_morph");
+
+	CATCIERGE_RUN_TEST((e = run_random_tests()),
+		"Random binary images",
+		"Binary morphology on random images", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_corpus_tests()),
+		"Test image corpus",
+		"Binary morphology on the test images", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_blob_shape_tests()),
+		"Blob shapes",
+		"Count blobs in simple shapes", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_blob_corpus_tests()),
+		"Blob test image corpus",
+		"Count blobs in the test images", &ret);
+
+	return ret;
+}
@@ -186,7 +186,11 @@ static char *run_generate_tests()
 			{ "%prey_method%", "adaptive" },
 			{ "%prey_steps%", "2" },
 			{ "%no_final_decision%", "1" },
-			{ "%obstruct_filename%", "obstructify" }
+			{ "%obstruct_filename%", "obstructify" },
+			{ "%match_group_span_match%", "12.50" },
+			{ "%match_group_span_lock%", "0.00" },
+			{ "%match_group_lock_latency%", "250.00" },
+			{ "%match2_span%", "3.00" }
 		};
 
 		#undef _XSTR
@@ -198,7 +202,8 @@ static char *run_generate_tests()
 			{ "%matchX_path%", NULL },
 			{ "%match1_step600_path%", NULL},
 			{ "%match1_stepKK_path%", NULL},
-			{ "%match_group_id:-4%", NULL }
+			{ "%match_group_id:-4%", NULL },
+			{ "%match_group_span_bogus%", NULL }
 		};
 
 		if (do_init_matcher(&grb, MATCHER_HAAR))
@@ -214,7 +219,8 @@ static char *run_generate_tests()
 		grb.args.max_consecutive_lockout_count = 20;
 		grb.args.consecutive_lockout_delay = 2.44;
 
-		strcpy(grb.match_group.matches[0].result.steps[0].path.dir, "some/step/path");
+		grb.match_group.matches[0].result.steps[0].path = catcierge_get_step_path(&grb, 0, 0);
+		strcpy(grb.match_group.matches[0].result.steps[0].path->dir, "some/step/path");
 		grb.match_group.success_count = 3;
 		grb.match_group.final_decision = 1;
 		grb.match_group.matches[0].result.steps[1].name = "the_step_name";
@@ -228,6 +234,10 @@ static char *run_generate_tests()
 		strcpy(grb.match_group.matches[3].path.dir, "/some/path/omg4/");
 		grb.match_group.direction = MATCH_DIR_IN;
 		strcpy(grb.match_group.obstruct_path.filename, "obstructify");
+		grb.match_group.spans[CATCIERGE_SPAN_MATCH].duration = 0.0125;
+		grb.match_group.spans[CATCIERGE_SPAN_CAPTURE].start = 10.0;
+		grb.match_group.spans[CATCIERGE_SPAN_LOCK].end = 10.25;
+		grb.match_group.matches[1].span.duration = 0.003;
 		grb.match_group.matches[0].result.success = 4;
 		grb.match_group.matches[2].result.direction = MATCH_DIR_IN;
 		grb.match_group.matches[2].result.result = 0.8;
@@ -1042,17 +1052,21 @@ char *run_for_loop_test()
 			"%endfor%\n"
 			"%endfor%\n");
 
-		strcpy(mg->matches[0].result.steps[0].path.dir, "/abc/def/step0");
-		strcpy(mg->matches[0].result.steps[0].path.filename, "1.txt");
+		mg->matches[0].result.steps[0].path = catcierge_get_step_path(&grb, 0, 0);
+		strcpy(mg->matches[0].result.steps[0].path->dir, "/abc/def/step0");
+		strcpy(mg->matches[0].result.steps[0].path->filename, "1.txt");
 	
-		strcpy(mg->matches[0].result.steps[1].path.dir, "/abc/def/step1");
-		strcpy(mg->matches[0].result.steps[1].path.filename, "2.txt");
+		mg->matches[0].result.steps[1].path = catcierge_get_step_path(&grb, 0, 1);
+		strcpy(mg->matches[0].result.steps[1].path->dir, "/abc/def/step1");
+		strcpy(mg->matches[0].result.steps[1].path->filename, "2.txt");
 
-		strcpy(mg->matches[1].result.steps[0].path.dir, "/ghi/klm/step0");
-		strcpy(mg->matches[1].result.steps[0].path.filename, "3.txt");
+		mg->matches[1].result.steps[0].path = catcierge_get_step_path(&grb, 1, 0);
+		strcpy(mg->matches[1].result.steps[0].path->dir, "/ghi/klm/step0");
+		strcpy(mg->matches[1].result.steps[0].path->filename, "3.txt");
 	
-		strcpy(mg->matches[1].result.steps[1].path.dir, "/ghi/klm/step1");
-		strcpy(mg->matches[1].result.steps[1].path.filename, "4.txt");
+		mg->matches[1].result.steps[1].path = catcierge_get_step_path(&grb, 1, 1);
+		strcpy(mg->matches[1].result.steps[1].path->dir, "/ghi/klm/step1");
+		strcpy(mg->matches[1].result.steps[1].path->filename, "4.txt");
 
 		TEST_GENERATE(
 			"arne weise\n"
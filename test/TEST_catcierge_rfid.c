@@ -247,6 +247,197 @@ cleanup:
 	return return_message;	
 }
 
+static void rfid_thread_read_cb(catcierge_rfid_t *rfid,
+				int complete, const char *data, size_t data_len, void *user)
+{
+	int *count = user;
+	catcierge_test_STATUS("Thread received (%u bytes): %s\n", data_len, data);
+
+	if (complete && !strcmp(data, EXAMPLE_RFID_STR))
+		(*count)++;
+}
+
+char *run_thread_tests()
+{
+	char *return_message = NULL;
+	int master = 0;
+	int slave = 0;
+	char *slave_name = NULL;
+	int ret;
+	int i;
+	int count = 0;
+	char *e = NULL;
+	catcierge_rfid_context_t ctx;
+	catcierge_rfid_t rfidin;
+
+	memset(&rfidin, 0, sizeof(rfidin));
+	catcierge_rfid_ctx_init(&ctx);
+
+	ret = openpty(&master, &slave, NULL, NULL, NULL);
+	mu_assertf("Failed to create pseudo terminal", ret == 0);
+
+	slave_name = strdup(ttyname(slave));
+	mu_assertf("Failed to get slave name", slave_name);
+
+	catcierge_rfid_init("Test thread", &rfidin, slave_name, rfid_thread_read_cb, &count);
+	catcierge_rfid_ctx_set_inner(&ctx, &rfidin);
+	catcierge_rfid_open(&rfidin);
+
+	if ((e = read_rfid_master(&ctx, master, "Expected RAT", "RAT\r\n")))
+	{
+		return_message = e;
+		goto cleanup;
+	}
+
+	ret = catcierge_rfid_ctx_start_thread(&ctx);
+	mu_assertf("Failed to start RFID thread", ret == 0);
+
+	write_rfid_master(master, "OK\r\n");
+	write_rfid_master(master, "999_0000");
+	write_rfid_master(master, "00001007\r\n"EXAMPLE_RFID_STR"\r\n");
+
+	// The tags are read in the background and passed on when servicing.
+	for (i = 0; (i < 100) && (count < 2); i++)
+	{
+		usleep(10000);
+		catcierge_rfid_ctx_service(&ctx);
+	}
+
+	mu_assertf("Expected 2 tags from the RFID thread", count == 2);
+	mu_assertf("Expected tag timestamp", rfidin.tag_tv.tv_sec || rfidin.tag_tv.tv_usec);
+
+	// Unplug the reader, the thread must close it and keep running.
+	close(master);
+	master = 0;
+
+	for (i = 0; (i < 100) && (rfidin.state != CAT_DISCONNECTED); i++)
+	{
+		usleep(10000);
+		catcierge_rfid_ctx_service(&ctx);
+	}
+
+	mu_assertf("Expected the reader to be disconnected", rfidin.state == CAT_DISCONNECTED);
+	mu_assertf("Expected the reader to be closed", rfidin.fd == -1);
+	mu_assertf("Expected the thread to keep running", ctx.threaded);
+
+	catcierge_rfid_ctx_stop_thread(&ctx);
+	mu_assertf("Expected the thread to be stopped", !ctx.threaded);
+
+cleanup:
+	// Stop the thread before closing what it reads from.
+	catcierge_rfid_ctx_stop_thread(&ctx);
+	catcierge_rfid_destroy(&rfidin);
+	catcierge_rfid_ctx_destroy(&ctx);
+	if (master) close(master);
+	if (slave) close(slave);
+	if (slave_name) free(slave_name);
+
+	return return_message;
+}
+
+static char *run_framer_tests()
+{
+	catcierge_rfid_framer_t framer;
+	catcierge_rfid_frame_t frame;
+	struct timeval tv1 = {1, 100};
+	struct timeval tv2 = {2, 200};
+	size_t consumed;
+
+	// A tag split over several reads.
+	{
+		catcierge_rfid_framer_init(&framer);
+
+		consumed = catcierge_rfid_framer_feed(&framer, "999_0000", 8, &tv1);
+		mu_assert("Expected all bytes to be consumed", consumed == 8);
+		mu_assert("Expected no frame on partial line",
+			!catcierge_rfid_framer_pop(&framer, &frame));
+
+		catcierge_rfid_framer_feed(&framer, "00001007\r", 9, &tv2);
+		mu_assert("Expected frame on CR",
+			catcierge_rfid_framer_pop(&framer, &frame));
+		catcierge_rfid_framer_feed(&framer, "\n", 1, &tv2);
+		mu_assert("Expected no extra frame from CRLF",
+			!catcierge_rfid_framer_pop(&framer, &frame));
+		mu_assert("Expected a single framed line", framer.line_count == 1);
+		mu_assert("Expected frame timestamp of first byte",
+			(frame.tv.tv_sec == tv1.tv_sec) && (frame.tv.tv_usec == tv1.tv_usec));
+		mu_assert("Expected reassembled tag",
+			!strcmp(frame.data, EXAMPLE_RFID_STR)
+			&& (frame.len == strlen(EXAMPLE_RFID_STR)));
+
+		catcierge_test_SUCCESS("Framer reassembles a tag split over reads\n");
+	}
+
+	// Several tags in a single read.
+	{
+		const char buf[] = "OK\r\n"EXAMPLE_RFID_STR"\r\n999_000000001\r\n";
+		catcierge_rfid_framer_init(&framer);
+
+		consumed = catcierge_rfid_framer_feed(&framer, buf, sizeof(buf) - 1, &tv1);
+		mu_assert("Expected all bytes to be consumed", consumed == (sizeof(buf) - 1));
+
+		mu_assert("Expected OK frame", catcierge_rfid_framer_pop(&framer, &frame)
+			&& !strcmp(frame.data, "OK"));
+		mu_assert("Expected tag frame", catcierge_rfid_framer_pop(&framer, &frame)
+			&& !strcmp(frame.data, EXAMPLE_RFID_STR));
+		mu_assert("Expected partial tag frame", catcierge_rfid_framer_pop(&framer, &frame)
+			&& !strcmp(frame.data, "999_000000001"));
+		mu_assert("Expected no more frames", !catcierge_rfid_framer_pop(&framer, &frame));
+
+		catcierge_test_SUCCESS("Framer splits several tags in one read\n");
+	}
+
+	// More lines than fit in the ring buffer.
+	{
+		int i;
+		size_t offset = 0;
+		int count = 0;
+		char buf[(CATCIERGE_RFID_FRAME_COUNT * 2) * 4 + 1];
+		catcierge_rfid_framer_init(&framer);
+
+		for (i = 0; i < (CATCIERGE_RFID_FRAME_COUNT * 2); i++)
+		{
+			snprintf(&buf[i * 4], 5, "%02d\r\n", i);
+		}
+
+		while (offset < strlen(buf))
+		{
+			offset += catcierge_rfid_framer_feed(&framer,
+						&buf[offset], strlen(buf) - offset, &tv1);
+
+			while (catcierge_rfid_framer_pop(&framer, &frame))
+			{
+				mu_assert("Expected frames in order", atoi(frame.data) == count);
+				count++;
+			}
+		}
+
+		mu_assert("Expected all frames", count == (CATCIERGE_RFID_FRAME_COUNT * 2));
+
+		catcierge_test_SUCCESS("Framer never drops lines when full\n");
+	}
+
+	// Garbage line that overflows the line buffer.
+	{
+		char buf[CATCIERGE_RFID_LINE_MAX * 2];
+		memset(buf, 'x', sizeof(buf));
+		catcierge_rfid_framer_init(&framer);
+
+		catcierge_rfid_framer_feed(&framer, buf, sizeof(buf), &tv1);
+		catcierge_rfid_framer_feed(&framer, "\r\n"EXAMPLE_RFID_STR"\r\n",
+			strlen(EXAMPLE_RFID_STR) + 4, &tv2);
+
+		mu_assert("Expected overlong line to be counted", framer.overlong_count == 1);
+		mu_assert("Expected resync on next line", catcierge_rfid_framer_pop(&framer, &frame)
+			&& !strcmp(frame.data, EXAMPLE_RFID_STR));
+		mu_assert("Expected no more frames", !catcierge_rfid_framer_pop(&framer, &frame));
+
+		catcierge_test_SUCCESS("Framer resyncs after overlong line\n");
+	}
+
+	return NULL;
+}
+
 #endif // WITH_RFID
 
 int TEST_catcierge_rfid(int argc, char **argv)
@@ -258,6 +449,10 @@ int TEST_catcierge_rfid(int argc, char **argv)
 
 	#ifdef WITH_RFID
 
+	CATCIERGE_RUN_TEST((e = run_framer_tests()),
+		"Run RFID framer tests",
+		"RFID framer tests", &ret);
+
 	CATCIERGE_RUN_TEST((e = run_pseudo_console_tests()),
 		"Run pseudo console tests",
 		"Pseudo console tests", &ret);
@@ -276,6 +471,10 @@ int TEST_catcierge_rfid(int argc, char **argv)
 		"Run RFID double tests",
 		"RFID double tests", &ret);
 
+	CATCIERGE_RUN_TEST((e = run_thread_tests()),
+		"Run RFID thread tests",
+		"RFID thread tests", &ret);
+
 	#else
 	catcierge_test_SKIPPED("RFID support turned off!\n");
 	#endif // !WITH_RFID
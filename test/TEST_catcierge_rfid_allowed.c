@@ -0,0 +1,145 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifdef WITH_RFID
+#include "catcierge_rfid_allowed.h"
+
+static char *run_normalize_tests()
+{
+	size_t i;
+	char buf[CATCIERGE_RFID_TAG_MAX];
+
+	struct
+	{
+		const char *tag;
+		const char *expected;
+	} tests[] =
+	{
+		{ "999_000000001007", "999_000000001007" },
+		{ "  999_000000001007\r\n", "999_000000001007" },
+		{ "999_000000001007_1_0_AEC4_000000", "999_000000001007" },
+		{ "999_00000000abcd", "999_00000000ABCD" }
+	};
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+	{
+		mu_assert("Failed to normalize tag",
+			!catcierge_rfid_allowed_normalize(buf, sizeof(buf), tests[i].tag));
+		catcierge_test_STATUS("\"%s\" -> \"%s\"\n", tests[i].tag, buf);
+		mu_assert("Unexpected normalized tag", !strcmp(buf, tests[i].expected));
+	}
+
+	mu_assert("Expected empty tag to fail",
+		catcierge_rfid_allowed_normalize(buf, sizeof(buf), "   ") != 0);
+	mu_assert("Expected too long tag to fail",
+		catcierge_rfid_allowed_normalize(buf, 8, "999_000000001007") != 0);
+
+	return NULL;
+}
+
+static char *run_set_tests()
+{
+	catcierge_rfid_allowed_t *allowed = NULL;
+	catcierge_rfid_allowed_tag_t *t = NULL;
+	char *tags[] = { "999_000000001007", "999_000000001008", "999_000000001007" };
+
+	mu_assert("Failed to create allowed set", (allowed = catcierge_rfid_allowed_create()));
+	mu_assert("Failed to add tags", !catcierge_rfid_allowed_add_list(allowed, tags, 3));
+	mu_assert("Expected duplicates to be ignored", allowed->count == 2);
+
+	mu_assert("Expected allowed tag",
+		catcierge_rfid_allowed_check(allowed, "999_000000001007_1_0_AEC4_000000", 1234));
+	mu_assert("Expected allowed tag",
+		catcierge_rfid_allowed_check(allowed, "999_000000001007", 1235));
+	mu_assert("Expected incomplete tag to not be allowed",
+		!catcierge_rfid_allowed_check(allowed, "999_000000001", 1236));
+	mu_assert("Expected unknown tag to not be allowed",
+		!catcierge_rfid_allowed_check(allowed, "999_000000001009", 1237));
+
+	t = catcierge_rfid_allowed_find(allowed, "999_000000001007");
+	mu_assert("Expected to find tag", t);
+	mu_assert("Expected seen count 2", t->seen_count == 2);
+	mu_assert("Expected last seen time", t->last_seen == 1235);
+
+	t = catcierge_rfid_allowed_find(allowed, "999_000000001008");
+	mu_assert("Expected unseen tag", t && (t->seen_count == 0) && (t->last_seen == 0));
+
+	catcierge_rfid_allowed_print_stats(allowed);
+	catcierge_rfid_allowed_destroy(&allowed);
+	mu_assert("Expected set to be freed", allowed == NULL);
+
+	return NULL;
+}
+
+static char *run_load_tests()
+{
+	char *return_message = NULL;
+	const char *path = "rfid_allowed_test.txt";
+	catcierge_rfid_allowed_t *old = NULL;
+	catcierge_rfid_allowed_t *allowed = NULL;
+	catcierge_rfid_allowed_tag_t *t = NULL;
+	FILE *f;
+
+	mu_assertf("Failed to open test file", (f = fopen(path, "w")));
+	fprintf(f,
+		"# Allowed cats\n"
+		"999_000000001007   # Bob\n"
+		"\n"
+		"  999_000000001008_1_0_AEC4_000000\n");
+	fclose(f);
+
+	mu_assertf("Failed to create allowed set", (old = catcierge_rfid_allowed_create()));
+	mu_assertf("Failed to add tag", !catcierge_rfid_allowed_add(old, "999_000000001007"));
+	catcierge_rfid_allowed_check(old, "999_000000001007", 1000);
+
+	mu_assertf("Failed to create allowed set", (allowed = catcierge_rfid_allowed_create()));
+	mu_assertf("Failed to load allowed file", !catcierge_rfid_allowed_load(allowed, path));
+	mu_assertf("Expected 2 tags from file", allowed->count == 2);
+	mu_assertf("Expected tag from file", catcierge_rfid_allowed_find(allowed, "999_000000001008"));
+
+	// Stats should survive a reload.
+	catcierge_rfid_allowed_copy_stats(allowed, old);
+	t = catcierge_rfid_allowed_find(allowed, "999_000000001007");
+	mu_assertf("Expected stats to be kept", t && (t->seen_count == 1) && (t->last_seen == 1000));
+
+	mu_assertf("Expected missing file to fail",
+		catcierge_rfid_allowed_load(allowed, "non_existing_rfid_allowed.txt") != 0);
+
+cleanup:
+	catcierge_rfid_allowed_destroy(&old);
+	catcierge_rfid_allowed_destroy(&allowed);
+	remove(path);
+
+	return return_message;
+}
+#endif // WITH_RFID
+
+int TEST_catcierge_rfid_allowed(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	catcierge_test_HEADLINE("TEST_catcierge_rfid_allowed");
+
+	#ifdef WITH_RFID
+	CATCIERGE_RUN_TEST((e = run_normalize_tests()),
+		"Normalize RFID tags",
+		"Normalize RFID tags", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_set_tests()),
+		"Allowed RFID set",
+		"Allowed RFID set", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_load_tests()),
+		"Load allowed RFID file",
+		"Load allowed RFID file", &ret);
+	#else
+	catcierge_test_SKIPPED("RFID support turned off!\n");
+	#endif // !WITH_RFID
+
+	return ret;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "catcierge_util.h"
 #include "catcierge_strftime.h"
 #include "minunit.h"
@@ -70,6 +71,74 @@ static char *run_tests()
 	return NULL;
 }
 
+static char *run_cache_tests()
+{
+	int ret;
+	int expected_ret;
+	size_t i;
+	char buf[1024];
+	char expected[1024];
+	char long_fmt[512];
+	struct timeval tv;
+	struct tm tm;
+	time_t t = 1409661310;
+	const char *fmts[] =
+	{
+		"%Y-%m-%d %H:%M:%S.%f",
+		"%Y-%m-%d_%H_%M_%S.%f",
+		"%f",
+		"%f%f abc %f",
+		"%H:%M %%f %p",
+		"no conversions",
+		"%f %f %f %f %f %f %f %f %f %f", // Too many segments to cache.
+		NULL // Filled in with a format that is too long to cache.
+	};
+
+	catcierge_strftime_set_base_diff(0);
+
+	for (i = 0; i < (sizeof(long_fmt) - 3); i += 3)
+	{
+		memcpy(&long_fmt[i], "%S ", 3);
+	}
+	strcpy(&long_fmt[i], "%f");
+	fmts[(sizeof(fmts) / sizeof(fmts[0])) - 1] = long_fmt;
+
+	for (i = 0; i < (sizeof(fmts) / sizeof(fmts[0])); i++)
+	{
+		// Same second with different sub-seconds, then a new second.
+		for (tv.tv_usec = 1; tv.tv_usec < 1000000; tv.tv_usec *= 100)
+		{
+			tv.tv_sec = t + (tv.tv_usec / 10000);
+			localtime_r(&tv.tv_sec, &tm);
+
+			expected_ret = catcierge_strftime(expected, sizeof(expected), fmts[i], &tm, &tv);
+			ret = catcierge_strftime_time(buf, sizeof(buf), fmts[i], tv.tv_sec, &tv);
+
+			catcierge_test_STATUS("\"%.32s\" -> \"%.64s\" Expected: \"%.64s\"",
+				fmts[i], buf, expected);
+			mu_assert("Expected same length as uncached formatting", ret == expected_ret);
+			mu_assert("Expected same result as uncached formatting", !strcmp(buf, expected));
+		}
+	}
+
+	// Too small output buffer should fail like strftime.
+	tv.tv_usec = 451893;
+	ret = catcierge_strftime_time(buf, 10, "%Y-%m-%d %H:%M:%S.%f", t, &tv);
+	mu_assert("Expected too small buffer to fail", ret == 0);
+
+	// The cached second must not be used for other formats output.
+	ret = catcierge_strftime_time(buf, sizeof(buf), "%S.%f", t, &tv);
+	mu_assert("Expected formatting to succeed", ret > 0);
+	ret = catcierge_strftime_time(buf, sizeof(buf), "%S.%f", t + 1, &tv);
+	localtime_r(&t, &tm);
+	tm.tm_sec = (tm.tm_sec + 1) % 60;
+	snprintf(expected, sizeof(expected), "%02d.451893", tm.tm_sec);
+	catcierge_test_STATUS("Got: \"%s\" Expected: \"%s\"", buf, expected);
+	mu_assert("Expected new second to be rendered", !strcmp(buf, expected));
+
+	return NULL;
+}
+
 int TEST_catcierge_strftime(int argc, char **argv)
 {
 	int ret = 0;
@@ -78,6 +147,10 @@ int TEST_catcierge_strftime(int argc, char **argv)
 	CATCIERGE_RUN_TEST((e = run_tests()),
 		"TEST_catcierge_strftime",
 		"", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_cache_tests()),
+		"Cached time formatting",
+		"", &ret);
 	
 	return ret;
 }
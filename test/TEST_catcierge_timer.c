@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+#include <string.h>
 #include "catcierge_timer.h"
 #include "minunit.h"
 #include "catcierge_test_helpers.h"
@@ -31,6 +33,171 @@ char *run_tests()
 	return NULL;
 }
 
+char *run_span_tests()
+{
+	catcierge_span_t s;
+	catcierge_span_t total;
+	double begin;
+	double first_start;
+
+	catcierge_span_reset(&s);
+	catcierge_span_reset(&total);
+
+	begin = catcierge_span_begin(&s);
+	usleep(20000);
+	catcierge_span_end(&s, begin);
+	first_start = s.start;
+	catcierge_test_STATUS("First span: %f seconds", s.duration);
+	mu_assert("Expected span to be at least 20ms", s.duration >= 0.02);
+	mu_assert("Expected span end after start", s.end > s.start);
+
+	// Entering the span again should accumulate and keep the first start.
+	begin = catcierge_span_begin(&s);
+	usleep(20000);
+	catcierge_span_end(&s, begin);
+	catcierge_test_STATUS("Accumulated span: %f seconds", s.duration);
+	mu_assert("Expected span to be at least 40ms", s.duration >= 0.04);
+	mu_assert("Expected span start to be kept", s.start == first_start);
+
+	catcierge_span_add(&total, &s);
+	catcierge_span_add(&total, &s);
+	mu_assert("Expected merged start", total.start == s.start);
+	mu_assert("Expected merged end", total.end == s.end);
+	mu_assert("Expected merged duration", total.duration == (2 * s.duration));
+
+	return NULL;
+}
+
+char *run_histogram_tests()
+{
+	catcierge_histogram_t h;
+	int i;
+
+	catcierge_histogram_reset(&h);
+	mu_assert("Expected empty percentile to be 0", catcierge_histogram_percentile(&h, 50.0) == 0.0);
+
+	// 90 samples of 0.5ms, 9 of 3ms and 1 of 100ms.
+	for (i = 0; i < 90; i++)
+		catcierge_histogram_add(&h, 0.0005);
+
+	for (i = 0; i < 9; i++)
+		catcierge_histogram_add(&h, 0.003);
+
+	catcierge_histogram_add(&h, 0.1);
+
+	catcierge_histogram_print(stdout, &h, "test");
+
+	mu_assert("Expected 100 samples", h.count == 100);
+	mu_assert("Expected 90 in first bucket", h.buckets[0] == 90);
+	mu_assert("Expected 9 in 2-4ms bucket", h.buckets[2] == 9);
+	mu_assert("Expected 1 in 64-128ms bucket", h.buckets[7] == 1);
+	mu_assert("Expected p50 < 1ms", catcierge_histogram_percentile(&h, 50.0) == 1.0);
+	mu_assert("Expected p95 < 4ms", catcierge_histogram_percentile(&h, 95.0) == 4.0);
+	mu_assert("Expected p100 to be the max", catcierge_histogram_percentile(&h, 100.0) == h.max);
+
+	// Huge values end up in the last bucket.
+	catcierge_histogram_add(&h, 1000.0);
+	mu_assert("Expected overflow bucket", h.buckets[CATCIERGE_HISTOGRAM_BUCKETS - 1] == 1);
+
+	return NULL;
+}
+
+char *run_virtual_clock_tests()
+{
+	catcierge_timer_t t;
+	struct timeval tv;
+	struct timeval now;
+	time_t start;
+
+	catcierge_timer_set_virtual(1);
+	mu_assert("Expected virtual clock", catcierge_timer_is_virtual());
+
+	start = catcierge_timer_time(&now);
+	mu_assert("Expected virtual clock to start at the system time", start > 0);
+
+	catcierge_timer_reset(&t);
+	catcierge_timer_set(&t, 30.0);
+	catcierge_timer_start(&t);
+	mu_assert("Expected timer to be active", catcierge_timer_isactive(&t));
+
+	// The clock only moves when advanced.
+	usleep(20000);
+	mu_assert("Expected timer to be 0.0", catcierge_timer_get(&t) == 0.0);
+
+	catcierge_timer_advance(10.5);
+	catcierge_test_STATUS("Advanced 10.5 seconds, timer %f", catcierge_timer_get(&t));
+	mu_assert("Expected timer to be 10.5", fabs(catcierge_timer_get(&t) - 10.5) < 0.000001);
+	mu_assert("Expected timer not to have timed out", !catcierge_timer_has_timed_out(&t));
+
+	tv = now;
+	tv.tv_sec += 30;
+	catcierge_timer_set_virtual_time(&tv);
+	mu_assert("Expected timer to have timed out", catcierge_timer_has_timed_out(&t));
+	mu_assert("Expected time_t from the virtual clock", catcierge_timer_time(NULL) == tv.tv_sec);
+
+	// Never go backwards.
+	catcierge_timer_set_virtual_time(&now);
+	mu_assert("Expected clock not to go backwards", catcierge_timer_time(NULL) == tv.tv_sec);
+
+	catcierge_timer_set_virtual(0);
+	mu_assert("Expected system clock", !catcierge_timer_is_virtual());
+
+	return NULL;
+}
+
+char *run_virtual_clock_past_tests()
+{
+	catcierge_timer_t t;
+	struct timeval tv;
+	struct timeval seed;
+	int i;
+
+	// Replaying a recording from 2015, long before the clock was enabled.
+	catcierge_timer_set_virtual(1);
+
+	memset(&seed, 0, sizeof(seed));
+	seed.tv_sec = 1434139037; // 2015-06-12
+	seed.tv_usec = 250000;
+	catcierge_timer_set_virtual_time(&seed);
+	catcierge_test_STATUS("Virtual clock set to %ld", (long)catcierge_timer_time(NULL));
+	mu_assert("Expected the first time to seed the clock", catcierge_timer_time(NULL) == seed.tv_sec);
+
+	catcierge_timer_reset(&t);
+	catcierge_timer_set(&t, 2.0);
+	catcierge_timer_start(&t);
+
+	// Frames recorded 0.5 seconds apart.
+	tv = seed;
+	for (i = 1; i <= 4; i++)
+	{
+		tv.tv_usec += 500000;
+		if (tv.tv_usec >= 1000000)
+		{
+			tv.tv_sec++;
+			tv.tv_usec -= 1000000;
+		}
+
+		catcierge_timer_set_virtual_time(&tv);
+		catcierge_test_STATUS("Frame %d, timer %f", i, catcierge_timer_get(&t));
+		mu_assert("Expected the timer to follow the recorded times",
+			fabs(catcierge_timer_get(&t) - (i * 0.5)) < 0.000001);
+	}
+
+	mu_assert("Expected timer to have timed out", catcierge_timer_has_timed_out(&t));
+
+	// After seeding the clock still never goes backwards.
+	catcierge_timer_set_virtual_time(&seed);
+	mu_assert("Expected clock not to go backwards", catcierge_timer_time(NULL) == tv.tv_sec);
+
+	// An explicit seed can move it anywhere.
+	catcierge_timer_seed_virtual_time(&seed);
+	mu_assert("Expected the seed to move the clock", catcierge_timer_time(NULL) == seed.tv_sec);
+
+	catcierge_timer_set_virtual(0);
+
+	return NULL;
+}
+
 int TEST_catcierge_timer(int argc, char **argv)
 {
 	int ret = 0;
@@ -39,6 +206,22 @@ int TEST_catcierge_timer(int argc, char **argv)
 	CATCIERGE_RUN_TEST((e = run_tests()),
 		"TEST_catcierge_timer",
 		"", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_span_tests()),
+		"Timer spans",
+		"", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_histogram_tests()),
+		"Timer histogram",
+		"", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_virtual_clock_tests()),
+		"Timer virtual clock",
+		"", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_virtual_clock_past_tests()),
+		"Timer virtual clock replaying the past",
+		"", &ret);
 	
 	return ret;
 }
@@ -91,6 +91,121 @@ static char *run_make_path_tests()
 	return NULL;
 }
 
+static char *_test_encoding(const char *str, int expect_ret,
+	catcierge_image_format_t format, int level, int gray, const char *ext)
+{
+	int ret;
+	catcierge_image_encoding_t enc;
+	catcierge_image_encoding_init(&enc);
+
+	ret = catcierge_image_encoding_parse(&enc, str);
+	catcierge_test_STATUS("\"%s\" -> %d %s level %d gray %d",
+		str, ret, catcierge_image_format_str(enc.format), enc.level, enc.gray);
+	mu_assert("Unexpected parse result", ret == expect_ret);
+
+	if (ret)
+		return NULL;
+
+	mu_assert("Unexpected format", enc.format == format);
+	mu_assert("Unexpected level", enc.level == level);
+	mu_assert("Unexpected gray", enc.gray == gray);
+	mu_assert("Unexpected extension", !strcmp(catcierge_image_encoding_ext(&enc, 3), ext));
+
+	return NULL;
+}
+
+static char *run_image_encoding_tests()
+{
+	char *e = NULL;
+	char buf[64];
+	catcierge_image_encoding_t enc;
+
+	catcierge_image_encoding_init(&enc);
+	mu_assert("Expected PNG by default", enc.format == IMAGE_FORMAT_PNG);
+	mu_assert("Expected default level", enc.level == CATCIERGE_IMAGE_LEVEL_DEFAULT);
+	mu_assert("Expected color by default", !enc.gray);
+
+	if ((e = _test_encoding("png", 0, IMAGE_FORMAT_PNG, CATCIERGE_IMAGE_LEVEL_DEFAULT, 0, "png"))) return e;
+	if ((e = _test_encoding("PNG:0", 0, IMAGE_FORMAT_PNG, 0, 0, "png"))) return e;
+	if ((e = _test_encoding("png:9:gray", 0, IMAGE_FORMAT_PNG, 9, 1, "png"))) return e;
+	if ((e = _test_encoding("jpeg:85", 0, IMAGE_FORMAT_JPEG, 85, 0, "jpg"))) return e;
+	if ((e = _test_encoding("jpg:gray:100", 0, IMAGE_FORMAT_JPEG, 100, 1, "jpg"))) return e;
+	if ((e = _test_encoding("webp:50", 0, IMAGE_FORMAT_WEBP, 50, 0, "webp"))) return e;
+	if ((e = _test_encoding("raw", 0, IMAGE_FORMAT_RAW, CATCIERGE_IMAGE_LEVEL_DEFAULT, 0, "ppm"))) return e;
+	if ((e = _test_encoding("raw:grey", 0, IMAGE_FORMAT_RAW, CATCIERGE_IMAGE_LEVEL_DEFAULT, 1, "pgm"))) return e;
+
+	if ((e = _test_encoding("", -1, 0, 0, 0, NULL))) return e;
+	if ((e = _test_encoding("gif", -1, 0, 0, 0, NULL))) return e;
+	if ((e = _test_encoding("png:10", -1, 0, 0, 0, NULL))) return e;
+	if ((e = _test_encoding("jpeg:0", -1, 0, 0, 0, NULL))) return e;
+	if ((e = _test_encoding("jpeg:101", -1, 0, 0, 0, NULL))) return e;
+	if ((e = _test_encoding("jpeg:5x", -1, 0, 0, 0, NULL))) return e;
+	if ((e = _test_encoding("raw:5", -1, 0, 0, 0, NULL))) return e;
+
+	catcierge_image_encoding_parse(&enc, "jpeg:90:gray");
+	catcierge_image_encoding_str(&enc, buf, sizeof(buf));
+	catcierge_test_STATUS("String: %s", buf);
+	mu_assert("Unexpected encoding string", !strcmp(buf, "jpeg:90:gray"));
+
+	enc.format = IMAGE_FORMAT_RAW;
+	enc.gray = 0;
+	mu_assert("Expected pgm for gray raw images",
+		!strcmp(catcierge_image_encoding_ext(&enc, 1), "pgm"));
+
+	return NULL;
+}
+
+static char *run_match_filename_label_tests()
+{
+	int success = -1;
+	const char *rest;
+
+	rest = catcierge_parse_match_filename_label("a/b/match_fail_2014-05-17_10_01_02__1.png", &success);
+	mu_assert("Expected a failed match", rest && (success == 0));
+	mu_assert("Expected the rest of the name", !strcmp(rest, "2014-05-17_10_01_02__1.png"));
+
+	rest = catcierge_parse_match_filename_label("a\\match__2014-05-17_10_01_02__2.png", &success);
+	mu_assert("Expected a successful match", rest && (success == 1));
+	mu_assert("Expected the rest of the name", !strcmp(rest, "2014-05-17_10_01_02__2.png"));
+
+	success = -1;
+	mu_assert("Expected no label",
+		!catcierge_parse_match_filename_label("match_fail/obstruct.png", &success));
+	mu_assert("Expected success to be untouched", success == -1);
+
+	return NULL;
+}
+
+static char *run_mem_stats_tests()
+{
+	catcierge_mem_stats_t before;
+	catcierge_mem_stats_t after;
+	size_t size = 8 * 1024 * 1024;
+	char *p = NULL;
+
+	catcierge_get_mem_stats(&before);
+	catcierge_test_STATUS("RSS %ld kB, heap %ld kB", before.rss_kb, before.heap_kb);
+
+	// Touch the memory so that it becomes resident.
+	mu_assert("Out of memory", (p = malloc(size)));
+	memset(p, 1, size);
+
+	catcierge_get_mem_stats(&after);
+	catcierge_test_STATUS("RSS %ld kB, heap %ld kB", after.rss_kb, after.heap_kb);
+	free(p);
+
+	#ifdef __linux__
+	mu_assert("Expected the RSS to be known", before.rss_kb > 0);
+	mu_assert("Expected the RSS to grow", (after.rss_kb - before.rss_kb) >= 4096);
+	#endif
+
+	#ifdef __GLIBC__
+	mu_assert("Expected the heap to grow", (after.heap_kb - before.heap_kb) >= 8192);
+	#endif
+
+	return NULL;
+}
+
 int TEST_catcierge_util(int argc, char *argv[])
 {
 	int ret = 0;
@@ -108,6 +223,18 @@ int TEST_catcierge_util(int argc, char *argv[])
 		"catcierge_relative_path",
 		"catcierge_relative_path", &ret);
 
+	CATCIERGE_RUN_TEST((e = run_image_encoding_tests()),
+		"Image encoding",
+		"Parse image encoding settings", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_match_filename_label_tests()),
+		"Match file name labels",
+		"catcierge_parse_match_filename_label", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_mem_stats_tests()),
+		"Memory statistics",
+		"catcierge_get_mem_stats", &ret);
+
 	if (ret)
 	{
 		catcierge_test_FAILURE("One or more tests failed!");